@@ -75,6 +75,11 @@ enum class NodeType : u32
 
     eCondition,
     eRedirection,
+    eTime,
+    eWhileLoop,
+    eFunction,
+    eTest,
+    eCase,
 
     eCount,
 };
@@ -226,6 +231,128 @@ struct SubshellNode final : ASTNode
         else return -1;
     }
 };
+struct TimeNode final : ASTNode
+{
+    inline TimeNode() { ASTNode::Type = NodeType::eTime; }
+    ::Ref<ASTNode> Body;
+
+    virtual void   Print(usize indent = 0) const override
+    {
+        PrintIndent(indent);
+        printf("Time:\n");
+        if (Body) Body->Print(indent + 4);
+    }
+    virtual i32 Execute() const override { return Body ? Body->Execute() : 0; }
+};
+struct WhileNode final : ASTNode
+{
+    inline WhileNode() { ASTNode::Type = NodeType::eWhileLoop; }
+    ::Ref<ASTNode>         Condition;
+    ::Ref<ASTNode>         Body;
+    bool                   Until = false;
+    Vector<::Ref<ASTNode>> Redirections;
+
+    virtual void           Print(usize indent = 0) const override
+    {
+        PrintIndent(indent);
+        printf("%s:\n", Until ? "Until" : "While");
+        if (Condition) Condition->Print(indent + 4);
+        PrintIndent(indent);
+        printf("Do:\n");
+        if (Body) Body->Print(indent + 4);
+        for (auto& r : Redirections) r->Print(indent + 4);
+    }
+    virtual i32 Execute() const override { return 0; }
+};
+struct ForNode final : ASTNode
+{
+    inline ForNode() { ASTNode::Type = NodeType::eForLoop; }
+    String                 Variable;
+    // Without `in`, the positional parameters are iterated
+    bool                   HasList = false;
+    Vector<::Ref<ASTNode>> Words;
+    ::Ref<ASTNode>         Body;
+    Vector<::Ref<ASTNode>> Redirections;
+
+    virtual void           Print(usize indent = 0) const override
+    {
+        PrintIndent(indent);
+        printf("For: %s\n", Variable.Raw());
+        for (auto& word : Words) word->Print(indent + 4);
+        PrintIndent(indent);
+        printf("Do:\n");
+        if (Body) Body->Print(indent + 4);
+        for (auto& r : Redirections) r->Print(indent + 4);
+    }
+    virtual i32 Execute() const override { return 0; }
+};
+// [[ expression ]], operators included as plain words
+struct TestNode final : ASTNode
+{
+    inline TestNode() { ASTNode::Type = NodeType::eTest; }
+    Vector<::Ref<ASTNode>> Words;
+
+    virtual void           Print(usize indent = 0) const override
+    {
+        PrintIndent(indent);
+        printf("Test:\n");
+        for (auto& word : Words) word->Print(indent + 4);
+    }
+    virtual i32 Execute() const override { return 0; }
+};
+// case word in pattern | pattern) body ;; ... esac
+struct CaseNode final : ASTNode
+{
+    inline CaseNode() { ASTNode::Type = NodeType::eCase; }
+
+    struct Arm
+    {
+        enum class End : u8
+        {
+            eBreak,       // ;;
+            eFallThrough, // ;& runs the next body without matching it
+            eContinue,    // ;| goes on matching with the next arm
+        };
+
+        Vector<::Ref<ASTNode>> Patterns;
+        ::Ref<ASTNode>         Body;
+        End                    Terminator = End::eBreak;
+    };
+
+    ::Ref<ASTNode>         Subject;
+    Vector<Arm>            Arms;
+    Vector<::Ref<ASTNode>> Redirections;
+
+    virtual void           Print(usize indent = 0) const override
+    {
+        PrintIndent(indent);
+        printf("Case:\n");
+        if (Subject) Subject->Print(indent + 4);
+        for (auto& arm : Arms)
+        {
+            PrintIndent(indent);
+            printf("Arm:\n");
+            for (auto& pattern : arm.Patterns) pattern->Print(indent + 4);
+            if (arm.Body) arm.Body->Print(indent + 4);
+        }
+        for (auto& r : Redirections) r->Print(indent + 4);
+    }
+    virtual i32 Execute() const override { return 0; }
+};
+struct FunctionNode final : ASTNode
+{
+    inline FunctionNode() { ASTNode::Type = NodeType::eFunction; }
+    String         Name;
+    ::Ref<ASTNode> Body;
+
+    virtual void   Print(usize indent = 0) const override
+    {
+        PrintIndent(indent);
+        printf("Function: %s\n", Name.Raw());
+        if (Body) Body->Print(indent + 4);
+    }
+    virtual i32 Execute() const override { return 0; }
+};
 struct BlockNode final : public ASTNode
 {
     inline BlockNode() { ASTNode::Type = NodeType::eCodeBlock; }
@@ -246,6 +373,15 @@ struct WordNode final : public ASTNode
     String                 Value;
     usize                  StartOffset = 0;
     usize                  EndOffset   = 0;
+    // Unquoted, subject to pathname expansion
+    bool                   Glob        = false;
+    // Holds {a,b} or {x..y} to expand
+    bool                   Braces      = false;
+    // Double quoted, expansions in it apply but are not split or globbed
+    bool                   Quoted      = false;
+    // Pieces written without blanks between them, like a=$x, that make a
+    // single word. Value is unused then
+    Vector<::Ref<ASTNode>> Pieces;
     Vector<::Ref<ASTNode>> Commands;
 
     virtual void           Print(usize indent = 0) const override
@@ -278,6 +414,21 @@ struct AssignmentNode final : public ASTNode
     ::Ref<ASTNode> Value;
     usize          StartOffset = 0;
     usize          EndOffset   = 0;
+    // NAME[subscript]=value
+    String         Subscript;
+    bool           Subscripted = false;
+    // NAME+=value appends to the value, or adds to it when integer
+    bool           Append      = false;
+
+    // NAME=(value [subscript]=value ...), Value is left empty
+    struct Element
+    {
+        String         Subscript;
+        bool           Keyed = false;
+        ::Ref<ASTNode> Value;
+    };
+    bool            Compound = false;
+    Vector<Element> Elements;
 
     virtual void   Print(usize indent = 0) const override
     {
@@ -330,18 +481,16 @@ struct ArithmeticNode final : public ASTNode
 {
     inline ArithmeticNode() { Type = NodeType::eArithmetic; }
     String       Expression;
+    // (( )) as a command rather than the $(( )) word
+    bool         Command = false;
 
     virtual void Print(usize indent = 0) const override
     {
         PrintIndent(indent);
-        printf("Arithmetic: %s\n", Expression.Raw());
-    }
-    virtual i32 Execute() const override
-    {
-        // For simplicity, we just print the expression
-        printf("Evaluating arithmetic expression: %s\n", Expression.Raw());
-        return 0;
+        printf("Arithmetic%s: %s\n", Command ? " command" : "",
+               Expression.Raw());
     }
+    virtual i32 Execute() const override { return 0; }
 };
 struct CommandSubstitutionNode final : public ASTNode
 {
@@ -365,6 +514,8 @@ struct CommandNode final : ASTNode
 {
     inline CommandNode() { Type = NodeType::eCommand; }
     String                 Name;
+    // FOO=bar prefixes, only visible to this command
+    Vector<::Ref<ASTNode>> Assignments;
     Vector<::Ref<ASTNode>> Arguments;
     Vector<::Ref<ASTNode>> Redirections;
     ::Ref<ASTNode>         HereDoc;
@@ -429,12 +580,15 @@ struct RedirectionNode final : public ASTNode
         Append,
         InputFd,
         OutputFd,
-        HereDoc
+        ReadWrite,
+        HereDoc,
+        HereString,
     } RedirType;
-    String       Target;
+    String         Target;
+    ::Ref<ASTNode> TargetWord; // null for synthesized fd duplications
 
-    i32          Fd = -1;
-    virtual void Print(usize indent = 0) const override
+    i32            Fd = -1;
+    virtual void   Print(usize indent = 0) const override
     {
         PrintIndent(indent);
         const char* typeStr = "";
@@ -442,11 +596,13 @@ struct RedirectionNode final : public ASTNode
         {
             case Type::Input: typeStr = "<"; break;
             case Type::Output: typeStr = ">"; break;
-            case Type::OutputPipe: typeStr = "|>"; break;
+            case Type::OutputPipe: typeStr = ">|"; break;
             case Type::Append: typeStr = ">>"; break;
             case Type::InputFd: typeStr = "<&"; break;
             case Type::OutputFd: typeStr = ">&"; break;
+            case Type::ReadWrite: typeStr = "<>"; break;
             case Type::HereDoc: typeStr = "<<"; break;
+            case Type::HereString: typeStr = "<<<"; break;
         }
         printf("Redirection: Fd=%d, Type=%s, Target='%s'\n", Fd, typeStr,
                Target.Raw());
@@ -464,6 +620,7 @@ struct HereDocNode final : public ASTNode
     inline HereDocNode() { Type = NodeType::eHereDoc; }
     String       Delimiter;
     String       Content;
+    bool         Expand = true; // false when the delimiter was quoted
 
     virtual void Print(usize indent = 0) const override
     {
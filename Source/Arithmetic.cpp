@@ -0,0 +1,625 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <Arithmetic.hpp>
+#include <Environment.hpp>
+
+#include <Prism/Debug/Log.hpp>
+#include <Prism/String/StringUtils.hpp>
+
+using namespace Prism;
+
+namespace Arithmetic
+{
+    namespace
+    {
+        // Variables whose values are expressions, nested this deep
+        constexpr usize      MAX_RECURSION = 64;
+
+        // Longest first, so the cursor takes <<= before << and <
+        constexpr StringView s_Operators[]
+            = {"<<=", ">>=", "**", "<<", ">>", "<=", ">=", "==", "!=",
+               "&&",  "||",  "++", "--", "+=", "-=", "*=", "/=", "%=",
+               "&=",  "^=",  "|=", "+",  "-",  "*",  "/",  "%",  "<",
+               ">",   "&",   "^",  "|",  "!",  "~",  "=",  "?",  ":",
+               ",",   "(",   ")"};
+
+        bool IsBlank(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+        bool IsNameStart(char c)
+        {
+            return (StringUtils::IsAlphanumeric(c) && !StringUtils::IsDigit(c))
+                || c == '_';
+        }
+        bool IsNameChar(char c)
+        {
+            return StringUtils::IsAlphanumeric(c) || c == '_';
+        }
+        bool IsLiteralChar(char c)
+        {
+            return StringUtils::IsAlphanumeric(c) || c == '_' || c == '@'
+                || c == '#';
+        }
+
+        // 255, 0xff, 0377 or 16#ff, digits past 9 are a-z, A-Z, @ and _.
+        // Too many digits wrap around, like in bash
+        bool ParseLiteral(StringView text, i64& value)
+        {
+            u64   base = 10;
+            usize i    = 0;
+            usize hash = text.Find("#"_sv);
+            if (hash != StringView::NPos)
+            {
+                base = 0;
+                for (; i < hash; i++)
+                {
+                    if (!StringUtils::IsDigit(text[i])) return false;
+                    base = base * 10 + (text[i] - '0');
+                    if (base > 64) return false;
+                }
+                if (base < 2 || ++i == text.Size()) return false;
+            }
+            else if (text.Size() > 2 && text[0] == '0'
+                     && (text[1] == 'x' || text[1] == 'X'))
+                base = 16, i = 2;
+            else if (text.Size() > 1 && text[0] == '0') base = 8, i = 1;
+
+            u64 result = 0;
+            for (; i < text.Size(); i++)
+            {
+                char c = text[i];
+                u64  digit;
+                if (StringUtils::IsDigit(c)) digit = c - '0';
+                else if (c >= 'a' && c <= 'z') digit = c - 'a' + 10;
+                else if (c >= 'A' && c <= 'Z')
+                    digit = c - 'A' + (base <= 36 ? 10 : 36);
+                else if (c == '@') digit = 62;
+                else if (c == '_') digit = 63;
+                else return false;
+
+                if (digit >= base) return false;
+                result = result * base + digit;
+            }
+
+            value = static_cast<i64>(result);
+            return true;
+        }
+    }; // namespace
+
+    bool NeedsExpansion(StringView text)
+    {
+        for (usize i = 0; i < text.Size(); i++)
+        {
+            if (text[i] == '`') return true;
+            if (text[i] != '$' || i + 1 == text.Size()) continue;
+
+            // $(( )) nests as parentheses, ${name} is just the name
+            char next = text[i + 1];
+            if (next == '(' && (i + 2 == text.Size() || text[i + 2] != '('))
+                return true;
+            if (next != '{') continue;
+
+            usize close = text.Find("}"_sv, i + 2);
+            if (close == StringView::NPos || close == i + 2) return true;
+            for (usize j = i + 2; j < close; j++)
+                if (!IsNameChar(text[j])) return true;
+        }
+        return false;
+    }
+    bool ParseNumber(StringView value, i64& number)
+    {
+        usize start = 0, end = value.Size();
+        while (start < end && IsBlank(value[start])) ++start;
+        while (end > start && IsBlank(value[end - 1])) --end;
+
+        bool negative = false;
+        if (start < end && (value[start] == '-' || value[start] == '+'))
+            negative = value[start++] == '-';
+        if (start == end || !StringUtils::IsDigit(value[start])) return false;
+        for (usize i = start; i < end; i++)
+            if (!IsLiteralChar(value[i])) return false;
+
+        if (!ParseLiteral(value.Substr(start, end - start), number))
+            return false;
+        if (negative) number = static_cast<i64>(-static_cast<u64>(number));
+        return true;
+    }
+
+    Expression::Expression(StringView text)
+        : m_Text(text)
+    {
+        SkipBlanks();
+        if (m_Position == m_Text.Size())
+        {
+            // An empty expression is 0
+            Emit(Operation::ePush, 0);
+            return;
+        }
+
+        if (Comma() && (SkipBlanks(), m_Position < m_Text.Size()))
+            Error("syntax error in expression");
+    }
+
+    bool Expression::Evaluate(i64& result, isize status) const
+    {
+        return Evaluate(result, status, 0);
+    }
+    bool Expression::Evaluate(i64& result, isize status,
+                              usize recursion) const
+    {
+        if (Invalid()) return Fail(m_Error);
+
+        // Arithmetic wraps around, as the unsigned values it is done on
+        auto wrap  = [](u64 value) { return static_cast<i64>(value); };
+
+        i64   stack[MAX_STACK];
+        usize top = 0;
+        for (usize pc = 0; pc < m_Code.Size(); pc++)
+        {
+            auto& instruction = m_Code[pc];
+            auto  op          = instruction.Op;
+            if (op >= Operation::eAdd)
+            {
+                i64  rhs = stack[--top];
+                i64& lhs = stack[top - 1];
+                u64  l = lhs, r = rhs;
+                switch (op)
+                {
+                    case Operation::eAdd: lhs = wrap(l + r); break;
+                    case Operation::eSubtract: lhs = wrap(l - r); break;
+                    case Operation::eMultiply: lhs = wrap(l * r); break;
+                    case Operation::eDivide:
+                    case Operation::eModulo:
+                        if (rhs == 0) return Fail("division by 0");
+                        // -1 is the one divisor that may overflow
+                        if (rhs == -1)
+                            lhs = op == Operation::eDivide ? wrap(-l) : 0;
+                        else
+                            lhs = op == Operation::eDivide ? lhs / rhs
+                                                           : lhs % rhs;
+                        break;
+                    case Operation::ePower:
+                    {
+                        if (rhs < 0) return Fail("exponent less than 0");
+                        u64 power = 1;
+                        for (; r; r >>= 1, l *= l)
+                            if (r & 1) power *= l;
+                        lhs = wrap(power);
+                        break;
+                    }
+                    case Operation::eShiftLeft: lhs = wrap(l << (r & 63)); break;
+                    case Operation::eShiftRight: lhs = lhs >> (r & 63); break;
+                    case Operation::eLess: lhs = lhs < rhs; break;
+                    case Operation::eLessEqual: lhs = lhs <= rhs; break;
+                    case Operation::eGreater: lhs = lhs > rhs; break;
+                    case Operation::eGreaterEqual: lhs = lhs >= rhs; break;
+                    case Operation::eEqual: lhs = lhs == rhs; break;
+                    case Operation::eNotEqual: lhs = lhs != rhs; break;
+                    case Operation::eAnd: lhs = lhs & rhs; break;
+                    case Operation::eXor: lhs = lhs ^ rhs; break;
+                    case Operation::eOr: lhs = lhs | rhs; break;
+                    default: break;
+                }
+                continue;
+            }
+
+            switch (op)
+            {
+                case Operation::ePush: stack[top++] = instruction.Value; break;
+                case Operation::eLoad:
+                    if (!Load(instruction.Slot, stack[top++], status,
+                              recursion))
+                        return false;
+                    break;
+                case Operation::eStore:
+                    Environment::SetInteger(m_Names[instruction.Slot],
+                                            stack[top - 1]);
+                    break;
+                case Operation::eStep:
+                case Operation::eStepPost:
+                {
+                    i64 value;
+                    if (!Load(instruction.Slot, value, status, recursion))
+                        return false;
+
+                    i64 stepped = wrap(u64(value) + u64(instruction.Value));
+                    Environment::SetInteger(m_Names[instruction.Slot], stepped);
+                    stack[top++] = op == Operation::eStep ? stepped : value;
+                    break;
+                }
+                case Operation::eStatus: stack[top++] = status; break;
+                case Operation::ePop: --top; break;
+                case Operation::eBool: stack[top - 1] = stack[top - 1] != 0; break;
+                case Operation::eJump: pc = instruction.Value - 1; break;
+                case Operation::eJumpIfZero:
+                    if (stack[--top] == 0) pc = instruction.Value - 1;
+                    break;
+                case Operation::eJumpIfNonZero:
+                    if (stack[--top] != 0) pc = instruction.Value - 1;
+                    break;
+                case Operation::eNegate:
+                    stack[top - 1] = wrap(-u64(stack[top - 1]));
+                    break;
+                case Operation::eNot: stack[top - 1] = !stack[top - 1]; break;
+                case Operation::eComplement:
+                    stack[top - 1] = ~stack[top - 1];
+                    break;
+                default: break;
+            }
+        }
+
+        result = top ? stack[top - 1] : 0;
+        return true;
+    }
+    bool Expression::Load(u32 slot, i64& value, isize status,
+                          usize recursion) const
+    {
+        if (Environment::GetInteger(m_Names[slot], value)) return true;
+
+        StringView text = Environment::GetVariable(m_Names[slot]);
+        if (text.Empty())
+        {
+            value = 0;
+            return true;
+        }
+        if (ParseNumber(text, value)) return true;
+
+        // Anything else in a variable is an expression of its own
+        if (recursion >= MAX_RECURSION)
+            return Fail("expression recursion level exceeded");
+        return Expression(text).Evaluate(value, status, recursion + 1);
+    }
+    bool Expression::Fail(StringView message) const
+    {
+        PrismError("awsh: {}: {}\n", m_Text, message);
+        return false;
+    }
+
+    usize Expression::Emit(Operation op, i64 value, u32 slot)
+    {
+        m_Code.PushBack({op, slot, value});
+        return m_Code.Size() - 1;
+    }
+    u32 Expression::SlotOf(StringView name)
+    {
+        for (u32 slot = 0; slot < m_Names.Size(); slot++)
+            if (StringView(m_Names[slot]) == name) return slot;
+
+        m_Names.PushBack(String(name));
+        return m_Names.Size() - 1;
+    }
+    void Expression::Push(usize count)
+    {
+        m_Depth += count;
+        if (m_Depth > MAX_STACK) Error("expression nested too deeply");
+    }
+    bool Expression::Error(StringView message)
+    {
+        if (m_Error.Empty())
+        {
+            m_Error = message;
+            if (m_Position < m_Text.Size())
+                m_Error += " (error token is \""_s
+                         + m_Text.Substr(m_Position) + "\")";
+        }
+        return false;
+    }
+
+    void Expression::SkipBlanks()
+    {
+        while (m_Position < m_Text.Size() && IsBlank(m_Text[m_Position]))
+            ++m_Position;
+    }
+    StringView Expression::Operator()
+    {
+        SkipBlanks();
+        StringView rest = StringView(m_Text).Substr(m_Position);
+        for (auto op : s_Operators)
+            if (rest.StartsWith(op)) return op;
+        return {};
+    }
+    bool Expression::Accept(StringView op)
+    {
+        if (Operator() != op) return false;
+
+        m_Position += op.Size();
+        return true;
+    }
+    bool Expression::ParseName(String& name)
+    {
+        SkipBlanks();
+        StringView text  = m_Text;
+        usize      start = m_Position;
+        if (start < text.Size() && text[start] == '$')
+        {
+            // $?, $#, $1 and ${name} name the same as name alone
+            usize at     = start + 1;
+            bool  braced = at < text.Size() && text[at] == '{';
+            at += braced;
+            if (at < text.Size()
+                && (text[at] == '?' || text[at] == '#'
+                    || StringUtils::IsDigit(text[at])))
+            {
+                name = String(1, text[at]);
+                ++at;
+            }
+            else
+            {
+                usize end = at;
+                while (end < text.Size() && IsNameChar(text[end])) ++end;
+                if (end == at) return false;
+                name = text.Substr(at, end - at);
+                at   = end;
+            }
+            if (braced && (at == text.Size() || text[at++] != '}'))
+                return false;
+
+            m_Position = at;
+            return true;
+        }
+
+        if (start == text.Size() || !IsNameStart(text[start])) return false;
+        usize end = start;
+        while (end < text.Size() && IsNameChar(text[end])) ++end;
+        name       = text.Substr(start, end - start);
+        m_Position = end;
+        return true;
+    }
+
+    bool Expression::Comma()
+    {
+        if (!Assignment()) return false;
+        while (Accept(","_sv))
+        {
+            Emit(Operation::ePop);
+            Pop();
+            if (!Assignment()) return false;
+        }
+        return true;
+    }
+    bool Expression::Assignment()
+    {
+        // name = value and name op= value, anything else is a conditional
+        constexpr StringView operators[]
+            = {"=",   "*=",  "/=", "%=", "+=", "-=",
+               "<<=", ">>=", "&=", "^=", "|="};
+        constexpr Operation compound[]
+            = {Operation::ePush,      Operation::eMultiply,
+               Operation::eDivide,    Operation::eModulo,
+               Operation::eAdd,       Operation::eSubtract,
+               Operation::eShiftLeft, Operation::eShiftRight,
+               Operation::eAnd,       Operation::eXor,
+               Operation::eOr};
+
+        usize  start = m_Position;
+        String name;
+        SkipBlanks();
+        usize  op    = sizeof(operators) / sizeof(operators[0]);
+        if (m_Position < m_Text.Size() && m_Text[m_Position] != '$'
+            && ParseName(name))
+        {
+            StringView found = Operator();
+            for (op = 0; op < sizeof(operators) / sizeof(operators[0]); op++)
+                if (operators[op] == found) break;
+        }
+        if (op == sizeof(operators) / sizeof(operators[0]))
+        {
+            m_Position = start;
+            return Conditional();
+        }
+
+        m_Position += operators[op].Size();
+        u32 slot = SlotOf(name);
+        if (op > 0)
+        {
+            Emit(Operation::eLoad, 0, slot);
+            Push();
+        }
+        if (!Assignment()) return false;
+        if (op > 0)
+        {
+            Emit(compound[op]);
+            Pop();
+        }
+        Emit(Operation::eStore, 0, slot);
+        return true;
+    }
+    bool Expression::Conditional()
+    {
+        if (!LogicalOr()) return false;
+        if (!Accept("?"_sv)) return true;
+
+        usize skip = Emit(Operation::eJumpIfZero);
+        Pop();
+        if (!Assignment()) return false;
+        if (!Accept(":"_sv)) return Error("`:' expected for conditional");
+
+        usize end = Emit(Operation::eJump);
+        Patch(skip);
+        // Only one of the two is left on the stack
+        Pop();
+        if (!Conditional()) return false;
+        Patch(end);
+        return true;
+    }
+    bool Expression::LogicalOr()
+    {
+        if (!LogicalAnd()) return false;
+        while (Accept("||"_sv))
+        {
+            usize taken = Emit(Operation::eJumpIfNonZero);
+            Pop();
+            if (!LogicalAnd()) return false;
+            Emit(Operation::eBool);
+
+            usize end = Emit(Operation::eJump);
+            Patch(taken);
+            Emit(Operation::ePush, 1);
+            Patch(end);
+        }
+        return true;
+    }
+    bool Expression::LogicalAnd()
+    {
+        if (!Binary(0)) return false;
+        while (Accept("&&"_sv))
+        {
+            usize skip = Emit(Operation::eJumpIfZero);
+            Pop();
+            if (!Binary(0)) return false;
+            Emit(Operation::eBool);
+
+            usize end = Emit(Operation::eJump);
+            Patch(skip);
+            Emit(Operation::ePush, 0);
+            Patch(end);
+        }
+        return true;
+    }
+    bool Expression::Binary(usize level)
+    {
+        // Loosest first, each level binds tighter than the one before
+        struct Level
+        {
+            StringView Operators[4];
+            Operation  Operations[4];
+        };
+        static constexpr Level levels[] = {
+            {{"|"}, {Operation::eOr}},
+            {{"^"}, {Operation::eXor}},
+            {{"&"}, {Operation::eAnd}},
+            {{"==", "!="}, {Operation::eEqual, Operation::eNotEqual}},
+            {{"<", "<=", ">", ">="},
+             {Operation::eLess, Operation::eLessEqual, Operation::eGreater,
+              Operation::eGreaterEqual}},
+            {{"<<", ">>"}, {Operation::eShiftLeft, Operation::eShiftRight}},
+            {{"+", "-"}, {Operation::eAdd, Operation::eSubtract}},
+            {{"*", "/", "%"},
+             {Operation::eMultiply, Operation::eDivide, Operation::eModulo}},
+        };
+        if (level == sizeof(levels) / sizeof(levels[0])) return Power();
+
+        if (!Binary(level + 1)) return false;
+        for (;;)
+        {
+            StringView found = Operator();
+            usize      op    = 0;
+            while (op < 4
+                   && (found.Empty() || levels[level].Operators[op] != found))
+                ++op;
+            if (op == 4) return true;
+
+            m_Position += found.Size();
+            if (!Binary(level + 1)) return false;
+            Emit(levels[level].Operations[op]);
+            Pop();
+        }
+    }
+    bool Expression::Power()
+    {
+        // Right associative, and looser than the signs: -2**2 is 4
+        if (!Unary()) return false;
+        if (!Accept("**"_sv)) return true;
+        if (!Power()) return false;
+        Emit(Operation::ePower);
+        Pop();
+        return true;
+    }
+    bool Expression::Unary()
+    {
+        StringView op = Operator();
+        if (op == "++"_sv || op == "--"_sv)
+        {
+            // ++name and --name, or two signs in a row
+            usize  start = m_Position;
+            String name;
+            m_Position += 2;
+            SkipBlanks();
+            if (m_Position < m_Text.Size() && m_Text[m_Position] != '$'
+                && ParseName(name))
+            {
+                Emit(Operation::eStep, op == "++"_sv ? 1 : -1, SlotOf(name));
+                Push();
+                return true;
+            }
+            m_Position = start;
+            op         = op.Substr(0, 1);
+        }
+        if (op != "-"_sv && op != "+"_sv && op != "!"_sv && op != "~"_sv)
+            return Postfix();
+
+        m_Position += 1;
+        if (!Unary()) return false;
+        if (op == "-"_sv) Emit(Operation::eNegate);
+        else if (op == "!"_sv) Emit(Operation::eNot);
+        else if (op == "~"_sv) Emit(Operation::eComplement);
+        return true;
+    }
+    bool Expression::Postfix()
+    {
+        SkipBlanks();
+        usize start = m_Position;
+        bool  plain = start < m_Text.Size() && m_Text[start] != '$';
+
+        String name;
+        if (!ParseName(name))
+        {
+            m_Position = start;
+            return Primary();
+        }
+        if (name == "?"_sv)
+        {
+            Emit(Operation::eStatus);
+            Push();
+            return true;
+        }
+
+        StringView op = plain ? Operator() : StringView();
+        if (op == "++"_sv || op == "--"_sv)
+        {
+            m_Position += 2;
+            Emit(Operation::eStepPost, op == "++"_sv ? 1 : -1, SlotOf(name));
+        }
+        else Emit(Operation::eLoad, 0, SlotOf(name));
+        Push();
+        return true;
+    }
+    bool Expression::Primary()
+    {
+        SkipBlanks();
+        if (m_Position == m_Text.Size()) return Error("operand expected");
+
+        // $(( )) inside is only a parenthesized expression
+        char c = m_Text[m_Position];
+        if (c == '$' && m_Position + 1 < m_Text.Size()
+            && m_Text[m_Position + 1] == '(')
+        {
+            ++m_Position;
+            return Primary();
+        }
+        if (Accept("("_sv))
+        {
+            if (!Comma()) return false;
+            return Accept(")"_sv) || Error("missing `)'");
+        }
+        if (!StringUtils::IsDigit(c)) return Error("operand expected");
+
+        usize end = m_Position;
+        while (end < m_Text.Size() && IsLiteralChar(m_Text[end])) ++end;
+
+        i64 value;
+        if (!ParseLiteral(StringView(m_Text).Substr(m_Position, end - m_Position),
+                          value))
+            return Error("invalid number");
+
+        m_Position = end;
+        Emit(Operation::ePush, value);
+        Push();
+        return true;
+    }
+}; // namespace Arithmetic
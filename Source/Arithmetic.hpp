@@ -0,0 +1,125 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#pragma once
+
+#include <Prism/Containers/Vector.hpp>
+#include <Prism/Memory/Ref.hpp>
+#include <Prism/String/String.hpp>
+#include <Prism/String/StringView.hpp>
+
+// Shell arithmetic of $(( )) and (( )) on 64 bit integers, with the
+// operators, precedence and number syntax of bash. An expression is
+// compiled once into a program for a small stack machine, whose variables
+// are slots naming the shell variables it reads and assigns
+namespace Arithmetic
+{
+    // Whether text has a $(...), `...` or ${...} with an operator in it,
+    // which the shell has to expand before it is an expression
+    bool NeedsExpansion(StringView text);
+
+    class Expression : public RefCounted
+    {
+      public:
+        explicit Expression(StringView text);
+
+        // Whether it did not compile, Evaluate() then reports why
+        bool Invalid() const { return !m_Error.Empty(); }
+        // Runs it with status as $?, false after reporting an error
+        bool Evaluate(i64& result, isize status = 0) const;
+
+      private:
+        enum class Operation : u8
+        {
+            ePush,   // Value
+            eLoad,   // the variable in Slot
+            eStore,  // the top into the variable in Slot, where it stays
+            eStep,   // add Value to the variable in Slot, push the result
+            eStepPost, // same, but push what it was before
+            eStatus, // $?
+            ePop,
+            eBool,   // the top becomes 1 when it is not 0
+            eJump,   // to Value
+            eJumpIfZero,    // pops, then jumps to Value when it was 0
+            eJumpIfNonZero, // pops, then jumps to Value when it was not 0
+
+            eNegate,
+            eNot,
+            eComplement,
+
+            eAdd,
+            eSubtract,
+            eMultiply,
+            eDivide,
+            eModulo,
+            ePower,
+            eShiftLeft,
+            eShiftRight,
+            eLess,
+            eLessEqual,
+            eGreater,
+            eGreaterEqual,
+            eEqual,
+            eNotEqual,
+            eAnd,
+            eXor,
+            eOr,
+        };
+        struct Instruction
+        {
+            Operation Op;
+            u32       Slot  = 0;
+            i64       Value = 0;
+        };
+
+        // Values on the stack at most, deeper expressions do not compile
+        static constexpr usize MAX_STACK = 64;
+
+        String                 m_Text;
+        Vector<Instruction>    m_Code;
+        // Variable name of each slot
+        Vector<String>         m_Names;
+        String                 m_Error;
+
+        // Only while compiling
+        usize                  m_Position = 0;
+        usize                  m_Depth    = 0;
+
+        bool  Evaluate(i64& result, isize status, usize recursion) const;
+        bool  Load(u32 slot, i64& value, isize status, usize recursion) const;
+        bool  Fail(StringView message) const;
+
+        usize Emit(Operation op, i64 value = 0, u32 slot = 0);
+        u32   SlotOf(StringView name);
+        void  Patch(usize jump) { m_Code[jump].Value = m_Code.Size(); }
+        // Keeps track of how deep the stack gets
+        void  Push(usize count = 1);
+        void  Pop(usize count = 1) { m_Depth -= count; }
+        bool  Error(StringView message);
+
+        void  SkipBlanks();
+        // The longest operator at the cursor, empty when there is none
+        StringView Operator();
+        bool  Accept(StringView op);
+        // A variable name, $name, ${name} or a special parameter
+        bool  ParseName(String& name);
+
+        bool  Comma();
+        bool  Assignment();
+        bool  Conditional();
+        bool  LogicalOr();
+        bool  LogicalAnd();
+        bool  Binary(usize level);
+        bool  Unary();
+        bool  Power();
+        bool  Postfix();
+        bool  Primary();
+    };
+
+    // Parses a number as a variable holds it, with optional blanks and
+    // sign around it. False when value is anything else
+    bool ParseNumber(StringView value, i64& number);
+}; // namespace Arithmetic
@@ -0,0 +1,185 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <Arrays.hpp>
+
+using namespace Prism;
+
+namespace Arrays
+{
+    namespace
+    {
+        u32 Hash(StringView key)
+        {
+            u32 hash = 2166136261u;
+            for (char c : key)
+            {
+                hash ^= static_cast<u8>(c);
+                hash *= 16777619u;
+            }
+            return hash;
+        }
+    }; // namespace
+
+    Indexed::Indexed(Vector<String>&& values)
+        : m_Values(Move(values))
+        , m_Holes((m_Values.Size() + 63) / 64)
+        , m_Count(m_Values.Size())
+    {
+    }
+    const String* Indexed::Find(usize index) const
+    {
+        if (index < m_Values.Size())
+            return IsHole(index) ? nullptr : &m_Values[index];
+
+        usize at = Lower(index);
+        return at < m_Sparse.Size() && m_Sparse[at].Index == index
+                 ? &m_Sparse[at].Value
+                 : nullptr;
+    }
+    String* Indexed::Find(usize index)
+    {
+        const auto& self = *this;
+        return const_cast<String*>(self.Find(index));
+    }
+    usize Indexed::Next(usize from) const
+    {
+        // Whole words of holes are skipped at once, bits past the end are
+        // never holes
+        while (from < m_Values.Size())
+        {
+            u64 present = ~m_Holes[from >> 6] >> (from & 63);
+            if (present)
+            {
+                from += __builtin_ctzll(present);
+                if (from < m_Values.Size()) return from;
+                break;
+            }
+            from = (from | 63) + 1;
+        }
+
+        usize at = Lower(from);
+        return at < m_Sparse.Size() ? m_Sparse[at].Index : End();
+    }
+    void Indexed::Set(usize index, String value)
+    {
+        usize dense = m_Values.Size();
+        if (index < dense)
+        {
+            if (IsHole(index))
+            {
+                m_Holes[index >> 6] &= ~(u64(1) << (index & 63));
+                ++m_Count;
+            }
+            m_Values[index] = Move(value);
+            return;
+        }
+        if (index - dense > MAX_GAP)
+        {
+            usize at = Lower(index);
+            if (at < m_Sparse.Size() && m_Sparse[at].Index == index)
+            {
+                m_Sparse[at].Value = Move(value);
+                return;
+            }
+
+            m_Sparse.Resize(m_Sparse.Size() + 1);
+            for (usize i = m_Sparse.Size() - 1; i > at; i--)
+                m_Sparse[i] = Move(m_Sparse[i - 1]);
+            m_Sparse[at] = {index, Move(value)};
+            ++m_Count;
+            return;
+        }
+
+        // The gap becomes holes, and the sparse elements it reaches move
+        // into it
+        m_Values.Resize(index + 1);
+        m_Holes.Resize((index + 64) / 64);
+        for (usize hole = dense; hole <= index; hole++)
+            m_Holes[hole >> 6] |= u64(1) << (hole & 63);
+
+        usize moved = 0;
+        for (; moved < m_Sparse.Size() && m_Sparse[moved].Index <= index;
+             moved++)
+        {
+            usize at = m_Sparse[moved].Index;
+            m_Holes[at >> 6] &= ~(u64(1) << (at & 63));
+            m_Values[at] = Move(m_Sparse[moved].Value);
+        }
+        if (moved)
+        {
+            for (usize i = moved; i < m_Sparse.Size(); i++)
+                m_Sparse[i - moved] = Move(m_Sparse[i]);
+            m_Sparse.Resize(m_Sparse.Size() - moved);
+        }
+
+        if (IsHole(index)) ++m_Count;
+        m_Holes[index >> 6] &= ~(u64(1) << (index & 63));
+        m_Values[index] = Move(value);
+    }
+    usize Indexed::Lower(usize index) const
+    {
+        usize low = 0, high = m_Sparse.Size();
+        while (low < high)
+        {
+            usize middle = (low + high) / 2;
+            if (m_Sparse[middle].Index < index) low = middle + 1;
+            else high = middle;
+        }
+        return low;
+    }
+
+    const String* Associative::Find(StringView key) const
+    {
+        if (m_Index.Empty()) return nullptr;
+
+        usize slot = Slot(key, Hash(key));
+        return m_Index[slot] ? &m_Entries[m_Index[slot] - 1].Value : nullptr;
+    }
+    String* Associative::Find(StringView key)
+    {
+        const auto& self = *this;
+        return const_cast<String*>(self.Find(key));
+    }
+    void Associative::Set(StringView key, String value)
+    {
+        if ((m_Entries.Size() + 1) * 2 > m_Index.Size()) Grow();
+
+        u32   hash = Hash(key);
+        usize slot = Slot(key, hash);
+        if (m_Index[slot])
+        {
+            m_Entries[m_Index[slot] - 1].Value = Move(value);
+            return;
+        }
+
+        m_Entries.PushBack({String(key), Move(value), hash});
+        m_Index[slot] = m_Entries.Size();
+    }
+    usize Associative::Slot(StringView key, u32 hash) const
+    {
+        // The hash is compared first, most probes then skip the key
+        usize mask = m_Index.Size() - 1;
+        usize slot = hash & mask;
+        for (; m_Index[slot]; slot = (slot + 1) & mask)
+        {
+            auto& entry = m_Entries[m_Index[slot] - 1];
+            if (entry.Hash == hash && StringView(entry.Key) == key) break;
+        }
+        return slot;
+    }
+    void Associative::Grow()
+    {
+        usize capacity = m_Index.Empty() ? 16 : m_Index.Size() * 2;
+        m_Index.Clear();
+        m_Index.Resize(capacity);
+        for (usize i = 0; i < m_Entries.Size(); i++)
+        {
+            auto& entry = m_Entries[i];
+            m_Index[Slot(entry.Key, entry.Hash)] = i + 1;
+        }
+    }
+}; // namespace Arrays
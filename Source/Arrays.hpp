@@ -0,0 +1,99 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#pragma once
+
+#include <Prism/Containers/Vector.hpp>
+#include <Prism/String/String.hpp>
+#include <Prism/String/StringView.hpp>
+
+// Storage of indexed and associative array variables. Indexed arrays are a
+// dense vector of values with a bitmap of the indices left unset, so the
+// usual arrays with few or no holes take one string per element and
+// nothing else. Indices far past the dense part are kept apart, sorted.
+// Associative arrays are an open addressing table over the entries, which
+// own their keys and are kept in insertion order
+namespace Arrays
+{
+    class Indexed
+    {
+      public:
+        Indexed() = default;
+        // Values at 0, 1, 2...
+        explicit Indexed(Vector<String>&& values);
+
+        // Elements set
+        usize         Count() const { return m_Count; }
+        // One past the highest index set
+        usize         End() const
+        {
+            return m_Sparse.Empty() ? m_Values.Size()
+                                    : m_Sparse.Back().Index + 1;
+        }
+        // nullptr when index is unset
+        const String* Find(usize index) const;
+        String*       Find(usize index);
+        // First index set at or after from, End() when there is none
+        usize         Next(usize from) const;
+
+        void          Set(usize index, String value);
+        void          Append(String value) { Set(End(), Move(value)); }
+
+      private:
+        // Indices this far past the dense part go in m_Sparse, filling the
+        // gap would take a string each
+        static constexpr usize MAX_GAP = 1024;
+
+        Vector<String> m_Values;
+        // A set bit marks an index without a value
+        Vector<u64>    m_Holes;
+        // Elements past m_Values, by increasing index
+        struct Element
+        {
+            usize  Index;
+            String Value;
+        };
+        Vector<Element> m_Sparse;
+        usize           m_Count = 0;
+
+        // First of m_Sparse at or after index
+        usize           Lower(usize index) const;
+
+        bool           IsHole(usize index) const
+        {
+            return (m_Holes[index >> 6] >> (index & 63)) & 1;
+        }
+    };
+
+    class Associative
+    {
+      public:
+        usize         Count() const { return m_Entries.Size(); }
+        // nullptr when key is unset
+        const String* Find(StringView key) const;
+        String*       Find(StringView key);
+        void          Set(StringView key, String value);
+
+        // Entries in the order they were first set
+        StringView    KeyAt(usize i) const { return m_Entries[i].Key; }
+        const String& ValueAt(usize i) const { return m_Entries[i].Value; }
+
+      private:
+        struct Entry
+        {
+            String Key;
+            String Value;
+            u32    Hash;
+        };
+        Vector<Entry> m_Entries;
+        // Open addressing over m_Entries, 1 + index or 0 for an empty slot
+        Vector<u32>   m_Index;
+
+        // Slot holding key, or the empty one it would go in
+        usize         Slot(StringView key, u32 hash) const;
+        void          Grow();
+    };
+}; // namespace Arrays
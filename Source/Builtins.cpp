@@ -6,9 +6,19 @@
  */
 #include <Builtins.hpp>
 #include <Environment.hpp>
-#include <Prism/Containers/UnorderedMap.hpp>
+#include <Executor.hpp>
+#include <Expander.hpp>
+#include <Functions.hpp>
+#include <Input.hpp>
+#include <Jobs.hpp>
 #include <Prism/String/StringUtils.hpp>
 
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
 using namespace Prism;
 
 namespace Builtins
@@ -16,44 +26,1560 @@ namespace Builtins
     using BuiltinProc = isize (*)(BuiltinArgs args);
     namespace
     {
-        UnorderedMap<String, BuiltinProc> s_Builtins;
-        isize                             Exit(BuiltinArgs args)
+        Vector<String*> s_Captures;
+        isize           s_LastStatus = 0;
+
+        // Builtin output is collected here and written once the builtin
+        // returns, or whenever the buffer fills up
+        char            s_Output[4096];
+        usize           s_Buffered    = 0;
+        bool            s_WriteFailed = false;
+
+        void            WriteOut(const char* data, usize left)
         {
-            isize status
-                = args.Empty() ? 0 : StringUtils::ToNumber<i32>(args[0]);
-            exit(status);
+            while (left > 0)
+            {
+                isize nwritten = write(1, data, left);
+                if (nwritten < 0 && errno == EINTR) continue;
+                if (nwritten <= 0)
+                {
+                    s_WriteFailed = true;
+                    return;
+                }
+
+                data += nwritten;
+                left -= nwritten;
+            }
+        }
+
+        // argv handed to builtins is terminated by a nullptr
+        usize ArgCount(BuiltinArgs args)
+        {
+            return args.Size() - (!args.Empty() && !args.Back());
+        }
+
+        isize Exit(BuiltinArgs args)
+        {
+            usize argc = ArgCount(args);
+            if (argc > 2)
+            {
+                PrismError("awsh: exit: too many arguments\n");
+                return 1;
+            }
+
+            isize status = argc == 2 ? StringUtils::ToNumber<i32>(args[1])
+                                     : s_LastStatus;
+            Flush();
+            fflush(stdout);
+            exit(status & 0xff);
         }
         isize ChangeDirectory(BuiltinArgs args)
         {
-            String target = Environment::GetVariable("PATH");
-            if (args.Size() > 1)
+            usize argc = ArgCount(args);
+            if (argc > 2)
+            {
+                PrismError("awsh: cd: too many arguments\n");
+                return 1;
+            }
+
+            StringView target = argc == 2 ? StringView(args[1]) : "~"_sv;
+            bool       print  = false;
+            if (target == "~"_sv)
+            {
+                target = Environment::GetVariable("HOME");
+                if (target.Empty()) target = "/"_sv;
+            }
+            else if (target == "-"_sv)
             {
-                if (args.Size() > 3)
+                target = Environment::GetVariable("OLDPWD");
+                print  = true;
+                if (target.Empty())
                 {
-                    PrismWarn("awsh: cd invalid number of arguments");
-                    for (usize i = 0; auto arg : args)
-                        PrismWarn("arg[{}]='{}'", i++, arg);
+                    PrismError("awsh: cd: OLDPWD not set\n");
                     return 1;
                 }
-                target = args[1];
             }
 
-            return chdir(target.Raw());
+            // Copied, the variables it may point into are rewritten below
+            String directory = target;
+            if (chdir(directory.Raw()) < 0)
+            {
+                PrismError("awsh: cd: {}: {}\n", directory.Raw(),
+                           strerror(errno));
+                return 1;
+            }
+
+            char cwd[PATH_MAX];
+            if (!getcwd(cwd, sizeof(cwd))) return 0;
+            String previous = Environment::GetVariable("PWD");
+            Environment::SetVariable("OLDPWD", previous);
+            Environment::SetVariable("PWD", cwd);
+            if (print)
+            {
+                Write(cwd);
+                Write("\n");
+            }
+
+            return 0;
+        }
+        isize Wait(BuiltinArgs args)
+        {
+            usize argc = ArgCount(args);
+            if (argc == 1)
+            {
+                Jobs::WaitAll();
+                return 0;
+            }
+            if (StringView(args[1]) == "-n"_sv)
+                return Jobs::WaitAny().ValueOr(127);
+
+            isize status = 0;
+            for (usize i = 1; i < argc; i++)
+            {
+                StringView id  = args[i];
+                Jobs::Job* job = id.StartsWith("%"_sv)
+                                   ? Jobs::FindByNumber(
+                                         StringUtils::ToNumber<usize>(
+                                             id.Substr(1)))
+                                   : Jobs::FindByPid(
+                                         StringUtils::ToNumber<pid_t>(id));
+
+                status = job ? Jobs::Wait(job->Pid) : 127;
+            }
+
+            return status;
+        }
+        isize ListJobs(BuiltinArgs)
+        {
+            Jobs::List();
+            return 0;
+        }
+
+        isize Times(BuiltinArgs)
+        {
+            rusage self, children;
+            getrusage(RUSAGE_SELF, &self);
+            getrusage(RUSAGE_CHILDREN, &children);
+
+            auto print = [](const rusage& usage)
+            {
+                auto micros = [](const timeval& tv) -> u64
+                { return tv.tv_sec * 1000000 + tv.tv_usec; };
+
+                Write(Jobs::FormatDuration(micros(usage.ru_utime)));
+                Write(" ");
+                Write(Jobs::FormatDuration(micros(usage.ru_stime)));
+                Write("\n");
+            };
+            print(self);
+            print(children);
+            return 0;
+        }
+
+        isize True(BuiltinArgs) { return 0; }
+        isize False(BuiltinArgs) { return 1; }
+
+        // Writes text, interpreting backslash escapes as echo -e and printf
+        // do. octal0 selects the \0nnn form of echo and %b over \nnn.
+        // Returns false on \c, which ends all output
+        bool WriteEscaped(StringView text, bool octal0)
+        {
+            auto digit = [](char c, u32 base) -> i32
+            {
+                i32 value = c >= '0' && c <= '9'   ? c - '0'
+                          : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                          : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                                 : 99;
+                return value < static_cast<i32>(base) ? value : -1;
+            };
+
+            usize run = 0;
+            for (usize i = 0; i + 1 < text.Size(); i++)
+            {
+                if (text[i] != '\\') continue;
+
+                char  c     = text[i + 1];
+                char  out   = 0;
+                usize end   = i + 2;
+                bool  known = true;
+                switch (c)
+                {
+                    case 'a': out = '\a'; break;
+                    case 'b': out = '\b'; break;
+                    case 'e': out = '\033'; break;
+                    case 'f': out = '\f'; break;
+                    case 'n': out = '\n'; break;
+                    case 'r': out = '\r'; break;
+                    case 't': out = '\t'; break;
+                    case 'v': out = '\v'; break;
+                    case '\\': out = '\\'; break;
+                    case 'c':
+                        Write(text.Substr(run, i - run));
+                        return false;
+                    case 'x':
+                    {
+                        i32 value = 0;
+                        while (end < text.Size() && end < i + 4
+                               && digit(text[end], 16) >= 0)
+                            value = value * 16 + digit(text[end++], 16);
+                        known = end > i + 2;
+                        out   = static_cast<char>(value);
+                        break;
+                    }
+                    default:
+                    {
+                        if (digit(c, 8) < 0 || (octal0 && c != '0'))
+                        {
+                            known = false;
+                            break;
+                        }
+
+                        // \0 itself does not count towards the 3 digits
+                        usize first = octal0 ? i + 2 : i + 1;
+                        i32   value = 0;
+                        end         = first;
+                        while (end < text.Size() && end < first + 3
+                               && digit(text[end], 8) >= 0)
+                            value = value * 8 + digit(text[end++], 8);
+                        out = static_cast<char>(value);
+                        break;
+                    }
+                }
+                if (!known) continue;
+
+                Write(text.Substr(run, i - run));
+                Write(StringView(&out, 1));
+                run = end;
+                i   = end - 1;
+            }
+
+            Write(text.Substr(run));
+            return true;
+        }
+
+        isize Echo(BuiltinArgs args)
+        {
+            usize argc     = ArgCount(args);
+            usize first    = 1;
+            bool  newline  = true;
+            bool  escapes  = false;
+
+            // Only words made of n, e and E are options, like bash
+            for (; first < argc; first++)
+            {
+                StringView arg = args[first];
+                if (arg.Size() < 2 || arg[0] != '-') break;
+
+                bool option = true;
+                for (usize i = 1; i < arg.Size(); i++)
+                    option &= arg[i] == 'n' || arg[i] == 'e' || arg[i] == 'E';
+                if (!option) break;
+
+                for (usize i = 1; i < arg.Size(); i++)
+                {
+                    if (arg[i] == 'n') newline = false;
+                    else escapes = arg[i] == 'e';
+                }
+            }
+
+            for (usize i = first; i < argc; i++)
+            {
+                if (i > first) Write(" ");
+                if (!escapes) Write(args[i]);
+                else if (!WriteEscaped(args[i], true)) return 0;
+            }
+            if (newline) Write("\n");
+
+            return 0;
+        }
+
+        void WritePadding(usize count)
+        {
+            constexpr StringView spaces = "                                "_sv;
+            for (; count > spaces.Size(); count -= spaces.Size()) Write(spaces);
+            Write(spaces.Substr(0, count));
+        }
+        bool ParseInteger(const char* text, long long& value)
+        {
+            // A leading quote yields the code of the next character
+            if (*text == '\'' || *text == '"')
+            {
+                value = static_cast<u8>(text[1]);
+                return true;
+            }
+            if (!*text)
+            {
+                value = 0;
+                return true;
+            }
+
+            char* end = nullptr;
+            errno     = 0;
+            value     = strtoll(text, &end, 0);
+            return *end == '\0' && errno == 0;
+        }
+
+        isize Printf(BuiltinArgs args)
+        {
+            usize argc = ArgCount(args);
+            if (argc < 2)
+            {
+                PrismError("awsh: printf: usage: printf format [arguments]\n");
+                return 2;
+            }
+
+            StringView format = args[1];
+            usize      next   = 2;
+            isize      status = 0;
+            auto       take   = [&]() -> const char*
+            { return next < argc ? args[next++] : ""; };
+
+            // The format is reused for as long as it consumes arguments
+            do {
+                usize start = next;
+                usize run   = 0;
+                for (usize i = 0; i < format.Size(); i++)
+                {
+                    if (format[i] != '%') continue;
+                    if (!WriteEscaped(format.Substr(run, i - run), false))
+                        return status;
+
+                    if (i + 1 < format.Size() && format[i + 1] == '%')
+                    {
+                        Write("%");
+                        run = ++i + 1;
+                        continue;
+                    }
+
+                    // Flags, width and precision are passed on to snprintf
+                    char  spec[32] = "%";
+                    usize length   = 1;
+                    bool  left     = false;
+                    usize j        = i + 1;
+                    for (; j < format.Size() && length < 8; j++)
+                    {
+                        char c = format[j];
+                        if (c != '-' && c != '+' && c != ' ' && c != '#'
+                            && c != '0')
+                            break;
+                        left |= c == '-';
+                        spec[length++] = c;
+                    }
+
+                    auto number = [&](i32& out)
+                    {
+                        out = -1;
+                        if (j < format.Size() && format[j] == '*')
+                        {
+                            long long value = 0;
+                            ParseInteger(take(), value);
+                            out = value < 0 ? 0 : value > 1024 ? 1024 : value;
+                            ++j;
+                            return;
+                        }
+                        while (j < format.Size() && StringUtils::IsDigit(format[j]))
+                            out = (out < 0 ? 0 : out) * 10 + format[j++] - '0';
+                        if (out > 1024) out = 1024;
+                    };
+                    i32 width = -1, precision = -1;
+                    number(width);
+                    if (j < format.Size() && format[j] == '.')
+                    {
+                        ++j;
+                        number(precision);
+                        if (precision < 0) precision = 0;
+                    }
+                    if (j == format.Size())
+                    {
+                        PrismError("awsh: printf: missing format character\n");
+                        return 1;
+                    }
+
+                    char conversion = format[j];
+                    run             = j + 1;
+                    i               = j;
+                    switch (conversion)
+                    {
+                        case 's':
+                        case 'b':
+                        case 'c':
+                        {
+                            StringView arg = take();
+                            if (conversion == 'c') arg = arg.Substr(0, 1);
+                            if (precision >= 0
+                                && static_cast<usize>(precision) < arg.Size())
+                                arg = arg.Substr(0, precision);
+
+                            usize pad = width > 0
+                                         && static_cast<usize>(width) > arg.Size()
+                                          ? width - arg.Size()
+                                          : 0;
+                            if (!left) WritePadding(pad);
+                            if (conversion != 'b') Write(arg);
+                            else if (!WriteEscaped(arg, true)) return status;
+                            if (left) WritePadding(pad);
+                            break;
+                        }
+                        case 'd':
+                        case 'i':
+                        case 'u':
+                        case 'o':
+                        case 'x':
+                        case 'X':
+                        {
+                            const char* arg   = take();
+                            long long   value = 0;
+                            if (!ParseInteger(arg, value))
+                            {
+                                PrismError("awsh: printf: {}: invalid number\n",
+                                           arg);
+                                status = 1;
+                            }
+
+                            length += snprintf(spec + length,
+                                               sizeof(spec) - length, "%s",
+                                               width >= 0 ? "*" : "");
+                            length += snprintf(spec + length,
+                                               sizeof(spec) - length, "%s",
+                                               precision >= 0 ? ".*" : "");
+                            spec[length++] = 'l';
+                            spec[length++] = 'l';
+                            spec[length++] = conversion;
+                            spec[length]   = '\0';
+
+                            // Width and precision are capped, so this fits
+                            char buffer[2100];
+                            i32  size = 0;
+                            if (width >= 0 && precision >= 0)
+                                size = snprintf(buffer, sizeof(buffer), spec,
+                                                width, precision, value);
+                            else if (width >= 0)
+                                size = snprintf(buffer, sizeof(buffer), spec,
+                                                width, value);
+                            else if (precision >= 0)
+                                size = snprintf(buffer, sizeof(buffer), spec,
+                                                precision, value);
+                            else
+                                size = snprintf(buffer, sizeof(buffer), spec,
+                                                value);
+                            Write(StringView(buffer, size));
+                            break;
+                        }
+
+                        default:
+                            PrismError(
+                                "awsh: printf: %{}: invalid format character\n",
+                                conversion);
+                            return 1;
+                    }
+                }
+
+                if (!WriteEscaped(format.Substr(run), false)) return status;
+                if (next == start) break;
+            } while (next < argc);
+
+            return status;
+        }
+
+        // POSIX test, evaluated straight off argv
+        class TestExpression
+        {
+          public:
+            TestExpression(char* const* argv, usize count)
+                : m_Argv(argv)
+                , m_Count(count)
+            {
+            }
+
+            // 0 when true, 1 when false and 2 on a syntax error
+            isize Evaluate()
+            {
+                bool result = Evaluate(0, m_Count);
+                if (!m_Error && m_Position < m_Count)
+                    Fail("unexpected argument", m_Position);
+
+                return m_Error ? 2 : !result;
+            }
+
+          private:
+            char* const* m_Argv;
+            usize        m_Count;
+            usize        m_Position = 0;
+            bool         m_Error    = false;
+
+            StringView   At(usize i) const
+            {
+                return i < m_Count ? StringView(m_Argv[i]) : StringView();
+            }
+            bool Fail(StringView message, usize at)
+            {
+                if (!m_Error)
+                    PrismError("awsh: test: {}: {}\n",
+                               at < m_Count ? m_Argv[at] : "", message);
+                m_Error = true;
+                return false;
+            }
+
+            static bool IsUnary(StringView op)
+            {
+                if (op.Size() != 2 || op[0] != '-') return false;
+                for (char c : "bcdefghLnprsStuwxz"_sv)
+                    if (op[1] == c) return true;
+                return false;
+            }
+            static bool IsBinary(StringView op)
+            {
+                constexpr StringView ops[]
+                    = {"=",   "==",  "!=",  "<",   ">",   "-eq", "-ne", "-lt",
+                       "-le", "-gt", "-ge", "-nt", "-ot", "-ef"};
+                for (auto candidate : ops)
+                    if (op == candidate) return true;
+                return false;
+            }
+
+            // POSIX fixes the meaning of up to four arguments, anything
+            // longer is parsed with -a binding tighter than -o
+            bool Evaluate(usize begin, usize count)
+            {
+                m_Position = begin;
+                switch (count)
+                {
+                    case 0: return false;
+                    case 1: m_Position = begin + 1; return !At(begin).Empty();
+                    case 2:
+                        if (At(begin) == "!"_sv)
+                            return !Evaluate(begin + 1, 1);
+                        if (IsUnary(At(begin)))
+                        {
+                            m_Position = begin + 2;
+                            return Unary(At(begin), begin + 1);
+                        }
+                        return Fail("unary operator expected", begin);
+                    case 3:
+                        if (IsBinary(At(begin + 1)))
+                        {
+                            m_Position = begin + 3;
+                            return Binary(begin);
+                        }
+                        if (At(begin) == "!"_sv) return !Evaluate(begin + 1, 2);
+                        if (At(begin) == "("_sv && At(begin + 2) == ")"_sv)
+                        {
+                            bool result = Evaluate(begin + 1, 1);
+                            m_Position  = begin + 3;
+                            return result;
+                        }
+                        break;
+                    case 4:
+                        if (At(begin) == "!"_sv) return !Evaluate(begin + 1, 3);
+                        if (At(begin) == "("_sv && At(begin + 3) == ")"_sv)
+                        {
+                            bool result = Evaluate(begin + 1, 2);
+                            m_Position  = begin + 4;
+                            return result;
+                        }
+                        break;
+                    default: break;
+                }
+
+                m_Position = begin;
+                return Or(begin + count);
+            }
+
+            bool Or(usize end)
+            {
+                bool result = And(end);
+                while (!m_Error && m_Position < end && At(m_Position) == "-o"_sv)
+                {
+                    ++m_Position;
+                    result = And(end) || result;
+                }
+                return result;
+            }
+            bool And(usize end)
+            {
+                bool result = Not(end);
+                while (!m_Error && m_Position < end && At(m_Position) == "-a"_sv)
+                {
+                    ++m_Position;
+                    result = Not(end) && result;
+                }
+                return result;
+            }
+            bool Not(usize end)
+            {
+                if (m_Position < end && At(m_Position) == "!"_sv)
+                {
+                    ++m_Position;
+                    return !Not(end);
+                }
+                return Primary(end);
+            }
+            bool Primary(usize end)
+            {
+                if (m_Position >= end)
+                    return Fail("argument expected", m_Position);
+
+                usize at = m_Position;
+                if (At(at) == "("_sv)
+                {
+                    ++m_Position;
+                    bool result = Or(end);
+                    if (At(m_Position) != ")"_sv)
+                        return Fail("')' expected", m_Position);
+                    ++m_Position;
+                    return result;
+                }
+                if (at + 2 < end && IsBinary(At(at + 1)))
+                {
+                    m_Position = at + 3;
+                    return Binary(at);
+                }
+                if (IsUnary(At(at)) && at + 1 < end)
+                {
+                    m_Position = at + 2;
+                    return Unary(At(at), at + 1);
+                }
+
+                m_Position = at + 1;
+                return !At(at).Empty();
+            }
+
+            bool Unary(StringView op, usize at)
+            {
+                const char* operand = m_Argv[at];
+                switch (op[1])
+                {
+                    case 'n': return *operand != '\0';
+                    case 'z': return *operand == '\0';
+                    case 't':
+                    {
+                        long long fd = 0;
+                        if (!ParseInteger(operand, fd))
+                            return Fail("integer expression expected", at);
+                        return isatty(fd);
+                    }
+                    case 'r': return access(operand, R_OK) == 0;
+                    case 'w': return access(operand, W_OK) == 0;
+                    case 'x': return access(operand, X_OK) == 0;
+                    default: break;
+                }
+
+                struct stat st;
+                bool        link = op[1] == 'L' || op[1] == 'h';
+                if ((link ? lstat(operand, &st) : stat(operand, &st)) < 0)
+                    return false;
+
+                switch (op[1])
+                {
+                    case 'e': return true;
+                    case 'f': return S_ISREG(st.st_mode);
+                    case 'd': return S_ISDIR(st.st_mode);
+                    case 'b': return S_ISBLK(st.st_mode);
+                    case 'c': return S_ISCHR(st.st_mode);
+                    case 'p': return S_ISFIFO(st.st_mode);
+                    case 'S': return S_ISSOCK(st.st_mode);
+                    case 'L':
+                    case 'h': return S_ISLNK(st.st_mode);
+                    case 's': return st.st_size > 0;
+                    case 'g': return st.st_mode & S_ISGID;
+                    case 'u': return st.st_mode & S_ISUID;
+                    default: break;
+                }
+
+                return false;
+            }
+            bool Binary(usize at)
+            {
+                StringView lhs = At(at);
+                StringView op  = At(at + 1);
+                StringView rhs = At(at + 2);
+                if (op == "="_sv || op == "=="_sv) return lhs == rhs;
+                if (op == "!="_sv) return lhs != rhs;
+                if (op == "<"_sv || op == ">"_sv)
+                {
+                    i32 order = strcmp(m_Argv[at], m_Argv[at + 2]);
+                    return op == "<"_sv ? order < 0 : order > 0;
+                }
+
+                if (op == "-nt"_sv || op == "-ot"_sv || op == "-ef"_sv)
+                {
+                    struct stat left, right;
+                    bool        hasLeft  = stat(m_Argv[at], &left) == 0;
+                    bool        hasRight = stat(m_Argv[at + 2], &right) == 0;
+                    if (op == "-ef"_sv)
+                        return hasLeft && hasRight && left.st_dev == right.st_dev
+                            && left.st_ino == right.st_ino;
+
+                    auto newer = [](const struct stat& a, const struct stat& b)
+                    {
+                        return a.st_mtim.tv_sec != b.st_mtim.tv_sec
+                                 ? a.st_mtim.tv_sec > b.st_mtim.tv_sec
+                                 : a.st_mtim.tv_nsec > b.st_mtim.tv_nsec;
+                    };
+                    if (op == "-nt"_sv)
+                        return hasLeft && (!hasRight || newer(left, right));
+                    return hasRight && (!hasLeft || newer(right, left));
+                }
+
+                long long a = 0, b = 0;
+                if (!ParseInteger(m_Argv[at], a) || *m_Argv[at] == '\0')
+                    return Fail("integer expression expected", at);
+                if (!ParseInteger(m_Argv[at + 2], b) || *m_Argv[at + 2] == '\0')
+                    return Fail("integer expression expected", at + 2);
+
+                if (op == "-eq"_sv) return a == b;
+                if (op == "-ne"_sv) return a != b;
+                if (op == "-lt"_sv) return a < b;
+                if (op == "-le"_sv) return a <= b;
+                if (op == "-gt"_sv) return a > b;
+                return a >= b;
+            }
+        };
+        isize Test(BuiltinArgs args)
+        {
+            usize count = ArgCount(args) - 1;
+            if (StringView(args[0]) == "["_sv)
+            {
+                if (count == 0 || StringView(args[count]) != "]"_sv)
+                {
+                    PrismError("awsh: [: missing ']'\n");
+                    return 2;
+                }
+                --count;
+            }
+
+            return TestExpression(args.Raw() + 1, count).Evaluate();
+        }
+
+        isize PrintWorkingDirectory(BuiltinArgs args)
+        {
+            bool physical = ArgCount(args) > 1 && StringView(args[1]) == "-P"_sv;
+
+            // $PWD is kept unless it no longer names the current directory
+            StringView logical = Environment::GetVariable("PWD");
+            struct stat pwd, dot;
+            if (!physical && logical.StartsWith("/"_sv)
+                && stat(String(logical).Raw(), &pwd) == 0
+                && stat(".", &dot) == 0 && pwd.st_dev == dot.st_dev
+                && pwd.st_ino == dot.st_ino)
+            {
+                Write(logical);
+                Write("\n");
+                return 0;
+            }
+
+            char cwd[PATH_MAX];
+            if (!getcwd(cwd, sizeof(cwd)))
+            {
+                PrismError("awsh: pwd: {}\n", strerror(errno));
+                return 1;
+            }
+
+            Write(cwd);
+            Write("\n");
+            return 0;
+        }
+
+        // Splits line into fields for read. Whitespace in IFS folds into
+        // one separator and is trimmed at both ends, the last name takes
+        // whatever is left
+        void AssignFields(StringView line, char* const* names, usize count)
+        {
+            // An unset IFS splits on blanks, an empty one not at all
+            auto separators
+                = Environment::IsSet("IFS")
+                    ? Expander::Separators(Environment::GetVariable("IFS"))
+                    : Expander::Separators();
+
+            Expander::Fields fields(line, separators);
+            for (usize n = 0; n + 1 < count; n++)
+            {
+                StringView field;
+                fields.Next(field);
+                Environment::SetVariable(names[n], field);
+            }
+            if (count > 0)
+                Environment::SetVariable(names[count - 1], fields.Rest());
+        }
+
+        // read [-r] [-d delim] [-u fd] [-p prompt] [name...]
+        isize Read(BuiltinArgs args)
+        {
+            usize      argc      = ArgCount(args);
+            bool       raw       = false;
+            char       delimiter = '\n';
+            i32        fd        = 0;
+            StringView prompt;
+
+            usize      i = 1;
+            for (; i < argc && args[i][0] == '-' && args[i][1]; i++)
+            {
+                StringView option = args[i];
+                if (option == "--"_sv)
+                {
+                    ++i;
+                    break;
+                }
+
+                for (usize j = 1; j < option.Size(); j++)
+                {
+                    char flag = option[j];
+                    if (flag == 'r')
+                    {
+                        raw = true;
+                        continue;
+                    }
+                    if (flag != 'd' && flag != 'u' && flag != 'p')
+                    {
+                        PrismError("awsh: read: -{}: invalid option\n", flag);
+                        return 2;
+                    }
+
+                    // The value is the rest of this word, or the next one
+                    StringView value;
+                    if (j + 1 < option.Size()) value = option.Substr(j + 1);
+                    else if (i + 1 < argc) value = args[++i];
+                    else
+                    {
+                        PrismError("awsh: read: -{}: option requires an "
+                                   "argument\n",
+                                   flag);
+                        return 2;
+                    }
+
+                    if (flag == 'd') delimiter = value.Empty() ? '\0' : value[0];
+                    else if (flag == 'p') prompt = value;
+                    else
+                    {
+                        bool number = !value.Empty();
+                        for (char c : value) number &= StringUtils::IsDigit(c);
+                        if (!number)
+                        {
+                            PrismError("awsh: read: {}: invalid file "
+                                       "descriptor\n",
+                                       value);
+                            return 1;
+                        }
+                        fd = StringUtils::ToNumber<i32>(value);
+                    }
+                    break;
+                }
+            }
+
+            if (!prompt.Empty() && isatty(fd))
+                write(2, prompt.Raw(), prompt.Size());
+
+            // Without -r, a backslash escapes the next character, and one
+            // right before the delimiter joins the next line
+            String             line;
+            Input::ReadResult result;
+            for (;;)
+            {
+                result = Input::ReadLine(fd, line, delimiter);
+                usize backslashes = 0;
+                while (backslashes < line.Size()
+                       && line[line.Size() - backslashes - 1] == '\\')
+                    ++backslashes;
+
+                if (raw || result != Input::ReadResult::eLine
+                    || backslashes % 2 == 0)
+                    break;
+                line = line.Substr(0, line.Size() - 1);
+            }
+            if (result == Input::ReadResult::eError)
+            {
+                PrismError("awsh: read: {}: {}\n", fd, strerror(errno));
+                return 1;
+            }
+
+            if (!raw && line.Find('\\') != String::NPos)
+            {
+                String unescaped;
+                for (usize c = 0; c < line.Size(); c++)
+                {
+                    if (line[c] == '\\' && c + 1 < line.Size()) ++c;
+                    unescaped += line[c];
+                }
+                line = Move(unescaped);
+            }
+
+            // REPLY gets the line as it is
+            if (i >= argc) Environment::SetVariable("REPLY", line);
+            else AssignFields(line, args.Raw() + i, argc - i);
+
+            return result == Input::ReadResult::eLine ? 0 : 1;
+        }
+
+        // mapfile [-t] [-d delim] [-n count] [-s count] [-u fd] [array],
+        // and readarray. Without -n, the whole input is read at once and
+        // split into lines in a single pass
+        isize MapFile(BuiltinArgs args)
+        {
+            usize      argc      = ArgCount(args);
+            StringView builtin   = args[0];
+            bool       trim      = false;
+            char       delimiter = '\n';
+            i32        fd        = 0;
+            usize      count     = 0;
+            usize      skip      = 0;
+
+            usize      i = 1;
+            for (; i < argc && args[i][0] == '-' && args[i][1]; i++)
+            {
+                StringView option = args[i];
+                if (option == "--"_sv)
+                {
+                    ++i;
+                    break;
+                }
+
+                for (usize j = 1; j < option.Size(); j++)
+                {
+                    char flag = option[j];
+                    if (flag == 't')
+                    {
+                        trim = true;
+                        continue;
+                    }
+                    if (!strchr("dnsu", flag))
+                    {
+                        PrismError("awsh: {}: -{}: invalid option\n", builtin,
+                                   flag);
+                        return 2;
+                    }
+
+                    StringView value;
+                    if (j + 1 < option.Size()) value = option.Substr(j + 1);
+                    else if (i + 1 < argc) value = args[++i];
+                    else
+                    {
+                        PrismError("awsh: {}: -{}: option requires an "
+                                   "argument\n",
+                                   builtin, flag);
+                        return 2;
+                    }
+                    if (flag == 'd')
+                    {
+                        delimiter = value.Empty() ? '\0' : value[0];
+                        break;
+                    }
+
+                    bool number = !value.Empty();
+                    for (char c : value) number &= StringUtils::IsDigit(c);
+                    if (!number)
+                    {
+                        PrismError("awsh: {}: {}: invalid {}\n", builtin,
+                                   value,
+                                   flag == 'u' ? "file descriptor" : "count");
+                        return 1;
+                    }
+                    if (flag == 'u') fd = StringUtils::ToNumber<i32>(value);
+                    else if (flag == 'n')
+                        count = StringUtils::ToNumber<usize>(value);
+                    else skip = StringUtils::ToNumber<usize>(value);
+                    break;
+                }
+            }
+
+            StringView name  = i < argc ? StringView(args[i]) : "MAPFILE"_sv;
+            bool       valid = !name.Empty() && !StringUtils::IsDigit(name[0]);
+            for (char c : name)
+                valid &= StringUtils::IsAlphanumeric(c) || c == '_';
+            if (!valid)
+            {
+                PrismError("awsh: {}: `{}': not a valid identifier\n",
+                           builtin, name);
+                return 1;
+            }
+            if (Environment::KindOf(name)
+                == Environment::VariableKind::eAssociative)
+            {
+                PrismError("awsh: {}: {}: not an indexed array\n", builtin,
+                           name);
+                return 1;
+            }
+
+            Vector<String> lines;
+            if (count > 0)
+            {
+                // Only as many lines as asked for may be taken off the input
+                String line;
+                for (usize n = 0; lines.Size() < count; n++)
+                {
+                    line.Clear();
+                    auto result = Input::ReadLine(fd, line, delimiter);
+                    if (result == Input::ReadResult::eError)
+                    {
+                        PrismError("awsh: {}: {}: {}\n", builtin, fd,
+                                   strerror(errno));
+                        return 1;
+                    }
+                    if (result == Input::ReadResult::eEnd) break;
+                    if (n < skip) continue;
+
+                    if (!trim && result == Input::ReadResult::eLine)
+                        line += delimiter;
+                    lines.PushBack(line);
+                    if (result == Input::ReadResult::ePartial) break;
+                }
+            }
+            else
+            {
+                String data;
+                if (Input::ReadAll(fd, data) == Input::ReadResult::eError)
+                {
+                    PrismError("awsh: {}: {}: {}\n", builtin, fd,
+                               strerror(errno));
+                    return 1;
+                }
+
+                // The delimiter is the only separator, so lines are found
+                // a block of bytes at a time
+                Expander::Separators delimiters(StringView(&delimiter, 1));
+                for (usize pos = 0, n = 0; pos < data.Size(); n++)
+                {
+                    usize end  = delimiters.FindSeparator(data, pos);
+                    usize next = end < data.Size() ? end + 1 : end;
+                    if (n >= skip)
+                        lines.PushBack(
+                            data.Substr(pos, (trim ? end : next) - pos));
+                    pos = next;
+                }
+            }
+
+            Environment::SetArray(name, Arrays::Indexed(Move(lines)));
+            return 0;
+        }
+
+        // export [-p] [name[=value]...]
+        // Values are assigned by the executor once this returns
+        isize Export(BuiltinArgs args)
+        {
+            usize argc = ArgCount(args);
+            usize i    = 1;
+            if (i < argc && StringView(args[i]) == "-p"_sv) ++i;
+
+            if (i == argc)
+            {
+                for (auto env = Environment::Block(); *env; env++)
+                {
+                    StringView entry  = *env;
+                    usize      equals = 0;
+                    while (equals < entry.Size() && entry[equals] != '=')
+                        ++equals;
+
+                    Write("export ");
+                    Write(entry.Substr(0, equals));
+                    if (equals == entry.Size())
+                    {
+                        Write("\n");
+                        continue;
+                    }
+
+                    // Single quotes keep the value intact when read back
+                    Write("='");
+                    StringView value = entry.Substr(equals + 1);
+                    for (char c : value)
+                    {
+                        if (c == '\'') Write("'\\''");
+                        else Write(StringView(&c, 1));
+                    }
+                    Write("'\n");
+                }
+                return 0;
+            }
+
+            isize status = 0;
+            for (; i < argc; i++)
+            {
+                StringView name  = args[i];
+                bool       valid = !name.Empty() && !StringUtils::IsDigit(name[0]);
+                for (char c : name)
+                    valid &= StringUtils::IsAlphanumeric(c) || c == '_';
+                if (!valid)
+                {
+                    PrismError("awsh: export: `{}': not a valid identifier\n",
+                               name);
+                    status = 1;
+                    continue;
+                }
+
+                Environment::Export(name);
+            }
+            return status;
+        }
+
+        // declare [-aAix] [+i] [name[=value]...], and local with the same
+        // options. Values are assigned by the executor once this returns, so
+        // an integer's value is already evaluated as one
+        isize DeclareNames(BuiltinArgs args, bool local)
+        {
+            StringView builtin  = local ? "local"_sv : "declare"_sv;
+            usize      argc     = ArgCount(args);
+            isize      integer  = -1;
+            bool       exported = false;
+            char       array    = 0;
+            usize      i        = 1;
+            for (; i < argc && (args[i][0] == '-' || args[i][0] == '+')
+                   && args[i][1];
+                 i++)
+            {
+                StringView option = args[i];
+                if (option == "--"_sv)
+                {
+                    ++i;
+                    break;
+                }
+
+                for (usize j = 1; j < option.Size(); j++)
+                {
+                    if (option[j] == 'i') integer = option[0] == '-';
+                    else if (option[j] == 'x' && option[0] == '-')
+                        exported = true;
+                    else if ((option[j] == 'a' || option[j] == 'A')
+                             && option[0] == '-')
+                        array = option[j];
+                    else
+                    {
+                        PrismError("awsh: {}: {}{}: invalid option\n", builtin,
+                                   option[0], option[j]);
+                        return 2;
+                    }
+                }
+            }
+
+            // Declarations in a function are local to it
+            local |= Functions::Depth() > 0;
+            isize status = 0;
+            for (; i < argc; i++)
+            {
+                StringView name = args[i];
+                if (local && !Environment::DeclareLocal(name))
+                {
+                    PrismError("awsh: local: can only be used in a function\n");
+                    return 1;
+                }
+                if (integer >= 0) Environment::DeclareInteger(name, integer);
+                if (exported) Environment::Export(name);
+                if (array && !Environment::DeclareArray(name, array == 'A'))
+                {
+                    PrismError("awsh: {}: {}: cannot convert {} array\n",
+                               builtin, name,
+                               array == 'A' ? "indexed to associative"
+                                            : "associative to indexed");
+                    status = 1;
+                }
+            }
+            return status;
+        }
+        isize Declare(BuiltinArgs args) { return DeclareNames(args, false); }
+        isize Local(BuiltinArgs args) { return DeclareNames(args, true); }
+        isize Return(BuiltinArgs args)
+        {
+            if (Functions::Depth() == 0)
+            {
+                PrismError("awsh: return: can only `return' from a function\n");
+                return 1;
+            }
+
+            isize status = ArgCount(args) > 1
+                             ? StringUtils::ToNumber<i32>(args[1])
+                             : s_LastStatus;
+            Functions::Return();
+            return status & 0xff;
+        }
+
+        // Items of `parallel`, either the words after ::: or lines of stdin
+        class WorkSource
+        {
+          public:
+            WorkSource(BuiltinArgs args, usize first, usize last)
+                : m_Args(args)
+                , m_Next(first)
+                , m_Last(last)
+                , m_FromStdin(first == 0)
+            {
+            }
+
+            usize Remaining() const { return m_FromStdin ? 0 : m_Last - m_Next; }
+            bool  Next(String& item)
+            {
+                if (!m_FromStdin)
+                {
+                    if (m_Next >= m_Last) return false;
+                    item = m_Args[m_Next++];
+                    return true;
+                }
+
+                // Through the buffer read uses, so neither loses what the
+                // other already took from the fd
+                item.Clear();
+                auto result = Input::ReadLine(0, item);
+                return result == Input::ReadResult::eLine
+                    || result == Input::ReadResult::ePartial;
+            }
+
+          private:
+            BuiltinArgs m_Args;
+            usize       m_Next      = 0;
+            usize       m_Last      = 0;
+            bool        m_FromStdin = false;
+        };
+        struct ParallelJob
+        {
+            pid_t  Pid    = -1;
+            i32    Fd     = -1;
+            bool   Eof    = false;
+            i32    Status = 0;
+            String Output;
+        };
+
+        // parallel [-j jobs] [-n max-args] command [args...] [::: items...]
+        // Runs command once per batch of items, with at most `jobs` batches
+        // in flight. A batch takes up to max-args items that fit into
+        // ARG_MAX, {} in the template marks where they go. Items after :::
+        // are spread evenly over the jobs, lines of stdin go one per job
+        // unless -n says otherwise, as their number is not known up front.
+        // Output of every job is buffered and written in submission order
+        isize Parallel(BuiltinArgs args)
+        {
+            usize argc    = ArgCount(args);
+            usize maxJobs = sysconf(_SC_NPROCESSORS_ONLN);
+            usize maxArgs = 0;
+
+            usize i       = 1;
+            for (; i < argc && args[i][0] == '-'; i++)
+            {
+                StringView option = args[i];
+                if (option == "--"_sv)
+                {
+                    ++i;
+                    break;
+                }
+                if (option.Size() < 2
+                    || (option[1] != 'j' && option[1] != 'n'))
+                {
+                    PrismError("awsh: parallel: unknown option '{}'\n",
+                               option);
+                    return 2;
+                }
+
+                StringView value
+                    = option.Size() > 2 ? option.Substr(2)
+                                        : (i + 1 < argc ? StringView(args[++i])
+                                                        : StringView(""));
+                usize number = StringUtils::ToNumber<usize>(value);
+                if (option[1] == 'j') maxJobs = number;
+                else maxArgs = number;
+            }
+            if (maxJobs == 0) maxJobs = 1;
+
+            usize templateBegin = i;
+            usize templateEnd   = i;
+            while (templateEnd < argc && StringView(args[templateEnd]) != ":::"_sv)
+                ++templateEnd;
+            if (templateBegin == templateEnd)
+            {
+                PrismError("awsh: parallel: no command given\n");
+                return 2;
+            }
+
+            WorkSource source(args, templateEnd < argc ? templateEnd + 1 : 0,
+                              argc);
+            // Spread a known list of items evenly over the job slots
+            if (source.Remaining() > 0 && maxArgs == 0)
+                maxArgs = (source.Remaining() + maxJobs - 1) / maxJobs;
+            else if (maxArgs == 0) maxArgs = 1;
+
+            // Leave room for the environment, like xargs does
+            usize argMax  = sysconf(_SC_ARG_MAX);
+            usize budget  = argMax > 4096 ? argMax - 2048 : argMax / 2;
+            auto  reserve = [&budget](const char* arg)
+            {
+                usize cost = StringUtils::Length(arg) + 1 + sizeof(char*);
+                budget     = cost < budget ? budget - cost : 0;
+            };
+            for (auto env = Environment::Block(); *env; env++) reserve(*env);
+            for (usize t = templateBegin; t < templateEnd; t++)
+                reserve(args[t]);
+
+            String pending;
+            bool   hasPending = source.Next(pending);
+            auto   nextBatch  = [&](Vector<String>& batch) -> bool
+            {
+                batch.Clear();
+                usize bytes = 0;
+                while (hasPending && (maxArgs == 0 || batch.Size() < maxArgs))
+                {
+                    usize cost = pending.Size() + 1 + sizeof(char*);
+                    if (!batch.Empty() && bytes + cost > budget) break;
+
+                    bytes += cost;
+                    batch.PushBack(Move(pending));
+                    hasPending = source.Next(pending);
+                }
+
+                return !batch.Empty();
+            };
+
+            // Jobs in submission order; finished ones stay until everything
+            // before them was written out, which also bounds the queue
+            Vector<ParallelJob> window;
+            usize               running   = 0;
+            usize               failed    = 0;
+            const usize         maxWindow = maxJobs * 4;
+            Vector<String>      batch;
+
+            for (;;)
+            {
+                while (running < maxJobs && window.Size() < maxWindow
+                       && nextBatch(batch))
+                {
+                    Vector<char*> argv;
+                    bool          placed = false;
+                    for (usize t = templateBegin; t < templateEnd; t++)
+                    {
+                        if (StringView(args[t]) != "{}"_sv)
+                        {
+                            argv.PushBack(args[t]);
+                            continue;
+                        }
+
+                        for (auto& item : batch)
+                            argv.PushBack(const_cast<char*>(item.Raw()));
+                        placed = true;
+                    }
+                    if (!placed)
+                        for (auto& item : batch)
+                            argv.PushBack(const_cast<char*>(item.Raw()));
+                    argv.PushBack(nullptr);
+
+                    i32 fds[2];
+                    if (pipe2(fds, O_CLOEXEC) < 0) break;
+
+                    Vector<FdAction> output;
+                    output.PushBack(
+                        {FdAction::Type::eDuplicate, 1, 0, fds[1], {}});
+                    pid_t pid = Executor::Spawn(argv.Raw(), false, &output);
+                    close(fds[1]);
+
+                    auto& job = window.EmplaceBack();
+                    job.Pid   = pid;
+                    job.Fd    = fds[0];
+                    if (pid < 0)
+                    {
+                        close(fds[0]);
+                        job.Fd     = -1;
+                        job.Eof    = true;
+                        job.Status = 127;
+                        continue;
+                    }
+                    ++running;
+                }
+                if (window.Empty()) break;
+
+                Vector<pollfd> fds;
+                Vector<usize>  owners;
+                for (usize j = 0; j < window.Size(); j++)
+                {
+                    if (window[j].Eof) continue;
+
+                    fds.PushBack({window[j].Fd, POLLIN, 0});
+                    owners.PushBack(j);
+                }
+
+                if (!fds.Empty()
+                    && poll(fds.Raw(), fds.Size(), -1) < 0 && errno != EINTR)
+                    break;
+                for (usize f = 0; f < fds.Size(); f++)
+                {
+                    if (!fds[f].revents) continue;
+
+                    auto& job = window[owners[f]];
+                    char  chunk[4096];
+                    isize nread = read(job.Fd, chunk, sizeof(chunk));
+                    if (nread < 0 && errno == EINTR) continue;
+                    if (nread > 0)
+                    {
+                        // The oldest job streams straight through
+                        if (owners[f] == 0) Write(StringView(chunk, nread));
+                        else job.Output += StringView(chunk, nread);
+                        continue;
+                    }
+
+                    close(job.Fd);
+                    job.Fd     = -1;
+                    job.Eof    = true;
+                    job.Status = Jobs::Wait(job.Pid);
+                    --running;
+                }
+
+                while (!window.Empty() && window[0].Eof)
+                {
+                    if (window[0].Status != 0) ++failed;
+                    window.Erase(0);
+                    if (!window.Empty())
+                    {
+                        Write(window[0].Output);
+                        window[0].Output.Clear();
+                    }
+                }
+            }
+
+            return failed > 101 ? 101 : failed;
         }
     }; // namespace
 
-    void Initialize()
+    namespace
     {
-        // Register builtins
-        s_Builtins["cd"]   = ChangeDirectory;
-        s_Builtins["exit"] = Exit;
+        struct Entry
+        {
+            const char* Name;
+            BuiltinProc Proc;
+        };
+        constexpr Entry s_Entries[] = {
+            {":", True},
+            {"[", Test},
+            {"cd", ChangeDirectory},
+            {"declare", Declare},
+            {"echo", Echo},
+            {"exit", Exit},
+            {"export", Export},
+            {"false", False},
+            {"jobs", ListJobs},
+            {"local", Local},
+            {"mapfile", MapFile},
+            {"parallel", Parallel},
+            {"printf", Printf},
+            {"pwd", PrintWorkingDirectory},
+            {"read", Read},
+            {"readarray", MapFile},
+            {"return", Return},
+            {"test", Test},
+            {"times", Times},
+            {"true", True},
+            {"wait", Wait},
+        };
+        constexpr usize ENTRY_COUNT = sizeof(s_Entries) / sizeof(s_Entries[0]);
+
+        // Sparse enough that a collision-free seed turns up within a few
+        // tries, small enough to stay in one or two cache lines
+        constexpr usize TABLE_SIZE = []
+        {
+            usize size = 8;
+            while (size < ENTRY_COUNT * 4) size <<= 1;
+            return size;
+        }();
+
+        constexpr u32 Hash(const char* name, usize length, u32 seed)
+        {
+            u32 hash = 2166136261u ^ seed;
+            for (usize i = 0; i < length; i++)
+            {
+                hash ^= static_cast<u8>(name[i]);
+                hash *= 16777619u;
+            }
+
+            return hash ^ (hash >> 15);
+        }
+        constexpr usize Length(const char* name)
+        {
+            usize length = 0;
+            while (name[length]) ++length;
+            return length;
+        }
+
+        struct PerfectHash
+        {
+            u32 Seed = 0; // 0 when no seed was found
+            i8  Slots[TABLE_SIZE]{};
+        };
+        constexpr PerfectHash BuildPerfectHash()
+        {
+            for (u32 seed = 1; seed < 65536; seed++)
+            {
+                PerfectHash table;
+                table.Seed = seed;
+                for (auto& slot : table.Slots) slot = -1;
+
+                bool perfect = true;
+                for (usize i = 0; perfect && i < ENTRY_COUNT; i++)
+                {
+                    auto  name = s_Entries[i].Name;
+                    auto& slot
+                        = table.Slots[Hash(name, Length(name), seed)
+                                      & (TABLE_SIZE - 1)];
+                    if (slot >= 0) perfect = false;
+                    else slot = static_cast<i8>(i);
+                }
+
+                if (perfect) return table;
+            }
+
+            return {};
+        }
+
+        constexpr PerfectHash s_Table = BuildPerfectHash();
+        static_assert(s_Table.Seed != 0, "no perfect hash for the builtins");
+    }; // namespace
+
+    isize Find(StringView name)
+    {
+        u32 hash  = Hash(name.Raw(), name.Size(), s_Table.Seed);
+        i8  index = s_Table.Slots[hash & (TABLE_SIZE - 1)];
+        if (index < 0) return -1;
+
+        return name == StringView(s_Entries[index].Name) ? index : -1;
+    }
+    bool  IsBuiltin(StringView name) { return Find(name) >= 0; }
+    isize Run(usize id, BuiltinArgs args)
+    {
+        isize status = s_Entries[id].Proc(args);
+        if (!Flush() && status == 0)
+        {
+            PrismError("awsh: {}: write error: {}\n", args[0], strerror(errno));
+            status = 1;
+        }
+
+        return status;
     }
+    void SetLastStatus(isize status) { s_LastStatus = status; }
     Optional<isize> TryRun(StringView name, BuiltinArgs args)
     {
-        auto builtin = s_Builtins.Find(String(name));
-        if (builtin == s_Builtins.end()) return NullOpt;
+        isize id = Find(name);
+        if (id < 0) return NullOpt;
+
+        return Run(id, args);
+    }
+
+    void Write(StringView output)
+    {
+        if (!s_Captures.Empty() && s_Captures.Back())
+        {
+            *s_Captures.Back() += output;
+            return;
+        }
+
+        if (s_Buffered + output.Size() > sizeof(s_Output)) Flush();
+        if (output.Size() >= sizeof(s_Output))
+        {
+            WriteOut(output.Raw(), output.Size());
+            return;
+        }
+
+        memcpy(s_Output + s_Buffered, output.Raw(), output.Size());
+        s_Buffered += output.Size();
+    }
+    bool Flush()
+    {
+        if (s_Buffered > 0) WriteOut(s_Output, s_Buffered);
+        s_Buffered = 0;
 
-        auto func = *builtin->Value;
-        return func(args);
+        bool failed   = s_WriteFailed;
+        s_WriteFailed = false;
+        return !failed;
     }
+    void PushCapture(String& into) { s_Captures.PushBack(&into); }
+    void PushDirectOutput() { s_Captures.PushBack(nullptr); }
+    void PopCapture() { s_Captures.PopBack(); }
 }; // namespace Builtins
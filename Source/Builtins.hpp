@@ -6,6 +6,7 @@
  */
 #pragma once
 
+#include <Prism/String/String.hpp>
 #include <Prism/String/StringView.hpp>
 #include <Prism/Utility/Optional.hpp>
 
@@ -13,6 +14,23 @@ namespace Builtins
 {
     using BuiltinArgs = const Vector<char*>&;
 
-    void            Initialize();
+    // Builtins live in a perfect hash table built at compile time, their ids
+    // are stable for the lifetime of the binary
+    isize           Find(StringView name); // -1 when not a builtin
+    bool            IsBuiltin(StringView name);
+    isize           Run(usize id, BuiltinArgs args);
     Optional<isize> TryRun(StringView name, BuiltinArgs args);
+
+    // The value of $? for builtins that need it, like exit
+    void            SetLastStatus(isize status);
+
+    // Output of builtins goes to stdout, unless an in-process command
+    // substitution captures it. It is buffered until the builtin returns,
+    // Flush() is only needed for output written outside of a builtin
+    void            Write(StringView output);
+    bool            Flush();
+    void            PushCapture(String& into);
+    // Bypasses any capture until PopCapture(), for a redirected stdout
+    void            PushDirectOutput();
+    void            PopCapture();
 }; // namespace Builtins
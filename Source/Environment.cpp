@@ -4,20 +4,887 @@
  *
  * SPDX-License-Identifier: GPL-3
  */
+#include <Arithmetic.hpp>
 #include <Environment.hpp>
 
 #include <Prism/Containers/UnorderedMap.hpp>
-#include <Prism/String/String.hpp>
+#include <Prism/String/StringUtils.hpp>
+
+#include <atomic>
+#include <cstring>
+#include <sched.h>
+#include <unistd.h>
 
 using namespace Prism;
 
 namespace Environment
 {
-    static UnorderedMap<String, String> s_Environment;
+    namespace
+    {
+        // Overlays of up to this many entries fit in front of the block
+        constexpr usize OVERLAY_SLOTS = 16;
+
+        // Every this many scopes, one starts with a copy of everything
+        // visible in the scopes above the global one, so no lookup walks
+        // more than this far
+        constexpr usize FLATTEN_DEPTH = 8;
+        // Threads holding a snapshot at the same time, more of them wait
+        // for a free slot
+        constexpr usize MAX_READERS   = 64;
+
+        struct Variable
+        {
+            // Stale while Number holds the value and nothing read it yet
+            String Value;
+            i64    Number   = 0;
+            bool   Numeric  = false;
+            bool   Rendered = false;
+            // declare -i
+            bool   Integer  = false;
+            bool   Exported = false;
+            // Arrays keep their values here instead, Value is unused
+            VariableKind        Kind = VariableKind::eScalar;
+            Arrays::Indexed     Indexed;
+            Arrays::Associative Associative;
+            // Generation of the block that last listed it
+            usize  Listed   = 0;
+            // Scope it lives in, copies in a flattened scope keep naming
+            // the original one
+            usize  Owner    = 0;
+        };
+        struct Scope
+        {
+            ScopeKind                      Kind = ScopeKind::eFunction;
+            UnorderedMap<String, Variable> Variables;
+            // Nearest snapshot at or below this scope, 0 for none
+            usize                          Snapshot       = 0;
+            bool                           Flattened      = false;
+            bool                           TouchesExports = false;
+        };
+
+        // The global scope is at the bottom and never popped
+        Vector<Scope>  s_Scopes = Vector<Scope>(1);
+        Vector<usize>  s_Flattened;
+
+        // What the shell was started with, never modified. Values are only
+        // parsed out of it when read, and copied when assigned
+        char**         s_Inherited = environ;
+        // Open addressing over s_Inherited, 1 + index of the entry or 0 for
+        // an empty slot. Built by the first lookup that misses the scopes
+        Vector<u32>    s_Index;
+        bool           s_Indexed = false;
+        // Names that were exported at some point, stale ones are dropped
+        // whenever the block is rebuilt
+        Vector<String> s_Exported;
+        Vector<char>   s_Strings;
+        Vector<char*>  s_Block;
+        bool           s_Dirty      = true;
+        usize          s_Generation = 0;
+        // Bumped by every change, a snapshot of the same version is current
+        usize          s_Changes    = 1;
+
+        // Snapshots are reclaimed by epoch: each reader announces the epoch
+        // it started in, and a replaced snapshot is freed once every reader
+        // started after it was replaced
+        Snapshot                     s_Empty;
+        std::atomic<const Snapshot*> s_Current{&s_Empty};
+        std::atomic<u64>             s_Epoch{1};
+        // Epoch of the reader using the slot, 0 for a free one
+        std::atomic<u64>             s_Readers[MAX_READERS]{};
+        struct Retired
+        {
+            const Snapshot* Value;
+            u64             Epoch;
+        };
+        Vector<Retired> s_Retired;
+
+        StringView                     NameOf(const char* entry)
+        {
+            const char* equals = strchr(entry, '=');
+            return equals ? StringView(entry, equals - entry)
+                          : StringView(entry);
+        }
+        bool Matches(const char* entry, StringView name)
+        {
+            return strncmp(entry, name.Raw(), name.Size()) == 0
+                && (entry[name.Size()] == '=' || !entry[name.Size()]);
+        }
+        StringView ValueOf(const char* entry, StringView name)
+        {
+            return entry[name.Size()] ? StringView(entry + name.Size() + 1)
+                                      : StringView();
+        }
+        u32 Hash(StringView name)
+        {
+            u32 hash = 2166136261u;
+            for (char c : name)
+            {
+                hash ^= static_cast<u8>(c);
+                hash *= 16777619u;
+            }
+            return hash;
+        }
+        void BuildIndex()
+        {
+            s_Indexed   = true;
+            usize count = 0;
+            while (s_Inherited && s_Inherited[count]) ++count;
+            if (count == 0) return;
+
+            usize capacity = 16;
+            while (capacity < count * 2) capacity *= 2;
+            s_Index.Resize(capacity);
+
+            for (usize i = 0; i < count; i++)
+            {
+                StringView name = NameOf(s_Inherited[i]);
+                usize      slot = Hash(name) & (capacity - 1);
+                // Like getenv(), the first of two definitions wins
+                while (s_Index[slot]
+                       && !Matches(s_Inherited[s_Index[slot] - 1], name))
+                    slot = (slot + 1) & (capacity - 1);
+                if (!s_Index[slot]) s_Index[slot] = i + 1;
+            }
+        }
+        // Never builds the index, so it is safe on any thread once built
+        const char* SearchInherited(StringView name)
+        {
+            if (s_Index.Empty()) return nullptr;
+
+            usize mask = s_Index.Size() - 1;
+            for (usize slot = Hash(name) & mask; s_Index[slot];
+                 slot       = (slot + 1) & mask)
+            {
+                const char* entry = s_Inherited[s_Index[slot] - 1];
+                if (Matches(entry, name)) return entry;
+            }
+            return nullptr;
+        }
+        const char* FindInherited(StringView name)
+        {
+            if (!s_Indexed) BuildIndex();
+            return SearchInherited(name);
+        }
+        bool IsInherited(StringView name) { return FindInherited(name); }
+
+        // What an unset element reads as
+        const String s_Unset;
+
+        const String& Text(Variable& variable)
+        {
+            if (variable.Kind == VariableKind::eIndexed)
+            {
+                auto value = variable.Indexed.Find(0);
+                return value ? *value : s_Unset;
+            }
+            if (variable.Kind == VariableKind::eAssociative)
+            {
+                auto value = variable.Associative.Find("0"_sv);
+                return value ? *value : s_Unset;
+            }
+            if (variable.Numeric && !variable.Rendered)
+            {
+                variable.Value    = StringUtils::ToString(variable.Number);
+                variable.Rendered = true;
+            }
+            return variable.Value;
+        }
+
+        usize Top() { return s_Scopes.Size() - 1; }
+        Variable* Lookup(const String& name)
+        {
+            for (usize i = s_Scopes.Size(); i-- > 0;)
+            {
+                auto& scope = s_Scopes[i];
+                auto  entry = scope.Variables.Find(name);
+                if (entry != scope.Variables.end()) return entry->Value;
+
+                // It holds everything visible below it but the globals
+                if (scope.Flattened) i = 1;
+            }
+            return nullptr;
+        }
+
+        // Writes land in the scope owning the variable, unless a snapshot
+        // sits above it, which gets its own copy instead
+        Variable& Writable(const String& name, usize& target)
+        {
+            auto& top      = s_Scopes[Top()];
+            usize snapshot = top.Kind == ScopeKind::eSnapshot ? Top()
+                                                              : top.Snapshot;
+            auto* visible  = Lookup(name);
+            target         = visible ? visible->Owner : 0;
+            if (snapshot > target) target = snapshot;
+
+            // A flattened copy becomes the scope's own
+            auto& scope = s_Scopes[target];
+            auto  entry = scope.Variables.Find(name);
+            if (entry != scope.Variables.end())
+            {
+                entry->Value->Owner = target;
+                return *entry->Value;
+            }
+
+            Variable copy;
+            copy.Owner = target;
+            if (visible)
+            {
+                copy.Value    = visible->Value;
+                copy.Number   = visible->Number;
+                copy.Numeric  = visible->Numeric;
+                copy.Rendered = visible->Rendered;
+                copy.Integer  = visible->Integer;
+                copy.Exported = visible->Exported;
+                copy.Kind        = visible->Kind;
+                copy.Indexed     = visible->Indexed;
+                copy.Associative = visible->Associative;
+            }
+            else if (auto inherited = FindInherited(name))
+            {
+                // Inherited variables stay exported once the shell has them
+                copy.Value    = ValueOf(inherited, name);
+                copy.Exported = true;
+                s_Exported.PushBack(name);
+            }
+
+            auto& variable = scope.Variables[name];
+            variable       = Move(copy);
+            return variable;
+        }
+        // Refreshes the copies flattened scopes above target hold
+        void Publish(const String& name, usize target)
+        {
+            const auto& variable = *s_Scopes[target].Variables.Find(name)->Value;
+            if (variable.Exported) s_Scopes[target].TouchesExports = true;
+            if (target == 0) return;
+
+            for (usize flattened : s_Flattened)
+            {
+                if (flattened <= target) continue;
+
+                auto& scope = s_Scopes[flattened].Variables;
+                auto  entry = scope.Find(name);
+                // Shadowed by something closer
+                if (entry != scope.end() && entry->Value->Owner > target)
+                    continue;
+                scope[name] = variable;
+            }
+        }
+
+        // A scalar turning into an array keeps its value as element 0,
+        // unless it was never set
+        void MakeArray(Variable& variable, VariableKind kind, bool set)
+        {
+            String value = set ? String(Text(variable)) : String();
+            variable.Kind    = kind;
+            variable.Value   = String();
+            variable.Numeric = false;
+            if (!set) return;
+
+            if (kind == VariableKind::eIndexed)
+                variable.Indexed.Set(0, Move(value));
+            else variable.Associative.Set("0"_sv, Move(value));
+        }
+        // Assigns element 0 of an array, or its key "0"
+        void SetFirst(StringView name, VariableKind kind, StringView value)
+        {
+            if (kind == VariableKind::eIndexed) SetElement(name, 0, value);
+            else SetEntry(name, "0"_sv, value);
+        }
+
+        // Appends in place, doubling the capacity whenever it runs out so
+        // that every byte is copied a bounded number of times over a loop
+        // of appends
+        void Extend(String& text, StringView value)
+        {
+            usize size = text.Size() + value.Size();
+            if (size > text.Capacity())
+                text.Reserve(size > text.Capacity() * 2 ? size
+                                                        : text.Capacity() * 2);
+            text += value;
+        }
+        void StoreElement(StringView name, usize index, StringView value,
+                          bool append)
+        {
+            String key(name);
+            bool   set = IsSet(name);
+            usize  target;
+            auto&  variable = Writable(key, target);
+            if (variable.Kind == VariableKind::eAssociative)
+            {
+                String subscript = StringUtils::ToString(index);
+                auto   element   = variable.Associative.Find(subscript);
+                if (append && element) Extend(*element, value);
+                else variable.Associative.Set(subscript, String(value));
+            }
+            else
+            {
+                if (variable.Kind == VariableKind::eScalar)
+                    MakeArray(variable, VariableKind::eIndexed, set);
+
+                auto element = variable.Indexed.Find(index);
+                if (append && element) Extend(*element, value);
+                else variable.Indexed.Set(index, String(value));
+            }
+
+            if (variable.Exported) s_Dirty = true;
+            Publish(key, target);
+            ++s_Changes;
+        }
+        void StoreEntry(StringView name, StringView key, StringView value,
+                        bool append)
+        {
+            String variableName(name);
+            bool   set = IsSet(name);
+            usize  target;
+            auto&  variable = Writable(variableName, target);
+            if (variable.Kind == VariableKind::eScalar)
+                MakeArray(variable, VariableKind::eAssociative, set);
+
+            auto element = variable.Associative.Find(key);
+            if (append && element) Extend(*element, value);
+            else variable.Associative.Set(key, String(value));
+
+            if (variable.Exported) s_Dirty = true;
+            Publish(variableName, target);
+            ++s_Changes;
+        }
+
+        void Rebuild()
+        {
+            ++s_Generation;
+            s_Strings.Clear();
+            s_Block.Clear();
+            s_Block.Resize(OVERLAY_SLOTS);
+
+            for (char** env = s_Inherited; env && *env; env++)
+                if (!Lookup(String(NameOf(*env)))) s_Block.PushBack(*env);
+
+            // Pointers into s_Strings are only taken once it stops growing
+            Vector<usize> offsets;
+            usize         kept = 0;
+            for (usize i = 0; i < s_Exported.Size(); i++)
+            {
+                auto variable = Lookup(s_Exported[i]);
+                if (!variable || !variable->Exported
+                    || variable->Listed == s_Generation)
+                    continue;
+                variable->Listed = s_Generation;
+
+                auto& name       = s_Exported[i];
+                auto& value      = Text(*variable);
+                usize offset         = s_Strings.Size();
+                offsets.PushBack(offset);
+                s_Strings.Resize(offset + name.Size() + value.Size() + 2);
+
+                char* cursor = s_Strings.Raw() + offset;
+                memcpy(cursor, name.Raw(), name.Size());
+                cursor[name.Size()] = '=';
+                memcpy(cursor + name.Size() + 1, value.Raw(), value.Size());
+                cursor[name.Size() + value.Size() + 1] = '\0';
+
+                if (kept != i) s_Exported[kept] = Move(s_Exported[i]);
+                ++kept;
+            }
+            s_Exported.Resize(kept);
+
+            for (usize offset : offsets)
+                s_Block.PushBack(s_Strings.Raw() + offset);
+            s_Block.PushBack(nullptr);
+            s_Dirty = false;
+        }
 
-    StringView GetVariable(StringView name) { return s_Environment[name]; }
-    void       SetVariable(StringView name, StringView value)
+        void Reclaim()
+        {
+            u64 oldest = UINT64_MAX;
+            for (auto& reader : s_Readers)
+            {
+                u64 epoch = reader.load();
+                if (epoch && epoch < oldest) oldest = epoch;
+            }
+
+            usize kept = 0;
+            for (auto& retired : s_Retired)
+            {
+                if (retired.Epoch < oldest) delete retired.Value;
+                else s_Retired[kept++] = retired;
+            }
+            s_Retired.Resize(kept);
+        }
+    }; // namespace
+
+    StringView GetVariable(StringView name)
+    {
+        String key(name);
+        if (auto variable = Lookup(key)) return Text(*variable);
+
+        auto inherited = FindInherited(name);
+        return inherited ? ValueOf(inherited, name) : StringView();
+    }
+    void SetVariable(StringView name, StringView value)
+    {
+        String key(name);
+        auto   visible = Lookup(key);
+        if (visible && visible->Integer)
+        {
+            // Evaluated before taking the variable, the expression may
+            // assign others
+            i64 number;
+            if (Arithmetic::Expression(value).Evaluate(number))
+                SetInteger(name, number);
+            return;
+        }
+        if (visible && visible->Kind != VariableKind::eScalar)
+        {
+            SetFirst(name, visible->Kind, value);
+            return;
+        }
+
+        usize target;
+        auto& variable   = Writable(key, target);
+        variable.Value   = String(value);
+        variable.Numeric = false;
+        if (variable.Exported) s_Dirty = true;
+        Publish(key, target);
+        ++s_Changes;
+    }
+    void AppendVariable(StringView name, StringView value)
+    {
+        String key(name);
+        auto   visible = Lookup(key);
+        if (visible && visible->Integer)
+        {
+            i64 number;
+            if (!Arithmetic::Expression(value).Evaluate(number)) return;
+
+            // Looked up again, the expression may have assigned it
+            i64 current = 0;
+            if (!GetInteger(name, current)
+                && !Arithmetic::ParseNumber(GetVariable(name), current))
+                current = 0;
+            SetInteger(name, current + number);
+            return;
+        }
+        if (visible && visible->Kind == VariableKind::eIndexed)
+        {
+            AppendElement(name, 0, value);
+            return;
+        }
+        if (visible && visible->Kind == VariableKind::eAssociative)
+        {
+            AppendEntry(name, "0"_sv, value);
+            return;
+        }
+
+        usize target;
+        auto& variable = Writable(key, target);
+        // Renders a number held natively before appending to its digits
+        Text(variable);
+        Extend(variable.Value, value);
+        variable.Numeric = false;
+        if (variable.Exported) s_Dirty = true;
+        Publish(key, target);
+        ++s_Changes;
+    }
+    bool IsSet(StringView name)
+    {
+        return Lookup(String(name)) || IsInherited(name);
+    }
+
+    bool GetInteger(StringView name, i64& value)
+    {
+        auto variable = Lookup(String(name));
+        if (!variable || !variable->Numeric) return false;
+
+        value = variable->Number;
+        return true;
+    }
+    void SetInteger(StringView name, i64 value)
+    {
+        String key(name);
+        auto   visible = Lookup(key);
+        if (visible && visible->Kind != VariableKind::eScalar)
+        {
+            SetFirst(name, visible->Kind, StringUtils::ToString(value));
+            return;
+        }
+
+        usize  target;
+        auto&  variable   = Writable(key, target);
+        variable.Number   = value;
+        variable.Numeric  = true;
+        variable.Rendered = false;
+        if (variable.Exported) s_Dirty = true;
+        Publish(key, target);
+        ++s_Changes;
+    }
+    void DeclareInteger(StringView name, bool integer)
+    {
+        String key(name);
+        usize  target;
+        auto&  variable  = Writable(key, target);
+        variable.Integer = integer;
+        Publish(key, target);
+        ++s_Changes;
+    }
+    bool IsInteger(StringView name)
+    {
+        auto variable = Lookup(String(name));
+        return variable && variable->Integer;
+    }
+
+    VariableKind KindOf(StringView name)
+    {
+        auto variable = Lookup(String(name));
+        return variable ? variable->Kind : VariableKind::eScalar;
+    }
+    const Arrays::Indexed* GetIndexed(StringView name)
+    {
+        auto variable = Lookup(String(name));
+        return variable && variable->Kind == VariableKind::eIndexed
+                 ? &variable->Indexed
+                 : nullptr;
+    }
+    const Arrays::Associative* GetAssociative(StringView name)
+    {
+        auto variable = Lookup(String(name));
+        return variable && variable->Kind == VariableKind::eAssociative
+                 ? &variable->Associative
+                 : nullptr;
+    }
+    void Elements(StringView name, Vector<StringView>& values)
+    {
+        auto variable = Lookup(String(name));
+        if (!variable)
+        {
+            if (auto inherited = FindInherited(name))
+                values.PushBack(ValueOf(inherited, name));
+            return;
+        }
+
+        switch (variable->Kind)
+        {
+            case VariableKind::eScalar:
+                values.PushBack(Text(*variable));
+                break;
+            case VariableKind::eIndexed:
+            {
+                auto& array = variable->Indexed;
+                for (usize i = array.Next(0); i < array.End();
+                     i       = array.Next(i + 1))
+                    values.PushBack(*array.Find(i));
+                break;
+            }
+            case VariableKind::eAssociative:
+                for (usize i = 0; i < variable->Associative.Count(); i++)
+                    values.PushBack(variable->Associative.ValueAt(i));
+                break;
+        }
+    }
+    void SetArray(StringView name, Arrays::Indexed&& array)
     {
-        s_Environment[name] = String(value);
+        String key(name);
+        usize  target;
+        auto&  variable      = Writable(key, target);
+        variable.Kind        = VariableKind::eIndexed;
+        variable.Indexed     = Move(array);
+        variable.Associative = Arrays::Associative();
+        variable.Value       = String();
+        variable.Numeric     = false;
+        if (variable.Exported) s_Dirty = true;
+        Publish(key, target);
+        ++s_Changes;
     }
+    void SetArray(StringView name, Arrays::Associative&& array)
+    {
+        String key(name);
+        usize  target;
+        auto&  variable      = Writable(key, target);
+        variable.Kind        = VariableKind::eAssociative;
+        variable.Associative = Move(array);
+        variable.Indexed     = Arrays::Indexed();
+        variable.Value       = String();
+        variable.Numeric     = false;
+        if (variable.Exported) s_Dirty = true;
+        Publish(key, target);
+        ++s_Changes;
+    }
+    void SetElement(StringView name, usize index, StringView value)
+    {
+        StoreElement(name, index, value, false);
+    }
+    void SetEntry(StringView name, StringView key, StringView value)
+    {
+        StoreEntry(name, key, value, false);
+    }
+    void AppendElement(StringView name, usize index, StringView value)
+    {
+        StoreElement(name, index, value, true);
+    }
+    void AppendEntry(StringView name, StringView key, StringView value)
+    {
+        StoreEntry(name, key, value, true);
+    }
+    bool DeclareArray(StringView name, bool associative)
+    {
+        auto   kind = associative ? VariableKind::eAssociative
+                                  : VariableKind::eIndexed;
+        String key(name);
+        bool   set = IsSet(name);
+        usize  target;
+        auto&  variable = Writable(key, target);
+        if (variable.Kind == VariableKind::eScalar)
+            MakeArray(variable, kind, set);
+        Publish(key, target);
+        ++s_Changes;
+        return variable.Kind == kind;
+    }
+
+    void Export(StringView name)
+    {
+        String key(name);
+        usize  target;
+        auto&  variable = Writable(key, target);
+        if (!variable.Exported)
+        {
+            variable.Exported = true;
+            s_Exported.PushBack(key);
+            s_Dirty = true;
+        }
+        Publish(key, target);
+        ++s_Changes;
+    }
+    bool IsExported(StringView name)
+    {
+        if (auto variable = Lookup(String(name))) return variable->Exported;
+        return IsInherited(name);
+    }
+    char* const* Block()
+    {
+        if (s_Dirty) Rebuild();
+        return s_Block.Raw() + OVERLAY_SLOTS;
+    }
+
+    void PushScope(ScopeKind kind)
+    {
+        usize parent = Top();
+        Scope scope;
+        scope.Kind     = kind;
+        scope.Snapshot = s_Scopes[parent].Kind == ScopeKind::eSnapshot
+                          ? parent
+                          : s_Scopes[parent].Snapshot;
+
+        usize base = s_Flattened.Empty() ? 0 : s_Flattened.Back();
+        if (parent - base >= FLATTEN_DEPTH)
+        {
+            // Nearer scopes are copied last, so their definitions win
+            scope.Flattened = true;
+            for (usize i = base > 0 ? base : 1; i <= parent; i++)
+            {
+                auto& variables = s_Scopes[i].Variables;
+                for (auto entry = variables.begin(); entry != variables.end();
+                     ++entry)
+                    scope.Variables[entry->Key] = *entry->Value;
+            }
+            s_Flattened.PushBack(parent + 1);
+        }
+
+        s_Scopes.PushBack(Move(scope));
+    }
+    void PopScope()
+    {
+        if (Top() == 0) return;
+
+        auto& scope = s_Scopes.Back();
+        if (scope.TouchesExports) s_Dirty = true;
+        if (scope.Flattened) s_Flattened.PopBack();
+        s_Scopes.PopBack();
+        ++s_Changes;
+    }
+    bool DeclareLocal(StringView name)
+    {
+        usize function = Top();
+        while (function > 0
+               && s_Scopes[function].Kind != ScopeKind::eFunction)
+            --function;
+        if (function == 0) return false;
+
+        // Inside a subshell of the function, the local belongs to the
+        // subshell's copy of it
+        usize snapshot = s_Scopes[Top()].Kind == ScopeKind::eSnapshot
+                           ? Top()
+                           : s_Scopes[Top()].Snapshot;
+        usize target   = snapshot > function ? snapshot : function;
+
+        String key(name);
+        auto&  variables = s_Scopes[target].Variables;
+        auto   entry     = variables.Find(key);
+        if (entry != variables.end() && entry->Value->Owner == target)
+            return true;
+
+        auto& variable = variables[key];
+        variable       = Variable{};
+        variable.Owner = target;
+        Publish(key, target);
+        ++s_Changes;
+        return true;
+    }
+
+    void SetTemporary(StringView name, StringView value)
+    {
+        if (s_Scopes[Top()].Kind != ScopeKind::eTemporary)
+            PushScope(ScopeKind::eTemporary);
+
+        String key(name);
+        auto&  variable = s_Scopes[Top()].Variables[key];
+        if (variable.Owner != Top()) variable = Variable{};
+        variable.Value   = String(value);
+        variable.Numeric = false;
+        variable.Owner   = Top();
+        if (!variable.Exported)
+        {
+            variable.Exported = true;
+            s_Exported.PushBack(key);
+        }
+        s_Scopes[Top()].TouchesExports = true;
+        s_Dirty                        = true;
+        ++s_Changes;
+    }
+    void DropTemporaries()
+    {
+        if (s_Scopes[Top()].Kind == ScopeKind::eTemporary) PopScope();
+    }
+
+    void Overlay::Add(StringView name, StringView value)
+    {
+        m_Shadows |= IsExported(name);
+
+        String entry = String(name);
+        entry += '=';
+        entry += value;
+        m_Entries.PushBack(Move(entry));
+    }
+    char* const* Overlay::Envp()
+    {
+        char* const* block = Block();
+        usize        count = m_Entries.Size();
+        if (!m_Shadows && count <= OVERLAY_SLOTS)
+        {
+            char** front = s_Block.Raw() + OVERLAY_SLOTS - count;
+            for (usize i = 0; i < count; i++)
+                front[i] = const_cast<char*>(m_Entries[i].Raw());
+            return front;
+        }
+
+        m_Envp.Clear();
+        for (auto& entry : m_Entries)
+            m_Envp.PushBack(const_cast<char*>(entry.Raw()));
+        for (; *block; block++)
+        {
+            bool shadowed = false;
+            for (usize i = 0; m_Shadows && !shadowed && i < count; i++)
+            {
+                StringView name = NameOf(m_Entries[i].Raw());
+                shadowed        = NameOf(*block) == name;
+            }
+            if (!shadowed) m_Envp.PushBack(*block);
+        }
+        m_Envp.PushBack(nullptr);
+        return m_Envp.Raw();
+    }
+
+    StringView Snapshot::Get(StringView name) const
+    {
+        if (auto entry = Find(name)) return entry->Value;
+
+        // Only snapshots taken after the index was built look at it
+        auto inherited = m_Version ? SearchInherited(name) : nullptr;
+        return inherited ? ValueOf(inherited, name) : StringView();
+    }
+    bool Snapshot::IsSet(StringView name) const
+    {
+        return Find(name) || (m_Version && SearchInherited(name));
+    }
+    const Snapshot::Entry* Snapshot::Find(StringView name) const
+    {
+        if (m_Index.Empty()) return nullptr;
+
+        usize mask = m_Index.Size() - 1;
+        for (usize slot = Hash(name) & mask; m_Index[slot];
+             slot       = (slot + 1) & mask)
+        {
+            auto& entry = m_Entries[m_Index[slot] - 1];
+            if (entry.Name == name) return &entry;
+        }
+        return nullptr;
+    }
+
+    void PublishSnapshot()
+    {
+        if (s_Current.load()->m_Version == s_Changes) return;
+        if (!s_Indexed) BuildIndex();
+
+        // What Lookup() can reach, nearest scope first so it wins
+        usize base  = s_Flattened.Empty() ? 1 : s_Flattened.Back();
+        usize count = s_Scopes[0].Variables.Size();
+        for (usize i = base; i < s_Scopes.Size(); i++)
+            count += s_Scopes[i].Variables.Size();
+
+        usize capacity = 16;
+        while (capacity < count * 2) capacity *= 2;
+
+        auto snapshot       = new Snapshot;
+        snapshot->m_Version = s_Changes;
+        snapshot->m_Index.Resize(capacity);
+        auto add = [&](const String& name, Variable& variable)
+        {
+            usize slot = Hash(name) & (capacity - 1);
+            for (; snapshot->m_Index[slot];
+                 slot = (slot + 1) & (capacity - 1))
+                if (snapshot->m_Entries[snapshot->m_Index[slot] - 1].Name
+                    == name)
+                    return;
+
+            snapshot->m_Entries.PushBack({name, Text(variable)});
+            snapshot->m_Index[slot] = snapshot->m_Entries.Size();
+        };
+        for (usize i = s_Scopes.Size(); i-- > base;)
+        {
+            auto& variables = s_Scopes[i].Variables;
+            for (auto entry = variables.begin(); entry != variables.end();
+                 ++entry)
+                add(entry->Key, *entry->Value);
+        }
+        auto& globals = s_Scopes[0].Variables;
+        for (auto entry = globals.begin(); entry != globals.end(); ++entry)
+            add(entry->Key, *entry->Value);
+
+        // Readers that announced an epoch up to this one may still see the
+        // old snapshot, anyone later can only get the new one
+        auto old     = s_Current.exchange(snapshot);
+        u64  retired = s_Epoch.fetch_add(1);
+        if (old != &s_Empty) s_Retired.PushBack({old, retired});
+        Reclaim();
+    }
+
+    SnapshotReader::SnapshotReader()
+    {
+        // Threads keep coming back to the slot they had last time
+        static thread_local usize hint = 0;
+
+        u64 epoch = s_Epoch.load();
+        for (usize tries = 1;; tries++)
+        {
+            u64 expected = 0;
+            if (s_Readers[hint].compare_exchange_weak(expected, epoch)) break;
+
+            hint = (hint + 1) % MAX_READERS;
+            if (tries % MAX_READERS == 0) sched_yield();
+        }
+
+        m_Slot     = hint;
+        m_Snapshot = s_Current.load();
+    }
+    SnapshotReader::~SnapshotReader() { s_Readers[m_Slot].store(0); }
+
 }; // namespace Environment
@@ -6,10 +6,158 @@
  */
 #pragma once
 
+#include <Arrays.hpp>
+#include <Prism/Containers/Vector.hpp>
+#include <Prism/String/String.hpp>
 #include <Prism/String/StringView.hpp>
 
 namespace Environment
 {
-    StringView GetVariable(StringView name);
-    void       SetVariable(StringView name, StringView value);
+    enum class ScopeKind
+    {
+        // Function calls, only variables declared local live here
+        eFunction,
+        // Fork-free subshells, every write is kept here
+        eSnapshot,
+        // FOO=bar prefixes of a builtin
+        eTemporary,
+    };
+
+    // A variable holding an integer is only turned into a string once it
+    // is read as one
+    StringView   GetVariable(StringView name);
+    // Assigning to a variable declared integer evaluates value as an
+    // arithmetic expression, and keeps the old value when that fails
+    void         SetVariable(StringView name, StringView value);
+    // NAME+=value, which adds value to a variable declared integer and
+    // appends it to any other. Values grow their buffer geometrically, so
+    // building one by appends takes time linear in its final length
+    void         AppendVariable(StringView name, StringView value);
+    bool         IsSet(StringView name);
+
+    // The value of a variable holding an integer, false for any other, whose
+    // string the caller has to parse
+    bool         GetInteger(StringView name, i64& value);
+    void         SetInteger(StringView name, i64 value);
+    // declare -i and declare +i
+    void         DeclareInteger(StringView name, bool integer = true);
+    bool         IsInteger(StringView name);
+
+    enum class VariableKind
+    {
+        eScalar,
+        eIndexed,
+        eAssociative,
+    };
+    // An array read or assigned as a scalar is its element 0, or its key
+    // "0" when associative. Unset names are scalars
+    VariableKind KindOf(StringView name);
+    // nullptr when name is not an array of that kind. Valid until the
+    // variable changes
+    const Arrays::Indexed*     GetIndexed(StringView name);
+    const Arrays::Associative* GetAssociative(StringView name);
+    // Appends a view of each value in order, a scalar being the only one.
+    // The views end in a NUL and stay valid until the variable changes
+    void         Elements(StringView name, Vector<StringView>& values);
+    void         SetArray(StringView name, Arrays::Indexed&& array);
+    void         SetArray(StringView name, Arrays::Associative&& array);
+    // A scalar becomes element 0 of the array
+    void         SetElement(StringView name, usize index, StringView value);
+    void         SetEntry(StringView name, StringView key, StringView value);
+    // NAME[subscript]+=value, appending to the element in place
+    void         AppendElement(StringView name, usize index, StringView value);
+    void         AppendEntry(StringView name, StringView key, StringView value);
+    // declare -a and declare -A, a scalar becomes element 0. False when
+    // name already is an array of the other kind
+    bool         DeclareArray(StringView name, bool associative);
+
+    // Exported variables are passed to children, on top of whatever the
+    // shell inherited and did not redefine. Variables inherited from the
+    // environment stay exported when the shell assigns them
+    void         Export(StringView name);
+    bool         IsExported(StringView name);
+    // envp for children, rebuilt only after an exported variable changed.
+    // Valid until the next change
+    char* const* Block();
+
+    // Assignments prefixed to a builtin, exported and dropped together with
+    // their scope by DropTemporaries() once it returns
+    void         SetTemporary(StringView name, StringView value);
+    void         DropTemporaries();
+
+    // envp of a single command with FOO=bar prefixes. New names are put in
+    // free slots in front of the cached block, so the block is not copied.
+    // Only redefining an exported name copies its pointers, as children
+    // disagree on which of two definitions wins. Valid until the next
+    // Envp() call or change of an exported variable
+    class Overlay
+    {
+      public:
+        void         Add(StringView name, StringView value);
+        char* const* Envp();
+
+      private:
+        Vector<String> m_Entries;
+        Vector<char*>  m_Envp;
+        bool           m_Shadows = false;
+    };
+
+    // Variables live in a stack of scopes over the global one. Pushing a
+    // scope is free, a variable is only copied into one when written there,
+    // and popping it throws away whatever it holds
+    void PushScope(ScopeKind kind);
+    void PopScope();
+    // Defines name in the innermost function scope, false outside of one
+    bool DeclareLocal(StringView name);
+
+    // Immutable copy of every variable visible when it was published, for
+    // code running on other threads while the shell keeps assigning
+    class Snapshot
+    {
+      public:
+        StringView Get(StringView name) const;
+        bool       IsSet(StringView name) const;
+        // Bumped by every change of the shell's variables
+        usize      Version() const { return m_Version; }
+
+      private:
+        friend void PublishSnapshot();
+
+        struct Entry
+        {
+            String Name;
+            String Value;
+        };
+        const Entry*  Find(StringView name) const;
+
+        Vector<Entry> m_Entries;
+        // Open addressing over m_Entries, 1 + index or 0 for an empty slot
+        Vector<u32>   m_Index;
+        usize         m_Version = 0;
+    };
+
+    // Only called by the thread running the shell. Makes the current
+    // variables the ones new readers get, free when nothing changed since
+    // the last call. Older snapshots are freed here once no reader holds
+    // them anymore
+    void PublishSnapshot();
+
+    // Pins the latest published snapshot, from any thread and without
+    // locks, until it goes out of scope
+    class SnapshotReader
+    {
+      public:
+        SnapshotReader();
+        ~SnapshotReader();
+
+        SnapshotReader(const SnapshotReader&)            = delete;
+        SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+        const Snapshot& operator*() const { return *m_Snapshot; }
+        const Snapshot* operator->() const { return m_Snapshot; }
+
+      private:
+        usize           m_Slot;
+        const Snapshot* m_Snapshot;
+    };
 }; // namespace Environment
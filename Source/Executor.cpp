@@ -7,21 +7,326 @@
 #include <Builtins.hpp>
 #include <Environment.hpp>
 #include <Executor.hpp>
+#include <Expander.hpp>
+#include <Functions.hpp>
+#include <Input.hpp>
+#include <Jobs.hpp>
+#include <Pattern.hpp>
+#include <Trace.hpp>
 #include <Prism/Debug/Log.hpp>
 
+#include <fcntl.h>
+#include <limits.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 
 using namespace Prism;
 
+namespace
+{
+    // How a command shows up in the job table, the usage log and traces
+    String JoinArguments(char* const* argv)
+    {
+        String command = argv[0];
+        for (usize i = 1; argv[i]; i++)
+        {
+            command += ' ';
+            command += argv[i];
+        }
+        return command;
+    }
+
+    // Input read ahead is handed back, and output still buffered is written
+    // out, so that the child neither misses the one nor repeats the other
+    void PrepareFork()
+    {
+        Input::SyncAll();
+        fflush(stdout);
+    }
+
+    Expander::Separators CurrentSeparators()
+    {
+        // An unset IFS splits on blanks, an empty one not at all
+        return Environment::IsSet("IFS"_sv)
+                 ? Expander::Separators(Environment::GetVariable("IFS"_sv))
+                 : Expander::Separators();
+    }
+
+    // An offset or length of ${v:offset:length}, with optional blanks and
+    // sign in front
+    void ParseOffset(StringView text, i64& number)
+    {
+        usize i = 0;
+        while (i < text.Size() && (text[i] == ' ' || text[i] == '\t')) ++i;
+        bool negative = i < text.Size() && text[i] == '-';
+        if (i < text.Size() && (text[i] == '-' || text[i] == '+')) ++i;
+        for (number = 0; i < text.Size() && StringUtils::IsDigit(text[i]); i++)
+            number = number * 10 + (text[i] - '0');
+        if (negative) number = -number;
+    }
+
+    bool WriteAll(i32 fd, StringView data)
+    {
+        const char* cursor = data.Raw();
+        usize       left   = data.Size();
+        while (left > 0)
+        {
+            isize nwritten = write(fd, cursor, left);
+            if (nwritten < 0 && errno == EINTR) continue;
+            if (nwritten <= 0) return false;
+
+            cursor += nwritten;
+            left -= nwritten;
+        }
+
+        return true;
+    }
+
+    // The expression of [[ ]] over the atoms of its word, expanded but
+    // neither split nor globbed. Only literal atoms are operators, and
+    // anything but patterns and strings is left to the test builtin. An
+    // operand is only expanded once the result depends on it, the right
+    // side of a decided || or && is parsed without it
+    template <typename Expand>
+    class TestExpression
+    {
+      public:
+        TestExpression(const Program& program, const Word& word,
+                       Expand expand)
+            : m_Program(program)
+            , m_Atoms(word.Atoms)
+            , m_Expand(expand)
+        {
+            m_Values.Resize(m_Atoms.Size());
+            m_Expanded.Resize(m_Atoms.Size());
+            for (auto& expanded : m_Expanded) expanded = 0;
+        }
+
+        // 0 when true, 1 when false and 2 on an error
+        isize Evaluate()
+        {
+            bool result = Or();
+            if (!m_Error && m_Position < m_Atoms.Size())
+                Fail("unexpected argument");
+
+            return m_Error ? 2 : !result;
+        }
+
+      private:
+        const Program&          m_Program;
+        const Vector<WordAtom>& m_Atoms;
+        Expand                  m_Expand;
+        Vector<String>          m_Values;
+        Vector<u8>              m_Expanded;
+        usize                   m_Position = 0;
+        // Inside operands whose result does not matter
+        usize                   m_Skipping = 0;
+        bool                    m_Error    = false;
+
+        const String&           Value(usize i)
+        {
+            if (!m_Expanded[i])
+            {
+                m_Values[i]   = m_Expand(i);
+                m_Expanded[i] = 1;
+            }
+            return m_Values[i];
+        }
+        bool IsOperator(usize i, StringView op) const
+        {
+            return i < m_Atoms.Size()
+                && m_Atoms[i].Type == WordAtom::Type::eLiteral
+                && StringView(m_Atoms[i].Value) == op;
+        }
+        bool IsBinary(usize i) const
+        {
+            constexpr StringView ops[]
+                = {"==",  "=",   "!=",  "=~",  "<",   ">",   "-eq", "-ne",
+                   "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef"};
+            for (auto op : ops)
+                if (IsOperator(i, op)) return true;
+            return false;
+        }
+        bool IsUnary(usize i) const
+        {
+            if (i >= m_Atoms.Size()
+                || m_Atoms[i].Type != WordAtom::Type::eLiteral)
+                return false;
+            auto& text = m_Atoms[i].Value;
+            return text.Size() == 2 && text[0] == '-'
+                && StringUtils::IsAlphanumeric(text[1])
+                && !StringUtils::IsDigit(text[1]);
+        }
+        bool Fail(StringView message)
+        {
+            if (!m_Error)
+                PrismError("awsh: [[: {}: {}\n",
+                           m_Position < m_Atoms.Size()
+                               ? StringView(Value(m_Position))
+                               : StringView(),
+                           message);
+            m_Error = true;
+            return false;
+        }
+
+        bool Or()
+        {
+            bool result = And();
+            while (!m_Error && IsOperator(m_Position, "||"_sv))
+            {
+                ++m_Position;
+                // A true left side still has its right one parsed
+                m_Skipping += result;
+                bool right = And();
+                m_Skipping -= result;
+                result = result || right;
+            }
+            return result;
+        }
+        bool And()
+        {
+            bool result = Not();
+            while (!m_Error && IsOperator(m_Position, "&&"_sv))
+            {
+                ++m_Position;
+                m_Skipping += !result;
+                bool right = Not();
+                m_Skipping -= !result;
+                result = result && right;
+            }
+            return result;
+        }
+        bool Not()
+        {
+            if (!IsOperator(m_Position, "!"_sv)) return Primary();
+            ++m_Position;
+            return !Not();
+        }
+        bool Primary()
+        {
+            usize at = m_Position;
+            if (at >= m_Atoms.Size()) return Fail("expression expected");
+
+            if (IsOperator(at, "("_sv))
+            {
+                ++m_Position;
+                bool result = Or();
+                if (!IsOperator(m_Position, ")"_sv))
+                    return Fail("')' expected");
+                ++m_Position;
+                return result;
+            }
+            if (at + 2 < m_Atoms.Size() && IsBinary(at + 1))
+            {
+                m_Position = at + 3;
+                return !m_Skipping && Binary(at);
+            }
+            if (at + 1 < m_Atoms.Size() && IsUnary(at))
+            {
+                m_Position = at + 2;
+                return !m_Skipping && RunTest(at, 2);
+            }
+
+            m_Position = at + 1;
+            return !m_Skipping && !Value(at).Empty();
+        }
+
+        bool Binary(usize at)
+        {
+            StringView op = m_Atoms[at + 1].Value;
+            if (op == "=="_sv || op == "="_sv) return Matches(at, at + 2);
+            if (op == "!="_sv) return !Matches(at, at + 2);
+            if (op == "=~"_sv) return MatchesRegex(at, at + 2);
+            if (op == "<"_sv || op == ">"_sv)
+            {
+                i32 order = strcmp(Value(at).Raw(), Value(at + 2).Raw());
+                return op == "<"_sv ? order < 0 : order > 0;
+            }
+            return RunTest(at, 3);
+        }
+        // A pattern is matched against the whole of the left side. Quoted
+        // words only match themselves, the value of an unquoted expansion
+        // is a pattern
+        bool Matches(usize lhs, usize rhs)
+        {
+            auto& atom = m_Atoms[rhs];
+            if (atom.Type == WordAtom::Type::eGlob && atom.Slot >= 0)
+                return m_Program.Patterns[atom.Slot]->Matches(Value(lhs));
+
+            bool expanded
+                = !atom.Quoted
+               && (atom.Type == WordAtom::Type::eVariable
+                   || atom.Type == WordAtom::Type::eParameter
+                   || atom.Type == WordAtom::Type::eCommandSubstitution);
+            const String& left  = Value(lhs);
+            const String& right = Value(rhs);
+            if (!expanded || !Pattern::IsPattern(right)) return left == right;
+            return Pattern::Compile(right)->Matches(left);
+        }
+        bool MatchesRegex(usize lhs, usize rhs)
+        {
+            auto&               atom = m_Atoms[rhs];
+            Ref<Pattern::Regex> regex;
+            const String&       left = Value(lhs);
+            if (atom.Type != WordAtom::Type::eLiteral)
+                regex = Pattern::CompileRegex(Value(rhs));
+            else if (atom.Slot >= 0) regex = m_Program.Regexes[atom.Slot];
+
+            // Why it did not compile was already reported
+            if (!regex)
+            {
+                m_Error = true;
+                return false;
+            }
+            return regex->Matches(left);
+        }
+        bool RunTest(usize at, usize count)
+        {
+            Vector<char*> argv;
+            argv.PushBack(const_cast<char*>("test"));
+            for (usize i = at; i < at + count; i++)
+                argv.PushBack(const_cast<char*>(Value(i).Raw()));
+            argv.PushBack(nullptr);
+
+            isize status = *Builtins::TryRun("test"_sv, argv);
+            if (status > 1) m_Error = true;
+            return status == 0;
+        }
+    };
+
+    // Here-document fds only live as long as the redirections using them
+    struct TemporaryFds
+    {
+        Vector<i32>& Fds;
+        ~TemporaryFds()
+        {
+            for (i32 fd : Fds) close(fd);
+            Fds.Clear();
+        }
+    };
+}; // namespace
+
 Executor::Executor(Program& prog, isize lastExitCode, bool debugLog)
     : m_Program(prog)
     , m_LastExitCode(lastExitCode)
     , m_DebugLog(debugLog)
 {
+    m_Captures.Resize(m_Program.CaptureCount);
+    m_HereDocs.Resize(m_Program.Redirections.Size());
+    m_LoopStatus.Resize(m_Program.LoopCount);
+    m_ForLoops.Resize(m_Program.LoopCount);
+    m_CaseSubjects.Resize(m_Program.Cases.Size());
 }
+Executor::~Executor() { ForgetHereDocs(); }
 isize Executor::Execute()
 {
-    for (usize pc = 0; pc < m_Program.Instructions.Size(); pc++)
+    return ExecuteRange(0, m_Program.Instructions.Size());
+}
+isize Executor::ExecuteRange(usize begin, usize end)
+{
+    for (usize pc = begin; pc < end && !Functions::IsReturning(); pc++)
     {
         auto& instr = m_Program.Instructions[pc];
         switch (instr.Op)
@@ -29,12 +334,48 @@ isize Executor::Execute()
             case OpCode::eExec: HandleExec(instr); break;
             case OpCode::eExpandWords: HandleExpandWords(instr); break;
             case OpCode::eSetVar: HandleSetVar(instr); break;
+            case OpCode::eSetElement: HandleSetElement(instr, false); break;
+            case OpCode::eSetArray: HandleSetArray(instr, false); break;
+            case OpCode::eAppendElement: HandleSetElement(instr, true); break;
+            case OpCode::eAppendArray: HandleSetArray(instr, true); break;
+            case OpCode::eRedirect:
+                m_PendingRedirections.PushBack(instr.Arg0);
+                break;
+            case OpCode::ePrefixAssign:
+                m_PendingAssignments.PushBack(pc);
+                break;
+            case OpCode::eDefineFunction:
+                Functions::Define(
+                    m_Program.WordTable[instr.Arg0]->Atoms[0].Value,
+                    m_Program.Functions[instr.Arg1]);
+                m_LastExitCode = 0;
+                break;
+            case OpCode::eSubshell:
+                HandleSubshell(instr, pc);
+                pc += instr.Arg0;
+                break;
+            case OpCode::eSubstitute:
+                HandleSubstitute(instr, pc);
+                pc += instr.Arg0;
+                break;
+            case OpCode::eBackground:
+                HandleBackground(instr, pc);
+                pc += instr.Arg0;
+                break;
+            case OpCode::eTime:
+                HandleTime(instr, pc);
+                pc += instr.Arg0;
+                break;
+            case OpCode::eRedirectBody:
+                HandleRedirectBody(instr, pc);
+                pc += instr.Arg0;
+                break;
             case OpCode::eJumpIfNonZero:
             {
                 if (m_DebugLog) PrismTrace("NonZero: Word[{}] = ", instr.Arg0);
                 isize jumpOffset = instr.Arg0;
 
-                if (m_LastExitCode != 0) pc += jumpOffset;
+                if (m_LastExitCode != 0) LeaveLoop(instr, pc, jumpOffset);
                 break;
             }
             case OpCode::eJumpIfZero:
@@ -42,7 +383,33 @@ isize Executor::Execute()
                 if (m_DebugLog) PrismTrace("Zero: Word[{}] = ", instr.Arg0);
                 isize jumpOffset = instr.Arg0;
 
-                if (m_LastExitCode == 0) pc += jumpOffset;
+                if (m_LastExitCode == 0) LeaveLoop(instr, pc, jumpOffset);
+                break;
+            }
+            case OpCode::eJump:
+                if (instr.Arg1 >= 0) m_LoopStatus[instr.Arg1] = m_LastExitCode;
+                pc += instr.Arg0;
+                break;
+            case OpCode::eForInit: HandleForInit(instr); break;
+            case OpCode::eTest: HandleTest(instr); break;
+            case OpCode::eCase: HandleCase(instr, pc); break;
+            case OpCode::eArithmetic:
+            {
+                i64 value;
+                m_LastExitCode
+                    = EvaluateArithmetic(instr.Arg0, value) ? value == 0 : 1;
+                break;
+            }
+            case OpCode::eForNext:
+            {
+                String word;
+                if (!NextForWord(m_ForLoops[instr.Arg1], word))
+                {
+                    LeaveLoop(instr, pc, instr.Arg0);
+                    break;
+                }
+                Environment::SetVariable(
+                    m_Program.WordTable[instr.Payload]->Atoms[0].Value, word);
                 break;
             }
             default: break;
@@ -51,98 +418,1420 @@ isize Executor::Execute()
 
     return m_LastExitCode;
 }
-isize Executor::Execute(StringView name, const Vector<String>& args)
+void Executor::HandleTest(const Instruction& instr)
+{
+    auto& word   = *m_Program.WordTable[instr.Arg0];
+    usize bad    = m_BadExpansions;
+    auto  expand = [&](usize i)
+    {
+        // Only a regex right of =~ is joined from pieces
+        auto& atom = word.Atoms[i];
+        return atom.Type == WordAtom::Type::eJoined ? ExpandRegex(atom)
+                                                    : TakeAtom(atom);
+    };
+    isize status   = TestExpression(m_Program, word, expand).Evaluate();
+    m_LastExitCode = m_BadExpansions != bad ? 1 : status;
+}
+void Executor::HandleCase(const Instruction& instr, usize& pc)
+{
+    auto&   table   = m_Program.Cases[instr.Arg1];
+    String& subject = m_CaseSubjects[instr.Arg1];
+    // A case that matches nothing exits with 0
+    if (instr.Arg0 >= 0)
+    {
+        subject        = ExpandWord(instr.Arg0);
+        m_LastExitCode = 0;
+    }
+
+    u32  from    = instr.Payload;
+    u32  arm     = table.Targets.Size() - 1;
+    auto literal = table.Literals.Find(subject);
+    if (literal != table.Literals.end())
+        for (u32 candidate : *literal->Value)
+            if (candidate >= from)
+            {
+                arm = candidate;
+                break;
+            }
+    if (table.Patterns)
+    {
+        usize first = table.Patterns->First(subject, table.FirstPattern[from]);
+        if (first != StringView::NPos && table.PatternArms[first] < arm)
+            arm = table.PatternArms[first];
+    }
+
+    // Patterns with expansions only matter in front of the arm found, the
+    // value of an unquoted expansion is a pattern
+    for (auto& expanded : table.Expanded)
+    {
+        if (expanded.Arm < from) continue;
+        if (expanded.Arm >= arm) break;
+
+        String pattern;
+        for (auto& atom : m_Program.WordTable[expanded.Word]->Atoms)
+            pattern += ExpandPattern(atom);
+        bool matches = Pattern::IsPattern(pattern)
+                         ? Pattern::Compile(pattern)->Matches(subject)
+                         : Pattern::Unescape(pattern) == subject;
+        if (matches)
+        {
+            arm = expanded.Arm;
+            break;
+        }
+    }
+
+    // The loop steps onto the target
+    pc = table.Targets[arm] - 1;
+}
+void Executor::LeaveLoop(const Instruction& instr, usize& pc, isize offset)
+{
+    pc += offset;
+    if (instr.Arg1 < 0) return;
+
+    // A loop exits with the status of its body, or 0 if it never ran
+    m_LastExitCode           = m_LoopStatus[instr.Arg1];
+    m_LoopStatus[instr.Arg1] = 0;
+}
+void Executor::HandleForInit(const Instruction& instr)
+{
+    auto& loop      = m_ForLoops[instr.Arg1];
+    loop.List       = instr.Arg0;
+    loop.Atom       = 0;
+    loop.Positional = 0;
+    loop.InBraces   = false;
+    loop.InFields   = false;
+    loop.Pending.Clear();
+    loop.Taken = 0;
+}
+bool Executor::NextForWord(ForLoop& loop, String& word)
+{
+    using namespace StringUtils;
+    for (;;)
+    {
+        if (loop.Taken < loop.Pending.Size())
+        {
+            word = Move(loop.Pending[loop.Taken++]);
+            return true;
+        }
+        loop.Pending.Clear();
+        loop.Taken = 0;
+
+        if (loop.InBraces)
+        {
+            if (!loop.Braces.Next(word))
+            {
+                loop.InBraces = false;
+                continue;
+            }
+            // Empty words of {,} are dropped like empty expansions
+            if (word.Empty()) continue;
+            if (Expander::IsPattern(word)
+                && Expander::Glob(word, loop.Pending))
+                continue;
+            return true;
+        }
+        if (loop.InFields)
+        {
+            StringView field;
+            if (!loop.Fields.Next(field))
+            {
+                loop.InFields = false;
+                continue;
+            }
+            if (Expander::IsPattern(field)
+                && Expander::Glob(field, loop.Pending))
+                continue;
+
+            word = field;
+            return true;
+        }
+
+        // Without a list the loop goes over "$@"
+        if (loop.List < 0)
+        {
+            auto arguments = Functions::Arguments();
+            if (!arguments || loop.Positional >= arguments->Size())
+                return false;
+            word = (*arguments)[loop.Positional++];
+            return true;
+        }
+
+        auto& atoms = m_Program.WordTable[loop.List]->Atoms;
+        if (loop.Atom >= atoms.Size()) return false;
+        auto& atom = atoms[loop.Atom++];
+        if (atom.Type == WordAtom::Type::eBrace)
+        {
+            loop.Braces   = Expander::Braces(atom.Value);
+            loop.InBraces = true;
+            continue;
+        }
+        if (IsElements(atom))
+        {
+            ExpandFields(atom, loop.Pending);
+            continue;
+        }
+        if (IsSplit(atom))
+        {
+            loop.Value    = TakeAtom(atom);
+            loop.Fields   = Expander::Fields(loop.Value, CurrentSeparators());
+            loop.InFields = true;
+            continue;
+        }
+        if (IsQuotedGlob(atom))
+        {
+            ExpandQuotedGlob(atom, loop.Pending);
+            continue;
+        }
+        if (atom.Type == WordAtom::Type::eGlob
+            && Expander::Glob(atom.Value, loop.Pending))
+            continue;
+
+        word = ExpandAtom(atom);
+        return true;
+    }
+}
+void Executor::ExpandFields(const WordAtom& atom, Vector<String>& fields)
+{
+    if (atom.Type == WordAtom::Type::eBrace)
+    {
+        ExpandBraces(atom, fields);
+        return;
+    }
+    if (IsElements(atom))
+    {
+        if (atom.Quoted)
+        {
+            ExpandElements(atom, fields);
+            return;
+        }
 
+        Vector<String> values;
+        ExpandElements(atom, values);
+        String joined;
+        for (auto& value : values)
+        {
+            if (!joined.Empty()) joined += ' ';
+            joined += value;
+        }
+        Expander::Fields split(joined, CurrentSeparators());
+        StringView       field;
+        while (split.Next(field))
+            if (!Expander::IsPattern(field) || !Expander::Glob(field, fields))
+                fields.PushBack(String(field));
+        return;
+    }
+    if (IsSplit(atom))
+    {
+        String           value = TakeAtom(atom);
+        Expander::Fields split(value, CurrentSeparators());
+        StringView       field;
+        while (split.Next(field))
+            if (!Expander::IsPattern(field) || !Expander::Glob(field, fields))
+                fields.PushBack(String(field));
+        return;
+    }
+    if (IsQuotedGlob(atom))
+    {
+        ExpandQuotedGlob(atom, fields);
+        return;
+    }
+    if (atom.Type != WordAtom::Type::eGlob
+        || !Expander::Glob(atom.Value, fields))
+        fields.PushBack(ExpandAtom(atom));
+}
+void Executor::ExpandBraces(const WordAtom& atom, Vector<String>& words)
+{
+    Expander::Braces braces(atom.Value);
+    String           word;
+    while (braces.Next(word))
+        if (!word.Empty()
+            && (!Expander::IsPattern(word) || !Expander::Glob(word, words)))
+            words.PushBack(word);
+}
+pid_t Executor::Spawn(char* const* argv, bool background,
+                      const Vector<FdAction>* actions, char* const* envp)
 {
-    Vector<const char*> argv;
-    for (auto& arg : args) argv.PushBack(arg.Raw());
-    argv.PushBack(0);
+    // posix_spawn reports a failed file action just like a failed exec, so
+    // files are opened here, where the failing one is known. They are moved
+    // above every target, so no earlier action can overwrite them
+    i32 lowest = 10;
+    for (usize i = 0; actions && i < actions->Size(); i++)
+        if ((*actions)[i].Fd >= lowest) lowest = (*actions)[i].Fd + 1;
+
+    Vector<i32> opened;
+    auto        closeOpened = [&opened]()
+    {
+        for (i32 fd : opened)
+            if (fd >= 0) close(fd);
+    };
+    for (usize i = 0; actions && i < actions->Size(); i++)
+    {
+        auto& action = (*actions)[i];
+        if (action.Type != FdAction::Type::eOpen)
+        {
+            opened.PushBack(-1);
+            continue;
+        }
+
+        i32 fd = open(action.Path.Raw(), action.Flags | O_CLOEXEC, 0666);
+        if (fd >= 0 && fd < lowest)
+        {
+            i32 moved = fcntl(fd, F_DUPFD_CLOEXEC, lowest);
+            i32 error = errno;
+            close(fd);
+            fd    = moved;
+            errno = error;
+        }
+        if (fd < 0)
+        {
+            PrismError("awsh: {}: {}\n", action.Path.Raw(), strerror(errno));
+            closeOpened();
+            return REDIRECTION_FAILED;
+        }
+        opened.PushBack(fd);
+    }
+
+    posix_spawn_file_actions_t fileActions;
+    posix_spawn_file_actions_init(&fileActions);
+    for (usize i = 0; actions && i < actions->Size(); i++)
+    {
+        auto& action = (*actions)[i];
+        switch (action.Type)
+        {
+            case FdAction::Type::eOpen:
+                posix_spawn_file_actions_adddup2(&fileActions, opened[i],
+                                                 action.Fd);
+                break;
+            case FdAction::Type::eDuplicate:
+                posix_spawn_file_actions_adddup2(&fileActions,
+                                                 action.SourceFd, action.Fd);
+                break;
+            case FdAction::Type::eClose:
+                posix_spawn_file_actions_addclose(&fileActions, action.Fd);
+                break;
+        }
+    }
+
+    // The child must see input the shell buffered but did not consume
+    Input::SyncAll();
+    u64   start = Jobs::MonotonicTime();
+    pid_t pid   = -1;
+    i32   error = posix_spawnp(&pid, argv[0], &fileActions, nullptr, argv,
+                               envp ? envp : Environment::Block());
+    posix_spawn_file_actions_destroy(&fileActions);
+    closeOpened();
+    if (error != 0)
+    {
+        if (error == ENOENT)
+            PrismError("awsh: command not found: {}\n", argv[0]);
+        else PrismError("awsh: {}: {}\n", argv[0], strerror(error));
+        return -1;
+    }
+
+    Jobs::Add(pid, JoinArguments(argv), background, start);
+    return pid;
+}
 
-    i32 pid = fork();
+isize Executor::RunForked(usize begin, usize end)
+{
+    PrepareFork();
+    u64   start = Jobs::MonotonicTime();
+    pid_t pid   = fork();
     if (pid == -1)
     {
-        perror("awsh: fork failed\n");
-        std::exit(1);
+        perror("awsh: fork failed");
+        return 1;
     }
     else if (pid == 0)
     {
-        execvp(name.Raw(), const_cast<char* const*>(argv.Raw()));
-        PrismError("awsh: command not found: {}", name);
-        return errno;
+        Jobs::ResetAfterFork();
+        isize status = ExecuteRange(begin, end);
+        fflush(stdout);
+        _exit(status);
     }
 
-    int wstatus = -1;
-    while (!WIFEXITED(wstatus)) waitpid(pid, &wstatus, 0);
+    Jobs::Add(pid, "subshell", false, start);
+    return Jobs::Wait(pid);
+}
+isize Executor::RunInProcess(usize begin, usize end, i32 flags,
+                             String* capture)
+{
+    // The body runs against a snapshot of the shell state, which is thrown
+    // away once it finishes, just like the address space of a forked child
+    i32 cwdFd = -1;
+    if (flags & BodyFlags::eRestoreCwd)
+        cwdFd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
 
-    int status = WEXITSTATUS(wstatus);
-    return status;
-};
+    Environment::PushScope(Environment::ScopeKind::eSnapshot);
+    if (capture) Builtins::PushCapture(*capture);
 
-void Executor::HandleExpandWords(const Instruction& instr)
-{
-    if (m_DebugLog)
+    isize status = ExecuteRange(begin, end);
+
+    if (capture) Builtins::PopCapture();
+    Environment::PopScope();
+    if (cwdFd >= 0)
     {
-        auto& word = m_Program.WordTable[instr.Arg0];
-        fmt::print("Expanded: ");
-        for (auto& atom : word->Atoms) fmt::print("{} ", atom.Value);
-        fmt::print("\n");
+        fchdir(cwdFd);
+        close(cwdFd);
     }
+
+    return status;
 }
-void Executor::HandleExec(const Instruction& instr)
+
+void Executor::HandleSubshell(const Instruction& instr, usize pc)
 {
-    auto&         word = m_Program.WordTable[instr.Arg0];
+    usize begin = pc + 1;
+    usize end   = begin + instr.Arg0;
 
-    // Convert Word.Atoms to char*[] for execvp
-    Vector<char*> argv;
-    for (auto& atom : word->Atoms)
+    if (instr.Payload & BodyFlags::eInProcess)
+        m_LastExitCode = RunInProcess(begin, end, instr.Payload);
+    else m_LastExitCode = RunForked(begin, end);
+}
+void Executor::HandleSubstitute(const Instruction& instr, usize pc)
+{
+    usize   begin   = pc + 1;
+    usize   end     = begin + instr.Arg0;
+    String& capture = m_Captures[instr.Arg1];
+    capture.Clear();
+
+    if (instr.Payload & BodyFlags::eInProcess)
+        m_LastExitCode = RunInProcess(begin, end, instr.Payload, &capture);
+    else
     {
-        if (atom.Type == WordAtom::Type::eLiteral)
-            argv.PushBack(const_cast<char*>(atom.Value.Raw()));
-        else if (atom.Type == WordAtom::Type::eVariable)
+        i32 fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0)
+        {
+            perror("awsh: pipe failed");
+            m_LastExitCode = 1;
+            return;
+        }
+
+        // Drain the pipe before reaping, so that the child never blocks on a
+        // full pipe buffer
+        PrepareFork();
+        u64   start = Jobs::MonotonicTime();
+        pid_t pid   = fork();
+        if (pid == 0)
         {
-            using namespace StringUtils;
-            auto envName = atom.Value;
-            String env = envName == "?"_sv
-                           ? ToString(m_LastExitCode)
-                           : String(Environment::GetVariable(envName));
-            argv.PushBack(const_cast<char*>(env.Raw()));
+            Jobs::ResetAfterFork();
+            close(fds[0]);
+            dup2(fds[1], 1);
+
+            isize status = ExecuteRange(begin, end);
+            fflush(stdout);
+            _exit(status);
+        }
+        close(fds[1]);
+        if (pid > 0)
+            Jobs::Add(pid, "command substitution", false, start);
+
+        char buffer[4096];
+        for (;;)
+        {
+            isize nread = read(fds[0], buffer, sizeof(buffer));
+            if (nread < 0 && errno == EINTR) continue;
+            if (nread <= 0) break;
+
+            capture += StringView(buffer, nread);
         }
+        close(fds[0]);
+
+        m_LastExitCode = pid > 0 ? Jobs::Wait(pid) : 1;
     }
-    argv.PushBack(nullptr);
 
-    if (m_DebugLog) PrismTrace("Executor: Executing command => {}", argv[0]);
-    for (usize i = 0; m_DebugLog && i < argv.Size() - 1; i++)
-        PrismMessage("argv[{}]: '{}'\n", i, argv[i]);
+    // Trailing newlines are stripped from the result of a substitution
+    usize size = capture.Size();
+    while (size > 0 && capture[size - 1] == '\n') --size;
+    if (size != capture.Size()) capture = capture.Substr(0, size);
+}
+void Executor::HandleBackground(const Instruction& instr, usize pc)
+{
+    usize begin = pc + 1;
+    usize end   = begin + instr.Arg0;
 
-    auto name   = argv[0];
-    auto status = Builtins::TryRun(name, argv);
-    if (status.HasValue())
+    PrepareFork();
+    u64   start = Jobs::MonotonicTime();
+    pid_t pid   = fork();
+    if (pid == -1)
     {
-        m_LastExitCode = *status;
+        perror("awsh: fork failed");
+        m_LastExitCode = 1;
         return;
     }
+    else if (pid == 0)
+    {
+        // Rewinding a shared memfd would race with the parent
+        Jobs::ResetAfterFork();
+        ForgetHereDocs();
+        isize status = ExecuteRange(begin, end);
+        fflush(stdout);
+        _exit(status);
+    }
 
-    pid_t pid = fork();
-    if (pid == 0)
+    Jobs::Add(pid, m_Program.WordTable[instr.Arg1]->Atoms[0].Value, true,
+              start);
+    m_LastExitCode = 0;
+}
+void Executor::HandleRedirectBody(const Instruction& instr, usize pc)
+{
+    usize            begin = pc + 1;
+    usize            end   = begin + instr.Arg0;
+
+    usize            bad = m_BadExpansions;
+    Vector<FdAction> actions;
+    auto             resolved = ResolveRedirections(actions);
+    m_PendingRedirections.Clear();
+
+    FdTable fdTable;
     {
-        execvp(argv[0], argv.Raw());
-        perror("execvp failed");
-        exit(1);
+        TemporaryFds temporaries{m_TemporaryFds};
+        if (!resolved || m_BadExpansions != bad || !fdTable.Apply(actions))
+        {
+            m_LastExitCode = 1;
+            return;
+        }
     }
 
-    int wstatus = 0;
-    waitpid(pid, &wstatus, 0);
+    // Nothing but builtins reads the redirected input, so it can be buffered
+    // even when it is a pipe
+    if (instr.Payload & BodyFlags::eInProcess)
+        for (auto& action : actions)
+            if (action.Type != FdAction::Type::eClose)
+                Input::SetExclusive(action.Fd);
 
-    m_LastExitCode = WEXITSTATUS(wstatus);
-    if (m_DebugLog)
-        PrismTrace("Executor: Last Exit Status => {}", m_LastExitCode);
+    bool direct = false;
+    for (auto& action : actions) direct |= action.Fd == 1;
+    if (direct) Builtins::PushDirectOutput();
+    ExecuteRange(begin, end);
+    fflush(stdout);
+    if (direct) Builtins::PopCapture();
 }
-void Executor::HandleSetVar(const Instruction& instr)
+void Executor::HandleTime(const Instruction& instr, usize pc)
 {
-    auto       nameWord  = m_Program.WordTable[instr.Arg0];
-    auto       valueWord = m_Program.WordTable[instr.Arg1];
-    StringView name      = nameWord->Atoms[0].Value;
-    StringView value     = valueWord->Atoms[0].Value;
+    usize  begin = pc + 1;
+    usize  end   = begin + instr.Arg0;
 
-    Environment::SetVariable(name, value);
+    rusage selfBefore, childrenBefore, selfAfter, childrenAfter;
+    getrusage(RUSAGE_SELF, &selfBefore);
+    getrusage(RUSAGE_CHILDREN, &childrenBefore);
+    u64 start = Jobs::MonotonicTime();
+
+    ExecuteRange(begin, end);
+
+    u64 wall = Jobs::MonotonicTime() - start;
+    getrusage(RUSAGE_SELF, &selfAfter);
+    getrusage(RUSAGE_CHILDREN, &childrenAfter);
+
+    auto spent = [](const timeval& before, const timeval& after) -> u64
+    {
+        return (after.tv_sec - before.tv_sec) * 1000000
+             + (after.tv_usec - before.tv_usec);
+    };
+    u64 user = spent(selfBefore.ru_utime, selfAfter.ru_utime)
+             + spent(childrenBefore.ru_utime, childrenAfter.ru_utime);
+    u64 sys = spent(selfBefore.ru_stime, selfAfter.ru_stime)
+            + spent(childrenBefore.ru_stime, childrenAfter.ru_stime);
+
+    dprintf(2, "\nreal\t%s\nuser\t%s\nsys\t%s\n",
+            Jobs::FormatDuration(wall).Raw(),
+            Jobs::FormatDuration(user).Raw(),
+            Jobs::FormatDuration(sys).Raw());
+}
+String Executor::ExpandAtom(const WordAtom& atom)
+{
+    using namespace StringUtils;
+    switch (atom.Type)
+    {
+        case WordAtom::Type::eLiteral:
+        case WordAtom::Type::eGlob:
+        case WordAtom::Type::eBrace: return atom.Value;
+        case WordAtom::Type::eVariable:
+        {
+            String value;
+            LookupVariable(atom.Value, value);
+            return value;
+        }
+        case WordAtom::Type::eParameter: return ExpandParameter(atom);
+        case WordAtom::Type::eCommandSubstitution:
+            RunDeferred(atom);
+            ++m_SubstitutionsTaken;
+            return m_Captures[atom.Slot];
+        case WordAtom::Type::eArithmetic:
+        {
+            i64 value;
+            if (EvaluateArithmetic(atom.Slot, value)) return ToString(value);
+            ++m_BadExpansions;
+            return {};
+        }
+        case WordAtom::Type::eQuoted:
+        case WordAtom::Type::eJoined: return ExpandWord(atom.Slot);
+    }
+
+    return {};
+}
+bool Executor::LookupVariable(StringView name, String& value)
+{
+    using namespace StringUtils;
+    if (name == "?"_sv)
+    {
+        value = ToString(m_LastExitCode);
+        return true;
+    }
+    if (name == "!"_sv)
+    {
+        pid_t pid = Jobs::LastBackgroundPid();
+        value     = pid ? ToString(pid) : String();
+        return pid != 0;
+    }
+
+    // $# and $1... are the arguments of the innermost call, outside of a
+    // function there are none
+    auto  arguments = Functions::Arguments();
+    usize index     = 0;
+    if (name == "#"_sv)
+    {
+        value = ToString(arguments ? arguments->Size() : 0);
+        return true;
+    }
+    for (char c : name)
+        index = IsDigit(c) && index < INT_MAX ? index * 10 + (c - '0') : 0;
+    if (index > 0)
+    {
+        bool set = arguments && index <= arguments->Size();
+        value    = set ? (*arguments)[index - 1] : String();
+        return set;
+    }
+
+    value = Environment::GetVariable(name);
+    return Environment::IsSet(name);
+}
+String Executor::ExpandWord(isize index)
+{
+    String text;
+    if (index < 0) return text;
+    for (auto& atom : m_Program.WordTable[index]->Atoms)
+        text += ExpandAtom(atom);
+    return text;
+}
+bool Executor::LookupElement(StringView name, isize subscript, String& value)
+{
+    if (auto array = Environment::GetAssociative(name))
+    {
+        auto element
+            = array->Find(ExpandWord(m_Program.Subscripts[subscript].Key));
+        if (element) value = *element;
+        return element;
+    }
+
+    i64 index;
+    if (!ElementIndex(name, subscript, index)) return false;
+    if (auto array = Environment::GetIndexed(name))
+    {
+        auto element = array->Find(index);
+        if (element) value = *element;
+        return element;
+    }
+    // A scalar is its own element 0
+    return index == 0 && LookupVariable(name, value);
+}
+bool Executor::ElementIndex(StringView name, isize subscript, i64& index)
+{
+    if (!EvaluateArithmetic(m_Program.Subscripts[subscript].Index, index))
+        return false;
+    if (index < 0)
+    {
+        auto array = Environment::GetIndexed(name);
+        index += array ? array->End() : Environment::IsSet(name);
+    }
+    if (index >= 0) return true;
+
+    PrismError("awsh: {}: bad array subscript\n", name);
+    return false;
+}
+bool Executor::AssignElement(StringView name, isize subscript,
+                             StringView value, bool append)
+{
+    if (Environment::KindOf(name) == Environment::VariableKind::eAssociative)
+    {
+        String key = ExpandWord(m_Program.Subscripts[subscript].Key);
+        if (append) Environment::AppendEntry(name, key, value);
+        else Environment::SetEntry(name, key, value);
+        return true;
+    }
+
+    i64 index;
+    if (!ElementIndex(name, subscript, index)) return false;
+    if (append) Environment::AppendElement(name, index, value);
+    else Environment::SetElement(name, index, value);
+    return true;
+}
+String Executor::ExpandParameter(const WordAtom& atom)
+{
+    using Type      = ParameterExpansion::Type;
+    auto& expansion = m_Program.Expansions[atom.Slot];
+    if (expansion.Operator == Type::eBad)
+    {
+        PrismError("awsh: ${{{}}}: bad substitution\n", atom.Value);
+        ++m_BadExpansions;
+        return {};
+    }
+    if (!expansion.Elements)
+    {
+        String value;
+        bool   set = expansion.Subscript >= 0
+                     ? LookupElement(atom.Value, expansion.Subscript, value)
+                     : LookupVariable(atom.Value, value);
+        return ApplyOperator(atom, expansion, Move(value), set);
+    }
+
+    if (expansion.Operator == Type::eLength)
+    {
+        usize count = 0;
+        if (auto array = Environment::GetIndexed(atom.Value))
+            count = array->Count();
+        else if (auto array = Environment::GetAssociative(atom.Value))
+            count = array->Count();
+        else count = Environment::IsSet(atom.Value);
+        return StringUtils::ToString(count);
+    }
+
+    // As a single word, the elements are joined by a blank, or the first
+    // byte of IFS for ${name[*]}
+    Vector<String> values;
+    ExpandElements(atom, values);
+
+    String     text;
+    StringView ifs = Environment::GetVariable("IFS"_sv);
+    char       separator
+        = expansion.Elements == '*' && Environment::IsSet("IFS"_sv)
+            ? (ifs.Empty() ? '\0' : ifs[0])
+            : ' ';
+    for (usize i = 0; i < values.Size(); i++)
+    {
+        if (i > 0 && separator) text += separator;
+        text += values[i];
+    }
+    return text;
+}
+void Executor::ExpandElements(const WordAtom& atom, Vector<String>& values)
+{
+    using Type      = ParameterExpansion::Type;
+    auto& expansion = m_Program.Expansions[atom.Slot];
+    if (expansion.Operator == Type::eKeys)
+    {
+        if (auto array = Environment::GetIndexed(atom.Value))
+            for (usize i = array->Next(0); i < array->End();
+                 i       = array->Next(i + 1))
+                values.PushBack(StringUtils::ToString(i));
+        else if (auto array = Environment::GetAssociative(atom.Value))
+            for (usize i = 0; i < array->Count(); i++)
+                values.PushBack(array->KeyAt(i));
+        else if (Environment::IsSet(atom.Value)) values.PushBack("0");
+        return;
+    }
+
+    Vector<StringView> elements;
+    Environment::Elements(atom.Value, elements);
+    if (expansion.Operator == Type::eSubstring)
+    {
+        // Elements from an offset on, not a part of each
+        i64 size   = elements.Size();
+        i64 offset = 0, length = size;
+        ParseOffset(ExpandWord(expansion.Operand), offset);
+        if (expansion.Second >= 0)
+            ParseOffset(ExpandWord(expansion.Second), length);
+
+        if (offset < 0) offset += size;
+        if (offset < 0 || offset > size) return;
+        i64 end = length < 0 ? size + length : offset + length;
+        if (end > size) end = size;
+        for (i64 i = offset; i < end; i++) values.PushBack(elements[i]);
+        return;
+    }
+
+    // Without elements, only a default still expands to something
+    if (elements.Empty())
+    {
+        if (expansion.Operand >= 0
+            && (expansion.Operator == Type::eDefault
+                || expansion.Operator == Type::eAssign))
+            values.PushBack(ApplyOperator(atom, expansion, {}, false));
+        return;
+    }
+    for (auto element : elements)
+        values.PushBack(ApplyOperator(atom, expansion, element, true));
+}
+String Executor::ApplyOperator(const WordAtom&           atom,
+                               const ParameterExpansion& expansion,
+                               String value, bool set)
+{
+    using Type = ParameterExpansion::Type;
+    bool null  = !set || (expansion.Colon && value.Empty());
+    switch (expansion.Operator)
+    {
+        case Type::eDefault:
+            return null ? ExpandWord(expansion.Operand) : value;
+        case Type::eAssign:
+            if (!null) return value;
+            value = ExpandWord(expansion.Operand);
+            if (expansion.Subscript >= 0)
+                AssignElement(atom.Value, expansion.Subscript, value);
+            else Environment::SetVariable(atom.Value, value);
+            return value;
+        case Type::eAlternative:
+            return null ? String() : ExpandWord(expansion.Operand);
+        case Type::eLength: return StringUtils::ToString(value.Size());
+        case Type::eTrimPrefix:
+        case Type::eTrimSuffix:
+        {
+            bool suffix = expansion.Operator == Type::eTrimSuffix;
+            if (expansion.Compiled >= 0)
+                return Expander::Trim(
+                    value, *m_Program.Patterns[expansion.Compiled], suffix,
+                    expansion.Longest);
+            return Expander::Trim(value, ExpandWord(expansion.Operand),
+                                  suffix, expansion.Longest);
+        }
+        case Type::eReplace:
+        {
+            String result;
+            if (expansion.Compiled >= 0)
+                Expander::Replace(value,
+                                  *m_Program.Patterns[expansion.Compiled],
+                                  ExpandWord(expansion.Second), expansion.All,
+                                  expansion.Anchor, result);
+            else
+                Expander::Replace(value, ExpandWord(expansion.Operand),
+                                  ExpandWord(expansion.Second), expansion.All,
+                                  expansion.Anchor, result);
+            return result;
+        }
+        case Type::eSubstring:
+        {
+            // Negative offsets and lengths count from the end
+            i64 size   = value.Size();
+            i64 offset = 0, length = size;
+            ParseOffset(ExpandWord(expansion.Operand), offset);
+            if (expansion.Second >= 0)
+                ParseOffset(ExpandWord(expansion.Second), length);
+
+            if (offset < 0) offset += size;
+            if (offset < 0 || offset > size) return {};
+            i64 end = length < 0 ? size + length : offset + length;
+            if (end > size) end = size;
+            if (end <= offset) return {};
+            return value.Substr(offset, end - offset);
+        }
+        case Type::eKeys:
+        case Type::eBad: break;
+    }
+
+    return value;
+}
+bool Executor::EvaluateArithmetic(isize index, i64& value)
+{
+    auto& expansion = m_Program.Arithmetic[index];
+    if (expansion.Compiled)
+        return expansion.Compiled->Evaluate(value, m_LastExitCode);
+
+    // Only known once its substitutions ran, compiled every time
+    return Arithmetic::Expression(ExpandWord(expansion.Text))
+        .Evaluate(value, m_LastExitCode);
+}
+String Executor::TakeAtom(const WordAtom& atom)
+{
+    if (atom.Type != WordAtom::Type::eCommandSubstitution)
+        return ExpandAtom(atom);
+    RunDeferred(atom);
+    ++m_SubstitutionsTaken;
+    return Move(m_Captures[atom.Slot]);
+}
+String Executor::ExpandRegex(const WordAtom& atom)
+{
+    String regex;
+    for (auto& piece : m_Program.WordTable[atom.Slot]->Atoms)
+    {
+        String value = TakeAtom(piece);
+        if (piece.Quoted) regex += Pattern::EscapeRegex(value);
+        else regex += value;
+    }
+    return regex;
+}
+String Executor::ExpandPattern(const WordAtom& atom, String* word)
+{
+    auto quoted = [](const WordAtom& piece)
+    { return piece.Quoted || piece.Type == WordAtom::Type::eQuoted; };
+    if (atom.Type != WordAtom::Type::eJoined)
+    {
+        String value = TakeAtom(atom);
+        if (word) *word = value;
+        return quoted(atom) ? Pattern::Escape(value) : value;
+    }
+
+    String pattern;
+    for (auto& piece : m_Program.WordTable[atom.Slot]->Atoms)
+    {
+        String value = TakeAtom(piece);
+        if (word) *word += value;
+        pattern += quoted(piece) ? Pattern::Escape(value) : value;
+    }
+    return pattern;
+}
+void Executor::ExpandQuotedGlob(const WordAtom& atom, Vector<String>& words)
+{
+    String word;
+    String pattern = ExpandPattern(atom, &word);
+    if (!Expander::Glob(pattern, words)) words.PushBack(Move(word));
+}
+void Executor::RunDeferred(const WordAtom& atom)
+{
+    if (atom.Deferred < 0) return;
+    usize pc = atom.Deferred;
+    HandleSubstitute(m_Program.Instructions[pc], pc);
+}
+
+ErrorOr<void> Executor::ResolveRedirections(Vector<FdAction>& actions)
+{
+    for (usize index : m_PendingRedirections)
+    {
+        auto&    redir = m_Program.Redirections[index];
+        FdAction action;
+        action.Fd = redir.FD;
+        if (redir.Mode == Redirection::Type::HereDoc)
+        {
+            action.Type     = FdAction::Type::eDuplicate;
+            action.SourceFd = OpenHereDoc(index);
+            if (action.SourceFd < 0)
+            {
+                i32 error = errno;
+                PrismError("awsh: here-document: {}\n", strerror(error));
+                return Error(error);
+            }
+
+            actions.PushBack(Move(action));
+            continue;
+        }
+
+        String target;
+        for (auto& atom : redir.Target->Atoms) target += ExpandAtom(atom);
+        if (redir.Mode == Redirection::Type::Duplicate)
+        {
+            bool number = !target.Empty();
+            for (char c : target) number &= StringUtils::IsDigit(c);
+
+            if (target == "-"_sv) action.Type = FdAction::Type::eClose;
+            else if (number)
+            {
+                action.Type     = FdAction::Type::eDuplicate;
+                action.SourceFd = StringUtils::ToNumber<i32>(target);
+            }
+            else
+            {
+                PrismError("awsh: {}: ambiguous redirect\n", target.Raw());
+                return Error(EINVAL);
+            }
+
+            actions.PushBack(Move(action));
+            continue;
+        }
+
+        if (target.Empty())
+        {
+            PrismError("awsh: ambiguous redirect\n");
+            return Error(EINVAL);
+        }
+
+        action.Type = FdAction::Type::eOpen;
+        action.Path = Move(target);
+        switch (redir.Mode)
+        {
+            case Redirection::Type::Read: action.Flags = O_RDONLY; break;
+            case Redirection::Type::Write:
+                action.Flags = O_WRONLY | O_CREAT | O_TRUNC;
+                break;
+            case Redirection::Type::Append:
+                action.Flags = O_WRONLY | O_CREAT | O_APPEND;
+                break;
+            case Redirection::Type::ReadWrite:
+                action.Flags = O_RDWR | O_CREAT;
+                break;
+            default: break;
+        }
+        actions.PushBack(Move(action));
+    }
+
+    return {};
+}
+i32 Executor::OpenHereDoc(usize index)
+{
+    auto&    redir     = m_Program.Redirections[index];
+    bool     cacheable = true;
+    for (auto& atom : redir.Target->Atoms)
+        cacheable &= atom.Type == WordAtom::Type::eLiteral;
+
+    HereDoc* cached = nullptr;
+    if (cacheable)
+    {
+        cached = &m_HereDocs[index];
+        if (cached->Fd >= 0 && lseek(cached->Fd, 0, SEEK_SET) == 0)
+            return cached->Fd;
+    }
+
+    String body;
+    for (auto& atom : redir.Target->Atoms) body += ExpandAtom(atom);
+
+    // A body smaller than the pipe buffer is written up front without ever
+    // blocking. One that is read again is worth a memfd to rewind instead
+    bool reused = cached && cached->Uses++ > 0;
+    if (body.Size() < PIPE_BUF && !reused)
+    {
+        i32 fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0) return -1;
+
+        WriteAll(fds[1], body);
+        close(fds[1]);
+        m_TemporaryFds.PushBack(fds[0]);
+        return fds[0];
+    }
+
+    i32 fd = memfd_create("awsh-heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) return -1;
+    if (!WriteAll(fd, body))
+    {
+        i32 error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    // Sealed, so no reader can change what the next one sees
+    fcntl(fd, F_ADD_SEALS,
+          F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    lseek(fd, 0, SEEK_SET);
+
+    if (cached) cached->Fd = fd;
+    else m_TemporaryFds.PushBack(fd);
+    return fd;
+}
+void Executor::ForgetHereDocs()
+{
+    for (auto& hereDoc : m_HereDocs)
+    {
+        if (hereDoc.Fd >= 0) close(hereDoc.Fd);
+        hereDoc = HereDoc{};
+    }
+}
+
+void Executor::HandleExpandWords(const Instruction& instr)
+{
+    if (m_DebugLog)
+    {
+        auto& word = m_Program.WordTable[instr.Arg0];
+        fmt::print("Expanded: ");
+        for (auto& atom : word->Atoms) fmt::print("{} ", atom.Value);
+        fmt::print("\n");
+    }
+}
+void Executor::HandleExec(const Instruction& instr)
+{
+    // Redirection targets expand before the command runs, and only apply
+    // to this one command
+    usize            bad = m_BadExpansions;
+    Vector<FdAction> actions;
+    auto             resolved = ResolveRedirections(actions);
+    m_PendingRedirections.Clear();
+
+    TemporaryFds temporaries{m_TemporaryFds};
+    if (!resolved)
+    {
+        m_LastExitCode = 1;
+        return;
+    }
+
+    // Prefixes expand before the words, like plain assignments would
+    Vector<String> assignments;
+    for (usize index : m_PendingAssignments)
+    {
+        auto& prefix = m_Program.Instructions[index];
+        assignments.PushBack(m_Program.WordTable[prefix.Arg0]->Atoms[0].Value);
+        assignments.PushBack(
+            ExpandAtom(m_Program.WordTable[prefix.Arg1]->Atoms[0]));
+        // FOO+=bar prefixes see the old value with bar appended
+        if (prefix.Payload & AssignFlags::eAppend)
+        {
+            auto&  name  = assignments[assignments.Size() - 2];
+            auto&  value = assignments.Back();
+            String joined(Environment::GetVariable(name));
+            joined += value;
+            value = Move(joined);
+        }
+    }
+    m_PendingAssignments.Clear();
+
+    auto& word = m_Program.WordTable[instr.Arg0];
+    if (word->Atoms.Empty())
+    {
+        // A bare redirection still creates or truncates its target
+        FdTable fdTable;
+        m_LastExitCode = fdTable.Apply(actions) ? 0 : 1;
+        return;
+    }
+
+    bool literal = true;
+    for (auto& atom : word->Atoms)
+        literal &= atom.Type == WordAtom::Type::eLiteral;
+    if (literal)
+    {
+        if (word->Argv.Empty())
+        {
+            for (auto& atom : word->Atoms)
+                word->Argv.PushBack(const_cast<char*>(atom.Value.Raw()));
+            word->Argv.PushBack(nullptr);
+        }
+        RunCommand(instr, word->Argv, actions, assignments);
+        return;
+    }
+
+    // Expansions have to outlive argv, so they are kept aside. Values to
+    // split are kept whole, unless a field of theirs may have to be globbed
+    Vector<String>       expanded;
+    Vector<usize>        splits;
+    Expander::Separators separators;
+    bool                 substituted = false;
+    auto                 addSplit    = [&](String value)
+    {
+        if (splits.Empty()) separators = CurrentSeparators();
+        if (!Expander::IsPattern(value))
+        {
+            splits.PushBack(expanded.Size());
+            expanded.PushBack(Move(value));
+            return;
+        }
+
+        Expander::Fields fields(value, separators);
+        StringView       field;
+        while (fields.Next(field))
+            if (!Expander::IsPattern(field)
+                || !Expander::Glob(field, expanded))
+                expanded.PushBack(String(field));
+    };
+    // The elements of "${name[@]}" are not copied, argv points right into
+    // the array. Each run of them goes in front of the expanded word it
+    // was reached at
+    struct Lent
+    {
+        usize At;
+        usize End;
+    };
+    Vector<StringView> borrowed;
+    Vector<Lent>       lent;
+    for (auto& atom : word->Atoms)
+    {
+        if (atom.Type == WordAtom::Type::eBrace)
+        {
+            ExpandBraces(atom, expanded);
+            continue;
+        }
+        if (IsElements(atom))
+        {
+            auto& expansion = m_Program.Expansions[atom.Slot];
+            if (!atom.Quoted)
+            {
+                Vector<String> values;
+                ExpandElements(atom, values);
+                for (auto& value : values) addSplit(Move(value));
+            }
+            else if (expansion.Operator == ParameterExpansion::Type::eDefault
+                     && expansion.Operand < 0)
+            {
+                Environment::Elements(atom.Value, borrowed);
+                lent.PushBack({expanded.Size(), borrowed.Size()});
+            }
+            else ExpandElements(atom, expanded);
+            continue;
+        }
+        if (IsQuotedGlob(atom))
+        {
+            ExpandQuotedGlob(atom, expanded);
+            continue;
+        }
+        if (!IsSplit(atom))
+        {
+            if (atom.Type != WordAtom::Type::eGlob
+                || !Expander::Glob(atom.Value, expanded))
+                expanded.PushBack(ExpandAtom(atom));
+            continue;
+        }
+
+        substituted |= atom.Type == WordAtom::Type::eCommandSubstitution;
+        addSplit(TakeAtom(atom));
+    }
+    if (m_BadExpansions != bad)
+    {
+        m_LastExitCode = 1;
+        return;
+    }
+
+    // Convert Word.Atoms to char*[] for execvp. Fields are split in place,
+    // the separator after each one becomes its terminator
+    Vector<char*> argv;
+    usize         run = 0, from = 0;
+    auto          lend = [&](usize at)
+    {
+        for (; run < lent.Size() && lent[run].At == at; run++)
+            for (; from < lent[run].End; from++)
+                argv.PushBack(const_cast<char*>(borrowed[from].Raw()));
+    };
+    for (usize i = 0, split = 0; i < expanded.Size(); i++)
+    {
+        lend(i);
+        char* arg = const_cast<char*>(expanded[i].Raw());
+        if (split == splits.Size() || splits[split] != i)
+        {
+            argv.PushBack(arg);
+            continue;
+        }
+
+        ++split;
+        Expander::Fields fields(expanded[i], separators);
+        StringView       field;
+        while (fields.Next(field))
+        {
+            arg[field.Raw() - arg + field.Size()] = '\0';
+            argv.PushBack(const_cast<char*>(field.Raw()));
+        }
+    }
+    lend(expanded.Size());
+    if (argv.Empty())
+    {
+        // Nothing was left of the command, it only redirects, and keeps
+        // the status of a substitution
+        FdTable fdTable;
+        if (!fdTable.Apply(actions)) m_LastExitCode = 1;
+        else if (!substituted) m_LastExitCode = 0;
+        return;
+    }
+    argv.PushBack(nullptr);
+    RunCommand(instr, argv, actions, assignments);
+}
+void Executor::RunCommand(const Instruction& instr, const Vector<char*>& argv,
+                          Vector<FdAction>&     actions,
+                          const Vector<String>& assignments)
+{
+    if (m_DebugLog) PrismTrace("Executor: Executing command => {}", argv[0]);
+    for (usize i = 0; m_DebugLog && i < argv.Size() - 1; i++)
+        PrismMessage("argv[{}]: '{}'\n", i, argv[i]);
+
+    auto name    = argv[0];
+    bool measure = Jobs::IsUsageLogEnabled() || Trace::IsEnabled();
+    u64  start   = measure ? Jobs::MonotonicTime() : 0;
+    // Functions are looked up first, they may shadow anything
+    Ref<Functions::Function> function;
+    if (!Functions::Empty()) function = Functions::Find(name);
+
+    isize builtin = instr.Arg1;
+    if (builtin < 0 && !(instr.Payload & ExecFlags::eExternal))
+        builtin = Builtins::Find(name);
+    if (function)
+    {
+        FdTable fdTable;
+        if (!fdTable.Apply(actions))
+        {
+            m_LastExitCode = 1;
+            return;
+        }
+
+        bool direct = false;
+        for (auto& action : actions) direct |= action.Fd == 1;
+        if (direct) Builtins::PushDirectOutput();
+        for (usize i = 0; i < assignments.Size(); i += 2)
+            Environment::SetTemporary(assignments[i], assignments[i + 1]);
+
+        m_LastExitCode = Functions::Call(function, argv, m_LastExitCode);
+        fflush(stdout);
+        Environment::DropTemporaries();
+        if (direct) Builtins::PopCapture();
+        return;
+    }
+    if (builtin >= 0)
+    {
+        // Builtins run inside the shell, so their redirections have to be
+        // undone afterwards
+        FdTable fdTable;
+        if (!fdTable.Apply(actions))
+        {
+            m_LastExitCode = 1;
+            return;
+        }
+
+        bool direct = false;
+        for (auto& action : actions) direct |= action.Fd == 1;
+        if (direct) Builtins::PushDirectOutput();
+
+        for (usize i = 0; i < assignments.Size(); i += 2)
+            Environment::SetTemporary(assignments[i], assignments[i + 1]);
+
+        Builtins::SetLastStatus(m_LastExitCode);
+        m_LastExitCode = Builtins::Run(builtin, argv);
+        fflush(stdout);
+        if (direct) Builtins::PopCapture();
+        Environment::DropTemporaries();
+        if (!measure) return;
+
+        // Logged like a child, only their wall time is theirs
+        u64    elapsed = Jobs::MonotonicTime() - start;
+        String command = JoinArguments(argv.Raw());
+        if (Trace::IsEnabled())
+            Trace::Complete(command, "builtin", start, elapsed);
+        if (Jobs::IsUsageLogEnabled())
+        {
+            Jobs::ResourceUsage usage;
+            usage.WallTime = elapsed;
+            Jobs::LogUsage(command, getpid(), m_LastExitCode, usage);
+        }
+        return;
+    }
+
+    // Only the child sees the prefixes
+    Environment::Overlay overlay;
+    for (usize i = 0; i < assignments.Size(); i += 2)
+        overlay.Add(assignments[i], assignments[i + 1]);
+    char* const* envp
+        = assignments.Empty() ? Environment::Block() : overlay.Envp();
+
+    // Accounting needs a child to reap, so it keeps the shell around
+    if ((instr.Payload & ExecFlags::eReplaceShell)
+        && !Jobs::IsUsageLogEnabled() && !Trace::IsEnabled())
+    {
+        fflush(stdout);
+        fflush(stderr);
+
+        FdTable fdTable;
+        if (!fdTable.Apply(actions, false))
+        {
+            m_LastExitCode = 1;
+            return;
+        }
+        Input::SyncAll();
+        execvpe(argv[0], argv.Raw(), envp);
+
+        PrismError("awsh: command not found: {}\n", argv[0]);
+        m_LastExitCode = 127;
+        return;
+    }
+
+    auto* spawnActions = actions.Empty() ? nullptr : &actions;
+    pid_t pid          = Spawn(argv.Raw(), false, spawnActions, envp);
+    if (pid < 0) m_LastExitCode = pid == REDIRECTION_FAILED ? 1 : 127;
+    else m_LastExitCode = Jobs::Wait(pid);
+    if (m_DebugLog)
+        PrismTrace("Executor: Last Exit Status => {}", m_LastExitCode);
+}
+void Executor::HandleSetVar(const Instruction& instr)
+{
+    auto       nameWord  = m_Program.WordTable[instr.Arg0];
+    auto       valueWord = m_Program.WordTable[instr.Arg1];
+    StringView name      = nameWord->Atoms[0].Value;
+    usize      bad       = m_BadExpansions;
+    usize      taken     = m_SubstitutionsTaken;
+    String     value     = ExpandAtom(valueWord->Atoms[0]);
+    if (m_BadExpansions != bad)
+    {
+        m_LastExitCode = 1;
+        return;
+    }
+    if (m_SubstitutionsTaken == taken) m_LastExitCode = 0;
+
+    if (instr.Payload & AssignFlags::eAppend)
+        Environment::AppendVariable(name, value);
+    else Environment::SetVariable(name, value);
+}
+void Executor::HandleSetElement(const Instruction& instr, bool append)
+{
+    StringView name  = m_Program.WordTable[instr.Arg0]->Atoms[0].Value;
+    usize      bad   = m_BadExpansions;
+    usize      taken = m_SubstitutionsTaken;
+    String     value = ExpandAtom(m_Program.WordTable[instr.Arg1]->Atoms[0]);
+    if (m_BadExpansions != bad
+        || !AssignElement(name, instr.Payload, value, append))
+        m_LastExitCode = 1;
+    else if (m_SubstitutionsTaken == taken) m_LastExitCode = 0;
+}
+void Executor::HandleSetArray(const Instruction& instr, bool append)
+{
+    StringView name       = m_Program.WordTable[instr.Arg0]->Atoms[0].Value;
+    auto&      values     = m_Program.WordTable[instr.Arg1]->Atoms;
+    auto       subscripts = instr.Payload >= 0
+                              ? &m_Program.ArrayLiterals[instr.Payload]
+                              : nullptr;
+    auto       subscript  = [&](usize i)
+    { return subscripts ? (*subscripts)[i] : -1; };
+
+    m_LastExitCode = 0;
+    if (Environment::KindOf(name) == Environment::VariableKind::eAssociative)
+    {
+        Arrays::Associative array;
+        for (usize i = 0; i < values.Size(); i++)
+        {
+            if (subscript(i) < 0)
+            {
+                PrismError("awsh: {}: {}: must use subscript when assigning "
+                           "associative array\n",
+                           name, values[i].Value);
+                m_LastExitCode = 1;
+                continue;
+            }
+            String key   = ExpandWord(m_Program.Subscripts[subscript(i)].Key);
+            String value = ExpandAtom(values[i]);
+            // Appending sets each entry in place instead of replacing them
+            if (append) Environment::SetEntry(name, key, value);
+            else array.Set(key, Move(value));
+        }
+        if (!append) Environment::SetArray(name, Move(array));
+        return;
+    }
+
+    // Values without a subscript may expand to any number of elements, one
+    // with a subscript moves where the next ones go. Appending starts past
+    // the last element, a scalar being element 0
+    Arrays::Indexed array;
+    Vector<String>  fields;
+    auto            end = [&]() -> usize
+    {
+        if (!append) return array.End();
+        auto existing = Environment::GetIndexed(name);
+        return existing ? existing->End() : Environment::IsSet(name);
+    };
+    usize next = end();
+    for (usize i = 0; i < values.Size(); i++)
+    {
+        fields.Clear();
+        if (subscript(i) >= 0)
+        {
+            i64 index;
+            if (!EvaluateArithmetic(m_Program.Subscripts[subscript(i)].Index,
+                                    index))
+            {
+                m_LastExitCode = 1;
+                continue;
+            }
+            if (index < 0) index += end();
+            if (index < 0)
+            {
+                PrismError("awsh: {}: bad array subscript\n", name);
+                m_LastExitCode = 1;
+                continue;
+            }
+            next = index;
+            fields.PushBack(ExpandAtom(values[i]));
+        }
+        else ExpandFields(values[i], fields);
+
+        for (auto& field : fields)
+        {
+            if (append) Environment::SetElement(name, next++, field);
+            else array.Set(next++, Move(field));
+        }
+    }
+    if (!append) Environment::SetArray(name, Move(array));
 }
@@ -6,6 +6,8 @@
  */
 #pragma once
 
+#include <Expander.hpp>
+#include <FdTable.hpp>
 #include <Lowerer.hpp>
 #include <Prism/String/String.hpp>
 
@@ -13,16 +15,168 @@ class Executor
 {
   public:
     Executor(Program& program, isize lastExitCode = 0, bool debugLog = false);
+    ~Executor();
 
     isize Execute();
-    isize Execute(StringView name, const Vector<String>& args);
+
+    // Starts argv[0] with posix_spawn, the child is registered with the job
+    // table. Redirections become spawn file actions, so they only ever touch
+    // the child's fd table. envp defaults to the exported environment.
+    // Returns REDIRECTION_FAILED when a file could not be opened
+    static constexpr pid_t REDIRECTION_FAILED = -2;
+    static pid_t Spawn(char* const* argv, bool background = false,
+                       const Vector<FdAction>* actions = nullptr,
+                       char* const*            envp    = nullptr);
 
   private:
-    Program& m_Program;
-    isize    m_LastExitCode = 0;
-    bool     m_DebugLog     = false;
+    Program&       m_Program;
+    isize          m_LastExitCode = 0;
+    bool           m_DebugLog     = false;
+    // Expansions that did not parse or evaluate so far, a command that sees
+    // this grow while expanding its words fails instead of running
+    usize          m_BadExpansions = 0;
+    // Outputs of substitutions taken so far. An assignment whose value took
+    // none exits with 0, else with the status of the substitution
+    usize          m_SubstitutionsTaken = 0;
+    Vector<String> m_Captures;
+    // Redirections queued by eRedirect for the next eExec
+    Vector<usize>  m_PendingRedirections;
+    // FOO=bar prefixes queued by ePrefixAssign for the next eExec
+    Vector<usize>  m_PendingAssignments;
+    // Here-document fds that only live as long as the command reading them
+    Vector<i32>    m_TemporaryFds;
+
+    // Sealed memfds of here-documents without expansions, indexed by
+    // redirection, rewound for every command that reads them again
+    struct HereDoc
+    {
+        i32   Fd   = -1;
+        usize Uses = 0;
+    };
+    Vector<HereDoc> m_HereDocs;
+    // Status of the last body run of every loop, indexed by loop slot
+    Vector<isize>   m_LoopStatus;
+
+    // Where a for loop is in its list. Words are expanded only as the loop
+    // gets to them, braces one word at a time
+    struct ForLoop
+    {
+        // Index into WordTable, -1 for the positional parameters
+        isize             List       = -1;
+        usize             Atom       = 0;
+        usize             Positional = 0;
+        Expander::Braces  Braces;
+        bool              InBraces = false;
+        // An unquoted expansion being split, the fields point into Value
+        String            Value;
+        Expander::Fields  Fields;
+        bool              InFields = false;
+        // Paths a glob expanded to, handed out from Taken on
+        Vector<String>    Pending;
+        usize             Taken = 0;
+    };
+    // Indexed by loop slot
+    Vector<ForLoop> m_ForLoops;
+    // Expanded word of every case, kept for the dispatch after ;|
+    Vector<String>  m_CaseSubjects;
+
+    isize          ExecuteRange(usize begin, usize end);
+    isize          RunForked(usize begin, usize end);
+    isize          RunInProcess(usize begin, usize end, i32 flags,
+                                String* capture = nullptr);
+
+    String         ExpandAtom(const WordAtom& atom);
+    // Like ExpandAtom, but moves the output of a substitution out of its
+    // slot instead of copying it, for the one place that reads it
+    String         TakeAtom(const WordAtom& atom);
+    // The regex of an eJoined atom right of =~, with the values of its
+    // quoted pieces escaped
+    String         ExpandRegex(const WordAtom& atom);
+    // A case pattern, quoted pieces and quoted expansions only ever match
+    // themselves, the values of unquoted ones are patterns. word, if given,
+    // gets the expansion without any escapes
+    String         ExpandPattern(const WordAtom& atom, String* word = nullptr);
+    // Runs the substitution of an operand that was jumped over, now that
+    // its output is needed
+    void           RunDeferred(const WordAtom& atom);
+    // Unquoted variables and substitutions are split into fields
+    static bool    IsSplit(const WordAtom& atom)
+    {
+        return !atom.Quoted
+            && (atom.Type == WordAtom::Type::eVariable
+                || atom.Type == WordAtom::Type::eParameter
+                || atom.Type == WordAtom::Type::eCommandSubstitution
+                || atom.Type == WordAtom::Type::eJoined);
+    }
+    // ${name[@]} and the like, which expand to a field per element.
+    // "${name[*]}" is a single one
+    bool           IsElements(const WordAtom& atom) const
+    {
+        if (atom.Type != WordAtom::Type::eParameter) return false;
+        auto& expansion = m_Program.Expansions[atom.Slot];
+        return expansion.Elements
+            && !(atom.Quoted && expansion.Elements == '*')
+            && expansion.Operator != ParameterExpansion::Type::eLength;
+    }
+    // A joined word with a quoted piece is not split, its unquoted pieces
+    // are still globbed, as in "$dir"/*
+    bool           IsQuotedGlob(const WordAtom& atom) const
+    {
+        if (atom.Type != WordAtom::Type::eJoined || !atom.Quoted) return false;
+        for (auto& piece : m_Program.WordTable[atom.Slot]->Atoms)
+            if (piece.Type == WordAtom::Type::eGlob) return true;
+        return false;
+    }
+    // Appends what such a word matches, or the word itself
+    void           ExpandQuotedGlob(const WordAtom& atom, Vector<String>& words);
+    // Returns whether name is set, $? and $! included
+    bool           LookupVariable(StringView name, String& value);
+    // Same for the element Subscripts[subscript] of an array
+    bool           LookupElement(StringView name, isize subscript,
+                                 String& value);
+    // The index Subscripts[subscript] selects in an indexed array, negative
+    // ones count back from its end. False after an error was reported
+    bool           ElementIndex(StringView name, isize subscript, i64& index);
+    bool           AssignElement(StringView name, isize subscript,
+                                 StringView value, bool append = false);
+    String         ExpandParameter(const WordAtom& atom);
+    // The operator of atom applied to value, which is unset unless set
+    String         ApplyOperator(const WordAtom&           atom,
+                                 const ParameterExpansion& expansion,
+                                 String value, bool set);
+    // Appends what ${name[@]} expands to, a value per element
+    void           ExpandElements(const WordAtom& atom, Vector<String>& values);
+    // Appends the fields of a single atom, split and globbed
+    void           ExpandFields(const WordAtom& atom, Vector<String>& fields);
+    // Word index of the WordTable expanded into a single string, the empty
+    // one for -1
+    String         ExpandWord(isize index);
+    // Arithmetic[index] evaluated, false after an error was reported
+    bool           EvaluateArithmetic(isize index, i64& value);
+    ErrorOr<void>  ResolveRedirections(Vector<FdAction>& actions);
+    i32            OpenHereDoc(usize index);
+    void           ForgetHereDocs();
 
-    void     HandleExec(const Instruction& instr);
-    void     HandleExpandWords(const Instruction& instr);
-    void     HandleSetVar(const Instruction& instr);
+    void           HandleExec(const Instruction& instr);
+    // Runs the function, builtin or program of an expanded argv, which
+    // ends with a nullptr
+    void           RunCommand(const Instruction& instr, const Vector<char*>& argv,
+                              Vector<FdAction>&     actions,
+                              const Vector<String>& assignments);
+    void           HandleExpandWords(const Instruction& instr);
+    void           HandleSetVar(const Instruction& instr);
+    void           HandleSetElement(const Instruction& instr, bool append);
+    void           HandleSetArray(const Instruction& instr, bool append);
+    void           HandleSubshell(const Instruction& instr, usize pc);
+    void           HandleSubstitute(const Instruction& instr, usize pc);
+    void           HandleBackground(const Instruction& instr, usize pc);
+    void           HandleTime(const Instruction& instr, usize pc);
+    void           HandleRedirectBody(const Instruction& instr, usize pc);
+    void           LeaveLoop(const Instruction& instr, usize& pc, isize offset);
+    void           HandleForInit(const Instruction& instr);
+    void           HandleTest(const Instruction& instr);
+    void           HandleCase(const Instruction& instr, usize& pc);
+    bool           NextForWord(ForLoop& loop, String& word);
+    // Appends every word of a brace atom, globbing the ones that are patterns
+    void           ExpandBraces(const WordAtom& atom, Vector<String>& words);
 };
@@ -4,4 +4,1111 @@
  *
  * SPDX-License-Identifier: GPL-3
  */
+#include <Environment.hpp>
+#include <Expander.hpp>
+#include <Pattern.hpp>
 
+#include <Prism/Containers/UnorderedMap.hpp>
+#include <Prism/String/StringUtils.hpp>
+
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+
+using namespace Prism;
+
+namespace Expander
+{
+    namespace
+    {
+        // Bytes of dirents fetched by one getdents64 call
+        constexpr usize DIRENT_BUFFER      = 64 * 1024;
+        // Names held by cached listings before the cache is dropped
+        constexpr usize MAX_CACHED_BYTES   = 32 * 1024 * 1024;
+        // A ** walk brings in helper threads once this many directories
+        // are waiting
+        constexpr usize PARALLEL_THRESHOLD = 16;
+        constexpr usize MAX_WALKERS        = 8;
+
+        // Calls visit(name, d_type) for every entry but . and .., the name
+        // is NUL terminated
+        template <typename Visit>
+        bool ReadDirectory(i32 fd, Vector<char>& buffer, Visit visit)
+        {
+            if (buffer.Empty()) buffer.Resize(DIRENT_BUFFER);
+            for (;;)
+            {
+                long nread
+                    = syscall(SYS_getdents64, fd, buffer.Raw(), buffer.Size());
+                if (nread <= 0) return nread == 0;
+
+                for (long offset = 0; offset < nread;)
+                {
+                    auto entry
+                        = reinterpret_cast<dirent64*>(buffer.Raw() + offset);
+                    offset += entry->d_reclen;
+
+                    const char* name = entry->d_name;
+                    if (name[0] == '.'
+                        && (!name[1] || (name[1] == '.' && !name[2])))
+                        continue;
+                    visit(StringView(name, strlen(name)), entry->d_type);
+                }
+            }
+        }
+
+        struct DirEntry
+        {
+            u32 Offset;
+            u32 Length;
+            u8  Type;
+        };
+        struct Listing
+        {
+            dev_t            Device = 0;
+            ino_t            Inode  = 0;
+            timespec         Modified{};
+            // Changed within the second it was read in, an unchanged mtime
+            // proves nothing then
+            bool             Racy = false;
+            Vector<char>     Names;
+            Vector<DirEntry> Entries;
+
+            StringView       NameOf(const DirEntry& entry) const
+            {
+                return StringView(Names.Raw() + entry.Offset, entry.Length);
+            }
+        };
+        i32 CompareEntries(const void* lhs, const void* rhs, void* context)
+        {
+            auto& names = static_cast<Listing*>(context)->Names;
+            return strcmp(
+                names.Raw() + static_cast<const DirEntry*>(lhs)->Offset,
+                names.Raw() + static_cast<const DirEntry*>(rhs)->Offset);
+        }
+        // Keyed by inode and device, so changing directory keeps them valid
+        UnorderedMap<u64, Listing> s_Listings;
+        usize                      s_CachedBytes = 0;
+        Vector<char>               s_Dirents;
+
+        // Valid until the next call
+        const Listing*             List(const String& directory)
+        {
+            const char* path = directory.Empty() ? "." : directory.Raw();
+            struct stat st;
+            if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) return nullptr;
+
+            u64  key    = static_cast<u64>(st.st_ino)
+                    ^ (static_cast<u64>(st.st_dev) << 40);
+            auto cached = s_Listings.Find(key);
+            if (cached != s_Listings.end())
+            {
+                auto& listing = *cached->Value;
+                if (!listing.Racy && listing.Device == st.st_dev
+                    && listing.Inode == st.st_ino
+                    && listing.Modified.tv_sec == st.st_mtim.tv_sec
+                    && listing.Modified.tv_nsec == st.st_mtim.tv_nsec)
+                    return &listing;
+            }
+
+            i32 fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd < 0) return nullptr;
+
+            Listing listing;
+            listing.Device   = st.st_dev;
+            listing.Inode    = st.st_ino;
+            listing.Modified = st.st_mtim;
+            ReadDirectory(fd, s_Dirents,
+                          [&](StringView name, u8 type)
+                          {
+                              usize offset = listing.Names.Size();
+                              listing.Names.Resize(offset + name.Size() + 1);
+                              memcpy(listing.Names.Raw() + offset, name.Raw(),
+                                     name.Size() + 1);
+                              listing.Entries.PushBack(
+                                  {static_cast<u32>(offset),
+                                   static_cast<u32>(name.Size()), type});
+                          });
+            close(fd);
+            // Sorted once here, so matches in a single directory come out
+            // in order without sorting them again
+            qsort_r(listing.Entries.Raw(), listing.Entries.Size(),
+                    sizeof(DirEntry), CompareEntries, &listing);
+
+            timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            listing.Racy = st.st_mtim.tv_sec >= now.tv_sec;
+
+            if (cached != s_Listings.end())
+                s_CachedBytes -= cached->Value->Names.Size();
+            if (s_CachedBytes + listing.Names.Size() > MAX_CACHED_BYTES)
+            {
+                s_Listings.Clear();
+                s_CachedBytes = 0;
+            }
+            s_CachedBytes += listing.Names.Size();
+
+            auto& stored   = s_Listings[key];
+            stored         = Move(listing);
+            return &stored;
+        }
+        // d_type is enough unless it is a symlink or the file system does
+        // not report it
+        bool IsDirectory(const String& path, u8 type)
+        {
+            if (type == DT_DIR) return true;
+            if (type != DT_LNK && type != DT_UNKNOWN) return false;
+
+            struct stat st;
+            return stat(path.Raw(), &st) == 0 && S_ISDIR(st.st_mode);
+        }
+
+        usize CountSlashes(StringView text)
+        {
+            usize slashes = 0;
+            for (char c : text) slashes += c == '/';
+            return slashes;
+        }
+        // The colon separated patterns of GLOBIGNORE. They match whole
+        // paths, with no * crossing a /, so a path only has to be tried
+        // against the patterns with as many slashes as it has
+        struct IgnoreList
+        {
+            struct Entry
+            {
+                usize                 Slashes;
+                Ref<Pattern::Matcher> Matcher;
+            };
+            Vector<Entry> Patterns;
+
+            explicit IgnoreList(StringView value = {})
+            {
+                usize start = 0;
+                for (usize i = 0; i <= value.Size(); i++)
+                {
+                    if (i < value.Size() && value[i] != ':') continue;
+                    StringView pattern = value.Substr(start, i - start);
+                    if (!pattern.Empty())
+                        Patterns.PushBack(
+                            {CountSlashes(pattern),
+                             CreateRef<Pattern::Matcher>(pattern)});
+                    start = i + 1;
+                }
+            }
+            bool Matches(StringView path)
+            {
+                usize slashes = CountSlashes(path);
+                for (auto& entry : Patterns)
+                    if (entry.Slashes == slashes
+                        && entry.Matcher->Matches(path))
+                        return true;
+                return false;
+            }
+        };
+
+        struct Walk;
+        struct Walker
+        {
+            Walk*           Owner   = nullptr;
+            usize           Index   = 0;
+            bool            Started = false;
+            pthread_t       Thread;
+            pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+            // Directories to visit, the owner takes from the back and
+            // thieves from the front
+            Vector<String>  Queue;
+            usize           Head = 0;
+            Vector<String>  Found;
+            Vector<char>    Buffer;
+            // Read from GLOBIGNORE, hidden names are treated like any other
+            // while it is set
+            IgnoreList      Ignore;
+            bool            Dotted = false;
+        };
+        // A ** walk. Every walker visits directories from its own queue and
+        // steals from the others once it runs dry
+        struct Walk
+        {
+            // Matched against the entries of every directory, none when
+            // empty
+            StringView         Tail;
+            // Every entry is found, not only directories
+            bool               Files = false;
+            // What is found are results, GLOBIGNORE leaves some of them out
+            bool               Final = false;
+            Walker             Walkers[MAX_WALKERS];
+            usize              Count = 1;
+            // Directories queued or being visited
+            std::atomic<usize> Pending{0};
+        };
+
+        void Push(Walker& walker, String directory)
+        {
+            pthread_mutex_lock(&walker.Lock);
+            walker.Queue.PushBack(Move(directory));
+            pthread_mutex_unlock(&walker.Lock);
+        }
+        bool Take(Walker& walker, String& directory, bool front)
+        {
+            pthread_mutex_lock(&walker.Lock);
+            bool any = walker.Head < walker.Queue.Size();
+            if (any && front) directory = Move(walker.Queue[walker.Head++]);
+            else if (any)
+            {
+                directory = Move(walker.Queue.Back());
+                walker.Queue.PopBack();
+            }
+            if (walker.Head == walker.Queue.Size())
+            {
+                walker.Queue.Clear();
+                walker.Head = 0;
+            }
+            pthread_mutex_unlock(&walker.Lock);
+            return any;
+        }
+        usize Waiting(Walker& walker)
+        {
+            pthread_mutex_lock(&walker.Lock);
+            usize waiting = walker.Queue.Size() - walker.Head;
+            pthread_mutex_unlock(&walker.Lock);
+            return waiting;
+        }
+
+        void Visit(Walker& self, Pattern::Matcher& tail, const String& directory)
+        {
+            auto& walk = *self.Owner;
+            i32   fd   = open(directory.Empty() ? "." : directory.Raw(),
+                              O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd < 0) return;
+
+            ReadDirectory(
+                fd, self.Buffer,
+                [&](StringView name, u8 type)
+                {
+                    // Symlinks are never followed, and hidden directories
+                    // only entered while GLOBIGNORE is set
+                    struct stat st;
+                    if (type == DT_UNKNOWN
+                        && fstatat(fd, name.Raw(), &st, AT_SYMLINK_NOFOLLOW)
+                               == 0)
+                        type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+
+                    bool   hidden = name[0] == '.' && !self.Dotted;
+                    String path   = directory + name;
+                    bool   found  = !walk.Tail.Empty()
+                                      ? (!hidden || tail.MatchesHidden())
+                                            && tail.Matches(name)
+                                      : !hidden
+                                            && (walk.Files || type == DT_DIR);
+                    if (found && walk.Final)
+                        found = !self.Ignore.Matches(path);
+                    if (found && walk.Tail.Empty() && !walk.Files)
+                        self.Found.PushBack(path + "/"_sv);
+                    else if (found) self.Found.PushBack(path);
+
+                    if (hidden || type != DT_DIR) return;
+                    path += '/';
+                    walk.Pending.fetch_add(1);
+                    Push(self, Move(path));
+                });
+            close(fd);
+        }
+        void* RunWalker(void* argument);
+        void  StartHelpers(Walk& walk)
+        {
+            long  cpus  = sysconf(_SC_NPROCESSORS_ONLN);
+            usize count = cpus > 1 ? cpus : 1;
+            if (count > MAX_WALKERS) count = MAX_WALKERS;
+
+            // Walkers that failed to start only ever have empty queues
+            walk.Count = count;
+            for (usize i = 1; i < count; i++)
+            {
+                auto& walker   = walk.Walkers[i];
+                walker.Owner   = &walk;
+                walker.Index   = i;
+                walker.Started = pthread_create(&walker.Thread, nullptr,
+                                                RunWalker, &walker)
+                              == 0;
+            }
+        }
+        void* RunWalker(void* argument)
+        {
+            auto&            self = *static_cast<Walker*>(argument);
+            auto&            walk = *self.Owner;
+            // Not the cached one, a matcher builds its DFA as it runs
+            Pattern::Matcher tail(walk.Tail);
+            {
+                // Helpers run while the shell could be assigning, so they
+                // read the variables published before the walk
+                Environment::SnapshotReader snapshot;
+                StringView ignore = snapshot->Get("GLOBIGNORE"_sv);
+                self.Ignore       = IgnoreList(ignore);
+                self.Dotted       = !ignore.Empty();
+            }
+
+            String           directory;
+            for (;;)
+            {
+                bool found = Take(self, directory, false);
+                for (usize i = 1; !found && i < walk.Count; i++)
+                    found = Take(walk.Walkers[(self.Index + i) % walk.Count],
+                                 directory, true);
+                if (!found)
+                {
+                    if (walk.Pending.load() == 0) return nullptr;
+                    sched_yield();
+                    continue;
+                }
+
+                Visit(self, tail, directory);
+                walk.Pending.fetch_sub(1);
+
+                // Small trees are walked by the shell alone
+                if (self.Index == 0 && walk.Count == 1
+                    && Waiting(self) >= PARALLEL_THRESHOLD)
+                    StartHelpers(walk);
+            }
+        }
+        void RunWalk(Walk& walk, const String& base, Vector<String>& found)
+        {
+            auto& main = walk.Walkers[0];
+            main.Owner = &walk;
+            walk.Pending.store(1);
+            main.Queue.PushBack(base);
+
+            RunWalker(&main);
+            for (usize i = 1; i < walk.Count; i++)
+                if (walk.Walkers[i].Started)
+                    pthread_join(walk.Walkers[i].Thread, nullptr);
+
+            for (usize i = 0; i < walk.Count; i++)
+                for (auto& path : walk.Walkers[i].Found)
+                    found.PushBack(Move(path));
+        }
+
+        struct Segment
+        {
+            StringView Text;
+            bool       Literal  = false;
+            bool       Globstar = false;
+        };
+
+        // Finds the } closing the brace at open, and whether a comma splits
+        // it at its own level. NPos when it is never closed
+        usize BraceEnd(StringView word, usize open, bool& comma)
+        {
+            usize depth = 0;
+            comma       = false;
+            for (usize i = open; i < word.Size(); i++)
+            {
+                if (word[i] == '\\') ++i;
+                else if (word[i] == '{') ++depth;
+                else if (word[i] == '}' && --depth == 0) return i;
+                else if (word[i] == ',' && depth == 1) comma = true;
+            }
+            return StringView::NPos;
+        }
+
+        bool ParseInteger(StringView text, i64& value)
+        {
+            bool  negative = !text.Empty() && text[0] == '-';
+            usize start    = !text.Empty() && (text[0] == '-' || text[0] == '+');
+            if (start == text.Size()) return false;
+
+            value = 0;
+            for (usize i = start; i < text.Size(); i++)
+            {
+                if (!StringUtils::IsDigit(text[i])) return false;
+                value = value * 10 + (text[i] - '0');
+            }
+            if (negative) value = -value;
+            return true;
+        }
+        // {1..10}, {01..10..3} or {a..z}
+        struct Range
+        {
+            i64   From    = 0;
+            i64   To      = 0;
+            i64   Step    = 1;
+            usize Width   = 0;
+            bool  Letters = false;
+        };
+        bool ParseRange(StringView body, Range& range)
+        {
+            usize dots = body.Find(".."_sv);
+            if (dots == StringView::NPos) return false;
+
+            StringView from = body.Substr(0, dots);
+            StringView to   = body.Substr(dots + 2);
+            i64        step = 1;
+            if (usize more = to.Find(".."_sv); more != StringView::NPos)
+            {
+                if (!ParseInteger(to.Substr(more + 2), step)) return false;
+                to = to.Substr(0, more);
+            }
+
+            if (ParseInteger(from, range.From) && ParseInteger(to, range.To))
+            {
+                auto padded = [](StringView number)
+                {
+                    usize digits = number[0] == '-' || number[0] == '+';
+                    return number.Size() > digits + 1 && number[digits] == '0';
+                };
+                if (padded(from) || padded(to))
+                    range.Width = from.Size() > to.Size() ? from.Size()
+                                                          : to.Size();
+            }
+            else if (from.Size() == 1 && to.Size() == 1
+                     && isalpha(static_cast<u8>(from[0]))
+                     && isalpha(static_cast<u8>(to[0])))
+            {
+                range.Letters = true;
+                range.From    = from[0];
+                range.To      = to[0];
+            }
+            else return false;
+
+            if (step < 0) step = -step;
+            if (step == 0) step = 1;
+            range.Step = range.From <= range.To ? step : -step;
+            return true;
+        }
+
+        // Index of the first byte from pos on that is one of bytes, or with
+        // Member false the first one that is not, looked for a whole block
+        // at a time. Returns where the last partial block starts when there
+        // is none, the caller finishes the scan byte by byte
+        template <bool Member>
+        usize ScanBlocks(StringView text, usize pos, const u8* bytes)
+        {
+            [[maybe_unused]] const char* data = text.Raw();
+            [[maybe_unused]] usize       size = text.Size();
+#if defined(__AVX2__)
+            __m256i wide[4];
+            for (usize i = 0; i < 4; i++)
+                wide[i] = _mm256_set1_epi8(static_cast<char>(bytes[i]));
+            for (; pos + 32 <= size; pos += 32)
+            {
+                __m256i block = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(data + pos));
+                __m256i hits = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(block, wide[0]),
+                                    _mm256_cmpeq_epi8(block, wide[1])),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(block, wide[2]),
+                                    _mm256_cmpeq_epi8(block, wide[3])));
+                u32 mask = _mm256_movemask_epi8(hits);
+                if (!Member) mask = ~mask;
+                if (mask) return pos + __builtin_ctz(mask);
+            }
+#endif
+#if defined(__SSE2__)
+            __m128i narrow[4];
+            for (usize i = 0; i < 4; i++)
+                narrow[i] = _mm_set1_epi8(static_cast<char>(bytes[i]));
+            for (; pos + 16 <= size; pos += 16)
+            {
+                __m128i block = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(data + pos));
+                __m128i hits
+                    = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, narrow[0]),
+                                                _mm_cmpeq_epi8(block, narrow[1])),
+                                   _mm_or_si128(_mm_cmpeq_epi8(block, narrow[2]),
+                                                _mm_cmpeq_epi8(block, narrow[3])));
+                u32 mask = _mm_movemask_epi8(hits);
+                if (!Member) mask = ~mask & 0xffff;
+                if (mask) return pos + __builtin_ctz(mask);
+            }
+#endif
+            return pos;
+        }
+
+        i32 ComparePaths(const void* lhs, const void* rhs, void* context)
+        {
+            auto& paths = *static_cast<Vector<String>*>(context);
+            return strcmp(paths[*static_cast<const u32*>(lhs)].Raw(),
+                          paths[*static_cast<const u32*>(rhs)].Raw());
+        }
+
+        // The longest match at one end is length bytes long, or NPos
+        void ReplaceAnchored(StringView value, usize length,
+                             StringView replacement, char anchor,
+                             String& result)
+        {
+            if (length > value.Size()) result += value;
+            else if (anchor == '#')
+            {
+                result += replacement;
+                result += value.Substr(length);
+            }
+            else
+            {
+                result += value.Substr(0, value.Size() - length);
+                result += replacement;
+            }
+        }
+        // Matches are looked for where needle is, or everywhere when it is
+        // empty. length(start) is how long the match at start is, or NPos
+        template <typename Length>
+        void ReplaceMatches(StringView value, StringView needle, Length length,
+                            StringView replacement, bool all, String& result)
+        {
+            usize pos = 0;
+            while (pos < value.Size())
+            {
+                usize start = pos;
+                if (!needle.Empty())
+                {
+                    auto found = static_cast<const char*>(
+                        memmem(value.Raw() + pos, value.Size() - pos,
+                               needle.Raw(), needle.Size()));
+                    if (!found) break;
+                    start = found - value.Raw();
+                }
+
+                usize matched = length(start);
+                if (matched == StringView::NPos)
+                {
+                    result += value.Substr(pos, start - pos + 1);
+                    pos = start + 1;
+                    continue;
+                }
+
+                // An empty match is replaced too, and the byte after it kept
+                result += value.Substr(pos, start - pos);
+                result += replacement;
+                if (matched == 0) result += value[start++];
+                pos = start + matched;
+                if (!all) break;
+            }
+            if (pos < value.Size()) result += value.Substr(pos);
+        }
+    }; // namespace
+
+    bool Glob(StringView pattern, Vector<String>& matches)
+    {
+        if (!Pattern::IsPattern(pattern)) return false;
+
+        // Slashes inside extglob groups do not separate anything
+        Vector<Segment> segments;
+        usize           depth = 0, start = 0;
+        for (usize i = 0; i <= pattern.Size(); i++)
+        {
+            if (i < pattern.Size() && pattern[i] == '\\') ++i;
+            else if (i < pattern.Size() && pattern[i] == '(') ++depth;
+            else if (i < pattern.Size() && pattern[i] == ')' && depth) --depth;
+            else if (i == pattern.Size() || (pattern[i] == '/' && !depth))
+            {
+                if (i > start)
+                {
+                    Segment segment;
+                    segment.Text     = pattern.Substr(start, i - start);
+                    segment.Globstar = segment.Text == "**"_sv;
+                    segment.Literal  = !Pattern::IsPattern(segment.Text);
+                    segments.PushBack(segment);
+                }
+                start = i + 1;
+            }
+        }
+        bool           directories = pattern[pattern.Size() - 1] == '/';
+
+        // A non-empty GLOBIGNORE also lets patterns match hidden names
+        StringView     ignore      = Environment::GetVariable("GLOBIGNORE"_sv);
+        bool           dotted      = !ignore.Empty();
+        // Whether the ** walk left out ignored results already
+        bool           filtered    = false;
+
+        Vector<String> current;
+        current.PushBack(pattern[0] == '/' ? "/" : "");
+        for (usize i = 0; i < segments.Size() && !current.Empty(); i++)
+        {
+            auto&          segment = segments[i];
+            bool           last    = i + 1 == segments.Size();
+            Vector<String> next;
+
+            if (segment.Literal)
+            {
+                String name = Pattern::Unescape(segment.Text);
+                for (auto& path : current)
+                {
+                    String candidate = path + name;
+                    // Whatever follows will fail to list it otherwise
+                    struct stat st;
+                    if (last
+                        && fstatat(AT_FDCWD, candidate.Raw(), &st,
+                                   directories ? 0 : AT_SYMLINK_NOFOLLOW)
+                               != 0)
+                        continue;
+                    if (last && directories && !S_ISDIR(st.st_mode)) continue;
+
+                    if (!last || directories) candidate += '/';
+                    next.PushBack(Move(candidate));
+                }
+            }
+            else if (segment.Globstar)
+            {
+                // **/pattern matches while walking, nothing is listed twice
+                bool tailed = i + 2 == segments.Size() && !directories
+                           && !segments[i + 1].Literal
+                           && !segments[i + 1].Globstar;
+                filtered = last || tailed;
+                Environment::PublishSnapshot();
+                for (auto& path : current)
+                {
+                    Walk walk;
+                    walk.Tail  = tailed ? segments[i + 1].Text : StringView();
+                    walk.Files = last && !directories;
+                    walk.Final = filtered;
+                    // No directory at all is one of the choices
+                    if ((!last && !tailed) || (last && !path.Empty()))
+                        next.PushBack(path);
+                    RunWalk(walk, path, next);
+                }
+                if (tailed) ++i;
+            }
+            else
+            {
+                auto matcher = Pattern::Compile(segment.Text);
+                for (auto& path : current)
+                {
+                    auto listing = List(path);
+                    if (!listing) continue;
+
+                    for (auto& entry : listing->Entries)
+                    {
+                        StringView name = listing->NameOf(entry);
+                        if (name[0] == '.' && !dotted
+                            && !matcher->MatchesHidden())
+                            continue;
+                        if (!matcher->Matches(name)) continue;
+
+                        String candidate = path + name;
+                        if (last && !directories)
+                        {
+                            next.PushBack(Move(candidate));
+                            continue;
+                        }
+                        if (!IsDirectory(candidate, entry.Type)) continue;
+
+                        candidate += '/';
+                        next.PushBack(Move(candidate));
+                    }
+                }
+            }
+
+            current = Move(next);
+        }
+
+        if (!filtered && dotted)
+        {
+            IgnoreList ignored(ignore);
+            usize      kept = 0;
+            for (usize i = 0; i < current.Size(); i++)
+            {
+                if (ignored.Matches(current[i])) continue;
+                if (kept != i) current[kept] = Move(current[i]);
+                ++kept;
+            }
+            current.Resize(kept);
+        }
+        if (current.Empty()) return false;
+
+        bool sorted = true;
+        for (usize i = 1; sorted && i < current.Size(); i++)
+            sorted = strcmp(current[i - 1].Raw(), current[i].Raw()) <= 0;
+        if (sorted)
+        {
+            for (auto& path : current) matches.PushBack(Move(path));
+            return true;
+        }
+
+        // Names are sorted by index, Strings are never moved around
+        Vector<u32> order(current.Size());
+        for (usize i = 0; i < current.Size(); i++) order[i] = i;
+        qsort_r(order.Raw(), order.Size(), sizeof(u32), ComparePaths, &current);
+        for (u32 index : order) matches.PushBack(Move(current[index]));
+        return true;
+    }
+    bool IsPattern(StringView word) { return Pattern::IsPattern(word); }
+
+    StringView Trim(StringView value, StringView pattern, bool suffix,
+                    bool longest)
+    {
+        if (Pattern::IsPattern(pattern))
+            return Trim(value, *Pattern::Compile(pattern, suffix), suffix,
+                        longest);
+
+        String literal = Pattern::Unescape(pattern);
+        if (literal.Size() > value.Size()) return value;
+
+        usize at = suffix ? value.Size() - literal.Size() : 0;
+        if (memcmp(value.Raw() + at, literal.Raw(), literal.Size()) != 0)
+            return value;
+        return suffix ? value.Substr(0, at) : value.Substr(literal.Size());
+    }
+    StringView Trim(StringView value, Pattern::Matcher& matcher, bool suffix,
+                    bool longest)
+    {
+        usize length = matcher.Match(value, longest);
+        if (length == StringView::NPos) return value;
+        return suffix ? value.Substr(0, value.Size() - length)
+                      : value.Substr(length);
+    }
+    void Replace(StringView value, StringView pattern, StringView replacement,
+                 bool all, char anchor, String& result)
+    {
+        if (Pattern::IsPattern(pattern))
+        {
+            Replace(value, *Pattern::Compile(pattern, anchor == '%'),
+                    replacement, all, anchor, result);
+            return;
+        }
+
+        String literal = Pattern::Unescape(pattern);
+        if (anchor)
+        {
+            // Only a match at that end is replaced
+            bool matched = Trim(value, literal, anchor == '%', true).Size()
+                             + literal.Size()
+                        == value.Size();
+            ReplaceAnchored(value, matched ? literal.Size() : StringView::NPos,
+                            replacement, anchor, result);
+            return;
+        }
+        if (literal.Empty())
+        {
+            result += value;
+            return;
+        }
+
+        // Literals are found with memmem alone
+        ReplaceMatches(
+            value, literal, [&](usize) { return literal.Size(); },
+            replacement, all, result);
+    }
+    void Replace(StringView value, Pattern::Matcher& matcher,
+                 StringView replacement, bool all, char anchor,
+                 String& result)
+    {
+        if (anchor)
+        {
+            ReplaceAnchored(value, matcher.Match(value, true), replacement,
+                            anchor, result);
+            return;
+        }
+
+        // Where matches start is found in one pass over value, the DFA
+        // then only runs from those places instead of from every byte
+        Vector<u64> starts;
+        matcher.Starts(value, starts);
+        auto length = [&](usize start)
+        {
+            if (!(starts[start >> 6] & (u64(1) << (start & 63))))
+                return StringView::NPos;
+            return matcher.Match(value.Substr(start), true);
+        };
+        ReplaceMatches(value, matcher.Prefix(), length, replacement, all,
+                       result);
+        // An empty value still has its one empty match
+        if (value.Empty() && matcher.Match(value, true) == 0)
+            result += replacement;
+    }
+
+    bool HasBraces(StringView word)
+    {
+        for (usize i = 0; i < word.Size(); i++)
+        {
+            bool  comma;
+            usize end = word[i] == '{' ? BraceEnd(word, i, comma)
+                                       : StringView::NPos;
+            Range range;
+            if (end == StringView::NPos) continue;
+            if (comma || ParseRange(word.Substr(i + 1, end - i - 1), range))
+                return true;
+        }
+        return false;
+    }
+
+    Braces::Braces(StringView word)
+    {
+        Parse(word);
+        m_Done = false;
+    }
+    bool Braces::Next(String& word)
+    {
+        if (m_Done) return false;
+        if (!m_Started)
+        {
+            m_Started = true;
+            Reset(0);
+        }
+        else if (!Advance(0))
+        {
+            m_Done = true;
+            return false;
+        }
+
+        word.Clear();
+        Append(0, word);
+        return true;
+    }
+
+    u32 Braces::Parse(StringView word)
+    {
+        // Nodes are referred to by index, the vector grows while parsing
+        u32 sequence = m_Nodes.Size();
+        m_Nodes.EmplaceBack();
+        m_Nodes[sequence].Kind = Node::Kind::eSequence;
+
+        String literal;
+        auto   add = [&](Node node)
+        {
+            m_Nodes.PushBack(Move(node));
+            m_Nodes[sequence].Children.PushBack(m_Nodes.Size() - 1);
+        };
+        auto flush = [&]()
+        {
+            if (literal.Empty()) return;
+
+            Node node;
+            node.Kind = Node::Kind::eLiteral;
+            node.Text = Move(literal);
+            literal   = String();
+            add(Move(node));
+        };
+
+        for (usize i = 0; i < word.Size(); i++)
+        {
+            bool  comma = false;
+            usize end   = word[i] == '{' ? BraceEnd(word, i, comma)
+                                         : StringView::NPos;
+            Range range;
+            if (word[i] == '\\' && i + 1 < word.Size())
+            {
+                literal += word[i++];
+                literal += word[i];
+                continue;
+            }
+            // Anything else is literal, braces inside may still expand
+            if (end == StringView::NPos
+                || (!comma
+                    && !ParseRange(word.Substr(i + 1, end - i - 1), range)))
+            {
+                literal += word[i];
+                continue;
+            }
+
+            flush();
+            if (!comma)
+            {
+                Node node;
+                node.Kind    = Node::Kind::eRange;
+                node.From    = range.From;
+                node.To      = range.To;
+                node.Step    = range.Step;
+                node.Width   = range.Width;
+                node.Letters = range.Letters;
+                add(Move(node));
+                i = end;
+                continue;
+            }
+
+            Node node;
+            node.Kind = Node::Kind::eAlternatives;
+            add(Move(node));
+            u32        alternatives = m_Nodes.Size() - 1;
+
+            StringView body         = word.Substr(i + 1, end - i - 1);
+            usize      start = 0, depth = 0;
+            for (usize j = 0; j <= body.Size(); j++)
+            {
+                if (j < body.Size() && body[j] == '\\') ++j;
+                else if (j < body.Size() && body[j] == '{') ++depth;
+                else if (j < body.Size() && body[j] == '}') --depth;
+                else if (j == body.Size() || (body[j] == ',' && depth == 0))
+                {
+                    u32 choice = Parse(body.Substr(start, j - start));
+                    m_Nodes[alternatives].Children.PushBack(choice);
+                    start = j + 1;
+                }
+            }
+            i = end;
+        }
+
+        flush();
+        return sequence;
+    }
+    void Braces::Reset(u32 index)
+    {
+        auto& node = m_Nodes[index];
+        switch (node.Kind)
+        {
+            case Node::Kind::eLiteral: break;
+            case Node::Kind::eSequence:
+                for (u32 child : node.Children) Reset(child);
+                break;
+            case Node::Kind::eAlternatives:
+                node.Chosen = 0;
+                Reset(node.Children[0]);
+                break;
+            case Node::Kind::eRange: node.Current = node.From; break;
+        }
+    }
+    // Moves on to the next combination like an odometer, the last part
+    // turning fastest. False once every one was produced
+    bool Braces::Advance(u32 index)
+    {
+        auto& node = m_Nodes[index];
+        switch (node.Kind)
+        {
+            case Node::Kind::eLiteral: return false;
+            case Node::Kind::eSequence:
+                for (usize i = node.Children.Size(); i-- > 0;)
+                {
+                    if (Advance(node.Children[i])) return true;
+                    Reset(node.Children[i]);
+                }
+                return false;
+            case Node::Kind::eAlternatives:
+                if (Advance(node.Children[node.Chosen])) return true;
+                if (++node.Chosen == node.Children.Size()) return false;
+
+                Reset(node.Children[node.Chosen]);
+                return true;
+            case Node::Kind::eRange:
+            {
+                i64 next = node.Current + node.Step;
+                if (node.Step > 0 ? next > node.To : next < node.To)
+                    return false;
+
+                node.Current = next;
+                return true;
+            }
+        }
+        return false;
+    }
+    void Braces::Append(u32 index, String& word) const
+    {
+        auto& node = m_Nodes[index];
+        switch (node.Kind)
+        {
+            case Node::Kind::eLiteral: word += node.Text; break;
+            case Node::Kind::eSequence:
+                for (u32 child : node.Children) Append(child, word);
+                break;
+            case Node::Kind::eAlternatives:
+                Append(node.Children[node.Chosen], word);
+                break;
+            case Node::Kind::eRange:
+            {
+                if (node.Letters)
+                {
+                    word += static_cast<char>(node.Current);
+                    break;
+                }
+
+                bool  negative = node.Current < 0;
+                u64   value    = negative ? -static_cast<u64>(node.Current)
+                                          : node.Current;
+                char  digits[20];
+                usize count = 0;
+                do digits[count++] = '0' + value % 10;
+                while (value /= 10);
+
+                if (negative) word += '-';
+                for (usize width = count + negative; width < node.Width;
+                     width++)
+                    word += '0';
+                while (count > 0) word += digits[--count];
+                break;
+            }
+        }
+    }
+
+    Separators::Separators()
+        : Separators(" \t\n"_sv)
+    {
+    }
+    Separators::Separators(StringView ifs)
+    {
+        for (u8 c : ifs)
+        {
+            if (IsSeparator(c)) continue;
+
+            m_Any[c >> 6] |= u64(1) << (c & 63);
+            if (m_ByteCount < VECTOR_BYTES) m_Bytes[m_ByteCount] = c;
+            ++m_ByteCount;
+            if (c != ' ' && c != '\t' && c != '\n') continue;
+
+            m_Blank[c >> 6] |= u64(1) << (c & 63);
+            m_Blanks[m_BlankCount++] = c;
+        }
+
+        for (usize i = m_ByteCount; i < VECTOR_BYTES; i++)
+            m_Bytes[i] = m_Bytes[0];
+        for (usize i = m_BlankCount; i < VECTOR_BYTES; i++)
+            m_Blanks[i] = m_Blanks[0];
+    }
+
+    usize Separators::FindSeparator(StringView text, usize pos) const
+    {
+        if (m_ByteCount == 0) return text.Size();
+        if (m_ByteCount <= VECTOR_BYTES)
+            pos = ScanBlocks<true>(text, pos, m_Bytes);
+
+        while (pos < text.Size() && !IsSeparator(text[pos])) ++pos;
+        return pos;
+    }
+    usize Separators::SkipBlanks(StringView text, usize pos) const
+    {
+        // Most runs of blanks are a single space
+        if (pos >= text.Size() || !IsBlank(text[pos])) return pos;
+        pos = ScanBlocks<false>(text, pos + 1, m_Blanks);
+
+        while (pos < text.Size() && IsBlank(text[pos])) ++pos;
+        return pos;
+    }
+
+    Fields::Fields(StringView value, const Separators& separators)
+        : m_Value(value)
+        , m_Separators(separators)
+        , m_Position(separators.SkipBlanks(value, 0))
+    {
+    }
+    bool Fields::Next(StringView& field)
+    {
+        if (m_Position >= m_Value.Size()) return false;
+
+        usize start = m_Position;
+        usize end   = m_Separators.FindSeparator(m_Value, start);
+        field       = m_Value.Substr(start, end - start);
+
+        // Blanks around a separator belong to it, and a separator at the
+        // very end does not start another, empty field
+        m_Position  = m_Separators.SkipBlanks(m_Value, end);
+        if (m_Position < m_Value.Size()
+            && m_Separators.IsSeparator(m_Value[m_Position]))
+            m_Position = m_Separators.SkipBlanks(m_Value, m_Position + 1);
+        return true;
+    }
+    StringView Fields::Rest() const
+    {
+        usize end = m_Value.Size();
+        while (end > m_Position && m_Separators.IsBlank(m_Value[end - 1]))
+            --end;
+        return m_Value.Substr(m_Position, end - m_Position);
+    }
+}; // namespace Expander
@@ -6,3 +6,136 @@
  */
 #pragma once
 
+#include <Pattern.hpp>
+#include <Prism/Containers/Vector.hpp>
+#include <Prism/String/String.hpp>
+#include <Prism/String/StringView.hpp>
+
+// Brace expansion, field splitting and pathname expansion of words with
+// {a,b}, {x..y}, *, ?, [...], extglob groups or **. Directory listings are
+// cached until the directory changes, so the same glob in a loop lists
+// nothing again
+namespace Expander
+{
+    // Appends the paths matching pattern, sorted bytewise. Returns false
+    // when nothing matched, the word is then used as it is
+    bool Glob(StringView pattern, Vector<String>& matches);
+    // Whether word has anything Glob() would expand
+    bool IsPattern(StringView word);
+
+    // What is left of value once the shortest or longest match of pattern
+    // is cut off its start, or its end with suffix
+    StringView Trim(StringView value, StringView pattern, bool suffix,
+                    bool longest);
+    // Same with a compiled pattern, reversed for a suffix
+    StringView Trim(StringView value, Pattern::Matcher& matcher, bool suffix,
+                    bool longest);
+    // Appends value to result with the leftmost longest match of pattern
+    // replaced, or every one with all. Anchor # or % only replaces a match
+    // at the start or the end. Matches are looked for in a single pass
+    void       Replace(StringView value, StringView pattern,
+                       StringView replacement, bool all, char anchor,
+                       String& result);
+    // Same with a compiled pattern, reversed for anchor %
+    void       Replace(StringView value, Pattern::Matcher& matcher,
+                       StringView replacement, bool all, char anchor,
+                       String& result);
+
+    // Whether word has a {a,b} or {x..y} that Braces would expand
+    bool HasBraces(StringView word);
+    // Brace expansion of a word, one word per Next() call. Only the
+    // position in every brace is kept, so {1..10000000} or a cross product
+    // of ranges takes as little memory as a single word of it
+    class Braces
+    {
+      public:
+        Braces() = default;
+        explicit Braces(StringView word);
+
+        bool Next(String& word);
+
+      private:
+        struct Node
+        {
+            enum class Kind : u8
+            {
+                eLiteral,
+                eSequence,
+                eAlternatives,
+                eRange,
+            } Kind;
+
+            String      Text;
+            // Parts of a sequence, or choices of an alternative
+            Vector<u32> Children;
+            usize       Chosen  = 0;
+
+            i64         From    = 0;
+            i64         To      = 0;
+            i64         Step    = 1;
+            i64         Current = 0;
+            // Zero padded to this many digits, as in {01..10}
+            usize       Width   = 0;
+            bool        Letters = false;
+        };
+        Vector<Node> m_Nodes;
+        bool         m_Started = false;
+        bool         m_Done    = true;
+
+        u32          Parse(StringView word);
+        void         Reset(u32 index);
+        bool         Advance(u32 index);
+        void         Append(u32 index, String& word) const;
+    };
+
+    // The bytes of IFS. Blank ones, space, tab and newline, fold into the
+    // separator next to them and are trimmed at both ends of a value
+    class Separators
+    {
+      public:
+        // IFS when it is unset
+        Separators();
+        explicit Separators(StringView ifs);
+
+        bool IsSeparator(u8 c) const { return (m_Any[c >> 6] >> (c & 63)) & 1; }
+        bool IsBlank(u8 c) const { return (m_Blank[c >> 6] >> (c & 63)) & 1; }
+
+        // First separator at or after pos, or the size of text
+        usize FindSeparator(StringView text, usize pos) const;
+        // First byte at or after pos that is not blank
+        usize SkipBlanks(StringView text, usize pos) const;
+
+      private:
+        // Up to this many distinct separators are compared against whole
+        // blocks of 16 or 32 bytes at once, more only take the bitmap
+        static constexpr usize VECTOR_BYTES = 4;
+
+        u64                    m_Any[4]     = {};
+        u64                    m_Blank[4]   = {};
+        // Padded by repeating the first one, unused when the count is 0
+        u8                     m_Bytes[VECTOR_BYTES]  = {};
+        u8                     m_Blanks[VECTOR_BYTES] = {};
+        usize                  m_ByteCount  = 0;
+        usize                  m_BlankCount = 0;
+    };
+
+    // Field splitting of an unquoted expansion, one field per Next() call.
+    // Fields are views into the value. The separators after a field are
+    // consumed before it is returned, so the byte right after it may be
+    // overwritten, with a NUL for argv
+    class Fields
+    {
+      public:
+        Fields() = default;
+        Fields(StringView value, const Separators& separators);
+
+        bool       Next(StringView& field);
+        // Whatever the fields not taken yet span, trailing blanks dropped
+        StringView Rest() const;
+
+      private:
+        StringView m_Value;
+        Separators m_Separators;
+        usize      m_Position = 0;
+    };
+}; // namespace Expander
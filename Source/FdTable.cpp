@@ -0,0 +1,86 @@
+/*
+ * Created by v1tr10l7 on 18.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <FdTable.hpp>
+#include <Input.hpp>
+
+#include <Prism/Debug/Log.hpp>
+
+#include <fcntl.h>
+
+using namespace Prism;
+
+ErrorOr<void> FdTable::Apply(const Vector<FdAction>& actions, bool save)
+{
+    for (auto& action : actions)
+    {
+        // Saved first, so an open() landing on a closed target is undone too
+        if (save) Save(action.Fd);
+        Input::Forget(action.Fd);
+
+        i32 source = action.SourceFd;
+        if (action.Type == FdAction::Type::eOpen)
+        {
+            source = open(action.Path.Raw(), action.Flags | O_CLOEXEC, 0666);
+            if (source < 0)
+            {
+                i32 error = errno;
+                PrismError("awsh: {}: {}\n", action.Path.Raw(),
+                           strerror(error));
+                Restore();
+                return Error(error);
+            }
+        }
+
+        if (action.Type == FdAction::Type::eClose)
+        {
+            close(action.Fd);
+            continue;
+        }
+
+        // An fd that landed on its target only needs to lose O_CLOEXEC
+        if (source == action.Fd) fcntl(source, F_SETFD, 0);
+        else if (dup3(source, action.Fd, 0) < 0)
+        {
+            i32 error = errno;
+            PrismError("awsh: {}: {}\n", source, strerror(error));
+            if (action.Type == FdAction::Type::eOpen) close(source);
+            Restore();
+            return Error(error);
+        }
+
+        if (action.Type == FdAction::Type::eOpen && source != action.Fd)
+            close(source);
+    }
+
+    return {};
+}
+void FdTable::Restore()
+{
+    while (!m_Saved.Empty())
+    {
+        auto saved = m_Saved.Back();
+        m_Saved.PopBack();
+
+        Input::Forget(saved.Fd);
+        if (saved.Backup < 0)
+        {
+            close(saved.Fd);
+            continue;
+        }
+
+        dup3(saved.Backup, saved.Fd, 0);
+        close(saved.Backup);
+    }
+}
+
+void FdTable::Save(i32 fd)
+{
+    for (auto& saved : m_Saved)
+        if (saved.Fd == fd) return;
+
+    m_Saved.PushBack({fd, fcntl(fd, F_DUPFD_CLOEXEC, 10)});
+}
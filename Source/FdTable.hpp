@@ -0,0 +1,51 @@
+/*
+ * Created by v1tr10l7 on 18.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#pragma once
+
+#include <Prism/Containers/Vector.hpp>
+#include <Prism/Core/Error.hpp>
+#include <Prism/String/String.hpp>
+
+// A redirection with its target already expanded
+struct FdAction
+{
+    enum class Type
+    {
+        eOpen,      // open Path with Flags onto Fd
+        eDuplicate, // make Fd a copy of SourceFd
+        eClose,     // close Fd
+    } Type;
+
+    i32    Fd       = -1;
+    i32    Flags    = 0;
+    i32    SourceFd = -1;
+    String Path;
+};
+
+// Applies redirections to the shell's own fd table, for commands that run
+// inside the shell. Every fd is opened with O_CLOEXEC and moved into place
+// with a single dup3(), the previous fd is parked above 10 until Restore()
+class FdTable
+{
+  public:
+    ~FdTable() { Restore(); }
+
+    // Reports the failing target itself. Without save, the changes are
+    // permanent, as needed right before exec in place
+    ErrorOr<void> Apply(const Vector<FdAction>& actions, bool save = true);
+    void          Restore();
+
+  private:
+    struct Saved
+    {
+        i32 Fd;
+        i32 Backup; // -1 when Fd was not open before
+    };
+    Vector<Saved> m_Saved;
+
+    void          Save(i32 fd);
+};
@@ -0,0 +1,69 @@
+/*
+ * Created by v1tr10l7 on 18.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <Environment.hpp>
+#include <Executor.hpp>
+#include <Functions.hpp>
+
+#include <Prism/Containers/UnorderedMap.hpp>
+
+using namespace Prism;
+
+namespace Functions
+{
+    namespace
+    {
+        UnorderedMap<String, Ref<Function>> s_Functions;
+        // Arguments of every call in progress, the innermost one last. A
+        // call only sees its own, never those of its caller
+        Vector<Vector<String>>              s_Arguments;
+        bool                                s_Returning = false;
+    }; // namespace
+
+    void Define(StringView name, Ref<ASTNode> body)
+    {
+        auto function     = CreateRef<Function>();
+        function->Body    = body;
+        function->Program = Lowerer(body).Lower();
+
+        // A call that is running keeps the old definition alive
+        s_Functions[name] = function;
+    }
+    Ref<Function> Find(StringView name)
+    {
+        auto entry = s_Functions.Find(String(name));
+        if (entry == s_Functions.end()) return nullptr;
+
+        return *entry->Value;
+    }
+    bool  Empty() { return s_Functions.Empty(); }
+
+    isize Call(Ref<Function> function, Builtins::BuiltinArgs argv,
+               isize lastStatus)
+    {
+        usize          argc = argv.Size() - (!argv.Empty() && !argv.Back());
+        Vector<String> arguments;
+        arguments.Reserve(argc);
+        for (usize i = 1; i < argc; i++) arguments.PushBack(String(argv[i]));
+        s_Arguments.PushBack(Move(arguments));
+
+        Environment::PushScope(Environment::ScopeKind::eFunction);
+        isize status = Executor(function->Program, lastStatus).Execute();
+        s_Returning  = false;
+        Environment::PopScope();
+
+        s_Arguments.PopBack();
+        return status;
+    }
+    usize Depth() { return s_Arguments.Size(); }
+    const Vector<String>* Arguments()
+    {
+        return s_Arguments.Empty() ? nullptr : &s_Arguments.Back();
+    }
+
+    void  Return() { s_Returning = true; }
+    bool  IsReturning() { return s_Returning; }
+}; // namespace Functions
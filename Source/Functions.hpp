@@ -0,0 +1,37 @@
+/*
+ * Created by v1tr10l7 on 18.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#pragma once
+
+#include <Builtins.hpp>
+#include <Lowerer.hpp>
+
+namespace Functions
+{
+    // The body is lowered once, when the function is defined
+    struct Function : public RefCounted
+    {
+        Ref<ASTNode>   Body;
+        struct Program Program;
+    };
+
+    void          Define(StringView name, Ref<ASTNode> body);
+    // nullptr when name is not a function
+    Ref<Function> Find(StringView name);
+    bool          Empty();
+
+    // Runs function in a variable scope of its own, with the arguments in
+    // argv as $1... and their count as $#
+    isize         Call(Ref<Function> function, Builtins::BuiltinArgs argv,
+                       isize lastStatus);
+    usize         Depth();
+    // $1... of the innermost call, nullptr outside of a function
+    const Vector<String>* Arguments();
+
+    // Called by return, execution stops up to the innermost call
+    void          Return();
+    bool          IsReturning();
+}; // namespace Functions
@@ -0,0 +1,189 @@
+/*
+ * Created by v1tr10l7 on 18.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <Input.hpp>
+
+#include <Prism/Containers/Vector.hpp>
+
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace Prism;
+
+namespace Input
+{
+    namespace
+    {
+        // Regular files are read in big chunks, anything else only gets
+        // what is already available anyway
+        constexpr usize FILE_CHUNK = 64 * 1024;
+        constexpr usize PIPE_CHUNK = 4 * 1024;
+
+        struct Buffer
+        {
+            bool         Probed    = false;
+            bool         Seekable  = false;
+            bool         Exclusive = false;
+            usize        Start     = 0;
+            usize        End       = 0;
+            Vector<char> Data;
+        };
+        // Indexed by fd
+        Vector<Buffer> s_Buffers;
+        // Buffers holding unconsumed input, so SyncAll is free when empty
+        usize          s_Pending = 0;
+
+        Buffer&        BufferFor(i32 fd)
+        {
+            if (static_cast<usize>(fd) >= s_Buffers.Size())
+                s_Buffers.Resize(fd + 1);
+
+            auto& buffer = s_Buffers[fd];
+            if (buffer.Probed) return buffer;
+
+            struct stat st;
+            bool        regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+            buffer.Probed       = true;
+            buffer.Seekable     = lseek(fd, 0, SEEK_CUR) >= 0;
+            buffer.Data.Resize(regular ? FILE_CHUNK : PIPE_CHUNK);
+            return buffer;
+        }
+        void Consume(Buffer& buffer, usize count)
+        {
+            buffer.Start += count;
+            if (buffer.Start < buffer.End) return;
+
+            buffer.Start = buffer.End = 0;
+            --s_Pending;
+        }
+
+        // Nothing may be read past the delimiter, so this goes a byte at
+        // a time
+        ReadResult ReadUnbuffered(i32 fd, String& line, char delimiter)
+        {
+            bool any = false;
+            for (;;)
+            {
+                char  c;
+                isize nread = read(fd, &c, 1);
+                if (nread < 0 && errno == EINTR) continue;
+                if (nread < 0) return ReadResult::eError;
+                if (nread == 0)
+                    return any ? ReadResult::ePartial : ReadResult::eEnd;
+                if (c == delimiter) return ReadResult::eLine;
+
+                line += c;
+                any = true;
+            }
+        }
+    }; // namespace
+
+    ReadResult ReadLine(i32 fd, String& line, char delimiter)
+    {
+        if (fd < 0) return ReadResult::eError;
+
+        auto& buffer = BufferFor(fd);
+        if (!buffer.Seekable && !buffer.Exclusive)
+            return ReadUnbuffered(fd, line, delimiter);
+
+        bool any = false;
+        for (;;)
+        {
+            if (buffer.Start < buffer.End)
+            {
+                const char* begin = buffer.Data.Raw() + buffer.Start;
+                usize       size  = buffer.End - buffer.Start;
+                auto        found = static_cast<const char*>(
+                    memchr(begin, delimiter, size));
+                if (found)
+                {
+                    usize length = found - begin;
+                    line += StringView(begin, length);
+                    Consume(buffer, length + 1);
+                    return ReadResult::eLine;
+                }
+
+                line += StringView(begin, size);
+                Consume(buffer, size);
+                any = true;
+            }
+
+            isize nread = read(fd, buffer.Data.Raw(), buffer.Data.Size());
+            if (nread < 0 && errno == EINTR) continue;
+            if (nread < 0) return ReadResult::eError;
+            if (nread == 0)
+                return any ? ReadResult::ePartial : ReadResult::eEnd;
+
+            buffer.End = nread;
+            ++s_Pending;
+        }
+    }
+
+    ReadResult ReadAll(i32 fd, String& data)
+    {
+        if (fd < 0) return ReadResult::eError;
+
+        // Whatever a read before buffered comes first
+        auto& buffer = BufferFor(fd);
+        bool  any    = buffer.Start < buffer.End;
+        if (any)
+        {
+            data += StringView(buffer.Data.Raw() + buffer.Start,
+                               buffer.End - buffer.Start);
+            Consume(buffer, buffer.End - buffer.Start);
+        }
+
+        // Nothing is left over, so the buffer is only borrowed here
+        usize size = buffer.Data.Size() < FILE_CHUNK ? FILE_CHUNK
+                                                     : buffer.Data.Size();
+        buffer.Data.Resize(size);
+        for (;;)
+        {
+            isize nread = read(fd, buffer.Data.Raw(), size);
+            if (nread < 0 && errno == EINTR) continue;
+            if (nread < 0) return ReadResult::eError;
+            if (nread == 0) return any ? ReadResult::eLine : ReadResult::eEnd;
+
+            data += StringView(buffer.Data.Raw(), nread);
+            any = true;
+        }
+    }
+
+    void Sync(i32 fd)
+    {
+        if (fd < 0 || static_cast<usize>(fd) >= s_Buffers.Size()) return;
+
+        auto& buffer = s_Buffers[fd];
+        if (buffer.Start == buffer.End) return;
+
+        // Unconsumed input of an exclusive pipe has nowhere to go back to
+        if (buffer.Seekable)
+            lseek(fd, -static_cast<off_t>(buffer.End - buffer.Start),
+                  SEEK_CUR);
+        buffer.Start = buffer.End = 0;
+        --s_Pending;
+    }
+    void SyncAll()
+    {
+        for (usize fd = 0; s_Pending > 0 && fd < s_Buffers.Size(); fd++)
+            Sync(fd);
+    }
+    void Forget(i32 fd)
+    {
+        if (fd < 0 || static_cast<usize>(fd) >= s_Buffers.Size()) return;
+
+        Sync(fd);
+        s_Buffers[fd].Probed    = false;
+        s_Buffers[fd].Exclusive = false;
+    }
+
+    void SetExclusive(i32 fd)
+    {
+        if (fd < 0) return;
+        BufferFor(fd).Exclusive = true;
+    }
+}; // namespace Input
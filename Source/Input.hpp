@@ -0,0 +1,44 @@
+/*
+ * Created by v1tr10l7 on 18.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#pragma once
+
+#include <Prism/String/String.hpp>
+
+// Line input for the read builtin. Every fd gets a buffer that lives across
+// calls, so a loop of reads costs one syscall per buffer, not per byte.
+// Input buffered past the end of a line is only a problem once someone else
+// reads the fd, so it is handed back lazily, by seeking back, right before
+// that can happen
+namespace Input
+{
+    enum class ReadResult
+    {
+        eLine,
+        // End of input after some text, without the delimiter
+        ePartial,
+        eEnd,
+        eError,
+    };
+
+    // Appends the next line from fd to line, without the delimiter
+    ReadResult ReadLine(i32 fd, String& line, char delimiter = '\n');
+    // Appends everything left until the end of input, eEnd once there was
+    // nothing left
+    ReadResult ReadAll(i32 fd, String& data);
+
+    // Seeks back over what was buffered but not consumed yet, must be called
+    // before anything other than ReadLine reads the fd
+    void       Sync(i32 fd);
+    void       SyncAll();
+    // The fd is about to point somewhere else, drops its buffer
+    void       Forget(i32 fd);
+
+    // Input that only the shell reads, e.g. a pipe redirected into a loop of
+    // builtins, may be buffered even though it can not be sought back.
+    // Cleared by Forget
+    void       SetExclusive(i32 fd);
+}; // namespace Input
@@ -0,0 +1,347 @@
+/*
+ * Created by v1tr10l7 on 18.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <Builtins.hpp>
+#include <Jobs.hpp>
+#include <Trace.hpp>
+
+#include <Prism/Containers/UnorderedMap.hpp>
+#include <Prism/Containers/Vector.hpp>
+#include <Prism/Debug/Log.hpp>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+
+using namespace Prism;
+
+namespace Jobs
+{
+    namespace
+    {
+        constexpr usize           MAX_EVENTS = 64;
+
+        // Indexed by job number - 1, finished slots are recycled
+        Vector<Job>               s_Jobs;
+        Vector<usize>             s_FreeSlots;
+        UnorderedMap<pid_t, usize> s_PidIndex;
+
+        // Background jobs in the order they finished, consumed by wait -n
+        struct Finished
+        {
+            usize Index;
+            pid_t Pid;
+        };
+        Vector<Finished>          s_Finished;
+        usize                     s_FinishedHead      = 0;
+        usize                     s_RunningBackground = 0;
+
+        i32                       s_EpollFd           = -1;
+        usize                     s_FallbackCount     = 0;
+        pid_t                     s_LastBackgroundPid = 0;
+        usize                     s_ChildCount        = 0;
+        i32                       s_UsageLogFd        = -1;
+
+        i32 PidFdOpen(pid_t pid)
+        {
+            return static_cast<i32>(syscall(SYS_pidfd_open, pid, 0));
+        }
+        i32 DecodeStatus(i32 wstatus)
+        {
+            if (WIFEXITED(wstatus)) return WEXITSTATUS(wstatus);
+            if (WIFSIGNALED(wstatus)) return 128 + WTERMSIG(wstatus);
+            return 1;
+        }
+
+        u64 ToMicroseconds(const timeval& tv)
+        {
+            return static_cast<u64>(tv.tv_sec) * 1000000 + tv.tv_usec;
+        }
+
+        void Finish(usize index, i32 wstatus, const rusage& usage)
+        {
+            auto& job                     = s_Jobs[index];
+            job.Done                      = true;
+            job.Status                    = DecodeStatus(wstatus);
+            job.Usage.WallTime            = MonotonicTime() - job.StartTime;
+            job.Usage.UserTime            = ToMicroseconds(usage.ru_utime);
+            job.Usage.SystemTime          = ToMicroseconds(usage.ru_stime);
+            job.Usage.MaxResidentSize     = usage.ru_maxrss;
+            job.Usage.VoluntarySwitches   = usage.ru_nvcsw;
+            job.Usage.InvoluntarySwitches = usage.ru_nivcsw;
+            if (s_UsageLogFd >= 0)
+                LogUsage(job.Command, job.Pid, job.Status, job.Usage);
+            if (Trace::IsEnabled())
+                Trace::Complete(job.Command, "child", job.StartTime,
+                                job.Usage.WallTime, job.Pid);
+
+            if (job.Background)
+            {
+                --s_RunningBackground;
+                s_Finished.PushBack({index, job.Pid});
+            }
+
+            if (job.PidFd < 0)
+            {
+                --s_FallbackCount;
+                return;
+            }
+
+            epoll_ctl(s_EpollFd, EPOLL_CTL_DEL, job.PidFd, nullptr);
+            close(job.PidFd);
+            job.PidFd = -1;
+        }
+        void Remove(Job& job)
+        {
+            s_PidIndex.Erase(job.Pid);
+            s_FreeSlots.PushBack(job.Number - 1);
+
+            job = Job{};
+        }
+        bool Collect(usize index, bool block)
+        {
+            auto&  job     = s_Jobs[index];
+            i32    wstatus = 0;
+            pid_t  pid     = 0;
+            rusage usage{};
+            do pid = wait4(job.Pid, &wstatus, block ? 0 : WNOHANG, &usage);
+            while (pid < 0 && errno == EINTR);
+
+            if (pid == 0) return false;
+            // Someone else already reaped it, report it as failed
+            if (pid < 0) wstatus = 0x7f00;
+
+            Finish(index, wstatus, usage);
+            return true;
+        }
+
+        // Waits for at least one pidfd to become readable, returns whether
+        // anything was reaped
+        bool Poll(i32 timeout)
+        {
+            bool reaped = false;
+            if (s_FallbackCount > 0)
+            {
+                for (usize i = 0; i < s_Jobs.Size(); i++)
+                {
+                    auto& job = s_Jobs[i];
+                    if (job.Pid && !job.Done && job.PidFd < 0)
+                        reaped |= Collect(i, false);
+                }
+
+                // Without pidfds there is nothing to sleep on
+                if (reaped || s_EpollFd < 0) return reaped;
+                if (timeout < 0) timeout = 10;
+            }
+            if (s_EpollFd < 0) return reaped;
+
+            epoll_event events[MAX_EVENTS];
+            i32 count = epoll_wait(s_EpollFd, events, MAX_EVENTS, timeout);
+            for (i32 i = 0; i < count; i++)
+                reaped |= Collect(events[i].data.u64, false);
+
+            return reaped;
+        }
+    }; // namespace
+
+    usize Add(pid_t pid, StringView command, bool background, u64 start)
+    {
+        usize index = s_Jobs.Size();
+        if (!s_FreeSlots.Empty())
+        {
+            index = s_FreeSlots.Back();
+            s_FreeSlots.PopBack();
+        }
+        else s_Jobs.EmplaceBack();
+
+        ++s_ChildCount;
+        auto& job      = s_Jobs[index];
+        job.Number     = index + 1;
+        job.Pid        = pid;
+        job.Background = background;
+        job.Command    = command;
+        job.StartTime  = start;
+        s_PidIndex[pid] = index;
+        if (background)
+        {
+            s_LastBackgroundPid = pid;
+            ++s_RunningBackground;
+        }
+
+        if (s_EpollFd < 0) s_EpollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (s_EpollFd >= 0) job.PidFd = PidFdOpen(pid);
+        if (job.PidFd >= 0)
+        {
+            fcntl(job.PidFd, F_SETFD, FD_CLOEXEC);
+
+            epoll_event event{};
+            event.events   = EPOLLIN;
+            event.data.u64 = index;
+            if (epoll_ctl(s_EpollFd, EPOLL_CTL_ADD, job.PidFd, &event) == 0)
+                return job.Number;
+
+            close(job.PidFd);
+            job.PidFd = -1;
+        }
+
+        // Old kernel, or out of fds, this child falls back to waitpid()
+        ++s_FallbackCount;
+        return job.Number;
+    }
+    void ResetAfterFork()
+    {
+        Trace::DisableAfterFork();
+
+        if (s_EpollFd >= 0) close(s_EpollFd);
+        for (auto& job : s_Jobs)
+            if (job.PidFd >= 0) close(job.PidFd);
+
+        s_Jobs.Clear();
+        s_FreeSlots.Clear();
+        s_PidIndex.Clear();
+        s_Finished.Clear();
+        s_FinishedHead      = 0;
+        s_RunningBackground = 0;
+        s_EpollFd           = -1;
+        s_FallbackCount     = 0;
+    }
+
+    i32 Wait(pid_t pid, ResourceUsage* usage)
+    {
+        auto entry = s_PidIndex.Find(pid);
+        if (entry == s_PidIndex.end()) return 127;
+
+        usize        index = *entry->Value;
+        Trace::Scope scope("wait", "wait");
+        if (!s_Jobs[index].Done && s_Jobs[index].PidFd < 0)
+            Collect(index, true);
+        while (!s_Jobs[index].Done) Poll(-1);
+
+        i32 status = s_Jobs[index].Status;
+        if (usage) *usage = s_Jobs[index].Usage;
+
+        Remove(s_Jobs[index]);
+        return status;
+    }
+    Optional<i32> WaitAny()
+    {
+        for (;;)
+        {
+            while (s_FinishedHead < s_Finished.Size())
+            {
+                auto [index, pid] = s_Finished[s_FinishedHead++];
+                auto& job         = s_Jobs[index];
+                // Already consumed by wait <pid> or jobs
+                if (job.Pid != pid || !job.Done) continue;
+
+                i32 status = job.Status;
+                Remove(job);
+                return status;
+            }
+
+            s_Finished.Clear();
+            s_FinishedHead = 0;
+            if (s_RunningBackground == 0) return NullOpt;
+
+            Poll(-1);
+        }
+    }
+    void WaitAll()
+    {
+        while (WaitAny());
+    }
+    void Reap()
+    {
+        while (Poll(0));
+    }
+
+    Job* FindByPid(pid_t pid)
+    {
+        auto entry = s_PidIndex.Find(pid);
+        if (entry == s_PidIndex.end()) return nullptr;
+
+        return &s_Jobs[*entry->Value];
+    }
+    Job* FindByNumber(usize number)
+    {
+        if (number == 0 || number > s_Jobs.Size()) return nullptr;
+
+        auto& job = s_Jobs[number - 1];
+        return job.Pid ? &job : nullptr;
+    }
+    pid_t LastBackgroundPid() { return s_LastBackgroundPid; }
+    usize ChildCount() { return s_ChildCount; }
+
+    void  List(bool onlyFinished)
+    {
+        Reap();
+        for (auto& job : s_Jobs)
+        {
+            if (!job.Pid || !job.Background) continue;
+            if (onlyFinished && !job.Done) continue;
+
+            char line[64];
+            snprintf(line, sizeof(line), "[%zu] %d %s\t", job.Number,
+                     job.Pid, job.Done ? "Done" : "Running");
+            Builtins::Write(line);
+            Builtins::Write(job.Command);
+            Builtins::Write("\n");
+
+            if (job.Done) Remove(job);
+        }
+
+        Builtins::Flush();
+    }
+
+    u64 MonotonicTime()
+    {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        return static_cast<u64>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+    }
+    String FormatDuration(u64 microseconds)
+    {
+        u64  minutes = microseconds / 60000000;
+        u64  millis  = (microseconds / 1000) % 60000;
+
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%llum%llu.%03llus",
+                 static_cast<unsigned long long>(minutes),
+                 static_cast<unsigned long long>(millis / 1000),
+                 static_cast<unsigned long long>(millis % 1000));
+        return buffer;
+    }
+    void EnableUsageLog(i32 fd) { s_UsageLogFd = fd; }
+    bool IsUsageLogEnabled() { return s_UsageLogFd >= 0; }
+    void LogUsage(StringView command, pid_t pid, i32 status,
+                  const ResourceUsage& usage)
+    {
+        if (s_UsageLogFd < 0) return;
+
+        String line = "{\"command\":\"";
+        Trace::AppendEscaped(line, command);
+
+        char fields[256];
+        snprintf(fields, sizeof(fields),
+                 "\",\"pid\":%d,\"status\":%d,\"wall_us\":%llu,"
+                 "\"user_us\":%llu,\"sys_us\":%llu,\"max_rss_kb\":%lld,"
+                 "\"nvcsw\":%lld,\"nivcsw\":%lld}\n",
+                 pid, status, static_cast<unsigned long long>(usage.WallTime),
+                 static_cast<unsigned long long>(usage.UserTime),
+                 static_cast<unsigned long long>(usage.SystemTime),
+                 static_cast<long long>(usage.MaxResidentSize),
+                 static_cast<long long>(usage.VoluntarySwitches),
+                 static_cast<long long>(usage.InvoluntarySwitches));
+        line += fields;
+
+        // A single write keeps lines whole when several shells share the fd
+        write(s_UsageLogFd, line.Raw(), line.Size());
+    }
+}; // namespace Jobs
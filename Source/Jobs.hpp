@@ -0,0 +1,77 @@
+/*
+ * Created by v1tr10l7 on 18.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#pragma once
+
+#include <Prism/String/String.hpp>
+#include <Prism/Utility/Optional.hpp>
+
+#include <sys/types.h>
+
+namespace Jobs
+{
+    // All times are in microseconds
+    struct ResourceUsage
+    {
+        u64 WallTime            = 0;
+        u64 UserTime            = 0;
+        u64 SystemTime          = 0;
+        i64 MaxResidentSize     = 0; // KiB
+        i64 VoluntarySwitches   = 0;
+        i64 InvoluntarySwitches = 0;
+    };
+    struct Job
+    {
+        usize         Number     = 0;
+        pid_t         Pid        = 0;
+        i32           PidFd      = -1;
+        i32           Status     = 0;
+        bool          Background = false;
+        bool          Done       = false;
+        String        Command;
+
+        u64           StartTime = 0;
+        ResourceUsage Usage;
+    };
+
+    // Every child of the shell is tracked here. Children get a pidfd which
+    // is watched by a single epoll set, so any number of them are reaped
+    // as they exit, without polling waitpid(). start is the MonotonicTime()
+    // taken right before the fork or spawn, so its cost counts as well
+    usize         Add(pid_t pid, StringView command, bool background,
+                      u64 start);
+    // Must be called in a forked child that keeps running shell code, so
+    // it does not share the epoll set, job table and trace of its parent
+    void          ResetAfterFork();
+
+    // Blocks until the child exits and returns its exit status
+    i32           Wait(pid_t pid, ResourceUsage* usage = nullptr);
+    // wait -n, returns NullOpt when there are no background jobs
+    Optional<i32> WaitAny();
+    // Plain wait, the statuses of the jobs are discarded
+    void          WaitAll();
+    // Reaps whatever has already exited, never blocks
+    void          Reap();
+
+    Job*          FindByPid(pid_t pid);
+    Job*          FindByNumber(usize number);
+    pid_t         LastBackgroundPid();
+    // Number of children started since startup
+    usize         ChildCount();
+
+    // Writes the background job table, and forgets finished jobs
+    void          List(bool onlyFinished = false);
+
+    u64           MonotonicTime();
+    // Formats like bash's time, e.g. 0m1.250s
+    String        FormatDuration(u64 microseconds);
+    // Once enabled, one JSON line describing the resource usage of every
+    // executed command is written to fd
+    void          EnableUsageLog(i32 fd);
+    bool          IsUsageLogEnabled();
+    void          LogUsage(StringView command, pid_t pid, i32 status,
+                           const ResourceUsage& usage);
+}; // namespace Jobs
@@ -24,6 +24,8 @@ static constexpr OperatorDef s_Operators[] = {
     {"<>", TokenType::eLeftGreater},
     {"<|", TokenType::eLess},
     {"<&", TokenType::eLessAmpersand},
+    {">&", TokenType::eGreaterAmpersand},
+    {">|", TokenType::eGreaterPipe},
     {"&>|", TokenType::eAmpersandGreaterPipe},
     {"&>", TokenType::eAmpersandGreater},
     {"&|", TokenType::eAmpersandPipe},
@@ -43,11 +45,26 @@ static constexpr OperatorDef s_Operators[] = {
     {"<", TokenType::eLess},
     {">", TokenType::eGreater},
     {"=", TokenType::eAssign},
+    {"+=", TokenType::eAppendAssign},
 };
 
 static constexpr StringView s_ShellKeywords[]
     = {"if", "then", "else", "elif", "fi", "for",      "while", "until",
        "do", "done", "case", "esac", "in", "function", "select"};
+static bool IsName(StringView s)
+{
+    if (s.Empty() || StringUtils::IsDigit(s[0])) return false;
+    for (char c : s)
+        if (!StringUtils::IsAlphanumeric(c) && c != '_') return false;
+    return true;
+}
+// NAME[subscript], which an assignment may start with
+static bool IsSubscripted(StringView s)
+{
+    usize open = s.Find("["_sv);
+    return open != StringView::NPos && s.Size() > open + 1
+        && s[s.Size() - 1] == ']' && IsName(s.Substr(0, open));
+}
 static bool IsKeyword(StringView s)
 {
     for (auto kw : s_ShellKeywords)
@@ -61,19 +78,41 @@ Vector<Token>& Lexer::Analyze()
     Token tok;
     do
     {
-        tok = NextToken();
+        usize start = m_CurrentPos;
+        tok         = NextToken();
+        tok.Joined  = !m_Tokens.Empty() && tok.Offset == start;
 #if 0
         PrismMessage("Token: {}, Type: {}\n", tok.Text,
                      StringUtils::ToString(tok.Type));
 #endif
 
         m_Tokens.PushBack(tok);
+        if (!m_PendingHereDocs.Empty()
+            && (tok.Type == TokenType::eShiftLeft
+                || tok.Type == TokenType::eShiftLeftHyphen))
+        {
+            auto& hd      = m_PendingHereDocs.Back();
+            hd.TokenIndex = m_Tokens.Size();
+            m_Tokens.PushBack({hd.AllowExpansion ? TokenType::eHereDoc
+                                                 : TokenType::eHereDocLiteral,
+                               "", tok.Offset});
+        }
     } while (tok.Type != TokenType::eEndOfFile
              && tok.Type != TokenType::eUnknown);
 
     return m_Tokens;
 }
 
+bool Lexer::FollowsName() const
+{
+    if (m_Tokens.Empty()) return false;
+
+    auto& last = m_Tokens.Back();
+    return last.Type == TokenType::eIdentifier
+        && last.Offset + last.Text.Size() == m_CurrentPos
+        && (IsName(last.Text) || IsSubscripted(last.Text));
+}
+
 void Lexer::SkipWhitespace()
 {
     while (Peek() == ' ' || Peek() == '\t') Advance();
@@ -83,6 +122,8 @@ Token Lexer::LexIdentifier()
 {
     usize start   = m_CurrentPos;
     bool  hasGlob = false;
+    // Open extglob groups, | and ) only belong to the word inside one
+    usize groups  = 0;
 
     for (;;)
     {
@@ -90,17 +131,45 @@ Token Lexer::LexIdentifier()
 
         // Standard word characters
         if (StringUtils::IsAlphanumeric(c) || c == '_' || c == '-' || c == '.'
-            || c == '/')
+            || c == '/' || c == ':' || c == '%' || c == '~' || c == '^')
+            Advance();
+        // Only NAME= and NAME[subscript]= start an assignment, in any
+        // other word = is literal
+        else if (c == '='
+                 && !IsName(m_Input.Substr(start, m_CurrentPos - start))
+                 && !IsSubscripted(m_Input.Substr(start, m_CurrentPos - start)))
             Advance();
+        // Same for NAME+= and NAME[subscript]+=
+        else if (c == '+' && PeekNext() == '='
+                 && (IsName(m_Input.Substr(start, m_CurrentPos - start))
+                     || IsSubscripted(
+                         m_Input.Substr(start, m_CurrentPos - start))))
+            break;
+        // The subscript of NAME[subscript]= is not a glob, and may have
+        // blanks in it
+        else if (c == '[' && !hasGlob
+                 && IsName(m_Input.Substr(start, m_CurrentPos - start))
+                 && SubscriptEnd() != StringView::NPos)
+            m_CurrentPos = SubscriptEnd() + 1;
         // Glob characters
         else if (c == '*' || c == '?' || c == '[' || c == ']' || c == '!'
-                 || c == '@' || c == '+' || c == '|')
+                 || c == '@' || c == '+' || (c == '|' && groups > 0))
         {
             hasGlob = true;
             Advance();
         }
-        // Handle nested parens in globs (e.g., @(a|b))
-        else if (hasGlob && (c == '(' || c == ')')) Advance();
+        // Handle nested parens in globs (e.g., @(a|b)), a ) of its own
+        // closes a case pattern like *)
+        else if (hasGlob && c == '(')
+        {
+            ++groups;
+            Advance();
+        }
+        else if (c == ')' && groups > 0)
+        {
+            --groups;
+            Advance();
+        }
         else break;
     }
 
@@ -180,7 +249,26 @@ Token Lexer::LexDoubleQuoteString()
     String str = m_Input.Substr(start, m_CurrentPos - start);
     Advance();
     m_State = LexerState::eNormal;
-    return {TokenType::eString, str, start - 1};
+    return {TokenType::eQuotedString, str, start - 1};
+}
+
+usize Lexer::SubscriptEnd() const
+{
+    usize depth = 0;
+    for (usize i = m_CurrentPos; i < m_Input.Size(); i++)
+    {
+        char c = m_Input[i];
+        if (c == '\n') break;
+        if (c == '[') ++depth;
+        else if (c == ']' && --depth == 0)
+        {
+            StringView rest = StringView(m_Input).Substr(i + 1);
+            return rest.StartsWith("="_sv) || rest.StartsWith("+="_sv)
+                     ? i
+                     : StringView::NPos;
+        }
+    }
+    return StringView::NPos;
 }
 
 Token Lexer::LexVariable()
@@ -191,21 +279,34 @@ Token Lexer::LexVariable()
 
     if (Peek() == '{')
     {
-        Advance();
-        while (StringUtils::IsAlphanumeric(Peek()) || Peek() == '_'
-               || Peek() == ':' || Peek() == '-' || Peek() == '?'
-               || Peek() == '/')
-            Advance();
+        // Operands like ${v//a b/c} or ${v:-${w}} run up to the matching }
+        usize depth = 0;
+        for (char quote = 0; Peek() != '\0'; Advance())
+        {
+            char c = Peek();
+            if (quote)
+            {
+                if (c == quote) quote = 0;
+                else if (c == '\\' && quote == '"' && PeekNext()) Advance();
+                continue;
+            }
+
+            if (c == '\\' && PeekNext()) Advance();
+            else if (c == '\'' || c == '"') quote = c;
+            else if (c == '{') ++depth;
+            else if (c == '}' && --depth == 0) break;
+        }
         if (Peek() != '}')
             ReportError(start, "Unterminated variable expansion");
         else Advance();
     }
-    else if (Peek() == '?') Advance();
+    else if (Peek() == '?' || Peek() == '!' || Peek() == '#') Advance();
     else
         while (StringUtils::IsAlphanumeric(Peek()) || Peek() == '_') Advance();
 
+    // Like other tokens, the offset is where its text starts in the input
     return {TokenType::eVariable, m_Input.Substr(start, m_CurrentPos - start),
-            start};
+            start - 1};
 }
 
 Token Lexer::LexCommandSubstitution()
@@ -241,29 +342,28 @@ Token Lexer::LexBacktick()
             m_Input.Substr(start, m_CurrentPos - start), start - 1};
 }
 
-Token Lexer::LexArithmetic()
+Token Lexer::LexArithmetic(bool command)
 {
-    usize tokenStart   = m_CurrentPos - 3; // $((
+    usize tokenStart   = m_CurrentPos - (command ? 2 : 3); // (( or $((
     usize contentStart = m_CurrentPos;
-    i32   depth        = 1;
+    i32   depth        = 0;
 
-    while (depth > 0 && Peek() != '\0')
+    // Parentheses inside nest, the first )) outside all of them ends it
+    while (Peek() != '\0' && (depth > 0 || Peek() != ')' || PeekNext() != ')'))
     {
-        if (Peek() == '(' && m_CurrentPos > 1
-            && m_Input[m_CurrentPos - 2] == '$')
-            ++depth;
+        if (Peek() == '(') ++depth;
         else if (Peek() == ')') --depth;
         Advance();
     }
 
-    if (depth != 0)
+    String text = m_Input.Substr(contentStart, m_CurrentPos - contentStart);
+    if (Peek() == '\0')
         ReportError(tokenStart, "Unterminated arithmetic expression");
-    String text = m_Input.Substr(contentStart,
-                                 m_CurrentPos - contentStart - (depth == 0));
-    Advance(); // Consume the final ')'
+    else Advance(2);
 
     m_State = LexerState::eNormal;
-    return {TokenType::eArithmetic, Move(text), tokenStart};
+    return {command ? TokenType::eArithmeticCommand : TokenType::eArithmetic,
+            Move(text), tokenStart};
 }
 
 Token Lexer::LexHereDoc(String delimiter, bool allowExpansion)
@@ -298,7 +398,10 @@ Token Lexer::NextToken()
 {
     SkipWhitespace();
     if (m_CurrentPos >= m_Input.Size())
+    {
+        ConsumePendingHereDocs();
         return {TokenType::eEndOfFile, "", m_CurrentPos};
+    }
 
     Token tok;
     switch (m_State)
@@ -313,7 +416,10 @@ Token Lexer::NextToken()
             if (Peek() == '\n')
             {
                 Advance();
-                return {TokenType::eNewLine, "\n", m_CurrentPos - 1};
+                // Bodies start on the line after their operators
+                usize offset = m_CurrentPos - 1;
+                ConsumePendingHereDocs();
+                return {TokenType::eNewLine, "\n", offset};
             }
             if (Peek() == '#') return LexComment();
             if (Peek() == '\'')
@@ -340,6 +446,12 @@ Token Lexer::NextToken()
                 m_State = LexerState::eDollarParen;
                 return LexCommandSubstitution();
             }
+            if (Peek() == '(' && PeekNext() == '(')
+            {
+                Advance(2);
+                m_State = LexerState::eArithmetic;
+                return LexArithmetic(true);
+            }
             if (Peek() == '`')
             {
                 Advance();
@@ -347,6 +459,10 @@ Token Lexer::NextToken()
                 return LexBacktick();
             }
             if (Peek() == '$') return LexVariable();
+            // A = that does not follow a name is a word, as in [ a = b ]
+            if ((Peek() == '=' || (Peek() == '+' && PeekNext() == '='))
+                && !FollowsName())
+                return LexWord();
 
             Token op;
             if (TryMatchOperator(op))
@@ -373,10 +489,18 @@ Token Lexer::NextToken()
 
                     return LexHereDoc(delimiter);
 #else
-                    String delimiter
-                        = m_Input.Substr(start, m_CurrentPos - start);
-                    RegisterHereDoc(Move(delimiter),
-                                    op.Type == TokenType::eShiftLeft);
+                    // Any quoting of the delimiter disables expansion
+                    String delimiter;
+                    bool   quoted = false;
+                    for (usize i = start; i < m_CurrentPos; i++)
+                    {
+                        char c = m_Input[i];
+                        if (c == '\'' || c == '"' || c == '\\')
+                            quoted = true;
+                        else delimiter += c;
+                    }
+                    RegisterHereDoc(Move(delimiter), !quoted,
+                                    op.Type == TokenType::eShiftLeftHyphen);
 #endif
                 }
                 return op;
@@ -418,11 +542,13 @@ Token Lexer::NextToken()
     return tok;
 }
 
-void Lexer::RegisterHereDoc(StringView delimiter, bool allowExpansion)
+void Lexer::RegisterHereDoc(StringView delimiter, bool allowExpansion,
+                            bool stripTabs)
 {
     m_PendingHereDocs.PushBack({
         .Delimiter      = Move(delimiter),
         .AllowExpansion = allowExpansion,
+        .StripTabs      = stripTabs,
     });
 }
 Token Lexer::ConsumeHereDoc(const PendingHereDoc& hd)
@@ -433,6 +559,8 @@ Token Lexer::ConsumeHereDoc(const PendingHereDoc& hd)
     while (m_CurrentPos < m_Input.Size())
     {
         String line;
+        if (hd.StripTabs)
+            while (Peek() == '\t') Advance();
         while (Peek() != '\n' && Peek() != '\0')
         {
             line += Peek();
@@ -455,6 +583,18 @@ Token Lexer::ConsumeHereDoc(const PendingHereDoc& hd)
     return {TokenType::eUnknown, Move(content), start};
 }
 
+void Lexer::ConsumePendingHereDocs()
+{
+    for (auto& hd : m_PendingHereDocs)
+    {
+        auto body = ConsumeHereDoc(hd);
+        if (hd.TokenIndex < m_Tokens.Size())
+            m_Tokens[hd.TokenIndex].Text = Move(body.Text);
+    }
+
+    m_PendingHereDocs.Clear();
+}
+
 void Lexer::ReportError(usize line, StringView message)
 {
     if (m_LogErrors) PrismError("{}: {}\n", line, message);
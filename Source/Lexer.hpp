@@ -23,7 +23,7 @@ enum class LexerState
     eDollarParen, // $(...)
     eBacktick,    // `...`
     eHereDoc,     // <<EOF ... EOF
-    eArithmetic,  // $(( ... ))
+    eArithmetic,  // $(( ... )) or (( ... ))
 };
 
 class Lexer
@@ -56,6 +56,10 @@ class Lexer
     {
         String Delimiter;
         bool   AllowExpansion;
+        bool   StripTabs  = false;
+        // The body token, placed right after its operator and filled in
+        // once the line holding the operator ends
+        usize  TokenIndex = 0;
     };
 
     Vector<PendingHereDoc> m_PendingHereDocs;
@@ -72,12 +76,17 @@ class Lexer
     }
     void                  Advance(usize n = 1) { m_CurrentPos += n; }
     void                  SkipWhitespace();
+    // Whether the last token is a name right before the cursor, as in NAME=
+    bool                  FollowsName() const;
+    // The ] closing the [ at the cursor when an = follows it, or NPos
+    usize                 SubscriptEnd() const;
 
     inline constexpr bool IsWordStart(u8 c) const
     {
         return StringUtils::IsAlphanumeric(c) || c == '_' || c == '/'
             || c == '-' || c == '.' || c == '*' || c == '[' || c == ']'
-            || c == '!' || c == '@' || c == '+' || c == '?'; // Added @, +, ?
+            || c == '!' || c == '@' || c == '+' || c == '?' // Added @, +, ?
+            || c == ':' || c == '%' || c == '~' || c == '^';
     }
     Token LexWord();
     bool  TryMatchOperatorPeek();
@@ -88,12 +97,15 @@ class Lexer
     Token LexVariable();
     Token LexCommandSubstitution();
     Token LexBacktick();
-    Token LexArithmetic();
+    // command is (( )) on its own, without the $
+    Token LexArithmetic(bool command = false);
     Token LexHereDoc(String delimiter, bool allowExpansion = true);
     bool  TryMatchOperator(Token& out);
 
-    void  RegisterHereDoc(StringView delimiter, bool allowExpansion);
+    void  RegisterHereDoc(StringView delimiter, bool allowExpansion,
+                          bool stripTabs = false);
     Token ConsumeHereDoc(const PendingHereDoc& hd);
+    void  ConsumePendingHereDocs();
 
     void  ReportError(usize line, StringView message);
 };
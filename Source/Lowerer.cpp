@@ -4,10 +4,16 @@
  *
  * SPDX-License-Identifier: GPL-3
  */
+#include <Builtins.hpp>
+#include <Expander.hpp>
+#include <Lexer.hpp>
 #include <Lowerer.hpp>
+#include <Parser.hpp>
+#include <Prism/Debug/Log.hpp>
 
-Lowerer::Lowerer(Ref<ASTNode> node)
+Lowerer::Lowerer(Ref<ASTNode> node, bool execTail)
     : AST(node)
+    , ExecTail(execTail)
 {
 }
 
@@ -16,21 +22,53 @@ isize Lowerer::AddWord(Ref<Word> w)
     Program.WordTable.PushBack(w);
     return Program.WordTable.Size() - 1;
 }
-isize Lowerer::Emit(OpCode op, int arg0, isize arg1)
+isize Lowerer::Emit(OpCode op, int arg0, isize arg1, i32 payload)
 {
-    Program.Instructions.PushBack({op, arg0, arg1, -1});
+    Program.Instructions.PushBack({op, arg0, arg1, payload});
     return Program.Instructions.Size() - 1;
 }
+isize Lowerer::AddPattern(StringView pattern, bool reversed)
+{
+    Program.Patterns.PushBack(Pattern::Compile(pattern, reversed));
+    return Program.Patterns.Size() - 1;
+}
+isize Lowerer::AddRegex(StringView regex)
+{
+    auto compiled = Pattern::CompileRegex(regex);
+    if (!compiled) return -1;
+
+    Program.Regexes.PushBack(compiled);
+    return Program.Regexes.Size() - 1;
+}
+void Lowerer::PatchJump(isize index)
+{
+    Program.Instructions[index].Arg0
+        = static_cast<isize>(Program.Instructions.Size() - index - 1);
+}
 
 struct Program Lowerer::Lower()
 {
     auto node = AST;
     LowerNode(node);
 
+    // Only a top-level command that is the very last instruction may exec
+    // in place of the shell, every jump past it lands on the end anyway
+    isize last = static_cast<isize>(Program.Instructions.Size()) - 1;
+    if (ExecTail && LastTopLevelExec >= 0 && LastTopLevelExec == last)
+    {
+        // Builtins still run in the shell, names that are only known after
+        // expansion are checked again by the executor
+        auto& exec = Program.Instructions[last];
+        auto& word = Program.WordTable[exec.Arg0];
+        if (!word->Atoms.Empty() && exec.Arg1 < 0)
+            exec.Payload |= ToUnderlying(ExecFlags::eReplaceShell);
+    }
+
     return Program;
 }
 void Lowerer::LowerNode(Ref<ASTNode> node)
 {
+    if (!node) return;
     if (node->Type == NodeType::eSequence)
         for (auto& cmd : node.template As<SequenceNode>()->Commands)
             LowerNode(cmd);
@@ -38,37 +76,91 @@ void Lowerer::LowerNode(Ref<ASTNode> node)
     {
         auto c = node.template As<CommandNode>();
         auto w = CreateRef<Word>();
+        // NAME=value arguments of a declaration pass NAME, the value is
+        // assigned once the command has run
+        Vector<Ref<AssignmentNode>> declared;
         for (auto& arg : c->Arguments)
         {
-            if (arg->Type == NodeType::eWord)
-                w->Atoms.EmplaceBack(WordAtom::Type::eLiteral,
-                                     arg.template As<WordNode>()->Value);
-            else if (arg->Type == NodeType::eVariable)
-                w->Atoms.EmplaceBack(WordAtom::Type::eVariable,
-                                     arg.template As<VariableNode>()->Name);
+            if (arg->Type != NodeType::eAssignment)
+            {
+                LowerAtom(arg, w);
+                continue;
+            }
+
+            auto assign = arg.template As<AssignmentNode>();
+            w->Atoms.EmplaceBack(WordAtom::Type::eLiteral, assign->Variable);
+            declared.PushBack(assign);
+        }
+
+        // A literal name is resolved once here, never by the executor
+        isize builtin = -1;
+        i32   flags   = 0;
+        if (!w->Atoms.Empty() && w->Atoms[0].Type == WordAtom::Type::eLiteral)
+        {
+            builtin = Builtins::Find(w->Atoms[0].Value);
+            if (builtin < 0) flags = ToUnderlying(ExecFlags::eExternal);
         }
 
+        // Without a command name, prefixes are plain assignments
+        auto prefix = w->Atoms.Empty() ? OpCode::eSetVar : OpCode::ePrefixAssign;
+        for (auto& assign : c->Assignments)
+            LowerAssignment(assign.template As<AssignmentNode>(), prefix);
+
         isize idx = AddWord(w);
         Emit(OpCode::eExpandWords, idx);
-        Emit(OpCode::eExec, idx);
+        for (auto& redir : c->Redirections)
+            LowerRedirection(redir.template As<RedirectionNode>());
+        isize exec = Emit(OpCode::eExec, idx, builtin, flags);
+        if (RegionDepth == 0) LastTopLevelExec = exec;
+
+        for (auto& assign : declared) LowerAssignment(assign, OpCode::eSetVar);
     }
     else if (node->Type == NodeType::eAssignment)
+        LowerAssignment(node.template As<AssignmentNode>(), OpCode::eSetVar);
+    else if (node->Type == NodeType::eSubShell)
+        LowerBody(OpCode::eSubshell, node.template As<SubshellNode>()->Body);
+    else if (node->Type == NodeType::eTime)
     {
-        auto assign   = node.template As<AssignmentNode>();
-        auto nameWord = CreateRef<Word>();
-        nameWord->Atoms.EmplaceBack(WordAtom::Type::eLiteral, assign->Variable);
-        isize nameIndex = AddWord(nameWord);
+        isize header = Emit(OpCode::eTime, 0);
+        ++RegionDepth;
+        LowerNode(node.template As<TimeNode>()->Body);
+        --RegionDepth;
+        PatchJump(header);
+    }
+    else if (node->Type == NodeType::eBackground)
+    {
+        auto body = node.template As<BackgroundNode>()->Body;
+        auto name = CreateRef<Word>();
+        name->Atoms.EmplaceBack(WordAtom::Type::eLiteral, Describe(body));
 
-        if (assign->Value->Type == NodeType::eWord)
-        {
-            auto valueWord = CreateRef<Word>();
-            valueWord->Atoms.EmplaceBack(
-                WordAtom::Type::eLiteral,
-                assign->Value.template As<WordNode>()->Value);
+        isize header = Emit(OpCode::eBackground, 0, AddWord(name));
+        ++RegionDepth;
+        LowerNode(body);
+        --RegionDepth;
+        PatchJump(header);
+    }
+    else if (node->Type == NodeType::eWhileLoop)
+        LowerLoop(node.template As<WhileNode>());
+    else if (node->Type == NodeType::eForLoop)
+        LowerFor(node.template As<ForNode>());
+    else if (node->Type == NodeType::eTest)
+        LowerTest(node.template As<TestNode>());
+    else if (node->Type == NodeType::eCase)
+        LowerCase(node.template As<CaseNode>());
+    else if (node->Type == NodeType::eArithmetic)
+        Emit(OpCode::eArithmetic,
+             LowerArithmetic(node.template As<ArithmeticNode>()->Expression));
+    else if (node->Type == NodeType::eCodeBlock)
+        LowerNode(node.template As<BlockNode>()->Body);
+    else if (node->Type == NodeType::eFunction)
+    {
+        auto function = node.template As<FunctionNode>();
+        auto name     = CreateRef<Word>();
+        name->Atoms.EmplaceBack(WordAtom::Type::eLiteral, function->Name);
 
-            isize valueIndex = AddWord(valueWord);
-            Emit(OpCode::eSetVar, nameIndex, valueIndex);
-        }
+        Program.Functions.PushBack(function->Body);
+        Emit(OpCode::eDefineFunction, AddWord(name),
+             Program.Functions.Size() - 1);
     }
     else if (node->Type == NodeType::eCondition)
     {
@@ -81,7 +173,951 @@ void Lowerer::LowerNode(Ref<ASTNode> node)
         );
         LowerNode(cond->Right);
         // patch jump to skip over right-hand side if needed
-        Program.Instructions[jumpIdx].Arg0
-            = static_cast<isize>(Program.Instructions.Size() - jumpIdx - 1);
+        PatchJump(jumpIdx);
+    }
+}
+void Lowerer::LowerAtom(Ref<ASTNode> node, Ref<Word> word)
+{
+    if (!node) return;
+
+    if (node->Type == NodeType::eWord)
+    {
+        // Words like [ or ! only look like patterns to the lexer
+        auto w    = node.template As<WordNode>();
+        if (w->Quoted)
+        {
+            LowerQuoted(w->Value, word);
+            return;
+        }
+        if (!w->Pieces.Empty())
+        {
+            LowerJoined(w, word);
+            return;
+        }
+        auto type = w->Braces ? WordAtom::Type::eBrace
+                  : w->Glob && Expander::IsPattern(w->Value)
+                      ? WordAtom::Type::eGlob
+                      : WordAtom::Type::eLiteral;
+        word->Atoms.EmplaceBack(type, w->Value);
+    }
+    else if (node->Type == NodeType::eVariable)
+    {
+        auto variable = node.template As<VariableNode>();
+        if (variable->Braced) LowerParameter(variable->Name, word);
+        else
+            word->Atoms.EmplaceBack(WordAtom::Type::eVariable,
+                                    variable->Name);
+    }
+    else if (node->Type == NodeType::eCommandSubstitution)
+    {
+        // The body runs right before the command that consumes its output,
+        // or is jumped over when it sits in an operand that may go unused
+        isize slot = Program.CaptureCount++;
+        isize skip = DeferDepth > 0 ? Emit(OpCode::eJump, 0) : -1;
+        isize body = static_cast<isize>(Program.Instructions.Size());
+        LowerBody(OpCode::eSubstitute,
+                  node.template As<CommandSubstitutionNode>()->Body, slot);
+        if (skip >= 0) PatchJump(skip);
+
+        auto& atom = word->Atoms.EmplaceBack(
+            WordAtom::Type::eCommandSubstitution, "", slot);
+        if (skip >= 0) atom.Deferred = body;
+    }
+    else if (node->Type == NodeType::eArithmetic)
+    {
+        auto& text = node.template As<ArithmeticNode>()->Expression;
+        word->Atoms.EmplaceBack(WordAtom::Type::eArithmetic, text,
+                                LowerArithmetic(text));
+    }
+}
+void Lowerer::LowerQuoted(StringView text, Ref<Word> word)
+{
+    if (text.Find("$"_sv) == StringView::NPos
+        && text.Find("\\"_sv) == StringView::NPos)
+    {
+        word->Atoms.EmplaceBack(WordAtom::Type::eLiteral, String(text));
+        return;
+    }
+
+    auto inner = CreateRef<Word>();
+    LowerText(text, inner, true);
+    // A lone expansion needs no word of its own, which also keeps the
+    // elements of "${name[@]}" apart
+    if (inner->Atoms.Size() == 1)
+    {
+        auto& atom  = inner->Atoms[0];
+        atom.Quoted = atom.Type != WordAtom::Type::eLiteral;
+        word->Atoms.PushBack(Move(atom));
+        return;
+    }
+    if (inner->Atoms.Empty())
+        inner->Atoms.EmplaceBack(WordAtom::Type::eLiteral, "");
+
+    word->Atoms.EmplaceBack(WordAtom::Type::eQuoted, String(text),
+                            AddWord(inner));
+}
+void Lowerer::LowerJoined(Ref<WordNode> node, Ref<Word> word)
+{
+    // A quoted piece would be split along with the rest, so a word with
+    // one is left whole. The piece itself is marked, a pattern only ever
+    // matches it literally
+    auto inner  = CreateRef<Word>();
+    bool quoted = false;
+    for (auto& piece : node->Pieces)
+    {
+        LowerAtom(piece, inner);
+        if (piece->Type != NodeType::eWord
+            || !piece.template As<WordNode>()->Quoted)
+            continue;
+        inner->Atoms.Back().Quoted = true;
+        quoted                     = true;
+    }
+
+    word->Atoms.EmplaceBack(WordAtom::Type::eJoined, Describe(node),
+                            AddWord(inner));
+    word->Atoms.Back().Quoted = quoted;
+}
+void Lowerer::LowerRegex(Ref<WordNode> node, Ref<Word> word)
+{
+    // The text between expansions is regex as it is, quoted pieces are
+    // escaped once they are expanded
+    auto inner = CreateRef<Word>();
+    for (auto& piece : node->Pieces)
+    {
+        if (piece->Type != NodeType::eWord)
+        {
+            LowerAtom(piece, inner);
+            continue;
+        }
+        if (piece.template As<WordNode>()->Quoted)
+        {
+            LowerAtom(piece, inner);
+            inner->Atoms.Back().Quoted = true;
+            continue;
+        }
+        inner->Atoms.EmplaceBack(WordAtom::Type::eLiteral,
+                                 piece.template As<WordNode>()->Value);
+    }
+
+    word->Atoms.EmplaceBack(WordAtom::Type::eJoined, Describe(node),
+                            AddWord(inner));
+    word->Atoms.Back().Quoted = true;
+}
+isize Lowerer::LowerSubscript(StringView text)
+{
+    Subscript subscript;
+    subscript.Index = LowerArithmetic(text);
+
+    auto key = CreateRef<Word>();
+    LowerText(text, key);
+    if (key->Atoms.Empty())
+        key->Atoms.EmplaceBack(WordAtom::Type::eLiteral, "");
+    subscript.Key = AddWord(key);
+
+    Program.Subscripts.PushBack(subscript);
+    return Program.Subscripts.Size() - 1;
+}
+isize Lowerer::LowerArithmetic(StringView text)
+{
+    // Plain $name is read by the expression itself, only substitutions
+    // and ${...} with operators are expanded before it runs
+    ArithmeticExpansion expansion;
+    if (Arithmetic::NeedsExpansion(text))
+    {
+        auto word = CreateRef<Word>();
+        LowerText(text, word);
+        expansion.Text = AddWord(word);
+    }
+    else expansion.Compiled = CreateRef<Arithmetic::Expression>(text);
+
+    Program.Arithmetic.PushBack(Move(expansion));
+    return Program.Arithmetic.Size() - 1;
+}
+void Lowerer::LowerBody(OpCode op, Ref<ASTNode> body, isize slot)
+{
+    BodyFlags flags = BodyFlags::eNone;
+    if (IsBuiltinOnly(body, flags)) flags = flags | BodyFlags::eInProcess;
+
+    isize header = Emit(op, 0, slot, ToUnderlying(flags));
+    ++RegionDepth;
+    LowerNode(body);
+    --RegionDepth;
+    PatchJump(header);
+}
+isize Lowerer::LowerLoopRedirections(Ref<ASTNode>                loop,
+                                     const Vector<Ref<ASTNode>>& redirections)
+{
+    // Redirections after done are applied once around the whole loop. When
+    // nothing but builtins runs inside, input redirected there is read by
+    // the shell alone and may be buffered freely
+    if (redirections.Empty()) return -1;
+    for (auto& redir : redirections)
+        LowerRedirection(redir.template As<RedirectionNode>());
+
+    BodyFlags flags = BodyFlags::eNone;
+    if (IsBuiltinOnly(loop, flags)) flags = flags | BodyFlags::eInProcess;
+    return Emit(OpCode::eRedirectBody, 0, -1, ToUnderlying(flags));
+}
+void Lowerer::LowerLoop(Ref<WhileNode> loop)
+{
+    isize header = LowerLoopRedirections(loop, loop->Redirections);
+
+    ++RegionDepth;
+    isize slot = Program.LoopCount++;
+    isize top  = Program.Instructions.Size();
+    LowerNode(loop->Condition);
+    isize exit = Emit(loop->Until ? OpCode::eJumpIfZero
+                                  : OpCode::eJumpIfNonZero,
+                      0, slot);
+    LowerNode(loop->Body);
+    isize back = Emit(OpCode::eJump, 0, slot);
+    Program.Instructions[back].Arg0 = top - back - 1;
+    PatchJump(exit);
+    --RegionDepth;
+
+    if (header >= 0) PatchJump(header);
+}
+void Lowerer::LowerFor(Ref<ForNode> loop)
+{
+    isize header = LowerLoopRedirections(loop, loop->Redirections);
+
+    // Words are expanded one at a time as the loop asks for them
+    isize list   = -1;
+    if (loop->HasList)
+    {
+        auto words = CreateRef<Word>();
+        for (auto& word : loop->Words) LowerAtom(word, words);
+        list = AddWord(words);
+    }
+    auto name = CreateRef<Word>();
+    name->Atoms.EmplaceBack(WordAtom::Type::eLiteral, loop->Variable);
+
+    ++RegionDepth;
+    isize slot = Program.LoopCount++;
+    Emit(OpCode::eForInit, list, slot);
+    isize top  = Program.Instructions.Size();
+    isize next = Emit(OpCode::eForNext, 0, slot, AddWord(name));
+    LowerNode(loop->Body);
+    isize back = Emit(OpCode::eJump, 0, slot);
+    Program.Instructions[back].Arg0 = top - back - 1;
+    PatchJump(next);
+    --RegionDepth;
+
+    if (header >= 0) PatchJump(header);
+}
+void Lowerer::LowerTest(Ref<TestNode> test)
+{
+    // Every operand is one atom. A literal pattern right of == or != and a
+    // literal regex right of =~ are compiled here, not per evaluation
+    auto word = CreateRef<Word>();
+    for (auto& operand : test->Words)
+    {
+        bool pattern = false, regex = false;
+        if (!word->Atoms.Empty()
+            && word->Atoms.Back().Type == WordAtom::Type::eLiteral)
+        {
+            StringView op = word->Atoms.Back().Value;
+            pattern       = op == "=="_sv || op == "="_sv || op == "!="_sv;
+            regex         = op == "=~"_sv;
+        }
+
+        // Substitutions only run once && and || get to them
+        usize at = word->Atoms.Size();
+        ++DeferDepth;
+        if (regex && operand->Type == NodeType::eWord
+            && !operand.template As<WordNode>()->Pieces.Empty())
+            LowerRegex(operand.template As<WordNode>(), word);
+        else LowerAtom(operand, word);
+        --DeferDepth;
+        if (word->Atoms.Size() != at + 1) continue;
+
+        auto& atom = word->Atoms[at];
+        if (pattern && atom.Type == WordAtom::Type::eGlob)
+            atom.Slot = AddPattern(atom.Value);
+        else if (regex && atom.Type == WordAtom::Type::eLiteral)
+            atom.Slot = AddRegex(atom.Value);
+    }
+
+    Emit(OpCode::eTest, AddWord(word));
+}
+void Lowerer::LowerCase(Ref<CaseNode> node)
+{
+    isize header  = LowerLoopRedirections(node, node->Redirections);
+
+    auto  subject = CreateRef<Word>();
+    LowerAtom(node->Subject, subject);
+
+    // Every pattern is one atom, the ones without expansions are sorted
+    // into the table here
+    CaseTable      table;
+    Vector<String> patterns;
+    for (u32 arm = 0; arm < node->Arms.Size(); arm++)
+    {
+        table.FirstPattern.PushBack(patterns.Size());
+        for (auto& pattern : node->Arms[arm].Patterns)
+        {
+            auto word = CreateRef<Word>();
+            LowerAtom(pattern, word);
+
+            auto type = word->Atoms.Size() == 1 ? word->Atoms[0].Type
+                                                : WordAtom::Type::eVariable;
+            if (type == WordAtom::Type::eGlob
+                || (type == WordAtom::Type::eBrace
+                    && Pattern::IsPattern(word->Atoms[0].Value)))
+            {
+                patterns.PushBack(word->Atoms[0].Value);
+                table.PatternArms.PushBack(arm);
+            }
+            else if (type == WordAtom::Type::eLiteral
+                     || type == WordAtom::Type::eBrace)
+            {
+                auto& arms = table.Literals[word->Atoms[0].Value];
+                if (arms.Empty() || arms.Back() != arm) arms.PushBack(arm);
+            }
+            else table.Expanded.PushBack({arm, AddWord(word)});
+        }
+    }
+    table.FirstPattern.PushBack(patterns.Size());
+    if (!patterns.Empty())
+        table.Patterns = CreateRef<Pattern::Matcher>(patterns);
+
+    isize slot = Program.Cases.Size();
+    Program.Cases.PushBack(Move(table));
+    Emit(OpCode::eCase, AddWord(subject), slot, 0);
+
+    // ;; leaves, ;& runs on into the next body and ;| dispatches again
+    // from the next arm
+    ++RegionDepth;
+    Vector<isize> exits;
+    for (u32 arm = 0; arm < node->Arms.Size(); arm++)
+    {
+        auto& current = node->Arms[arm];
+        Program.Cases[slot].Targets.PushBack(Program.Instructions.Size());
+        LowerNode(current.Body);
+
+        using End = CaseNode::Arm::End;
+        if (current.Terminator == End::eContinue)
+            Emit(OpCode::eCase, -1, slot, arm + 1);
+        else if (current.Terminator == End::eBreak
+                 && arm + 1 < node->Arms.Size())
+            exits.PushBack(Emit(OpCode::eJump, 0));
+    }
+    Program.Cases[slot].Targets.PushBack(Program.Instructions.Size());
+    for (isize exit : exits) PatchJump(exit);
+    --RegionDepth;
+
+    if (header >= 0) PatchJump(header);
+}
+void Lowerer::LowerAssignment(Ref<AssignmentNode> assign, OpCode op)
+{
+    auto nameWord = CreateRef<Word>();
+    nameWord->Atoms.EmplaceBack(WordAtom::Type::eLiteral, assign->Variable);
+    isize nameIndex = AddWord(nameWord);
+
+    // Every value gets exactly one atom, so subscripts line up with them
+    if (assign->Compound)
+    {
+        auto          values = CreateRef<Word>();
+        Vector<isize> subscripts;
+        bool          keyed = false;
+        for (auto& element : assign->Elements)
+        {
+            usize at = values->Atoms.Size();
+            LowerAtom(element.Value, values);
+            if (values->Atoms.Size() == at)
+                values->Atoms.EmplaceBack(WordAtom::Type::eLiteral, "");
+
+            subscripts.PushBack(
+                element.Keyed ? LowerSubscript(element.Subscript) : -1);
+            keyed |= element.Keyed;
+        }
+
+        i32 literal = -1;
+        if (keyed)
+        {
+            Program.ArrayLiterals.PushBack(Move(subscripts));
+            literal = Program.ArrayLiterals.Size() - 1;
+        }
+        Emit(assign->Append ? OpCode::eAppendArray : OpCode::eSetArray,
+             nameIndex, AddWord(values), literal);
+        return;
+    }
+
+    auto  valueWord = CreateRef<Word>();
+    LowerAtom(assign->Value, valueWord);
+    if (valueWord->Atoms.Empty())
+        valueWord->Atoms.EmplaceBack(WordAtom::Type::eLiteral, "");
+
+    isize valueIndex = AddWord(valueWord);
+    if (assign->Subscripted)
+        Emit(assign->Append ? OpCode::eAppendElement : OpCode::eSetElement,
+             nameIndex, valueIndex, LowerSubscript(assign->Subscript));
+    else
+        Emit(op, nameIndex, valueIndex,
+             assign->Append ? ToUnderlying(AssignFlags::eAppend) : 0);
+}
+void Lowerer::LowerRedirection(Ref<RedirectionNode> node)
+{
+    using Type = RedirectionNode::Type;
+
+    Redirection redir;
+    redir.FD     = node->Fd;
+    redir.Target = CreateRef<Word>();
+    switch (node->RedirType)
+    {
+        case Type::Input: redir.Mode = Redirection::Type::Read; break;
+        case Type::Output:
+        case Type::OutputPipe: redir.Mode = Redirection::Type::Write; break;
+        case Type::Append: redir.Mode = Redirection::Type::Append; break;
+        case Type::ReadWrite: redir.Mode = Redirection::Type::ReadWrite; break;
+        case Type::InputFd:
+        case Type::OutputFd: redir.Mode = Redirection::Type::Duplicate; break;
+        case Type::HereDoc:
+        case Type::HereString: redir.Mode = Redirection::Type::HereDoc; break;
+    }
+
+    if (node->RedirType == Type::HereDoc)
+    {
+        auto body = node->TargetWord.template As<HereDocNode>();
+        if (body->Expand) LowerText(body->Content, redir.Target);
+        else
+            redir.Target->Atoms.EmplaceBack(WordAtom::Type::eLiteral,
+                                            body->Content);
     }
+    else if (node->TargetWord) LowerAtom(node->TargetWord, redir.Target);
+    else
+        redir.Target->Atoms.EmplaceBack(WordAtom::Type::eLiteral,
+                                        node->Target);
+    if (node->RedirType == Type::HereString)
+        redir.Target->Atoms.EmplaceBack(WordAtom::Type::eLiteral, "\n");
+
+    Program.Redirections.PushBack(Move(redir));
+    Emit(OpCode::eRedirect, Program.Redirections.Size() - 1);
+}
+void Lowerer::LowerText(StringView text, Ref<Word> word, bool quoted)
+{
+    String literal;
+    auto   flush = [&]()
+    {
+        if (literal.Empty()) return;
+        word->Atoms.EmplaceBack(WordAtom::Type::eLiteral, Move(literal));
+        literal = String();
+    };
+    auto isNameChar = [](char c)
+    { return StringUtils::IsAlphanumeric(c) || c == '_'; };
+
+    for (usize i = 0; i < text.Size(); i++)
+    {
+        char c    = text[i];
+        char next = i + 1 < text.Size() ? text[i + 1] : '\0';
+        if (c == '\\'
+            && (next == '$' || next == '\\' || next == '`'
+                || (quoted && next == '"')))
+        {
+            literal += next;
+            ++i;
+            continue;
+        }
+        if (c != '$')
+        {
+            literal += c;
+            continue;
+        }
+
+        if (next == '?' || next == '!')
+        {
+            flush();
+            word->Atoms.EmplaceBack(WordAtom::Type::eVariable,
+                                    String(1, next));
+            ++i;
+        }
+        else if (next == '{')
+        {
+            usize end = ParameterEnd(text, i + 1);
+            if (end == StringView::NPos)
+            {
+                literal += c;
+                continue;
+            }
+
+            flush();
+            LowerParameter(text.Substr(i + 2, end - i - 2), word);
+            i = end;
+        }
+        else if (next == '(' && i + 2 < text.Size() && text[i + 2] == '(')
+        {
+            // $(( )) ends at the first )) outside of any parentheses
+            usize end   = i + 3;
+            usize depth = 0;
+            for (; end + 1 < text.Size(); end++)
+            {
+                if (text[end] == '(') ++depth;
+                else if (text[end] == ')' && depth > 0) --depth;
+                else if (text[end] == ')' && text[end + 1] == ')') break;
+            }
+            if (end + 1 >= text.Size())
+            {
+                literal += c;
+                continue;
+            }
+
+            flush();
+            StringView expression = text.Substr(i + 3, end - i - 3);
+            word->Atoms.EmplaceBack(WordAtom::Type::eArithmetic,
+                                    String(expression),
+                                    LowerArithmetic(expression));
+            i = end + 1;
+        }
+        else if (next == '(' && i + 2 < text.Size())
+        {
+            usize end   = i + 2;
+            usize depth = 1;
+            for (; end < text.Size(); end++)
+            {
+                if (text[end] == '(') ++depth;
+                else if (text[end] == ')' && --depth == 0) break;
+            }
+            if (depth != 0)
+            {
+                literal += c;
+                continue;
+            }
+
+            flush();
+            Lexer  lexer(text.Substr(i + 2, end - i - 2));
+            Parser parser(lexer.Analyze());
+
+            auto   substitution = CreateRef<CommandSubstitutionNode>();
+            substitution->Body  = parser.Parse();
+            LowerAtom(substitution, word);
+            i = end;
+        }
+        else if (isNameChar(next))
+        {
+            usize end = i + 1;
+            while (end < text.Size() && isNameChar(text[end])) ++end;
+
+            flush();
+            word->Atoms.EmplaceBack(WordAtom::Type::eVariable,
+                                    String(text.Substr(i + 1, end - i - 1)));
+            i = end - 1;
+        }
+        else literal += c;
+    }
+
+    flush();
+}
+
+usize Lowerer::ParameterEnd(StringView text, usize open)
+{
+    usize depth = 0;
+    for (usize i = open; i < text.Size(); i++)
+    {
+        char c = text[i];
+        if (c == '\\') ++i;
+        else if (c == '{') ++depth;
+        else if (c == '}' && --depth == 0) return i;
+        else if (c == '\'')
+        {
+            usize close = text.Find("'"_sv, i + 1);
+            if (close == StringView::NPos) return close;
+            i = close;
+        }
+    }
+    return StringView::NPos;
+}
+void Lowerer::LowerParameter(StringView text, Ref<Word> word)
+{
+    auto isNameChar = [](char c)
+    { return StringUtils::IsAlphanumeric(c) || c == '_'; };
+    // Operands end at an unescaped stop, nested expansions are skipped
+    auto operandEnd = [&](usize from, char stop)
+    {
+        for (usize i = from; i < text.Size(); i++)
+        {
+            if (text[i] == '\\') ++i;
+            else if (text[i] == stop) return i;
+            else if (text[i] == '$' && i + 1 < text.Size()
+                     && text[i + 1] == '{')
+            {
+                usize end = ParameterEnd(text, i + 1);
+                if (end == StringView::NPos) break;
+                i = end;
+            }
+        }
+        return text.Size();
+    };
+    auto operand = [&](StringView operandText)
+    {
+        auto operandWord = CreateRef<Word>();
+        ++DeferDepth;
+        LowerText(operandText, operandWord);
+        --DeferDepth;
+        return AddWord(operandWord);
+    };
+
+    // ${#name} is the length, ${#} alone the number of arguments, and
+    // ${!name[@]} the indices of an array
+    bool  length = text.Size() > 1 && text[0] == '#';
+    bool  keys   = text.Size() > 1 && text[0] == '!';
+    usize i      = length || keys;
+    usize start  = i;
+    if (i < text.Size() && StringUtils::IsDigit(text[i]))
+        while (i < text.Size() && StringUtils::IsDigit(text[i])) ++i;
+    else if (i < text.Size() && isNameChar(text[i]))
+        while (i < text.Size() && isNameChar(text[i])) ++i;
+    else if (i < text.Size() && strchr("?!#$-", text[i])) ++i;
+
+    String name = text.Substr(start, i - start);
+    // name[subscript], name[@] and name[*] of an array
+    ParameterExpansion expansion;
+    usize              close = StringView::NPos;
+    if (i < text.Size() && text[i] == '[' && i > start
+        && isNameChar(text[i - 1]) && !StringUtils::IsDigit(text[start]))
+    {
+        usize depth = 0;
+        for (close = i; close < text.Size(); close++)
+            if (text[close] == '[') ++depth;
+            else if (text[close] == ']' && --depth == 0) break;
+    }
+    if (close < text.Size())
+    {
+        StringView subscript = text.Substr(i + 1, close - i - 1);
+        if (subscript == "@"_sv || subscript == "*"_sv)
+            expansion.Elements = subscript[0];
+        else expansion.Subscript = LowerSubscript(subscript);
+        i = close + 1;
+    }
+
+    if (!length && !keys && i == text.Size() && !name.Empty()
+        && close == StringView::NPos)
+    {
+        word->Atoms.EmplaceBack(WordAtom::Type::eVariable, Move(name));
+        return;
+    }
+
+    using Type = ParameterExpansion::Type;
+    char op    = i < text.Size() ? text[i] : '\0';
+    if (length) expansion.Operator = Type::eLength;
+    if (keys) expansion.Operator = Type::eKeys;
+    if (op == ':' && i + 1 < text.Size() && strchr("-=+", text[i + 1]))
+    {
+        expansion.Colon = true;
+        op              = text[++i];
+    }
+
+    bool bad = name.Empty() || ((length || keys) && i != text.Size())
+            || (keys && !expansion.Elements);
+    if (!length && !keys && !bad && i < text.Size())
+    {
+        StringView rest = text.Substr(i + 1);
+        switch (op)
+        {
+            case '-':
+            case '=':
+            case '+':
+                expansion.Operator = op == '-'   ? Type::eDefault
+                                   : op == '=' ? Type::eAssign
+                                               : Type::eAlternative;
+                expansion.Operand  = operand(rest);
+                break;
+            case '#':
+            case '%':
+                expansion.Operator = op == '#' ? Type::eTrimPrefix
+                                               : Type::eTrimSuffix;
+                expansion.Longest  = !rest.Empty() && rest[0] == op;
+                expansion.Operand  = operand(rest.Substr(expansion.Longest));
+                break;
+            case '/':
+            {
+                expansion.Operator = Type::eReplace;
+                usize from         = i + 1;
+                if (from < text.Size() && text[from] == '/')
+                    expansion.All = true;
+                else if (from < text.Size()
+                         && (text[from] == '#' || text[from] == '%'))
+                    expansion.Anchor = text[from];
+                if (expansion.All || expansion.Anchor) ++from;
+
+                usize slash       = operandEnd(from, '/');
+                expansion.Operand = operand(text.Substr(from, slash - from));
+                if (slash < text.Size())
+                    expansion.Second = operand(text.Substr(slash + 1));
+                break;
+            }
+            case ':':
+            {
+                expansion.Operator = Type::eSubstring;
+                usize colon        = operandEnd(i + 1, ':');
+                expansion.Operand  = operand(text.Substr(i + 1, colon - i - 1));
+                if (colon < text.Size())
+                    expansion.Second = operand(text.Substr(colon + 1));
+                break;
+            }
+            default: bad = true;
+        }
+    }
+    // Reported once it is expanded, the whole text is kept for that
+    if (bad)
+    {
+        expansion          = {};
+        expansion.Operator = Type::eBad;
+        name               = text;
+    }
+
+    // A pattern without expansions in it is compiled right away
+    if (expansion.Operator == Type::eTrimPrefix
+        || expansion.Operator == Type::eTrimSuffix
+        || expansion.Operator == Type::eReplace)
+    {
+        auto& atoms    = Program.WordTable[expansion.Operand]->Atoms;
+        bool  reversed = expansion.Operator == Type::eTrimSuffix
+                     || expansion.Anchor == '%';
+        if (atoms.Size() == 1 && atoms[0].Type == WordAtom::Type::eLiteral
+            && Pattern::IsPattern(atoms[0].Value))
+            expansion.Compiled = AddPattern(atoms[0].Value, reversed);
+    }
+
+    WordAtom atom{WordAtom::Type::eParameter, Move(name)};
+    atom.Slot = Program.Expansions.Size();
+    Program.Expansions.PushBack(expansion);
+    word->Atoms.PushBack(Move(atom));
+}
+String Lowerer::Describe(Ref<ASTNode> node)
+{
+    if (!node) return "";
+
+    switch (node->Type)
+    {
+        case NodeType::eWord:
+        {
+            auto word = node.template As<WordNode>();
+            if (word->Pieces.Empty()) return word->Value;
+
+            String text;
+            for (auto& piece : word->Pieces) text += Describe(piece);
+            return text;
+        }
+        case NodeType::eVariable:
+        {
+            auto variable = node.template As<VariableNode>();
+            return variable->Braced ? "${"_s + variable->Name + "}"
+                                    : "$"_s + variable->Name;
+        }
+        case NodeType::eCommand:
+        {
+            String text;
+            auto   cmd = node.template As<CommandNode>();
+            for (auto& assign : cmd->Assignments)
+            {
+                text += Describe(assign);
+                text += ' ';
+            }
+            for (auto& arg : cmd->Arguments)
+            {
+                if (!text.Empty()) text += ' ';
+                text += Describe(arg);
+            }
+            return text;
+        }
+        case NodeType::eAssignment:
+        {
+            auto   assign = node.template As<AssignmentNode>();
+            String text   = assign->Variable;
+            if (assign->Subscripted) text += "["_s + assign->Subscript + "]";
+            text += assign->Append ? "+=" : "=";
+            if (!assign->Compound) return text + Describe(assign->Value);
+
+            text += '(';
+            for (usize i = 0; i < assign->Elements.Size(); i++)
+            {
+                auto& element = assign->Elements[i];
+                if (i > 0) text += ' ';
+                if (element.Keyed) text += "["_s + element.Subscript + "]=";
+                text += Describe(element.Value);
+            }
+            return text + ")";
+        }
+        case NodeType::eCondition:
+        {
+            auto cond = node.template As<ConditionalNode>();
+            return Describe(cond->Left)
+                 + (cond->CondType == ConditionalNode::Type::eAnd ? " && "
+                                                                  : " || ")
+                 + Describe(cond->Right);
+        }
+        case NodeType::eSequence:
+        {
+            String text;
+            for (auto& cmd : node.template As<SequenceNode>()->Commands)
+            {
+                if (!text.Empty()) text += "; ";
+                text += Describe(cmd);
+            }
+            return text;
+        }
+        case NodeType::eSubShell:
+            return "(" + Describe(node.template As<SubshellNode>()->Body)
+                 + ")";
+        case NodeType::eCommandSubstitution:
+            return "$("
+                 + Describe(node.template As<CommandSubstitutionNode>()->Body)
+                 + ")";
+        case NodeType::eArithmetic:
+        {
+            auto arithmetic = node.template As<ArithmeticNode>();
+            return (arithmetic->Command ? "(("_s : "$(("_s)
+                 + arithmetic->Expression + "))";
+        }
+        case NodeType::eWhileLoop:
+        {
+            auto loop = node.template As<WhileNode>();
+            return (loop->Until ? "until "_s : "while "_s)
+                 + Describe(loop->Condition) + "; do "
+                 + Describe(loop->Body) + "; done";
+        }
+        case NodeType::eForLoop:
+        {
+            auto   loop = node.template As<ForNode>();
+            String text = "for "_s + loop->Variable;
+            if (loop->HasList)
+            {
+                text += " in";
+                for (auto& word : loop->Words)
+                {
+                    text += ' ';
+                    text += Describe(word);
+                }
+            }
+            return text + "; do " + Describe(loop->Body) + "; done";
+        }
+        case NodeType::eCase:
+        {
+            auto   statement = node.template As<CaseNode>();
+            String text      = "case "_s + Describe(statement->Subject) + " in";
+            for (auto& arm : statement->Arms)
+            {
+                String patterns;
+                for (auto& pattern : arm.Patterns)
+                {
+                    if (!patterns.Empty()) patterns += '|';
+                    patterns += Describe(pattern);
+                }
+                text += " " + patterns + ") " + Describe(arm.Body) + " ;;";
+            }
+            return text + " esac";
+        }
+        case NodeType::eTest:
+        {
+            String text = "[[";
+            for (auto& word : node.template As<TestNode>()->Words)
+            {
+                text += ' ';
+                text += Describe(word);
+            }
+            return text + " ]]";
+        }
+
+        default: break;
+    }
+
+    return "...";
+}
+bool Lowerer::IsBuiltinOnly(Ref<ASTNode> node, BodyFlags& flags)
+{
+    if (!node) return true;
+
+    switch (node->Type)
+    {
+        case NodeType::eSequence:
+            for (auto& cmd : node.template As<SequenceNode>()->Commands)
+                if (!IsBuiltinOnly(cmd, flags)) return false;
+            return true;
+        case NodeType::eCondition:
+        {
+            auto cond = node.template As<ConditionalNode>();
+            return IsBuiltinOnly(cond->Left, flags)
+                && IsBuiltinOnly(cond->Right, flags);
+        }
+        case NodeType::eSubShell:
+            return IsBuiltinOnly(node.template As<SubshellNode>()->Body,
+                                 flags);
+        case NodeType::eCodeBlock:
+            return IsBuiltinOnly(node.template As<BlockNode>()->Body, flags);
+        case NodeType::eWhileLoop:
+        {
+            auto loop = node.template As<WhileNode>();
+            return IsBuiltinOnly(loop->Condition, flags)
+                && IsBuiltinOnly(loop->Body, flags);
+        }
+        case NodeType::eForLoop:
+        {
+            auto loop = node.template As<ForNode>();
+            for (auto& word : loop->Words)
+                if (!IsBuiltinOnly(word, flags)) return false;
+            return IsBuiltinOnly(loop->Body, flags);
+        }
+        case NodeType::eTest:
+            for (auto& word : node.template As<TestNode>()->Words)
+                if (!IsBuiltinOnly(word, flags)) return false;
+            return true;
+        case NodeType::eCase:
+        {
+            auto statement = node.template As<CaseNode>();
+            if (!IsBuiltinOnly(statement->Subject, flags)) return false;
+            for (auto& arm : statement->Arms)
+            {
+                for (auto& pattern : arm.Patterns)
+                    if (!IsBuiltinOnly(pattern, flags)) return false;
+                if (!IsBuiltinOnly(arm.Body, flags)) return false;
+            }
+            return true;
+        }
+        case NodeType::eCommandSubstitution:
+            return IsBuiltinOnly(
+                node.template As<CommandSubstitutionNode>()->Body, flags);
+        case NodeType::eArithmetic:
+            return !Arithmetic::NeedsExpansion(
+                node.template As<ArithmeticNode>()->Expression);
+        case NodeType::eAssignment:
+        {
+            auto assign = node.template As<AssignmentNode>();
+            for (auto& element : assign->Elements)
+                if (!IsBuiltinOnly(element.Value, flags)) return false;
+            return IsBuiltinOnly(assign->Value, flags);
+        }
+        case NodeType::eWord:
+        {
+            // Substitutions between double quotes run commands of their own
+            auto word = node.template As<WordNode>();
+            for (auto& piece : word->Pieces)
+                if (!IsBuiltinOnly(piece, flags)) return false;
+            return !word->Quoted
+                || StringView(word->Value).Find("$("_sv) == StringView::NPos;
+        }
+        case NodeType::eVariable: return true;
+        case NodeType::eCommand:
+        {
+            auto cmd = node.template As<CommandNode>();
+            if (!cmd->Redirections.Empty() || cmd->Arguments.Empty()
+                || !cmd->Arguments[0]
+                || cmd->Arguments[0]->Type != NodeType::eWord)
+                return false;
+
+            // `exit` has to terminate a real process
+            StringView name = cmd->Arguments[0].template As<WordNode>()->Value;
+            if (name == "exit"_sv || !Builtins::IsBuiltin(name)) return false;
+            if (name == "cd"_sv) flags = flags | BodyFlags::eRestoreCwd;
+
+            for (auto& assign : cmd->Assignments)
+                if (!IsBuiltinOnly(assign, flags)) return false;
+            for (auto& arg : cmd->Arguments)
+                if (!IsBuiltinOnly(arg, flags)) return false;
+            return true;
+        }
+
+        default: break;
+    }
+
+    return false;
 }
@@ -7,19 +7,84 @@
 #pragma once
 
 #include <AST.hpp>
+#include <Arithmetic.hpp>
+#include <Pattern.hpp>
+#include <Prism/Containers/UnorderedMap.hpp>
 #include <Prism/Containers/Vector.hpp>
 #include <Prism/String/StringUtils.hpp>
 
 enum class OpCode
 {
     eExpandWords, // expand a Word
-    eExec,        // execute a command
+    eExec,        // execute a command, Arg1 is the builtin id when known
     eGetVar,
     eSetVar,
     eJumpIfNonZero,
     eJumpIfZero,
+    eSubshell,   // run the next Arg0 instructions as a subshell
+    eSubstitute, // run the next Arg0 instructions, capture stdout into Arg1
+    eBackground, // fork the next Arg0 instructions as job named by Word Arg1
+    eTime,       // report resources used by the next Arg0 instructions
+    eRedirect,   // queue Redirections[Arg0] for the next eExec
+    eJump, // relative by Arg0, a loop's back edge records its status in Arg1
+    eRedirectBody, // run the next Arg0 instructions with the queued
+                   // redirections applied
+    ePrefixAssign, // queue Word Arg0 = Word Arg1 for the next eExec only
+    eDefineFunction, // define Word Arg0 as a function with body Functions[Arg1]
+    eForInit, // start loop slot Arg1 over the atoms of Word Arg0, or over the
+              // positional parameters when Arg0 is -1
+    eForNext, // assign the next word of loop Arg1 to the variable named by
+              // Word Payload, or leave the loop by Arg0 once there is none
+    eTest,    // evaluate the atoms of Word Arg0 as the expression of [[ ]]
+    eCase,    // go to the first arm of Cases[Arg1] from arm Payload on that
+              // Word Arg0 matches, -1 reuses the word of the last run for ;|
+    eArithmetic, // evaluate Arithmetic[Arg0] as (( )), status 0 when not 0
+    eSetElement, // assign Word Arg1 to the element Subscripts[Payload] of the
+                 // array named by Word Arg0
+    eSetArray,   // assign the atoms of Word Arg1 to the array named by Word
+                 // Arg0, ArrayLiterals[Payload] has their subscripts, if any
+    eAppendElement, // like eSetElement, but appends to the element
+    eAppendArray,   // like eSetArray, but adds to the elements already set
 };
 
+// Payload flags of eSubshell, eSubstitute and eRedirectBody
+enum class BodyFlags : i32
+{
+    eNone       = 0,
+    eInProcess  = 1 << 0, // body only touches shell state and builtins
+    eRestoreCwd = 1 << 1, // body may change the working directory
+};
+// Payload flags of eExec
+enum class ExecFlags : i32
+{
+    eNone         = 0,
+    eReplaceShell = 1 << 0, // nothing runs afterwards, exec in place of awsh
+    eExternal     = 1 << 1, // the name is literal and not a builtin
+};
+inline constexpr bool operator&(i32 payload, ExecFlags flag)
+{
+    return payload & ToUnderlying(flag);
+}
+// Payload flags of eSetVar and ePrefixAssign
+enum class AssignFlags : i32
+{
+    eNone   = 0,
+    eAppend = 1 << 0, // NAME+=value
+};
+inline constexpr bool operator&(i32 payload, AssignFlags flag)
+{
+    return payload & ToUnderlying(flag);
+}
+
+inline constexpr BodyFlags operator|(BodyFlags lhs, BodyFlags rhs)
+{
+    return static_cast<BodyFlags>(ToUnderlying(lhs) | ToUnderlying(rhs));
+}
+inline constexpr bool operator&(i32 payload, BodyFlags flag)
+{
+    return payload & ToUnderlying(flag);
+}
+
 struct Instruction
 {
     OpCode Op;
@@ -34,33 +99,202 @@ struct WordAtom
     {
         eLiteral,
         eVariable,
+        eCommandSubstitution,
+        eGlob,  // expands to the paths it matches, or itself
+        eBrace, // expands to the words of its braces, each one then globbed
+        eParameter, // ${name...} with an operator, Slot indexes Expansions
+        eArithmetic, // $(( )), Slot indexes Arithmetic
+        eQuoted, // "...", Slot is the word of what is inside, expanded into
+                 // a single field
+        eJoined, // pieces like a=$x, Slot is the word of them. They expand
+                 // into one value, split unless Quoted
     } Type;
 
     String Value;
+    isize  Slot   = -1; // capture slot of a command substitution
+    // The eSubstitute of a substitution in a ${name:-word} operand or in
+    // [[ ]], run only once the operand is used
+    isize  Deferred = -1;
+    // Between double quotes, so never split. "${name[@]}" still gives a
+    // field for each element
+    bool   Quoted = false;
+};
+// The operator of a ${name...} expansion, Value of its atom is the name
+struct ParameterExpansion
+{
+    enum class Type
+    {
+        eDefault,     // ${v:-word}
+        eAssign,      // ${v:=word}
+        eAlternative, // ${v:+word}
+        eLength,      // ${#v}
+        eTrimPrefix,  // ${v#pattern}, ${v##pattern} when Longest
+        eTrimSuffix,  // ${v%pattern}, ${v%%pattern} when Longest
+        eReplace,     // ${v/pattern/string}, every match when All
+        eSubstring,   // ${v:offset:length}
+        eKeys,        // ${!v[@]}, the indices or keys of an array
+        eBad,         // does not parse, fails the command that expands it
+    } Operator = Type::eDefault;
+
+    // ${v[@]} and ${v[*]} take every element, each through the operator,
+    // ${v[i]} only Subscripts[Subscript]
+    char  Elements  = 0;
+    isize Subscript = -1;
+
+    // The colon forms also take an empty value for an unset one
+    bool  Colon    = false;
+    bool  Longest  = false;
+    bool  All      = false;
+    // ${v/#p/r} and ${v/%p/r} only replace at the start or the end
+    char  Anchor   = 0;
+    // Words in WordTable, -1 when left out. The word, pattern or offset
+    isize Operand  = -1;
+    // The replacement or the length
+    isize Second   = -1;
+    // Patterns index of a literal pattern operand, compiled while lowering
+    isize Compiled = -1;
 };
 struct Word : public RefCounted
 {
     Vector<WordAtom> Atoms;
+    // The argv of a command word of literals only, built by the executor
+    // the first time it runs, so running it again allocates nothing
+    Vector<char*>    Argv;
+};
+// An arithmetic expression, compiled while lowering unless it has to be
+// expanded first, then Text is the word to expand and compile each time
+struct ArithmeticExpansion
+{
+    Ref<Arithmetic::Expression> Compiled;
+    isize                       Text = -1;
+};
+
+// The [...] of an array element. An indexed array takes it as arithmetic
+// and an associative one as a word, which one is only known once it runs
+struct Subscript
+{
+    isize Index = -1; // into Arithmetic
+    isize Key   = -1; // into WordTable
+};
+
+struct Redirection
+{
+    enum class Type
+    {
+        Read,
+        Write,
+        Append,
+        ReadWrite,
+        Duplicate, // Target is an fd number, or - to close FD
+        HereDoc,   // Target is the body fed to FD
+    } Mode;
+
+    i32       FD;
+    Ref<Word> Target;
+};
+
+// Where a case statement goes for its word. Literal patterns are found by
+// a single hash lookup and every other pattern known while lowering runs
+// in one automaton, so the number of arms does not matter. Only patterns
+// with expansions in them are tried one at a time
+struct CaseTable
+{
+    struct Dynamic
+    {
+        u32   Arm;
+        isize Word;
+    };
+
+    // Arms of each literal pattern, in order
+    UnorderedMap<String, Vector<u32>> Literals;
+    Ref<Pattern::Matcher>             Patterns;
+    // Arm of each of the Patterns, and the first of them for each arm
+    Vector<u32>                       PatternArms;
+    Vector<u32>                       FirstPattern;
+    // Patterns with expansions, in order
+    Vector<Dynamic>                   Expanded;
+    // Instruction each arm's body starts at, then the one past the case
+    Vector<usize>                     Targets;
 };
 
 struct Program
 {
-    Vector<Instruction> Instructions;
-    Vector<Ref<Word>>   WordTable;
+    Vector<Instruction>           Instructions;
+    Vector<Ref<Word>>             WordTable;
+    Vector<Redirection>           Redirections;
+    Vector<ParameterExpansion>    Expansions;
+    // Patterns and regexes known while lowering, compiled only once
+    Vector<Ref<Pattern::Matcher>> Patterns;
+    Vector<Ref<Pattern::Regex>>   Regexes;
+    Vector<CaseTable>             Cases;
+    Vector<ArithmeticExpansion>   Arithmetic;
+    Vector<Subscript>             Subscripts;
+    // Subscripts of each value of an eSetArray, -1 for a value without one
+    Vector<Vector<isize>>         ArrayLiterals;
+    // Bodies of the functions defined by eDefineFunction
+    Vector<Ref<ASTNode>>          Functions;
+    usize                         CaptureCount = 0;
+    // Each loop keeps the status of its last body run in a slot
+    usize                         LoopCount    = 0;
 };
 
 struct Lowerer
 {
-    Lowerer(Ref<ASTNode> node);
+    // With execTail, the last command is allowed to replace the shell
+    Lowerer(Ref<ASTNode> node, bool execTail = false);
 
     Ref<ASTNode>   AST;
     struct Program Program;
+    bool           ExecTail         = false;
+    usize          RegionDepth      = 0;
+    // Inside an operand of ${name...} or [[ ]], whose substitutions wait to
+    // be used
+    usize          DeferDepth       = 0;
+    isize          LastTopLevelExec = -1;
 
     isize          AddWord(Ref<Word> w);
-    isize          Emit(OpCode op, int arg0 = -1, isize arg1 = -1);
+    isize          Emit(OpCode op, int arg0 = -1, isize arg1 = -1,
+                        i32 payload = -1);
+    isize          AddPattern(StringView pattern, bool reversed = false);
+    // -1 when the regex does not compile
+    isize          AddRegex(StringView regex);
 
     struct Program Lower();
     void           LowerNode(Ref<ASTNode> node);
+    void           LowerAtom(Ref<ASTNode> node, Ref<Word> word);
+    void           LowerBody(OpCode op, Ref<ASTNode> body, isize slot = -1);
+    void           LowerLoop(Ref<WhileNode> loop);
+    void           LowerFor(Ref<ForNode> loop);
+    void           LowerTest(Ref<TestNode> test);
+    void           LowerCase(Ref<CaseNode> node);
+    // Emits the eRedirectBody around a loop with redirections after done,
+    // or a case with them after esac. Returns its index to be patched, or -1
+    isize          LowerLoopRedirections(Ref<ASTNode>                loop,
+                                         const Vector<Ref<ASTNode>>& redirections);
+    void           LowerAssignment(Ref<AssignmentNode> assign, OpCode op);
+    void           LowerRedirection(Ref<RedirectionNode> node);
+    // Splits text subject to expansion, like a here-document body, or
+    // what is between double quotes when quoted
+    void           LowerText(StringView text, Ref<Word> word,
+                             bool quoted = false);
+    // Lowers a double quoted string into a single atom
+    void           LowerQuoted(StringView text, Ref<Word> word);
+    // Lowers the pieces of a word like a=$x into a single atom
+    void           LowerJoined(Ref<WordNode> node, Ref<Word> word);
+    // A regex right of =~ with expansions in it, one eJoined atom
+    void           LowerRegex(Ref<WordNode> node, Ref<Word> word);
+    // Index of the [...] of an array element in Subscripts
+    isize          LowerSubscript(StringView text);
+    // Index of text in Arithmetic
+    isize          LowerArithmetic(StringView text);
+    // Lowers what is between the braces of ${...}
+    void           LowerParameter(StringView text, Ref<Word> word);
+    // Finds the } closing the ${ whose { is at open, or NPos
+    static usize   ParameterEnd(StringView text, usize open);
+    void           PatchJump(isize index);
+
+    static bool    IsBuiltinOnly(Ref<ASTNode> node, BodyFlags& flags);
+    static String  Describe(Ref<ASTNode> node);
 };
 constexpr void DumpProgram(const Program& prog)
 {
@@ -74,17 +308,20 @@ constexpr void DumpProgram(const Program& prog)
     }
 
     fmt::print("=== Redirections ===\n");
-    // for (usize i = 0; i < prog.Redirections.size(); i++)
-    // {
-    //     auto& r = prog.Redirections[i];
-    //     fmt::print("[{}] FD: {} Mode: {} Target: ", i, r.FD,
-    //                (r.Mode == Redirection::Type::Read    ? "Read"
-    //                 : r.Mode == Redirection::Type::Write ? "Write"
-    //                                                      : "Append"));
-    //     for (auto& atom : r.Target.Atoms) fmt::print("{} ", atom);
-    //     fmt::print("\n");
-    // }
-    //
+    for (usize i = 0; i < prog.Redirections.Size(); i++)
+    {
+        auto& r = prog.Redirections[i];
+        fmt::print("[{}] FD: {} Mode: {} Target: ", i, r.FD,
+                   (r.Mode == Redirection::Type::Read        ? "Read"
+                    : r.Mode == Redirection::Type::Write     ? "Write"
+                    : r.Mode == Redirection::Type::Append    ? "Append"
+                    : r.Mode == Redirection::Type::ReadWrite ? "ReadWrite"
+                    : r.Mode == Redirection::Type::HereDoc   ? "HereDoc"
+                                                             : "Duplicate"));
+        for (auto& atom : r.Target->Atoms) fmt::print("{} ", atom.Value);
+        fmt::print("\n");
+    }
+
     fmt::print("=== Instructions ===\n");
     for (usize i = 0; i < prog.Instructions.Size(); i++)
     {
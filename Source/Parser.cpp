@@ -4,8 +4,10 @@
  *
  * SPDX-License-Identifier: GPL-3
  */
+#include <Expander.hpp>
 #include <Lexer.hpp>
 #include <Parser.hpp>
+#include <Pattern.hpp>
 
 Ref<ASTNode> Parser::Parse()
 {
@@ -25,11 +27,17 @@ Ref<ASTNode> Parser::Parse()
 Ref<ASTNode> Parser::ParseSequence()
 {
     auto seq = CreateRef<SequenceNode>();
-    while (!End() && !Match(TokenType::eRightParen)
-           && !Match(TokenType::eRightBrace))
+    for (;;)
     {
-        auto stmt = ParseConditional();
-        if (!stmt) break;
+        while (Consume(TokenType::eNewLine) || Consume(TokenType::eComment)
+               || Consume(TokenType::eSemicolon));
+        if (End() || Match(TokenType::eRightParen)
+            || Match(TokenType::eRightBrace))
+            break;
+
+        usize start = m_Pos;
+        auto  stmt  = ParseConditional();
+        if (!stmt || m_Pos == start) break;
 
         if (Consume(TokenType::eAmpersand))
         {
@@ -73,6 +81,16 @@ Ref<ASTNode> Parser::ParseConditional()
 }
 Ref<ASTNode> Parser::ParsePipeline()
 {
+    // time is a reserved word, it applies to the whole pipeline
+    if (Match(TokenType::eIdentifier) && Current()->Text == "time"_sv)
+    {
+        Advance();
+
+        auto node  = CreateRef<TimeNode>();
+        node->Body = ParsePipeline();
+        return node;
+    }
+
     auto first = ParseStatement();
     if (!first) return nullptr;
 
@@ -98,24 +116,92 @@ Ref<ASTNode> Parser::ParseStatement()
 {
     if (Match(TokenType::eLeftParen)) return ParseSubshell();
     if (Match(TokenType::eLeftBrace)) return ParseBlock();
+    if (Match(TokenType::eKeyword)
+        && (Current()->Text == "while"_sv || Current()->Text == "until"_sv))
+        return ParseLoop();
+    if (Match(TokenType::eKeyword) && Current()->Text == "for"_sv)
+        return ParseFor();
+    if (Match(TokenType::eKeyword) && Current()->Text == "function"_sv)
+        return ParseFunction();
+    if (Match(TokenType::eKeyword) && Current()->Text == "case"_sv)
+        return ParseCase();
+    if (Match(TokenType::eGlobWord) && Current()->Text == "[["_sv)
+        return ParseTest();
+    if (Match(TokenType::eArithmeticCommand))
+    {
+        auto node        = CreateRef<ArithmeticNode>();
+        node->Expression = Current()->Text;
+        node->Command    = true;
+        Advance();
+        return node;
+    }
+    if (Match(TokenType::eIdentifier) && Peek().HasValue()
+        && Peek()->Type == TokenType::eLeftParen && Peek(2).HasValue()
+        && Peek(2)->Type == TokenType::eRightParen)
+        return ParseFunction();
+
+    if (!IsAssignment()) return ParseCommand();
+
+    Vector<Ref<ASTNode>> assignments;
+    while (IsAssignment())
+    {
+        auto assign = ParseAssignment();
+        if (!assign) return nullptr;
+        assignments.PushBack(assign);
+    }
 
-    return IsAssignment() ? ParseAssignment() : ParseCommand();
+    // Assignments in front of a command only apply to that command
+    auto cmd = ParseCommand();
+    if (cmd)
+    {
+        cmd.As<CommandNode>()->Assignments = Move(assignments);
+        return cmd;
+    }
+    if (assignments.Size() == 1) return assignments[0];
+
+    auto sequence      = CreateRef<SequenceNode>();
+    sequence->Commands = Move(assignments);
+    return sequence;
 }
 Ref<ASTNode> Parser::ParseWord()
 {
     const auto t = Current();
     if (!t.HasValue()) return nullptr;
 
+    if (IsBraceWord())
+    {
+        auto word         = CreateRef<WordNode>();
+        word->StartOffset = t->Offset;
+        for (;;)
+        {
+            auto piece = Current();
+            word->Value += piece->Text;
+            word->EndOffset = piece->Offset + piece->Text.Size();
+            Advance();
+
+            auto next = Current();
+            if (!next.HasValue() || !IsWordPiece(next->Type)
+                || !IsAdjacent(*piece, *next))
+                break;
+        }
+
+        word->Braces = Expander::HasBraces(word->Value);
+        word->Glob   = true;
+        return word;
+    }
+
     if (Match(TokenType::eVariable))
     {
         Advance();
 
-        // auto node    = CreateRef<WordNode>();
-        auto node  = CreateRef<VariableNode>();
-        node->Name = t->Text;
-        // node->StartOffset = t->Offset;
-        // node->EndOffset   = t->Offset + t->Text.Size();
-        // node->Braced = t->Text.StartsWith("{") && t->Text.EndsWith("}");
+        // ${...} keeps what is between the braces, operator included
+        auto node   = CreateRef<VariableNode>();
+        node->Name  = t->Text;
+        node->Braced = t->Text.Size() >= 2 && t->Text[0] == '{'
+                    && t->Text[t->Text.Size() - 1] == '}';
+        if (node->Braced) node->Name = t->Text.Substr(1, t->Text.Size() - 2);
+        node->StartOffset = t->Offset;
+        node->EndOffset   = t->Offset + t->Text.Size() + 1;
         return node;
     }
     if (Match(TokenType::eCommandSubst))
@@ -142,6 +228,7 @@ Ref<ASTNode> Parser::ParseWord()
     }
 
     if (t->Type != TokenType::eIdentifier && t->Type != TokenType::eString
+        && t->Type != TokenType::eQuotedString
         && t->Type != TokenType::eGlobWord)
         return nullptr;
 
@@ -149,10 +236,39 @@ Ref<ASTNode> Parser::ParseWord()
     word->Value       = t->Text;
     word->StartOffset = t->Offset;
     word->EndOffset   = t->Offset + t->Text.Size();
+    word->Glob        = t->Type == TokenType::eGlobWord;
+    word->Quoted      = t->Type == TokenType::eQuotedString;
 
     Advance();
     return word;
 }
+Ref<ASTNode> Parser::ParseJoined()
+{
+    auto first = ParseWord();
+    if (!first || !IsJoined()) return first;
+
+    auto word = CreateRef<WordNode>();
+    word->Pieces.PushBack(first);
+    ParsePieces(word);
+    return word;
+}
+void Parser::ParsePieces(Ref<WordNode> word)
+{
+    while (IsJoined())
+    {
+        // Reserved words are only special in command position
+        auto piece = ParseWord();
+        if (!piece && Match(TokenType::eKeyword))
+        {
+            auto literal   = CreateRef<WordNode>();
+            literal->Value = Current()->Text;
+            piece          = literal;
+            Advance();
+        }
+        if (!piece) break;
+        word->Pieces.PushBack(piece);
+    }
+}
 Ref<ASTNode> Parser::ParseSubshell()
 {
     const auto open = Current();
@@ -193,88 +309,584 @@ Ref<ASTNode> Parser::ParseBlock()
 
     return node;
 }
+Ref<ASTNode> Parser::ParseLoop()
+{
+    const auto keyword = Current();
+    Advance();
+
+    auto node       = CreateRef<WhileNode>();
+    node->Until     = keyword->Text == "until"_sv;
+    node->Condition = ParseSequence();
+    if (!ConsumeKeyword("do"_sv))
+    {
+        PrismError("Expected do after {} condition", keyword->Text);
+        return nullptr;
+    }
+
+    node->Body = ParseSequence();
+    if (!ConsumeKeyword("done"_sv))
+    {
+        PrismError("Expected done to close {} loop", keyword->Text);
+        return nullptr;
+    }
+
+    // Redirections after done apply to the whole loop
+    while (ParseRedirection(node->Redirections));
+    return node;
+}
+Ref<ASTNode> Parser::ParseFor()
+{
+    Advance();
+    if (!Match(TokenType::eIdentifier))
+    {
+        PrismError("Expected a variable name after for");
+        return nullptr;
+    }
+
+    auto node      = CreateRef<ForNode>();
+    node->Variable = Current()->Text;
+    Advance();
+
+    while (Consume(TokenType::eNewLine));
+    if (ConsumeKeyword("in"_sv))
+    {
+        // The list only ends at ; or a newline, reserved words included
+        node->HasList = true;
+        for (;;)
+        {
+            auto word = ParseJoined();
+            if (!word && Match(TokenType::eKeyword))
+            {
+                auto literal   = CreateRef<WordNode>();
+                literal->Value = Current()->Text;
+                word           = literal;
+                Advance();
+            }
+            if (!word) break;
+
+            node->Words.PushBack(word);
+        }
+    }
+
+    Consume(TokenType::eSemicolon);
+    while (Consume(TokenType::eNewLine));
+    if (!ConsumeKeyword("do"_sv))
+    {
+        PrismError("Expected do after for {}", node->Variable);
+        return nullptr;
+    }
+
+    node->Body = ParseSequence();
+    if (!ConsumeKeyword("done"_sv))
+    {
+        PrismError("Expected done to close for {}", node->Variable);
+        return nullptr;
+    }
+
+    // Redirections after done apply to the whole loop
+    while (ParseRedirection(node->Redirections));
+    return node;
+}
+Ref<ASTNode> Parser::ParseFunction()
+{
+    // Either `function name [()]` or `name ()`
+    if (Match(TokenType::eKeyword)) Advance();
+    if (!Match(TokenType::eIdentifier))
+    {
+        PrismError("Expected a function name");
+        return nullptr;
+    }
+
+    auto node  = CreateRef<FunctionNode>();
+    node->Name = Current()->Text;
+    Advance();
+    if (Match(TokenType::eLeftParen))
+    {
+        Advance();
+        if (!Consume(TokenType::eRightParen))
+        {
+            PrismError("Expected ) after function name {}", node->Name);
+            return nullptr;
+        }
+    }
+
+    while (Consume(TokenType::eNewLine));
+    node->Body = ParseStatement();
+    if (!node->Body)
+    {
+        PrismError("Expected a body for function {}", node->Name);
+        return nullptr;
+    }
+
+    return node;
+}
+Ref<ASTNode> Parser::ParseCase()
+{
+    Advance();
+
+    auto node     = CreateRef<CaseNode>();
+    node->Subject = ParseJoined();
+    if (!node->Subject)
+    {
+        PrismError("Expected a word after case");
+        return nullptr;
+    }
+
+    while (Consume(TokenType::eNewLine));
+    if (!ConsumeKeyword("in"_sv))
+    {
+        PrismError("Expected in after case word");
+        return nullptr;
+    }
+
+    using Terminator = CaseNode::Arm::End;
+    for (;;)
+    {
+        while (Consume(TokenType::eNewLine) || Consume(TokenType::eComment));
+        if (ConsumeKeyword("esac"_sv)) break;
+        if (End())
+        {
+            PrismError("Expected esac to close case");
+            return nullptr;
+        }
+
+        // Patterns are words, reserved ones included, and may be joined
+        // from quoted and unquoted pieces
+        CaseNode::Arm arm;
+        Consume(TokenType::eLeftParen);
+        do {
+            auto pattern = ParseJoined();
+            if (!pattern && Match(TokenType::eKeyword))
+            {
+                auto literal   = CreateRef<WordNode>();
+                literal->Value = Current()->Text;
+                pattern        = literal;
+                Advance();
+            }
+            if (!pattern)
+            {
+                PrismError("Expected a pattern in case");
+                return nullptr;
+            }
+            arm.Patterns.PushBack(pattern);
+        } while (Consume(TokenType::ePipe));
+        if (!Consume(TokenType::eRightParen))
+        {
+            PrismError("Expected ) after case pattern");
+            return nullptr;
+        }
+
+        // The last arm may leave out its ;;
+        arm.Body = ParseSequence();
+        if (Consume(TokenType::eSemiAmpersand))
+            arm.Terminator = Terminator::eFallThrough;
+        else if (Consume(TokenType::eSemiPipe))
+            arm.Terminator = Terminator::eContinue;
+        else if (!Consume(TokenType::eDoubleSemi)
+                 && !(Match(TokenType::eKeyword)
+                      && Current()->Text == "esac"_sv))
+        {
+            PrismError("Expected ;; or esac after case arm");
+            return nullptr;
+        }
+        node->Arms.PushBack(Move(arm));
+    }
+
+    // Redirections after esac apply to the whole case
+    while (ParseRedirection(node->Redirections));
+    return node;
+}
+Ref<ASTNode> Parser::ParseTest()
+{
+    Advance();
+
+    auto node    = CreateRef<TestNode>();
+    auto literal = [&](StringView text)
+    {
+        auto word   = CreateRef<WordNode>();
+        word->Value = text;
+        node->Words.PushBack(word);
+    };
+    for (;;)
+    {
+        auto token = Current();
+        if (End() || token->Type == TokenType::eNewLine)
+        {
+            PrismError("Expected ]] to close [[");
+            return nullptr;
+        }
+        if (token->Type == TokenType::eGlobWord && token->Text == "]]"_sv)
+        {
+            Advance();
+            break;
+        }
+
+        // The lexer takes these for operators of the shell
+        if (MatchAny(*token,
+                     {TokenType::eDoubleAmpersand, TokenType::eDoublePipe,
+                      TokenType::eLeftParen, TokenType::eRightParen,
+                      TokenType::eLess, TokenType::eGreater}))
+        {
+            literal(token->Text);
+            Advance();
+            continue;
+        }
+        if (token->Type == TokenType::eIdentifier && token->Text == "=~"_sv)
+        {
+            Advance();
+            literal(token->Text);
+
+            auto regex = ParseRegex();
+            if (!regex)
+            {
+                PrismError("Expected a regex after =~");
+                return nullptr;
+            }
+            node->Words.PushBack(regex);
+            continue;
+        }
+
+        auto word = ParseWord();
+        if (!word)
+        {
+            PrismError("Unexpected {} in [[", token->Text);
+            return nullptr;
+        }
+        node->Words.PushBack(word);
+    }
+
+    return node;
+}
+Ref<ASTNode> Parser::ParseRegex()
+{
+    auto first = Current();
+    if (End() || (first->Type == TokenType::eGlobWord && first->Text == "]]"_sv))
+        return nullptr;
+
+    // A lone expansion is only known to be a regex once it is expanded
+    auto next  = Peek();
+    bool alone = !next.HasValue() || !next->Joined;
+    if (alone
+        && (first->Type == TokenType::eVariable
+            || first->Type == TokenType::eCommandSubst))
+        return ParseWord();
+
+    // Quoted parts only match themselves. Expansions are kept as pieces
+    // of the word, the regex is then only known once they are expanded
+    auto word         = CreateRef<WordNode>();
+    word->StartOffset = first->Offset;
+    bool inText = false;
+    for (;;)
+    {
+        auto piece      = Current();
+        word->EndOffset = TokenEnd(*piece);
+        bool expands    = piece->Type == TokenType::eVariable
+                    || piece->Type == TokenType::eCommandSubst
+                    || piece->Type == TokenType::eArithmetic
+                    || (piece->Type == TokenType::eQuotedString
+                        && (StringView(piece->Text).Find("$"_sv)
+                                != StringView::NPos
+                            || StringView(piece->Text).Find("`"_sv)
+                                   != StringView::NPos));
+        if (expands)
+        {
+            word->Pieces.PushBack(ParseWord());
+            inText = false;
+        }
+        else
+        {
+            if (!inText) word->Pieces.PushBack(CreateRef<WordNode>());
+            inText    = true;
+            auto text = word->Pieces.Back().As<WordNode>();
+            if (piece->Type == TokenType::eString
+                || piece->Type == TokenType::eQuotedString)
+                text->Value += Pattern::EscapeRegex(piece->Text);
+            else text->Value += piece->Text;
+            Advance();
+        }
+
+        auto next = Current();
+        if (End() || next->Type == TokenType::eNewLine || !next->Joined)
+            break;
+    }
+
+    // Without expansions, it is compiled once while lowering
+    if (word->Pieces.Size() == 1 && inText)
+    {
+        word->Value = word->Pieces[0].As<WordNode>()->Value;
+        word->Pieces.Clear();
+    }
+    return word;
+}
 Ref<ASTNode> Parser::ParseAssignment()
 {
     auto name = Current();
     Advance();
-    Consume(TokenType::eAssign);
-
-    auto value = ParseWord();
-    if (!value) return nullptr;
+    auto equals = Current();
+    Advance();
 
     auto assign         = CreateRef<AssignmentNode>();
     assign->Variable    = name->Text;
-    assign->Value       = value;
     assign->StartOffset = name->Offset;
+    assign->Append      = equals->Type == TokenType::eAppendAssign;
     // assign->EndOffset   = value->EndOffset;
 
+    // NAME[subscript]= assigns one element
+    usize open = StringView(name->Text).Find("["_sv);
+    if (open != StringView::NPos)
+    {
+        assign->Variable    = name->Text.Substr(0, open);
+        assign->Subscript   = name->Text.Substr(
+            open + 1, name->Text.Size() - open - 2);
+        assign->Subscripted = true;
+    }
+
+    // FOO= assigns the empty string, whatever follows is another word
+    auto next  = Current();
+    bool value = next.HasValue() && IsAdjacent(*equals, *next);
+    if (value && !assign->Subscripted && next->Type == TokenType::eLeftParen)
+        return ParseArray(assign) ? assign : nullptr;
+
+    assign->Value = value ? ParseJoined() : nullptr;
+    if (!assign->Value) assign->Value = CreateRef<WordNode>();
     return assign;
 }
-Ref<ASTNode> Parser::ParseCommand()
+Ref<ASTNode> Parser::ParseAssignmentWord()
 {
-    auto cmd      = CreateRef<CommandNode>();
-    auto nameWord = ParseWord();
+    auto name = Current();
+    Advance();
+    auto equals = Current();
+    Advance();
 
-    if (nameWord)
-    {
-        if (nameWord->Type == NodeType::eWord)
-            cmd->Name = nameWord.As<WordNode>()->Value;
-        else if (nameWord->Type == NodeType::eVariable)
-            cmd->Name = nameWord.As<VariableNode>()->Name;
-        else
-            PrismError("Unknown node type => {}",
-                       StringUtils::ToString(nameWord->Type));
-    }
+    auto prefix         = CreateRef<WordNode>();
+    prefix->Value       = name->Text + equals->Text;
+    prefix->StartOffset = name->Offset;
+    prefix->EndOffset   = TokenEnd(*equals);
+    if (!IsJoined()) return prefix;
 
-    cmd->Arguments.PushBack(nameWord);
-    while (auto word = ParseWord()) cmd->Arguments.PushBack(word);
+    auto word = CreateRef<WordNode>();
+    word->Pieces.PushBack(prefix);
+    ParsePieces(word);
 
-    ParseRedirections(cmd);
-    if (cmd->Arguments.Size() == 0) return nullptr;
-    return cmd;
+    // A literal value keeps it a plain word, globbed like any other
+    if (word->Pieces.Size() == 2 && word->Pieces[1]->Type == NodeType::eWord)
+    {
+        auto value = word->Pieces[1].As<WordNode>();
+        if (!value->Quoted && !value->Braces && value->Pieces.Empty())
+        {
+            prefix->Value     += value->Value;
+            prefix->Glob       = value->Glob;
+            prefix->EndOffset  = value->EndOffset;
+            return prefix;
+        }
+    }
+    return word;
 }
-Ref<ASTNode> Parser::ParseRedirections(Ref<CommandNode> cmd)
+bool Parser::ParseArray(Ref<AssignmentNode> assign)
 {
-    while (Match(TokenType::eLess) || Match(TokenType::eGreater)
-           || Match(TokenType::eShiftRight) || Match(TokenType::eShiftLeft)
-           || Match(TokenType::eLessAmpersand)
-           || Match(TokenType::eGreaterAmpersand))
+    Advance();
+    assign->Value    = CreateRef<WordNode>();
+    assign->Compound = true;
+    for (;;)
     {
-        auto token = Current();
-        Advance();
+        while (Consume(TokenType::eNewLine) || Consume(TokenType::eComment))
+            ;
+        if (Consume(TokenType::eRightParen)) return true;
+
+        // [subscript]=value, the value may be a separate token after the =
+        AssignmentNode::Element element;
+        auto                    current = Current();
+        usize                   close
+            = current.HasValue() && current->Type == TokenType::eGlobWord
+                   && current->Text.StartsWith("["_sv)
+                ? StringView(current->Text).Find("]="_sv)
+                : StringView::NPos;
+        if (close != StringView::NPos)
+        {
+            element.Subscript = current->Text.Substr(1, close - 1);
+            element.Keyed     = true;
+
+            StringView rest = StringView(current->Text).Substr(close + 2);
+            auto       next = Peek();
+            Advance();
+            if (!rest.Empty())
+            {
+                auto word     = CreateRef<WordNode>();
+                word->Value   = rest;
+                word->Glob    = true;
+                element.Value = word;
+            }
+            else if (next.HasValue() && IsAdjacent(*current, *next))
+                element.Value = ParseWord();
+            if (!element.Value) element.Value = CreateRef<WordNode>();
+        }
+        else if (current.HasValue() && current->Type == TokenType::eKeyword)
+        {
+            // Reserved words are only special in command position
+            auto word     = CreateRef<WordNode>();
+            word->Value   = current->Text;
+            element.Value = word;
+            Advance();
+        }
+        else element.Value = ParseWord();
 
-        auto targetToken = Current();
-        Advance();
+        if (!element.Value)
+        {
+            PrismError("awsh: {}=(: expected ) to close the array\n",
+                       assign->Variable);
+            return false;
+        }
+        assign->Elements.PushBack(Move(element));
+    }
+}
+Ref<ASTNode> Parser::ParseCommand()
+{
+    auto cmd = CreateRef<CommandNode>();
+
+    // Redirections may appear anywhere between the words of a command
+    for (;;)
+    {
+        if (ParseRedirection(cmd->Redirections)) continue;
 
-        auto redir = CreateRef<RedirectionNode>();
-        switch (token->Type)
+        // Declarations take assignments as arguments, anywhere else
+        // NAME=value is just a word
+        if (!cmd->Arguments.Empty() && IsAssignment())
         {
-            case TokenType::eLess:
-                redir->RedirType = RedirectionNode::Type::Input;
-                break;
-            case TokenType::eGreater:
-                redir->RedirType = RedirectionNode::Type::Output;
-                break;
-            case TokenType::eShiftLeft:
-                redir->RedirType = RedirectionNode::Type::Append;
-                break;
-            case TokenType::eShiftRight:
-                redir->RedirType = RedirectionNode::Type::HereDoc;
-                break;
-            case TokenType::eLessAmpersand:
-                redir->RedirType = RedirectionNode::Type::InputFd;
-                break;
-            case TokenType::eGreaterAmpersand:
-                redir->RedirType = RedirectionNode::Type::OutputFd;
-                break;
-            default:
-                PrismError("Unknown redirection type", token->Offset);
+            if (!IsDeclaration(cmd->Name))
+            {
+                cmd->Arguments.PushBack(ParseAssignmentWord());
                 continue;
+            }
+
+            auto assign = ParseAssignment();
+            if (!assign) return nullptr;
+            cmd->Arguments.PushBack(assign);
+            continue;
         }
 
-        redir->Target = targetToken->Text;
-        cmd->Redirections.PushBack(redir);
+        // Reserved words are only special in command position
+        auto word = ParseJoined();
+        if (!word && !cmd->Arguments.Empty() && Match(TokenType::eKeyword))
+        {
+            auto literal   = CreateRef<WordNode>();
+            literal->Value = Current()->Text;
+            word           = literal;
+            Advance();
+        }
+        if (!word) break;
+
+        if (cmd->Arguments.Empty())
+        {
+            if (word->Type == NodeType::eWord)
+                cmd->Name = word.As<WordNode>()->Value;
+            else if (word->Type == NodeType::eVariable)
+                cmd->Name = word.As<VariableNode>()->Name;
+        }
+        cmd->Arguments.PushBack(word);
     }
 
+    if (cmd->Arguments.Empty() && cmd->Redirections.Empty()) return nullptr;
     return cmd;
 }
+bool Parser::ParseRedirection(Vector<Ref<ASTNode>>& redirections)
+{
+    auto current = Current();
+    if (!current.HasValue()) return false;
+
+    // An fd number glued to the operator, as in 2>file
+    i32  fd    = -1;
+    auto token = current;
+    if (token->Type == TokenType::eIdentifier)
+    {
+        auto next = Peek();
+        if (!next.HasValue()
+            || next->Offset != token->Offset + token->Text.Size())
+            return false;
+
+        for (char c : token->Text)
+            if (!StringUtils::IsDigit(c)) return false;
+
+        fd    = StringUtils::ToNumber<i32>(token->Text);
+        token = next;
+    }
+
+    using Type     = RedirectionNode::Type;
+    auto secondary = Type::OutputFd;
+    Type type;
+    switch (token->Type)
+    {
+        case TokenType::eLess: type = Type::Input; break;
+        case TokenType::eGreater: type = Type::Output; break;
+        case TokenType::eGreaterPipe: type = Type::OutputPipe; break;
+        case TokenType::eShiftRight: type = Type::Append; break;
+        case TokenType::eLeftGreater: type = Type::ReadWrite; break;
+        case TokenType::eLessAmpersand: type = Type::InputFd; break;
+        case TokenType::eGreaterAmpersand: type = Type::OutputFd; break;
+        case TokenType::eShiftLeft:
+        case TokenType::eShiftLeftHyphen: type = Type::HereDoc; break;
+        case TokenType::e3Less: type = Type::HereString; break;
+        // &> and >>& send both stdout and stderr to the target
+        case TokenType::eAmpersandGreater:
+        case TokenType::eAmpersandGreaterPipe:
+            if (fd >= 0) return false;
+            type      = Type::Output;
+            secondary = Type::Output;
+            break;
+        case TokenType::eShiftRightAmpersand:
+            if (fd >= 0) return false;
+            type      = Type::Append;
+            secondary = Type::Output;
+            break;
+
+        default: return false;
+    }
+
+    Advance(fd >= 0 ? 2 : 1);
+    Ref<ASTNode> target;
+    if (type == Type::HereDoc) target = ParseHereDoc();
+    else target = ParseJoined();
+    if (!target)
+    {
+        PrismError("Expected a redirection target", token->Offset);
+        return true;
+    }
+
+    auto redir        = CreateRef<RedirectionNode>();
+    redir->RedirType  = type;
+    redir->TargetWord = target;
+    redir->Fd         = fd >= 0 ? fd
+                      : (type == Type::Input || type == Type::InputFd
+                         || type == Type::ReadWrite || type == Type::HereDoc
+                         || type == Type::HereString)
+                          ? 0
+                          : 1;
+    if (target->Type == NodeType::eWord)
+        redir->Target = target.As<WordNode>()->Value;
+    redirections.PushBack(redir);
+
+    if (secondary == Type::Output)
+    {
+        auto err       = CreateRef<RedirectionNode>();
+        err->RedirType = Type::OutputFd;
+        err->Fd        = 2;
+        err->Target    = "1";
+        redirections.PushBack(err);
+    }
+
+    return true;
+}
+Ref<ASTNode> Parser::ParseHereDoc()
+{
+    // The lexer places the collected body right after its operator
+    auto body = Current();
+    if (!body.HasValue()
+        || (body->Type != TokenType::eHereDoc
+            && body->Type != TokenType::eHereDocLiteral))
+        return nullptr;
+    Advance();
+
+    auto node     = CreateRef<HereDocNode>();
+    node->Content = body->Text;
+    node->Expand  = body->Type == TokenType::eHereDoc;
+    return node;
+}
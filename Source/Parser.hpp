@@ -68,6 +68,17 @@ class Parser
         return false;
     }
 
+    inline bool ConsumeKeyword(StringView keyword)
+    {
+        auto current = Current();
+        if (!current.HasValue() || current->Type != TokenType::eKeyword
+            || current->Text != keyword)
+            return false;
+
+        Advance();
+        return true;
+    }
+
     inline bool End()
     {
         return m_Pos >= m_Tokens.Size()
@@ -81,7 +92,73 @@ class Parser
 
         return id.HasValue() && eq.HasValue()
             && id->Type == TokenType::eIdentifier
-            && eq->Type == TokenType::eAssign;
+            && (eq->Type == TokenType::eAssign
+                || eq->Type == TokenType::eAppendAssign)
+            && IsAdjacent(*id, *eq);
+    }
+    static inline bool IsAdjacent(const Token& first, const Token& second)
+    {
+        return second.Offset == first.Offset + first.Text.Size();
+    }
+    // Where the source of token ends, quotes and the $ of a variable are
+    // not part of its text
+    static inline usize TokenEnd(const Token& token)
+    {
+        return token.Offset + token.Text.Size()
+             + (token.Type == TokenType::eString
+                        || token.Type == TokenType::eQuotedString
+                    ? 2
+                : token.Type == TokenType::eVariable ? 1
+                                                     : 0);
+    }
+    // Braces and commas are tokens of their own, a word like
+    // file{01..10}.txt is glued back together from its adjacent pieces
+    static inline bool IsWordPiece(TokenType type)
+    {
+        return type == TokenType::eIdentifier || type == TokenType::eGlobWord
+            || type == TokenType::eLeftBrace || type == TokenType::eRightBrace
+            || type == TokenType::eComma;
+    }
+    inline bool IsBraceWord()
+    {
+        auto current = Current();
+        auto next    = Peek();
+        if (!current.HasValue()) return false;
+        if (current->Type == TokenType::eLeftBrace
+            || current->Type == TokenType::eComma)
+            return true;
+
+        return (current->Type == TokenType::eIdentifier
+                || current->Type == TokenType::eGlobWord)
+            && next.HasValue() && IsAdjacent(*current, *next)
+            && (next->Type == TokenType::eLeftBrace
+                || next->Type == TokenType::eRightBrace
+                || next->Type == TokenType::eComma);
+    }
+    // Whether the current token continues the word before it, like the $x
+    // of a=$x
+    inline bool IsJoined()
+    {
+        auto current = Current();
+        if (!current.HasValue() || !current->Joined) return false;
+
+        switch (current->Type)
+        {
+            case TokenType::eString:
+            case TokenType::eQuotedString:
+            case TokenType::eVariable:
+            case TokenType::eCommandSubst:
+            case TokenType::eArithmetic:
+            case TokenType::eKeyword: return true;
+            default: return IsWordPiece(current->Type);
+        }
+    }
+    // Commands whose NAME=value arguments are assignments
+    static inline bool IsDeclaration(StringView name)
+    {
+        return name == "export"_sv || name == "local"_sv
+            || name == "declare"_sv || name == "typeset"_sv
+            || name == "readonly"_sv;
     }
 
     Ref<ASTNode> ParseSequence();
@@ -89,10 +166,26 @@ class Parser
     Ref<ASTNode> ParsePipeline();
     Ref<ASTNode> ParseStatement();
     Ref<ASTNode> ParseWord();
+    // A word with the pieces joined to it, a lone piece is returned as is
+    Ref<ASTNode> ParseJoined();
+    void         ParsePieces(Ref<WordNode> word);
     Ref<ASTNode> ParseSubshell();
     Ref<ASTNode> ParseBlock();
     Ref<ASTNode> ParseAssignment();
+    // NAME=value as an argument of a command that is no declaration, an
+    // ordinary word
+    Ref<ASTNode> ParseAssignmentWord();
+    // The ( ... ) of NAME=( ... ), at the (
+    bool         ParseArray(Ref<AssignmentNode> assign);
     Ref<ASTNode> ParseCommand();
-    Ref<ASTNode> ParseRedirections(Ref<CommandNode> cmd);
+    Ref<ASTNode> ParseLoop();
+    Ref<ASTNode> ParseFor();
+    Ref<ASTNode> ParseFunction();
+    Ref<ASTNode> ParseCase();
+    Ref<ASTNode> ParseTest();
+    // The regex right of =~, glued together from the adjacent tokens
+    Ref<ASTNode> ParseRegex();
+    // Returns whether a redirection was consumed
+    bool         ParseRedirection(Vector<Ref<ASTNode>>& redirections);
     Ref<ASTNode> ParseHereDoc();
 };
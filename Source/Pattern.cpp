@@ -0,0 +1,619 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <Pattern.hpp>
+
+#include <Prism/Debug/Log.hpp>
+
+#include <cctype>
+#include <cstring>
+
+using namespace Prism;
+
+namespace Pattern
+{
+    namespace
+    {
+        // DFA states a pattern may build before its table starts over
+        constexpr usize MAX_DFA_STATES = 512;
+        // Patterns and regexes the cache holds on to
+        constexpr usize MAX_CACHED     = 64;
+
+        // Finds the ) closing the group opened at open, or NPos
+        usize           GroupEnd(StringView pattern, usize open)
+        {
+            usize depth = 0;
+            for (usize i = open; i < pattern.Size(); i++)
+            {
+                if (pattern[i] == '\\') ++i;
+                else if (pattern[i] == '(') ++depth;
+                else if (pattern[i] == ')' && --depth == 0) return i;
+            }
+            return StringView::NPos;
+        }
+        bool IsGroup(StringView pattern, usize i)
+        {
+            return i + 1 < pattern.Size() && pattern[i + 1] == '('
+                && (pattern[i] == '@' || pattern[i] == '?' || pattern[i] == '*'
+                    || pattern[i] == '+')
+                && GroupEnd(pattern, i + 1) != StringView::NPos;
+        }
+
+        // Parses the bracket expression at pattern[i] into a 256 bit set,
+        // returns the index past it or 0 when it is not one
+        usize ParseClass(StringView pattern, usize i, u64* set)
+        {
+            usize j      = i + 1;
+            bool  negate = j < pattern.Size()
+                       && (pattern[j] == '!' || pattern[j] == '^');
+            if (negate) ++j;
+
+            memset(set, 0, 4 * sizeof(u64));
+            auto add = [&](u8 c) { set[c >> 6] |= u64(1) << (c & 63); };
+            for (bool first = true;; first = false)
+            {
+                if (j >= pattern.Size()) return 0;
+
+                char c = pattern[j];
+                if (c == ']' && !first) break;
+                if (c == '[' && j + 1 < pattern.Size() && pattern[j + 1] == ':')
+                {
+                    usize close = pattern.Find(":]"_sv, j + 2);
+                    if (close == StringView::NPos) return 0;
+
+                    StringView name = pattern.Substr(j + 2, close - j - 2);
+                    for (u32 b = 0; b < 256; b++)
+                    {
+                        bool in = name == "alpha"_sv   ? isalpha(b)
+                                : name == "digit"_sv   ? isdigit(b)
+                                : name == "alnum"_sv   ? isalnum(b)
+                                : name == "upper"_sv   ? isupper(b)
+                                : name == "lower"_sv   ? islower(b)
+                                : name == "space"_sv   ? isspace(b)
+                                : name == "blank"_sv   ? isblank(b)
+                                : name == "punct"_sv   ? ispunct(b)
+                                : name == "xdigit"_sv  ? isxdigit(b)
+                                : name == "cntrl"_sv   ? iscntrl(b)
+                                : name == "print"_sv   ? isprint(b)
+                                : name == "graph"_sv   ? isgraph(b)
+                                                       : false;
+                        if (in && b < 128) add(b);
+                    }
+                    j = close + 2;
+                    continue;
+                }
+
+                if (c == '\\' && j + 1 < pattern.Size()) c = pattern[++j];
+                u8 low = c, high = c;
+                ++j;
+                if (j + 1 < pattern.Size() && pattern[j] == '-'
+                    && pattern[j + 1] != ']')
+                {
+                    j += pattern[j + 1] == '\\' && j + 2 < pattern.Size() ? 2 : 1;
+                    high = pattern[j++];
+                }
+                for (u32 b = low; b <= high; b++) add(b);
+            }
+
+            if (negate)
+                for (usize w = 0; w < 4; w++) set[w] = ~set[w];
+            return j + 1;
+        }
+
+        // Where the element of a pattern starting at i ends
+        usize ElementEnd(StringView pattern, usize i)
+        {
+            u64 set[4];
+            if (IsGroup(pattern, i)) return GroupEnd(pattern, i + 1) + 1;
+            if (pattern[i] == '[')
+                if (usize end = ParseClass(pattern, i, set)) return end;
+            return pattern[i] == '\\' && i + 1 < pattern.Size() ? i + 2
+                                                                 : i + 1;
+        }
+
+        // Entries are found by the hash of their key, a kind byte and the
+        // pattern, and checked against it. The least recently used one
+        // makes room for a new one
+        struct CacheEntry
+        {
+            String       Key;
+            Ref<Matcher> Compiled;
+            Ref<Regex>   Expression;
+            u64          LastUse = 0;
+        };
+        Vector<CacheEntry>     s_Cache;
+        UnorderedMap<u64, u32> s_CacheIndex;
+        u64                    s_CacheClock = 0;
+
+        u64                    HashKey(char kind, StringView pattern)
+        {
+            u64 hash = (14695981039346656037ull ^ static_cast<u8>(kind))
+                     * 1099511628211ull;
+            for (char c : pattern)
+                hash = (hash ^ static_cast<u8>(c)) * 1099511628211ull;
+            return hash;
+        }
+        bool SameKey(const String& key, char kind, StringView pattern)
+        {
+            return key.Size() == pattern.Size() + 1 && key[0] == kind
+                && memcmp(key.Raw() + 1, pattern.Raw(), pattern.Size()) == 0;
+        }
+        // The entry of kind and pattern, a blank one when it is not cached
+        CacheEntry& Lookup(char kind, StringView pattern)
+        {
+            u64  hash  = HashKey(kind, pattern);
+            auto found = s_CacheIndex.Find(hash);
+            if (found != s_CacheIndex.end()
+                && SameKey(s_Cache[*found->Value].Key, kind, pattern))
+            {
+                auto& entry   = s_Cache[*found->Value];
+                entry.LastUse = ++s_CacheClock;
+                return entry;
+            }
+
+            u32 slot = s_Cache.Size();
+            if (s_Cache.Size() < MAX_CACHED) s_Cache.EmplaceBack();
+            else
+            {
+                slot = 0;
+                for (u32 i = 1; i < s_Cache.Size(); i++)
+                    if (s_Cache[i].LastUse < s_Cache[slot].LastUse) slot = i;
+                auto& old   = s_Cache[slot].Key;
+                u64   stale = HashKey(old[0], StringView(old).Substr(1));
+                auto  held  = s_CacheIndex.Find(stale);
+                if (held != s_CacheIndex.end() && *held->Value == slot)
+                    s_CacheIndex.Erase(stale);
+            }
+
+            // A colliding key loses its slot in the index, not its entry
+            auto& entry   = s_Cache[slot];
+            entry         = CacheEntry();
+            entry.Key     = String(1, kind);
+            entry.Key    += pattern;
+            entry.LastUse = ++s_CacheClock;
+            s_CacheIndex[hash] = slot;
+            return entry;
+        }
+    }; // namespace
+
+    bool IsPattern(StringView text)
+    {
+        u64 set[4];
+        for (usize i = 0; i < text.Size(); i++)
+        {
+            char c = text[i];
+            if (c == '\\') ++i;
+            else if (c == '*' || c == '?' || IsGroup(text, i)) return true;
+            else if (c == '[' && ParseClass(text, i, set)) return true;
+        }
+        return false;
+    }
+    String Unescape(StringView text)
+    {
+        String result;
+        for (usize i = 0; i < text.Size(); i++)
+        {
+            if (text[i] == '\\' && i + 1 < text.Size()) ++i;
+            result += text[i];
+        }
+        return result;
+    }
+    String Escape(StringView text)
+    {
+        String result;
+        for (char c : text)
+        {
+            if (c && strchr("\\*?[]()|!+@", c)) result += '\\';
+            result += c;
+        }
+        return result;
+    }
+    String EscapeRegex(StringView text)
+    {
+        String result;
+        for (char c : text)
+        {
+            if (c && strchr("\\.[]()*+?{}|^$", c)) result += '\\';
+            result += c;
+        }
+        return result;
+    }
+
+    Matcher::Matcher(StringView pattern, bool reversed, bool open)
+        : m_Reversed(reversed)
+        , m_Source(pattern)
+    {
+        // The star read before or after the pattern keeps its elements
+        // from having literal ends
+        usize       i = 0;
+        Vector<i32> elements;
+        if (open && reversed) CompileElement("*"_sv, i, nullptr);
+        i = 0;
+        CompileSequence(pattern, i, false, open ? nullptr : &elements);
+        i = 0;
+        if (open && !reversed) CompileElement("*"_sv, i, nullptr);
+        m_Ends.PushBack(Emit(Operation::eMatch));
+
+        usize prefix = 0, suffix = 0, stars = 0;
+        while (prefix < elements.Size() && elements[prefix] >= 0) ++prefix;
+        while (suffix < elements.Size() - prefix
+               && elements[elements.Size() - suffix - 1] >= 0)
+            ++suffix;
+        for (i32 element : elements) stars += element == -1;
+
+        for (usize j = 0; j < prefix; j++) m_Prefix += char(elements[j]);
+        for (usize j = elements.Size() - suffix; j < elements.Size(); j++)
+            m_Suffix += char(elements[j]);
+        m_StarOnly = stars == 1 && prefix + suffix + 1 == elements.Size();
+        m_Hidden   = !elements.Empty() && elements[0] == '.';
+
+        m_SetWords = (m_Code.Size() + 63) / 64;
+        Reset();
+    }
+
+    Matcher::Matcher(const Vector<String>& patterns)
+    {
+        // split p0, next; p0; match; next: split p1, next; ...
+        for (usize k = 0; k < patterns.Size(); k++)
+        {
+            bool last  = k + 1 == patterns.Size();
+            u32  split = last ? 0 : Emit(Operation::eSplit, m_Code.Size() + 1);
+
+            usize i    = 0;
+            CompileSequence(patterns[k], i, false, nullptr);
+            m_Ends.PushBack(Emit(Operation::eMatch));
+            if (!last) m_Code[split].Arg1 = m_Code.Size();
+        }
+
+        m_SetWords = (m_Code.Size() + 63) / 64;
+        Reset();
+    }
+
+    u32 Matcher::Emit(Operation op, u32 arg0, u32 arg1)
+    {
+        m_Code.PushBack({op, 0, arg0, arg1});
+        return m_Code.Size() - 1;
+    }
+    void Matcher::CompileSequence(StringView pattern, usize& i, bool group,
+                                  Vector<i32>* elements)
+    {
+        auto ends = [&]()
+        {
+            return i >= pattern.Size()
+                || (group && (pattern[i] == '|' || pattern[i] == ')'));
+        };
+        if (!m_Reversed)
+        {
+            while (!ends()) CompileElement(pattern, i, elements);
+            return;
+        }
+
+        // Backwards, the elements are found first and compiled from
+        // the last one
+        Vector<usize> starts;
+        for (; !ends(); i = ElementEnd(pattern, i)) starts.PushBack(i);
+        for (usize k = starts.Size(); k-- > 0;)
+        {
+            usize at = starts[k];
+            CompileElement(pattern, at, elements);
+        }
+    }
+    void Matcher::CompileElement(StringView pattern, usize& i,
+                                 Vector<i32>* elements)
+    {
+        char c = pattern[i];
+        if (IsGroup(pattern, i))
+        {
+            CompileGroup(pattern, i);
+            if (elements) elements->PushBack(-2);
+            return;
+        }
+        if (c == '*')
+        {
+            // loop: split any, out; any; jump loop
+            u32 loop = Emit(Operation::eSplit, m_Code.Size() + 1);
+            Emit(Operation::eAny);
+            Emit(Operation::eJump, loop);
+            m_Code[loop].Arg1 = m_Code.Size();
+            if (elements) elements->PushBack(-1);
+            ++i;
+            return;
+        }
+        if (c == '?')
+        {
+            Emit(Operation::eAny);
+            if (elements) elements->PushBack(-2);
+            ++i;
+            return;
+        }
+        if (c == '[')
+        {
+            usize index = m_Classes.Size();
+            m_Classes.Resize(index + 4);
+            if (usize end = ParseClass(pattern, i, &m_Classes[index]))
+            {
+                Emit(Operation::eClass, index);
+                if (elements) elements->PushBack(-2);
+                i = end;
+                return;
+            }
+            m_Classes.Resize(index);
+        }
+
+        if (c == '\\' && i + 1 < pattern.Size()) c = pattern[++i];
+        m_Code[Emit(Operation::eByte)].Byte = c;
+        if (elements) elements->PushBack(static_cast<u8>(c));
+        ++i;
+    }
+    void Matcher::CompileGroup(StringView pattern, usize& i)
+    {
+        char kind = pattern[i];
+        i += 2;
+
+        // ?(...) and *(...) may skip the group entirely
+        u32 skip  = kind == '?' || kind == '*' ? Emit(Operation::eSplit)
+                                               : 0;
+        u32 body  = m_Code.Size();
+
+        // split a, next; a; jump end; next: split b, next; b; ...
+        Vector<u32> exits;
+        for (;;)
+        {
+            u32 split = Emit(Operation::eSplit, m_Code.Size() + 1);
+            CompileSequence(pattern, i, true, nullptr);
+            bool more = i < pattern.Size() && pattern[i] == '|';
+            ++i;
+            if (!more)
+            {
+                // The last one falls through to the end
+                m_Code[split].Arg1 = split + 1;
+                break;
+            }
+
+            exits.PushBack(Emit(Operation::eJump));
+            m_Code[split].Arg1 = m_Code.Size();
+        }
+        for (u32 exit : exits) m_Code[exit].Arg0 = m_Code.Size();
+
+        // Another round, or on past the group
+        if (kind == '*') Emit(Operation::eJump, skip);
+        if (kind == '+')
+            Emit(Operation::eSplit, body, m_Code.Size() + 1);
+        if (kind == '?' || kind == '*')
+        {
+            m_Code[skip].Arg0 = body;
+            m_Code[skip].Arg1 = m_Code.Size();
+        }
+    }
+
+    void Matcher::Closure(u64* set, u32 pc) const
+    {
+        // Splits may loop back on themselves, the set doubles as the
+        // visited marks
+        Vector<u32> stack;
+        stack.PushBack(pc);
+        while (!stack.Empty())
+        {
+            u32 at = stack.Back();
+            stack.PopBack();
+            if (at >= m_Code.Size() || set[at >> 6] & (u64(1) << (at & 63)))
+                continue;
+            set[at >> 6] |= u64(1) << (at & 63);
+
+            auto& instruction = m_Code[at];
+            if (instruction.Op == Operation::eSplit)
+            {
+                stack.PushBack(instruction.Arg1);
+                stack.PushBack(instruction.Arg0);
+            }
+            else if (instruction.Op == Operation::eJump)
+                stack.PushBack(instruction.Arg0);
+        }
+    }
+    i32 Matcher::AddState(const u64* set)
+    {
+        u64 hash = 14695981039346656037ull;
+        for (usize w = 0; w < m_SetWords; w++)
+            hash = (hash ^ set[w]) * 1099511628211ull;
+
+        auto found = m_States.Find(hash);
+        if (found != m_States.end()
+            && memcmp(&m_Sets[*found->Value * m_SetWords], set,
+                      m_SetWords * sizeof(u64))
+                   == 0)
+            return *found->Value;
+        // Two sets with one hash, rare enough to search for
+        for (usize state = 0; found != m_States.end()
+                              && state < m_Accepting.Size();
+             state++)
+            if (memcmp(&m_Sets[state * m_SetWords], set,
+                       m_SetWords * sizeof(u64))
+                == 0)
+                return state;
+
+        i32 state = m_Accepting.Size();
+        for (usize w = 0; w < m_SetWords; w++) m_Sets.PushBack(set[w]);
+        u32 accepting = 0;
+        for (usize k = 0; k < m_Ends.Size() && !accepting; k++)
+            if ((set[m_Ends[k] >> 6] >> (m_Ends[k] & 63)) & 1)
+                accepting = k + 1;
+        m_Accepting.PushBack(accepting);
+        m_Transitions.Resize(m_Transitions.Size() + 256);
+        for (usize c = 0; c < 256; c++)
+            m_Transitions[state * 256 + c] = state == 0 ? 0 : -1;
+        if (found == m_States.end()) m_States[hash] = state;
+        return state;
+    }
+    i32 Matcher::Step(i32 state, u8 c)
+    {
+        Vector<u64> next(m_SetWords);
+        for (usize w = 0; w < m_SetWords; w++) next[w] = 0;
+
+        const u64* set = &m_Sets[state * m_SetWords];
+        for (u32 pc = 0; pc < m_Code.Size(); pc++)
+        {
+            if (!(set[pc >> 6] & (u64(1) << (pc & 63)))) continue;
+
+            auto& instruction = m_Code[pc];
+            bool  consumes    = instruction.Op == Operation::eAny
+                           || (instruction.Op == Operation::eByte
+                               && instruction.Byte == c)
+                           || (instruction.Op == Operation::eClass
+                               && m_Classes[instruction.Arg0 + (c >> 6)]
+                                      & (u64(1) << (c & 63)));
+            if (consumes) Closure(next.Raw(), pc + 1);
+        }
+
+        if (m_Accepting.Size() >= MAX_DFA_STATES)
+        {
+            Reset();
+            return AddState(next.Raw());
+        }
+
+        i32 target                     = AddState(next.Raw());
+        m_Transitions[state * 256 + c] = target;
+        return target;
+    }
+    void Matcher::Reset()
+    {
+        m_Sets.Clear();
+        m_Accepting.Clear();
+        m_Transitions.Clear();
+        m_States.Clear();
+
+        Vector<u64> set(m_SetWords);
+        for (usize w = 0; w < m_SetWords; w++) set[w] = 0;
+        AddState(set.Raw());
+        Closure(set.Raw(), 0);
+        AddState(set.Raw());
+    }
+
+    bool Matcher::Matches(StringView name)
+    {
+        usize ends = m_Prefix.Size() + m_Suffix.Size();
+        if (name.Size() < ends
+            || memcmp(name.Raw(), m_Prefix.Raw(), m_Prefix.Size()) != 0
+            || memcmp(name.Raw() + name.Size() - m_Suffix.Size(),
+                      m_Suffix.Raw(), m_Suffix.Size())
+                   != 0)
+            return false;
+        if (m_StarOnly) return true;
+
+        i32 state = 1;
+        for (char c : name)
+        {
+            u8  byte = c;
+            i32 next = m_Transitions[state * 256 + byte];
+            if (next < 0) next = Step(state, byte);
+            if (next == 0) return false;
+            state = next;
+        }
+        return m_Accepting[state];
+    }
+    usize Matcher::First(StringView text, usize from)
+    {
+        i32 state = 1;
+        for (char c : text)
+        {
+            u8  byte = c;
+            i32 next = m_Transitions[state * 256 + byte];
+            if (next < 0) next = Step(state, byte);
+            if (next == 0) return StringView::NPos;
+            state = next;
+        }
+
+        u32 accepting = m_Accepting[state];
+        if (accepting == 0) return StringView::NPos;
+        if (accepting > from) return accepting - 1;
+
+        // The first one is before from, the state's set tells which of
+        // the later ones match too
+        const u64* set = &m_Sets[state * m_SetWords];
+        for (usize k = from; k < m_Ends.Size(); k++)
+            if ((set[m_Ends[k] >> 6] >> (m_Ends[k] & 63)) & 1) return k;
+        return StringView::NPos;
+    }
+    usize Matcher::Match(StringView text, bool longest)
+    {
+        usize found = StringView::NPos;
+        i32   state = 1;
+        for (usize i = 0;; i++)
+        {
+            if (m_Accepting[state])
+            {
+                found = i;
+                if (!longest) break;
+            }
+            if (i == text.Size()) break;
+
+            u8  byte = m_Reversed ? text[text.Size() - i - 1] : text[i];
+            i32 next = m_Transitions[state * 256 + byte];
+            if (next < 0) next = Step(state, byte);
+            if (next == 0) break;
+            state = next;
+        }
+        return found;
+    }
+
+    void Matcher::Starts(StringView text, Vector<u64>& starts)
+    {
+        starts.Clear();
+        starts.Resize(text.Size() / 64 + 1);
+        for (auto& word : starts) word = 0;
+
+        // Read from the end, the open matcher accepts where the rest of
+        // text starts with a match
+        if (!m_Starts) m_Starts = CreateRef<Matcher>(m_Source, true, true);
+        auto& open  = *m_Starts;
+        i32   state = 1;
+        for (usize i = text.Size();; i--)
+        {
+            if (open.m_Accepting[state]) starts[i >> 6] |= u64(1) << (i & 63);
+            if (i == 0) break;
+
+            u8  byte = text[i - 1];
+            i32 next = open.m_Transitions[state * 256 + byte];
+            if (next < 0) next = open.Step(state, byte);
+            if (next == 0) break;
+            state = next;
+        }
+    }
+
+    Regex::Regex(const String& pattern)
+    {
+        i32 error = regcomp(&m_Regex, pattern.Raw(), REG_EXTENDED | REG_NOSUB);
+        if (error == 0) return;
+
+        char message[256];
+        regerror(error, &m_Regex, message, sizeof(message));
+        PrismError("awsh: {}: {}\n", pattern, message);
+        m_Invalid = true;
+    }
+    Regex::~Regex()
+    {
+        if (!m_Invalid) regfree(&m_Regex);
+    }
+    bool Regex::Matches(const String& text) const
+    {
+        return !m_Invalid && regexec(&m_Regex, text.Raw(), 0, nullptr, 0) == 0;
+    }
+
+    Ref<Matcher> Compile(StringView pattern, bool reversed)
+    {
+        auto& entry = Lookup(reversed ? '%' : '#', pattern);
+        if (!entry.Compiled)
+            entry.Compiled = CreateRef<Matcher>(pattern, reversed);
+        return entry.Compiled;
+    }
+    Ref<Regex> CompileRegex(StringView pattern)
+    {
+        // A regex that does not compile is cached too, and reported once
+        auto& entry = Lookup('~', pattern);
+        if (!entry.Expression)
+            entry.Expression = CreateRef<Regex>(String(pattern));
+        return entry.Expression->Invalid() ? nullptr : entry.Expression;
+    }
+}; // namespace Pattern
@@ -0,0 +1,148 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#pragma once
+
+#include <Prism/Containers/UnorderedMap.hpp>
+#include <Prism/Containers/Vector.hpp>
+#include <Prism/Memory/Ref.hpp>
+#include <Prism/String/String.hpp>
+#include <Prism/String/StringView.hpp>
+
+#include <regex.h>
+
+// Shell patterns, *, ?, [...] and the ?(), *(), +() and @() extglob groups,
+// and the extended regular expressions of [[ =~ ]]. Globbing, ${v#p},
+// ${v/p/s}, [[ ]] and case all get their matchers from here, compiled once
+// and shared through a small LRU cache keyed by the pattern text
+namespace Pattern
+{
+    // Whether text has anything that does not only match itself
+    bool   IsPattern(StringView text);
+    // text with its backslashes dropped, for a pattern with none of the above
+    String Unescape(StringView text);
+    // text with every byte a pattern treats specially escaped
+    String Escape(StringView text);
+    // text with every byte a regex treats specially escaped
+    String EscapeRegex(StringView text);
+
+    // A pattern compiled to a small program, run as a DFA whose states are
+    // only built once some text reaches them. A reversed one matches the
+    // text read from its end. Matching builds states, so a matcher belongs
+    // to one thread
+    class Matcher : public RefCounted
+    {
+      public:
+        // An open one also lets anything follow a match, or precede it
+        // when reversed
+        explicit Matcher(StringView pattern, bool reversed = false,
+                         bool open = false);
+        // All of patterns run at once, for First()
+        explicit Matcher(const Vector<String>& patterns);
+
+        // Whether the whole of text matches
+        bool       Matches(StringView text);
+        // Index of the first of the patterns, from on, that the whole of
+        // text matches, in a single pass over it. NPos when there is none
+        usize      First(StringView text, usize from = 0);
+        // Length of the shortest or longest match at the start of text,
+        // or its end when reversed. NPos when there is none
+        usize      Match(StringView text, bool longest);
+        // Sets the bit of every position of text a match starts at, in a
+        // single pass over it from its end. Only for one pattern
+        void       Starts(StringView text, Vector<u64>& starts);
+        // Names starting with . are only matched by a literal .
+        bool       MatchesHidden() const { return m_Hidden; }
+        // Bytes every match starts with
+        StringView Prefix() const { return m_Prefix; }
+
+      private:
+        enum class Operation : u8
+        {
+            eByte,
+            eAny,
+            eClass, // Arg0 is the index of the set in m_Classes
+            eSplit, // continues at both Arg0 and Arg1
+            eJump,
+            eMatch,
+        };
+        struct Instruction
+        {
+            Operation Op;
+            u8        Byte = 0;
+            u32       Arg0 = 0;
+            u32       Arg1 = 0;
+        };
+
+        Vector<Instruction>    m_Code;
+        Vector<u64>            m_Classes;
+
+        // Literal bytes every match starts and ends with, checked
+        // before the DFA runs
+        String                 m_Prefix;
+        String                 m_Suffix;
+        // Nothing but prefix*suffix, the DFA is never needed
+        bool                   m_StarOnly = false;
+        bool                   m_Hidden   = false;
+        bool                   m_Reversed = false;
+        // The pattern, for the open matcher Starts() runs backwards
+        String                 m_Source;
+        Ref<Matcher>           m_Starts;
+
+        // The eMatch ending each pattern
+        Vector<u32>            m_Ends;
+
+        // State 0 is dead and state 1 the start, each one is the set of
+        // instructions the text reaching it may continue at
+        usize                  m_SetWords = 0;
+        Vector<u64>            m_Sets;
+        // 1 + index of the first pattern a state matches, 0 for none
+        Vector<u32>            m_Accepting;
+        // 256 per state, -1 until it is built
+        Vector<i32>            m_Transitions;
+        UnorderedMap<u64, i32> m_States;
+
+        u32  Emit(Operation op, u32 arg0 = 0, u32 arg1 = 0);
+        // Top level elements are recorded as their byte, -1 for a star
+        // and -2 for anything else, to find the literal ends
+        void CompileSequence(StringView pattern, usize& i, bool group,
+                             Vector<i32>* elements);
+        void CompileElement(StringView pattern, usize& i,
+                            Vector<i32>* elements);
+        void CompileGroup(StringView pattern, usize& i);
+
+        void Closure(u64* set, u32 pc) const;
+        i32  AddState(const u64* set);
+        i32  Step(i32 state, u8 c);
+        void Reset();
+    };
+
+    // A POSIX extended regular expression
+    class Regex : public RefCounted
+    {
+      public:
+        explicit Regex(const String& pattern);
+        ~Regex();
+
+        Regex(const Regex&)            = delete;
+        Regex& operator=(const Regex&) = delete;
+
+        // Whether compiling it failed, the reason was already reported
+        bool Invalid() const { return m_Invalid; }
+        // Whether some part of text matches, text has to end in a NUL
+        bool Matches(const String& text) const;
+
+      private:
+        regex_t m_Regex;
+        bool    m_Invalid = false;
+    };
+
+    // The matcher of pattern, compiled the first time it is asked for. Only
+    // for the shell's own thread, the cache is not locked
+    Ref<Matcher> Compile(StringView pattern, bool reversed = false);
+    // Same for a regex, nullptr when it does not compile
+    Ref<Regex>   CompileRegex(StringView pattern);
+}; // namespace Pattern
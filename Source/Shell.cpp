@@ -6,6 +6,7 @@
  */
 #include <Builtins.hpp>
 #include <Executor.hpp>
+#include <Jobs.hpp>
 #include <Lexer.hpp>
 #include <Lowerer.hpp>
 #include <Parser.hpp>
@@ -17,7 +18,9 @@
 #include <Prism/Utility/Optional.hpp>
 
 #include <Shell.hpp>
+#include <Trace.hpp>
 
+#include <fcntl.h>
 #include <sys/wait.h>
 #include <termios.h>
 
@@ -37,7 +40,6 @@ namespace Shell
         termios            s_Termios;
         String             s_Cwd = "/";
 
-        Vector<StringView> s_Environment;
         isize              s_LastExitCode = 0;
 
         void Print(StringView string) { PrismMessage("{}", string); }
@@ -116,10 +118,8 @@ namespace Shell
 #endif
     }; // namespace
 
-    void Initialize(const Vector<StringView>& envp)
+    void Initialize()
     {
-        s_Environment = envp;
-
         s_UserID      = getuid();
         s_SessionID   = setsid();
 
@@ -129,13 +129,12 @@ namespace Shell
         auto* cwd = getcwd(nullptr, 0);
         s_Cwd     = cwd;
         free(cwd);
-
-        Builtins::Initialize();
     }
     ErrorOr<void> Run()
     {
         for (;;)
         {
+            Jobs::List(true);
             Prompt();
             auto result = ReadLine();
             if (!result.HasValue()) continue;
@@ -153,11 +152,27 @@ namespace Shell
     void          EnablePosixMode() { s_PosixMode = true; }
     void          EnableVerbose() { s_Verbose = true; }
     void          EnableTesting(TestMode mode) { s_TestMode = mode; }
+    void          EnableResourceLog(i32 fd) { Jobs::EnableUsageLog(fd); }
 
-    ErrorOr<void> RunCommand(StringView line)
+    ErrorOr<void> EnableTracing(PathView path) { return Trace::Open(path); }
+
+    ErrorOr<void> RunCommand(StringView line, bool last)
     {
+        Trace::Scope commandScope("RunCommand", "shell");
+
+        u64          phaseStart = Trace::IsEnabled() ? Jobs::MonotonicTime() : 0;
+        auto         endPhase   = [&phaseStart](StringView name)
+        {
+            if (!Trace::IsEnabled()) return;
+
+            u64 now = Jobs::MonotonicTime();
+            Trace::Complete(name, "phase", phaseStart, now - phaseStart);
+            phaseStart = now;
+        };
+
         Lexer lexer(line.Trim());
         auto& tokens = lexer.Analyze();
+        endPhase("lex");
 
         bool  exit   = false;
         IgnoreUnused(exit);
@@ -176,34 +191,59 @@ namespace Shell
                 return {};
         }
 
+        phaseStart = Trace::IsEnabled() ? Jobs::MonotonicTime() : 0;
         Parser parser(tokens);
         auto   ast = parser.Parse();
+        endPhase("parse");
         if (s_TestMode & TestMode::eParser)
         {
             ast->Print();
             if (!(s_TestMode & TestMode::eExecutor)) return {};
         }
 
-        Lowerer lowerer(ast);
+        Lowerer lowerer(ast, last);
 #define DebugTrace(...)                                                        \
     if (s_TestMode & TestMode::eExecutor) { PrismTrace(__VA_ARGS__); }
 #define DebugInfo(...)                                                         \
     if (s_TestMode & TestMode::eExecutor) { PrismInfo(__VA_ARGS__); }
 
         DebugTrace("Shell: Lowering the ast into IR");
+        phaseStart   = Trace::IsEnabled() ? Jobs::MonotonicTime() : 0;
         auto lowered = lowerer.Lower();
+        endPhase("lower");
         if (s_TestMode & TestMode::eExecutor) DumpProgram(lowered);
         DebugInfo("Shell: Lowering complete");
         Executor e(lowered, s_LastExitCode);
         DebugTrace("Shell: Executing IR");
+        phaseStart     = Trace::IsEnabled() ? Jobs::MonotonicTime() : 0;
         s_LastExitCode = e.Execute();
+        endPhase("execute");
         DebugInfo("Shell: Executing done");
 
         return {};
     }
     ErrorOr<void> RunFile(PathView path)
     {
-        IgnoreUnused(path);
-        return Error(ENOSYS);
+        i32 fd = open(path.Raw(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            PrismError("awsh: {}: cannot open file", path.Raw());
+            return Error(errno);
+        }
+
+        String script;
+        char   buffer[4096];
+        for (;;)
+        {
+            isize nread = read(fd, buffer, sizeof(buffer));
+            if (nread < 0 && errno == EINTR) continue;
+            if (nread <= 0) break;
+
+            script += StringView(buffer, nread);
+        }
+        close(fd);
+
+        return RunCommand(script, true);
     }
+    isize LastExitCode() { return s_LastExitCode; }
 }; // namespace Shell
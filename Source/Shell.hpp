@@ -32,14 +32,21 @@ namespace Shell
         return ToUnderlying(lhs) & ToUnderlying(rhs);
     }
 
-    void          Initialize(const Vector<StringView>& envp);
+    // The inherited environment is left to Environment, which only looks
+    // into it on demand
+    void          Initialize();
     ErrorOr<void> Run();
 
     void          EnableRestricted();
     void          EnablePosixMode();
     void          EnableVerbose();
     void          EnableTesting(TestMode mode);
+    void          EnableResourceLog(i32 fd);
+    ErrorOr<void> EnableTracing(PathView path);
 
-    ErrorOr<void> RunCommand(StringView command);
+    // When last is set, nothing runs after this command string, so its
+    // final command may exec in place of the shell
+    ErrorOr<void> RunCommand(StringView command, bool last = false);
     ErrorOr<void> RunFile(PathView path);
+    isize         LastExitCode();
 }; // namespace Shell
@@ -61,6 +61,10 @@ enum class TokenType : isize
     eBraceClose              = 45, // }
     eComma                   = 46, // ,
     eGlobWord                = 47, // word containing *, ?, or [...]
+    eHereDocLiteral          = 48, // here-document with a quoted delimiter
+    eArithmeticCommand       = 49, // (( ... )) as a command
+    eQuotedString            = 50, // "...", expansions in it still apply
+    eAppendAssign            = 51, // +=
 };
 
 struct Token
@@ -68,4 +72,6 @@ struct Token
     TokenType Type;
     String    Text;
     usize     Offset;
+    // Follows the token before it without a blank in between
+    bool      Joined = false;
 };
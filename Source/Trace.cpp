@@ -0,0 +1,139 @@
+/*
+ * Created by v1tr10l7 on 18.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <Jobs.hpp>
+#include <Trace.hpp>
+
+#include <fcntl.h>
+
+using namespace Prism;
+
+namespace Trace
+{
+    namespace
+    {
+        constexpr usize FLUSH_THRESHOLD = 64 * 1024;
+
+        i32             s_Fd            = -1;
+        pid_t           s_Pid           = 0;
+        bool            s_First         = true;
+        String          s_Buffer;
+
+        void            Flush()
+        {
+            const char* data = s_Buffer.Raw();
+            usize       left = s_Buffer.Size();
+            while (left > 0)
+            {
+                isize nwritten = write(s_Fd, data, left);
+                if (nwritten < 0 && errno == EINTR) continue;
+                if (nwritten <= 0) break;
+
+                data += nwritten;
+                left -= nwritten;
+            }
+
+            s_Buffer.Clear();
+        }
+        void BeginEvent()
+        {
+            s_Buffer += s_First ? "[\n" : ",\n";
+            s_First = false;
+        }
+    }; // namespace
+
+    ErrorOr<void> Open(PathView path)
+    {
+        s_Fd = open(path.Raw(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (s_Fd < 0) return Error(errno);
+
+        s_Pid = getpid();
+        s_Buffer.Reserve(FLUSH_THRESHOLD + 1024);
+
+        BeginEvent();
+        char event[128];
+        snprintf(event, sizeof(event),
+                 "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                 "\"args\":{\"name\":\"awsh\"}}",
+                 s_Pid);
+        s_Buffer += event;
+
+        atexit(Close);
+        return {};
+    }
+    void Close()
+    {
+        if (s_Fd < 0) return;
+
+        s_Buffer += "\n]\n";
+        Flush();
+        close(s_Fd);
+        s_Fd = -1;
+    }
+    void DisableAfterFork()
+    {
+        if (s_Fd < 0) return;
+
+        close(s_Fd);
+        s_Fd = -1;
+        s_Buffer.Clear();
+    }
+
+    bool IsEnabled() { return s_Fd >= 0; }
+    void Complete(StringView name, StringView category, u64 start,
+                  u64 duration, pid_t tid)
+    {
+        if (s_Fd < 0) return;
+
+        BeginEvent();
+        s_Buffer += "{\"name\":\"";
+        AppendEscaped(s_Buffer, name);
+        s_Buffer += "\",\"cat\":\"";
+        AppendEscaped(s_Buffer, category);
+
+        char fields[128];
+        snprintf(fields, sizeof(fields),
+                 "\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%d,"
+                 "\"tid\":%d}",
+                 static_cast<unsigned long long>(start),
+                 static_cast<unsigned long long>(duration), s_Pid,
+                 tid ? tid : s_Pid);
+        s_Buffer += fields;
+
+        if (s_Buffer.Size() >= FLUSH_THRESHOLD) Flush();
+    }
+
+    void AppendEscaped(String& out, StringView text)
+    {
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out += '\\';
+                out += c;
+            }
+            else if (static_cast<u8>(c) < 0x20)
+            {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            }
+            else out += c;
+        }
+    }
+
+    Scope::Scope(StringView name, StringView category)
+        : m_Name(name)
+        , m_Category(category)
+        , m_Start(s_Fd >= 0 ? Jobs::MonotonicTime() : 0)
+    {
+    }
+    Scope::~Scope()
+    {
+        if (s_Fd < 0) return;
+        Complete(m_Name, m_Category, m_Start, Jobs::MonotonicTime() - m_Start);
+    }
+}; // namespace Trace
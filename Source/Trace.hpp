@@ -0,0 +1,44 @@
+/*
+ * Created by v1tr10l7 on 18.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#pragma once
+
+#include <Prism/Core/Error.hpp>
+#include <Prism/String/String.hpp>
+#include <Prism/Utility/PathView.hpp>
+
+#include <sys/types.h>
+
+// Chrome/Perfetto trace-event output, enabled with --trace-file. Events are
+// collected in memory and written out in large batches
+namespace Trace
+{
+    ErrorOr<void> Open(PathView path);
+    void          Close();
+    // Forked children of the shell do not trace, their copy of the buffer
+    // is dropped
+    void          DisableAfterFork();
+
+    bool          IsEnabled();
+    // A span of duration microseconds, on the track of tid (the shell itself
+    // when tid is 0)
+    void          Complete(StringView name, StringView category, u64 start,
+                           u64 duration, pid_t tid = 0);
+
+    void          AppendEscaped(String& out, StringView text);
+
+    class Scope
+    {
+      public:
+        Scope(StringView name, StringView category);
+        ~Scope();
+
+      private:
+        StringView m_Name;
+        StringView m_Category;
+        u64        m_Start = 0;
+    };
+}; // namespace Trace
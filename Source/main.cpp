@@ -11,6 +11,7 @@
 #include <Shell.hpp>
 #include <Version.hpp>
 
+#include <fcntl.h>
 #include <getopt.h>
 
 using namespace Prism;
@@ -32,6 +33,12 @@ void          help()
         "  -t, --test <argument>   Test command execution up to a given "
         "stage\n");
     printf("                     (lexer, parser, executor)\n");
+    printf(
+        "  -R, --rusage-fd <fd>    Write resource usage of every command as "
+        "JSON lines to fd\n");
+    printf(
+        "  -T, --trace-file <path> Write a Chrome trace-event profile of the "
+        "run to path\n");
     printf("  -V, --verbose           Enable verbose output\n");
     printf("  -v, --version           Display version information and exit\n");
     printf("  -h, --help              Display this help message and exit\n");
@@ -47,10 +54,9 @@ void printVersion()
         AS_BUILD_TIME, AS_BUILD_TAG);
 }
 
-ErrorOr<void> NeonMain(const Vector<StringView>& args,
-                       const Vector<StringView>& envs)
+ErrorOr<void> NeonMain(const Vector<StringView>& args)
 {
-    Shell::Initialize(envs);
+    Shell::Initialize();
     auto options = Prism::ToArray<option>({
         {"command", no_argument, nullptr, 'c'},
         {"interactive", no_argument, nullptr, 'i'},
@@ -58,6 +64,8 @@ ErrorOr<void> NeonMain(const Vector<StringView>& args,
         {"restricted", no_argument, nullptr, 'r'},
         {"posix", no_argument, nullptr, 'p'},
         {"test", required_argument, nullptr, 't'},
+        {"rusage-fd", required_argument, nullptr, 'R'},
+        {"trace-file", required_argument, nullptr, 'T'},
         {"verbose", no_argument, nullptr, 'V'},
         {"version", no_argument, nullptr, 'v'},
         {"help", no_argument, nullptr, 'h'},
@@ -71,17 +79,19 @@ ErrorOr<void> NeonMain(const Vector<StringView>& args,
     } runMode
         = RunMode::eScriptFile;
 
-    usize modeSetCount = 0;
-    i32   optionIndex  = 0;
+    usize      modeSetCount = 0;
+    i32        optionIndex  = 0;
+    StringView commandString;
     for (;;)
     {
-        i32 c = getopt_long(s_SavedArgc, s_SavedArgv, "c:i:l:r:p:t:V:v:h",
+        i32 c = getopt_long(s_SavedArgc, s_SavedArgv, "c:i:l:r:p:t:R:T:V:v:h",
                             options.Raw(), &optionIndex);
         if (c == -1) break;
         switch (c)
         {
             case 'c':
-                runMode = RunMode::eSingleCommand;
+                runMode       = RunMode::eSingleCommand;
+                commandString = optarg;
                 ++modeSetCount;
                 break;
             case 'i':
@@ -114,6 +124,29 @@ ErrorOr<void> NeonMain(const Vector<StringView>& args,
                 Shell::EnableTesting(testMode);
                 break;
             }
+            case 'R':
+            {
+                i32 fd = StringUtils::ToNumber<i32>(optarg);
+                if (fcntl(fd, F_GETFD) < 0)
+                {
+                    PrismError("Invalid file descriptor for --rusage-fd: {}",
+                               optarg);
+                    return Error(EBADF);
+                }
+
+                Shell::EnableResourceLog(fd);
+                break;
+            }
+            case 'T':
+            {
+                auto status = Shell::EnableTracing(optarg);
+                if (!status)
+                {
+                    PrismError("Cannot open trace file: {}", optarg);
+                    return status;
+                }
+                break;
+            }
             case 'V': Shell::EnableVerbose(); break;
             case 'v': printVersion(); return {};
             case 'h': help(); return {};
@@ -126,6 +159,12 @@ ErrorOr<void> NeonMain(const Vector<StringView>& args,
         return Error(EINVAL);
     }
 
+    // -c's command string is its own argument, further operands would be
+    // $0 and the positional parameters
+    if (runMode == RunMode::eSingleCommand && !commandString.Empty()
+        && commandString != "-"_sv)
+        return Shell::RunCommand(commandString, true);
+
     if (optind < s_SavedArgc)
     {
         if (runMode == RunMode::eInteractive)
@@ -142,7 +181,7 @@ ErrorOr<void> NeonMain(const Vector<StringView>& args,
                 builder.Append(s_SavedArgv[i]);
             }
 
-            return Shell::RunCommand(builder.ToString());
+            return Shell::RunCommand(builder.ToString(), true);
         }
 
         PathView path = args[optind];
@@ -161,18 +200,16 @@ ErrorOr<void> NeonMain(const Vector<StringView>& args,
 
     return Shell::Run();
 }
-i32 main(int argc, char** argv, char** envp)
+i32 main(int argc, char** argv)
 {
     Vector<StringView> argArr;
-    Vector<StringView> envArr;
 
     for (isize i = 0; i < argc && argv[i]; i++) argArr.EmplaceBack(argv[i]);
-    for (usize i = 0; envp[i]; i++) envArr.EmplaceBack(envp[i]);
 
     s_SavedArgc = argc;
     s_SavedArgv = argv;
-    auto status = NeonMain(argArr, envArr);
+    auto status = NeonMain(argArr);
     if (!status) return status.Error();
 
-    return 0;
+    return Shell::LastExitCode();
 }
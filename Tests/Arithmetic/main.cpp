@@ -0,0 +1,75 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <ScriptTest.hpp>
+
+static Vector<ScriptTestCase> s_ArithmeticTests = {
+    {"Multiplicative binds tighter than additive",
+     R"(r=$(( 1 + 2 * 3 - (4 - 1) ** 2 % 5 )))",
+     "3"},
+    {"** is right associative",
+     R"(r=$(( 2 ** 3 ** 2 )))",
+     "512"},
+    {"Unary minus binds tighter than **",
+     R"(r=$(( -2 ** 2 )))",
+     "4"},
+    {"- and / are left associative",
+     R"(r=$(( 10 - 3 - 2 ))$(( 100 / 10 / 5 )))",
+     "52"},
+    {"Division truncates toward zero",
+     R"(r=$(( -7 / 2 ))$(( -7 % 2 )))",
+     "-3-1"},
+    {"Shift binds looser than additive",
+     R"(r=$(( 1 << 2 + 1 )))",
+     "8"},
+    {"Comparison binds tighter than equality",
+     R"(r=$(( 1 == 1 != 0 < 2 )))",
+     "0"},
+    {"Bitwise precedence",
+     R"(r=$(( 7 & 3 | 8 ^ 1 )))",
+     "11"},
+    {"Logical operators",
+     R"(r=$(( 3 > 2 && 0 || 5 ))$(( !0 + ~0 )))",
+     "10"},
+    {"&& does not evaluate its right side after 0",
+     R"(x=0; r=$(( 0 && (x = 1) ))$x)",
+     "00"},
+    {"Nested conditionals",
+     R"(r=$(( 1 ? 2 : 3 ? 4 : 5 )))",
+     "2"},
+    {"Assignment operators and the comma",
+     R"(x=5; (( x += 3, x *= 2 )); r=$x)",
+     "16"},
+    {"Increments",
+     R"(x=3; r=$(( x++ + ++x ))$x)",
+     "85"},
+    {"Variable holding a name",
+     R"(x=2; y=x; r=$(( y * 3 )))",
+     "6"},
+    {"Bases",
+     R"(r=$(( 0x1f + 010 + 2#101 )))",
+     "44"},
+    {"Status of (( ))",
+     R"((( 0 )); a=$?; (( 2 )); r=$a$?)",
+     "10"},
+    {"Syntax error fails the assignment",
+     R"(r=a; r=$(( 1 + )); r=$r$?)",
+     "a1"},
+    {"Division by zero fails (( ))",
+     R"((( 1 / 0 )); r=$?)",
+     "1"},
+    {"Remainder by zero fails the assignment",
+     R"(r=a; r=$(( 5 % 0 )); r=$r$?)",
+     "a1"},
+    {"Negative exponent fails and keeps the variable",
+     R"(r=a; x=1; x=$(( 2 ** -1 )); r=$r$?$x)",
+     "a11"},
+};
+
+int main()
+{
+    return RunScriptTests(s_ArithmeticTests);
+}
@@ -0,0 +1,96 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#pragma once
+
+#include <Executor.hpp>
+#include <Jobs.hpp>
+#include <Lexer.hpp>
+#include <Lowerer.hpp>
+#include <Parser.hpp>
+#include <Prism/Debug/Log.hpp>
+
+#include <cstdlib>
+#include <sys/resource.h>
+
+// Allocations made anywhere in the process. The replacement operators can
+// not be inline, so only the main.cpp of a benchmark includes this header
+inline usize s_Allocations    = 0;
+inline usize s_AllocatedBytes = 0;
+
+void* operator new(usize size)
+{
+    ++s_Allocations;
+    s_AllocatedBytes += size;
+    if (void* memory = malloc(size ? size : 1)) return memory;
+    abort();
+}
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete(void* memory, usize) noexcept { free(memory); }
+
+namespace Benchmark
+{
+    // What running a script cost, Elapsed is in microseconds and PeakGrowth
+    // in kB of resident size
+    struct Result
+    {
+        u64   Elapsed     = 0;
+        usize Allocations = 0;
+        usize Bytes       = 0;
+        usize Forks       = 0;
+        usize PeakGrowth  = 0;
+    };
+
+    // Peak resident size of the process in kB, it never goes down
+    inline usize PeakMemory()
+    {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    // Lowers source once and runs it the given number of times, each run
+    // in a fresh executor that sees the status of the one before, like the
+    // body of a loop in a script
+    inline Result Run(StringView source, usize runs = 1)
+    {
+        Lexer   lexer(source);
+        Parser  parser(lexer.Analyze());
+        Lowerer lowerer(parser.Parse());
+        auto    program     = lowerer.Lower();
+
+        usize   allocations = s_Allocations;
+        usize   bytes       = s_AllocatedBytes;
+        usize   forks       = Jobs::ChildCount();
+        usize   peak        = PeakMemory();
+        u64     start       = Jobs::MonotonicTime();
+        isize   status      = 0;
+        for (usize i = 0; i < runs; i++)
+        {
+            Executor executor(program, status);
+            status = executor.Execute();
+        }
+
+        Result result;
+        result.Elapsed     = Jobs::MonotonicTime() - start;
+        result.Allocations = s_Allocations - allocations;
+        result.Bytes       = s_AllocatedBytes - bytes;
+        result.Forks       = Jobs::ChildCount() - forks;
+        result.PeakGrowth  = PeakMemory() - peak;
+        return result;
+    }
+
+    // One line per run, count is how many units of work the script did
+    inline void Report(StringView name, usize count, StringView unit,
+                       const Result& result)
+    {
+        PrismInfo("{}: {} {} in {} ms, {} ns each, {} allocations of {} KiB, "
+                  "{} forks, peak grew by {} kB\n",
+                  name, count, unit, result.Elapsed / 1000,
+                  result.Elapsed * 1000 / count, result.Allocations,
+                  result.Bytes / 1024, result.Forks, result.PeakGrowth);
+    }
+}; // namespace Benchmark
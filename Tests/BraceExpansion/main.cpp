@@ -0,0 +1,40 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <Benchmark.hpp>
+
+// Runs for loops over braces and checks how much the peak resident size
+// grew, which would be the whole list if it was expanded up front
+int main()
+{
+    struct Case
+    {
+        StringView Name;
+        StringView Source;
+        usize      Words;
+    } cases[] = {
+        {"range", "for i in {1..10000000}; do true; done", 10000000},
+        {"padded range", "for i in {0000001..1000000}; do true; done",
+         1000000},
+        {"cross product",
+         "for w in {a..z}{a..z}{a..z}{0..99..3}; do true; done",
+         26 * 26 * 26 * 34},
+        {"nested", "for w in x{a,b{c,d{e,f}}}{1..50000}y; do true; done",
+         4 * 50000},
+    };
+
+    // Ten million words would take hundreds of MB as a list
+    constexpr usize LIMIT   = 8 * 1024;
+    bool            bounded = true;
+    for (auto& test : cases)
+    {
+        auto result = Benchmark::Run(test.Source);
+        Benchmark::Report(test.Name, test.Words, "words", result);
+        if (result.PeakGrowth >= LIMIT) bounded = false;
+    }
+
+    return bounded ? 0 : 1;
+}
@@ -0,0 +1,36 @@
+/*
+ * Created by v1tr10l7 on 18.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <Benchmark.hpp>
+#include <Prism/String/StringUtils.hpp>
+
+// A script loop running the same conditional on every iteration
+static Benchmark::Result RunLoop(StringView name, StringView condition,
+                                 usize iterations)
+{
+    String source = "i=0; while (( i < "_s;
+    source += StringUtils::ToString(iterations);
+    source += " )); do ";
+    source += condition;
+    source += "; (( i++ )); done";
+
+    auto result = Benchmark::Run(source);
+    Benchmark::Report(name, iterations, "iterations", result);
+    return result;
+}
+
+// The builtins must not cost a single child, nor an allocation per
+// iteration
+int main()
+{
+    constexpr usize ITERATIONS = 100000;
+    auto            builtins
+        = RunLoop("builtins", "[ -f /etc/passwd ] && true || false", ITERATIONS);
+    RunLoop("external",
+            "/usr/bin/test -f /etc/passwd && /bin/true || /bin/false", 1000);
+
+    return builtins.Forks == 0 && builtins.Allocations < ITERATIONS ? 0 : 1;
+}
@@ -0,0 +1,52 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <ScriptTest.hpp>
+
+static Vector<ScriptTestCase> s_CaseTests = {
+    {"First matching arm wins",
+     R"(case k in [a-m]) r=1 ;; k) r=2 ;; esac)",
+     "1"},
+    {"Literal arms",
+     R"(for v in c k z; do
+          case $v in a) r=${r}a ;; b) r=${r}b ;; c) r=${r}c ;; k) r=${r}k ;;
+          *) r=${r}- ;; esac
+        done)",
+     "ck-"},
+    {"Alternatives and expansions in a pattern",
+     R"(v=b; case b in a|$v) r=y ;; esac)",
+     "y"},
+    {";& falls through to the next body",
+     R"(case a in a) r=1 ;& b) r=${r}2 ;; c) r=${r}3 ;; esac)",
+     "12"},
+    {";& falls through an empty body",
+     R"(case x in x) ;& y) r=z ;& esac)",
+     "z"},
+    {";| goes on testing the next arms",
+     R"(case xy in x?) r=1 ;| z*) r=${r}2 ;| x*) r=${r}3 ;; x*) r=${r}4 ;;
+        esac)",
+     "13"},
+    {"Quoted pattern is literal",
+     R"(case x in "*") r=q ;; *) r=d ;; esac)",
+     "d"},
+    {"Quoted blank in a pattern",
+     R"(case "a b" in "a b") r=s ;; esac)",
+     "s"},
+    {"Quoted and unquoted expansions of the same pattern",
+     R"(v='?'; case x in "$v") r=q ;; $v) r=u ;; esac)",
+     "u"},
+    {"Status of the body",
+     R"(case k in a) ;; k) (exit 4) ;; esac; r=$?)",
+     "4"},
+    {"No matching arm succeeds",
+     R"(false; case x in y) ;; esac; r=$?)",
+     "0"},
+};
+
+int main()
+{
+    return RunScriptTests(s_CaseTests);
+}
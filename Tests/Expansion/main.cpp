@@ -0,0 +1,112 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <ScriptTest.hpp>
+
+static Vector<ScriptTestCase> s_ExpansionTests = {
+    {"Assignment word as an argument",
+     R"(x=1; r=$(echo a=$x))",
+     "a=1"},
+    {"Assignment word split like any other",
+     R"(x="1  2"; r=$(echo a=$x b=$x))",
+     "a=1 2 b=1 2"},
+    {"Assignment word with a quoted value",
+     R"(x="1  2"; r=$(echo a="$x"))",
+     "a=1  2"},
+    {"Assignment value joined from pieces",
+     R"(x=1; y=a$x/b; r=$y)",
+     "a1/b"},
+    {"Unused operand is not substituted",
+     R"(x=1; r=${x:-$(exit 3)}; r=$r$?)",
+     "10"},
+    {"Used operand is substituted",
+     R"(r=${nope:-$(echo d)})",
+     "d"},
+    {"Bad substitution fails the command",
+     R"(r=$(echo ${x!}; echo $?))",
+     "1"},
+    {"Bad substitution fails the assignment",
+     R"(r=a; r=${x!}; r=$r$?)",
+     "a1"},
+    {"Replacing every match of a pattern",
+     R"(v=abcabcXabc; r=${v//b*c/_}.${v//?(a)b/-})",
+     "a_.-c-cX-c"},
+    {"Decided [[ || ]] leaves its right side unexpanded",
+     R"([[ -n x || ${u:=set} ]]; [[ -z x && ${u:=set} ]]; r=$u.)",
+     "."},
+    {"Undecided [[ || ]] expands its right side",
+     R"([[ -z x || ${u:=set} ]]; r=$u)",
+     "set"},
+    {"Regex with an expansion in it",
+     R"(x=b; [[ abc =~ ^a$x ]]; r=$?)",
+     "0"},
+    {"Regex with a quoted expansion in it",
+     R"(x=.; [[ abc =~ a"$x" ]]; r=$?)",
+     "1"},
+    {"Array element far past the end",
+     R"(a[5000000]=x; a[3]=y; r="${!a[@]} ${a[5000000]}")",
+     "3 5000000 x"},
+    {"Arguments of the caller do not show through",
+     R"(f() { r=$#$1$3; }; g() { f a; }; g x y z)",
+     "1a"},
+    {"Quoted expansion in a case pattern is literal",
+     R"(v='*'; case x in "$v") r=q ;; $v) r=u ;; esac)",
+     "u"},
+    {"Quoted piece of a joined case pattern is literal",
+     R"(v='*'; case ab in a"$v") r=q ;; a$v) r=u ;; esac)",
+     "u"},
+    {"Arithmetic error fails the command",
+     R"(f() { r=ran; }; r=a; f $((2/0)); r=$r$?)",
+     "a1"},
+    {"Arithmetic error fails the assignment",
+     R"(r=a; r=$((1/0)); r=$r$?)",
+     "a1"},
+    {"Assignment resets the status",
+     R"(false; x=$?; r=$x$?)",
+     "10"},
+    {"Assignment keeps the status of its substitution",
+     R"(x=$(exit 3); r=$?)",
+     "3"},
+    {"Blank and non-blank separators together",
+     R"(f() { r=$#; for a; do r=$r[$a]; done; }
+        g() { local IFS=' :'; x=' a : b  c:d::e '; f $x; }; g)",
+     "6[a][b][c][d][][e]"},
+    {"Non-blank separators keep empty fields",
+     R"(f() { r=$#; for a; do r=$r[$a]; done; }
+        g() { local IFS=:; x='a::b:'; f $x; }; g)",
+     "3[a][][b]"},
+    {"Leading non-blank separator makes an empty field",
+     R"(f() { r=$#; for a; do r=$r[$a]; done; }
+        g() { local IFS=' :'; x=' : a'; f $x; }; g)",
+     "2[][a]"},
+    {"Blanks around a non-blank separator belong to it",
+     R"(f() { r=$#; for a; do r=$r[$a]; done; }
+        g() { local IFS=', '; x='1, 2,,3 ,4'; f $x; }; g)",
+     "5[1][2][][3][4]"},
+    {"Empty IFS does not split",
+     R"(f() { r=$#; for a; do r=$r[$a]; done; }
+        g() { local IFS=; x='a b:c'; f $x; }; g)",
+     "1[a b:c]"},
+    {"Quoted expansion is not split",
+     R"(f() { r=$#; for a; do r=$r[$a]; done; }
+        g() { local IFS=:; x='a:b'; f "$x" $x; }; g)",
+     "3[a:b][a][b]"},
+    {"Joined word is split as a whole",
+     R"(f() { r=$#; for a; do r=$r[$a]; done; }
+        g() { local IFS=' :'; x='a b'; y='c:d'; f $x$y; }; g)",
+     "3[a][bc][d]"},
+    {"Joined word in a for list is split as a whole",
+     R"(x='a b'; y='c d'; for a in $x$y; do r=$r[$a]; done)",
+     "[a][bc][d]"},
+    {"IFS is back to blanks after a local one",
+     R"(f() { r=$#; }; g() { local IFS=:; }; g; x='a:b c'; f $x)",
+     "2"},
+};
+
+int main()
+{
+    return RunScriptTests(s_ExpansionTests);
+}
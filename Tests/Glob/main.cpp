@@ -0,0 +1,60 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <ScriptTest.hpp>
+
+// Runs script in a fresh tree with hidden files and directories at every
+// level, then goes back and removes it
+#define IN_TREE(script)                                                        \
+    "o=$PWD; d=$(mktemp -d); cd $d; mkdir -p s/t .h\n"                         \
+    "touch a b .x s/c s/.y s/t/d .h/e\n" script "\ncd $o; rm -r $d"
+
+static Vector<ScriptTestCase> s_GlobTests = {
+    {"* skips hidden files",
+     IN_TREE("r=$(echo *)"),
+     "a b s"},
+    {".* matches hidden files but not . and ..",
+     IN_TREE("r=$(echo .*)"),
+     ".h .x"},
+    {"Hidden files in a subdirectory",
+     IN_TREE("r=$(echo s/.* .h/*)"),
+     "s/.y .h/e"},
+    {"** goes down every visible directory",
+     IN_TREE("r=$(echo **)"),
+     "a b s s/c s/t s/t/d"},
+    {"**/name matches at any depth",
+     IN_TREE("r=$(echo **/d **/c)"),
+     "s/t/d s/c"},
+    {"dir/** includes the directory itself",
+     IN_TREE("r=$(echo s/**)"),
+     "s/ s/c s/t s/t/d"},
+    {"**/ only matches directories",
+     IN_TREE("r=$(echo **/)"),
+     "s/ s/t/"},
+    {"*/* takes one level",
+     IN_TREE("r=$(echo */*)"),
+     "s/c s/t"},
+    {"Bracket and ? patterns",
+     IN_TREE("r=$(echo [ab] ?)"),
+     "a b a b s"},
+    {"Pattern without a match stays as it is",
+     IN_TREE("r=$(echo *.none s/*.none)"),
+     "*.none s/*.none"},
+    {"GLOBIGNORE drops matches and shows hidden files",
+     IN_TREE("GLOBIGNORE=a:s/c; r=$(echo * s/*); GLOBIGNORE="),
+     ".h .x b s s/.y s/t"},
+    {"Glob after a quoted expansion",
+     IN_TREE("p=s; q='*'; r=$(echo \"$p\"/* \"$q\"/c)"),
+     "s/c s/t */c"},
+    {"Glob after a quoted expansion in a for list",
+     IN_TREE("p=s; for i in \"$p\"/*; do r=$r[$i]; done"),
+     "[s/c][s/t]"},
+};
+
+int main()
+{
+    return RunScriptTests(s_GlobTests);
+}
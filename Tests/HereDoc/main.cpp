@@ -0,0 +1,67 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <ScriptTest.hpp>
+
+// Sets x to a kilobyte or to 100 kB, below and above PIPE_BUF
+#define SMALL_BODY                                                             \
+    "x=0123456789; x=$x$x$x$x$x$x$x$x$x$x; x=$x$x$x$x$x$x$x$x$x$x\n"
+#define LARGE_BODY                                                             \
+    SMALL_BODY "x=$x$x$x$x$x$x$x$x$x$x; x=$x$x$x$x$x$x$x$x$x$x\n"
+
+static Vector<ScriptTestCase> s_HereDocTests = {
+    {"Here-document is expanded",
+     R"(x=abc; read r <<EOF
+$x $((1 + 2))
+EOF)",
+     "abc 3"},
+    {"Quoted delimiter keeps the body as it is",
+     R"(x=abc; read r <<'EOF'
+$x
+EOF)",
+     "$x"},
+    {"Body below PIPE_BUF reaches a command",
+     SMALL_BODY R"(f=$(mktemp); cat > $f <<EOF
+$x
+EOF
+r=$(wc -c < $f); rm $f)",
+     "1001"},
+    {"Body above PIPE_BUF reaches a command",
+     LARGE_BODY R"(f=$(mktemp); cat > $f <<EOF
+$x
+EOF
+r=$(wc -c < $f); rm $f)",
+     "100001"},
+    {"Here-string above PIPE_BUF",
+     LARGE_BODY R"(r=$(wc -c <<< "$x"))",
+     "100001"},
+    {"Builtin and command share a here-document",
+     R"(g() { read a; b=$(cat); r=$a$b; }; g <<EOF
+1
+2
+EOF)",
+     "12"},
+    {"Builtin and command share a large here-document",
+     LARGE_BODY R"(g() { read a; b=$(cat); r=${#a}${#b}; }; g <<EOF
+$x
+$x
+EOF)",
+     "100000100000"},
+    {"Here-document in a loop is read anew each time",
+     R"(for i in 1 2 3; do read x <<EOF
+$i
+EOF
+r=$r$x; done)",
+     "123"},
+    {"Here-string to a command",
+     R"(r=$(tr a-z A-Z <<< hello))",
+     "HELLO"},
+};
+
+int main()
+{
+    return RunScriptTests(s_HereDocTests);
+}
@@ -0,0 +1,37 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <Benchmark.hpp>
+#include <Prism/String/StringUtils.hpp>
+
+// Runs the loop over body at two lengths, the longer one must not make
+// more allocations
+static bool RunLoop(StringView name, StringView body, usize iterations)
+{
+    Benchmark::Result results[2];
+    for (usize i = 0; i < 2; i++)
+    {
+        usize  count  = i == 0 ? iterations / 10 : iterations;
+        String source = "i=0; s=0; while (( i < "_s;
+        source += StringUtils::ToString(count);
+        source += " )); do ";
+        source += body;
+        source += "; done";
+
+        results[i] = Benchmark::Run(source);
+        Benchmark::Report(name, count, "iterations", results[i]);
+    }
+
+    return results[1].Allocations <= results[0].Allocations;
+}
+
+int main()
+{
+    bool ok = RunLoop("counter", "(( i++ ))", 1000000);
+    ok &= RunLoop("accumulator", "(( s += i * i % 7, i++ ))", 1000000);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,40 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <ScriptTest.hpp>
+
+static Vector<ScriptTestCase> s_JobTests = {
+    {"wait -n takes jobs in the order they exit",
+     R"((sleep 0.3; exit 3) & (sleep 0.05; exit 5) &
+        wait -n; a=$?; wait -n; r=$a$?)",
+     "53"},
+    {"wait -n takes a job that exited before it was called",
+     R"((exit 2) & sleep 0.1; (sleep 0.2; exit 4) & wait -n; a=$?; wait;
+        r=$a)",
+     "2"},
+    {"wait for a pid gives its status",
+     R"((sleep 0.05; exit 7) & p=$!; wait $p; r=$?)",
+     "7"},
+    {"Plain wait reaps every job and succeeds",
+     R"(for i in 1 2 3 4 5 6 7 8; do (exit $i) & done; wait; r=$?)",
+     "0"},
+    {"wait -n fails once no job is left",
+     R"((exit 1) & (exit 2) & n=0
+        while wait -n; [ $? -ne 127 ]; do n=$((n + 1)); done; r=$n)",
+     "2"},
+    {"Hundreds of jobs are all reaped",
+     R"(for i in {1..300}; do (exit 1) & done; wait; r=$?$(jobs))",
+     "0"},
+    {"$! is the pid of the last job",
+     R"(sleep 0.05 & p=$!; (exit 9) & q=$!; wait $q; a=$?; wait $p
+        r=$a$?$([ $p != $q ] && echo ok))",
+     "90ok"},
+};
+
+int main()
+{
+    return RunScriptTests(s_JobTests);
+}
@@ -84,6 +84,15 @@ echo $((1 + 2 * 3))
 echo 'literal $USER'
 echo 'nested $(echo hi)'
 echo "escaped \" quote"
+)",
+     false},
+
+    // ---------------- REDIRECTIONS ----------------
+    {"Redirections",
+     R"(cat < in.txt > out.txt
+make 2>&1 >> build.log
+exec 3<> fifo 4>&- >| forced.txt
+ls &> all.txt
 )",
      false},
 
@@ -0,0 +1,46 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <ScriptTest.hpp>
+
+static Vector<ScriptTestCase> s_ParallelTests = {
+    {"Output comes in submission order",
+     R"(r=$(parallel -j 3 sh -c 'sleep 0.$1; echo $1' _ ::: 3 1 2))",
+     "3\n1\n2"},
+    {"Items are spread evenly over the jobs",
+     R"(r=$(parallel -j 2 echo ::: a b c d))",
+     "a b\nc d"},
+    {"-n caps the items of a batch",
+     R"(r=$(parallel -j 1 -n 3 echo ::: a b c d))",
+     "a b c\nd"},
+    {"{} marks where the items go",
+     R"(r=$(parallel -j 2 -n 1 echo {} x ::: a b c))",
+     "a x\nb x\nc x"},
+    {"Lines of stdin go one per job",
+     R"(f=$(mktemp); printf 'x\ny\nz\n' > $f
+        r=$(parallel -j 2 echo L < $f); rm $f)",
+     "L x\nL y\nL z"},
+    {"-n batches lines of stdin",
+     R"(f=$(mktemp); printf '1\n2\n3\n4\n5\n' > $f
+        r=$(parallel -n 2 echo < $f); rm $f)",
+     "1 2\n3 4\n5"},
+    {"A line of stdin is a single item",
+     R"(f=$(mktemp); printf 'a b\nc\n' > $f
+        r=$(parallel -j 1 sh -c 'echo $#' _ < $f); rm $f)",
+     "1\n1"},
+    {"Status is the number of failed jobs",
+     R"(parallel -n 1 sh -c 'exit $1' _ ::: 0 3 4; r=$?)",
+     "2"},
+    {"Every item runs once with many jobs in flight",
+     R"(r=$(parallel -j 8 -n 1 echo ::: {1..200}); n=0
+        for i in $r; do n=$((n + i)); done; r=$n)",
+     "20100"},
+};
+
+int main()
+{
+    return RunScriptTests(s_ParallelTests);
+}
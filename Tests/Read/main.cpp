@@ -0,0 +1,52 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <ScriptTest.hpp>
+
+static Vector<ScriptTestCase> s_ReadTests = {
+    {"while read goes over every line",
+     R"(f=$(mktemp); printf 'a b\nc d\n' > $f
+        while read x y; do r=$r$y; done < $f; rm $f)",
+     "bd"},
+    {"while read over thousands of lines",
+     R"(f=$(mktemp); for i in {1..3000}; do echo $i; done > $f
+        n=0; while read l; do n=$((n + l)); done < $f; r=$n; rm $f)",
+     "4501500"},
+    {"Command reads on where read stopped",
+     R"(f=$(mktemp); printf 'a b\nc d\ne\n' > $f
+        g() { read first; rest=$(cat); r="$first|$rest"; }; g < $f; rm $f)",
+     "a b|c d\ne"},
+    {"read goes on where a command stopped",
+     R"(f=$(mktemp); printf 'a\nb\nc\n' > $f
+        g() { read x; head -n 1; read y; r=$x$y; }; g < $f > /dev/null
+        rm $f)",
+     "ac"},
+    {"Last line without a newline",
+     R"(f=$(mktemp); printf last > $f; read x < $f; r=$x$?; rm $f)",
+     "last1"},
+    {"Blanks around the line are trimmed",
+     R"(f=$(mktemp); printf '  lead  trail  \n' > $f; read x < $f
+        r="[$x]"; rm $f)",
+     "[lead  trail]"},
+    {"Last name takes the rest of the line",
+     R"(read a b c <<< '1 2 3 4 5'; r=$c)",
+     "3 4 5"},
+    {"-r keeps backslashes and IFS splits",
+     R"(IFS=: read -r a b <<< 'x:y\z'; r=$a,$b)",
+     "x,y\\z"},
+    {"Backslash newline continues the line",
+     R"(read x <<< 'a\
+b'; r=$x)",
+     "ab"},
+    {"-d ends the line at another delimiter",
+     R"(read -d , x <<< 'a,b'; r=$x)",
+     "a"},
+};
+
+int main()
+{
+    return RunScriptTests(s_ReadTests);
+}
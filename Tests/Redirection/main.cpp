@@ -0,0 +1,55 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <ScriptTest.hpp>
+
+static Vector<ScriptTestCase> s_RedirectionTests = {
+    {">file 2>&1 sends both streams to the file",
+     R"(f=$(mktemp); sh -c 'echo o; echo e >&2' > $f 2>&1
+        r=$(cat $f); rm $f)",
+     "o\ne"},
+    {"2>&1 >file sends stderr where stdout was",
+     R"(f=$(mktemp); r=$(sh -c 'echo o; echo e >&2' 2>&1 > $f)$(cat $f)
+        rm $f)",
+     "eo"},
+    {">> appends",
+     R"(f=$(mktemp); echo a > $f; echo b >> $f; r=$(cat $f); rm $f)",
+     "a\nb"},
+    {">>& appends both streams",
+     R"(f=$(mktemp); echo a > $f; sh -c 'echo o; echo e >&2' >>& $f
+        r=$(cat $f); rm $f)",
+     "a\no\ne"},
+    {"Stdout is back after a redirected builtin",
+     R"(r=$(echo a > /dev/null; echo b))",
+     "b"},
+    {"Redirected function",
+     R"(f=$(mktemp); g() { echo in; }; g > $f; r=$(cat $f); rm $f)",
+     "in"},
+    {"Duplicated fd reaches a child",
+     R"(r=$(sh -c 'echo three >&3' 3>&1))",
+     "three"},
+    {"Input of a builtin",
+     R"(f=$(mktemp); echo a > $f; read r < $f; rm $f)",
+     "a"},
+    {"Target joined from pieces",
+     R"(f=$(mktemp); echo a > $f.2; r=$(cat $f.2); rm $f $f.2)",
+     "a"},
+    {"Failed redirection fails a builtin",
+     R"(echo x > /nonexistent/d/f; r=$?)",
+     "1"},
+    {"Failed redirection fails a command and opens nothing after it",
+     R"(f=$(mktemp); rm $f; /bin/echo x > /nonexistent/d/f > $f; r=$?
+        [ -e $f ] && r=${r}made)",
+     "1"},
+    {"Failed redirection does not run a function",
+     R"(g() { r=ran; }; g > /nonexistent/d/f; r=$r$?)",
+     "1"},
+};
+
+int main()
+{
+    return RunScriptTests(s_RedirectionTests);
+}
@@ -0,0 +1,56 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#pragma once
+
+#include <Environment.hpp>
+#include <Executor.hpp>
+#include <Lexer.hpp>
+#include <Lowerer.hpp>
+#include <Parser.hpp>
+#include <Prism/Debug/Log.hpp>
+
+struct ScriptTestCase
+{
+    StringView Name;
+    StringView Script;
+    // What the script leaves in r
+    StringView Expected;
+};
+
+inline bool RunScriptTest(const ScriptTestCase& test)
+{
+    Environment::SetVariable("r", "");
+
+    Lexer    lexer(test.Script);
+    Parser   parser(lexer.Analyze());
+    Lowerer  lowerer(parser.Parse());
+    auto     program = lowerer.Lower();
+    Executor executor(program, 0);
+    executor.Execute();
+
+    StringView result = Environment::GetVariable("r");
+    if (result != test.Expected)
+    {
+        PrismError("[FAIL] {} — got '{}', expected '{}'\n", test.Name, result,
+                   test.Expected);
+        return false;
+    }
+
+    PrismInfo("[PASS] {} \n", test.Name);
+    return true;
+}
+
+// Runs every case in order, they share the environment, and returns the
+// exit code of the test
+inline int RunScriptTests(const Vector<ScriptTestCase>& tests)
+{
+    usize passed = 0;
+    for (auto& test : tests) passed += RunScriptTest(test);
+
+    PrismInfo("Summary: {}/{} tests passed\n", passed, tests.Size());
+    return passed == tests.Size() ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <Environment.hpp>
+#include <Prism/Debug/Log.hpp>
+#include <Prism/String/StringUtils.hpp>
+
+#include <atomic>
+#include <pthread.h>
+
+constexpr usize         READER_COUNT = 16;
+constexpr usize         ITERATIONS   = 200000;
+
+static std::atomic<bool> s_Done{false};
+
+struct ReaderStats
+{
+    usize Reads    = 0;
+    usize Failures = 0;
+};
+
+// A and B are always assigned together, so every snapshot has to show them
+// equal, and versions never go backwards
+static void* RunReader(void* argument)
+{
+    auto& stats   = *static_cast<ReaderStats*>(argument);
+    usize version = 0;
+    usize value   = 0;
+    while (!s_Done.load())
+    {
+        Environment::SnapshotReader snapshot;
+        StringView                  a = snapshot->Get("A");
+        StringView                  b = snapshot->Get("B");
+        usize current = a.Empty() ? 0 : StringUtils::ToNumber<usize>(a);
+
+        if (a != b || snapshot->Version() < version || current < value
+            || snapshot->IsSet("LOCAL"))
+            ++stats.Failures;
+        version = snapshot->Version();
+        value   = current;
+        ++stats.Reads;
+    }
+    return nullptr;
+}
+
+int main()
+{
+    ReaderStats stats[READER_COUNT];
+    pthread_t   threads[READER_COUNT];
+    for (usize i = 0; i < READER_COUNT; i++)
+        pthread_create(&threads[i], nullptr, RunReader, &stats[i]);
+
+    for (usize i = 1; i <= ITERATIONS; i++)
+    {
+        String value = StringUtils::ToString(i);
+        Environment::SetVariable("A", value);
+        // Never published while set, readers must not see it
+        Environment::PushScope(Environment::ScopeKind::eFunction);
+        Environment::DeclareLocal("LOCAL");
+        Environment::SetVariable("LOCAL", value);
+        Environment::PopScope();
+        Environment::SetVariable("B", value);
+
+        Environment::PublishSnapshot();
+    }
+
+    s_Done.store(true);
+    usize reads = 0, failures = 0;
+    for (usize i = 0; i < READER_COUNT; i++)
+    {
+        pthread_join(threads[i], nullptr);
+        reads += stats[i].Reads;
+        failures += stats[i].Failures;
+    }
+
+    PrismInfo("{} publishes, {} reads by {} readers, {} inconsistent\n",
+              ITERATIONS, reads, READER_COUNT, failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,41 @@
+/*
+ * Created by v1tr10l7 on 19.10.2026.
+ * Copyright (c) 2024-2026, Szymon Zemke <v1tr10l7@proton.me>
+ *
+ * SPDX-License-Identifier: GPL-3
+ */
+#include <Benchmark.hpp>
+#include <Environment.hpp>
+#include <Prism/String/StringUtils.hpp>
+
+// Appends step to a variable the given number of times, false when it does
+// not end up holding all of them
+static bool Append(StringView step, usize count, Benchmark::Result& result)
+{
+    String source = "s=; i=0; while (( i < "_s;
+    source += StringUtils::ToString(count);
+    source += " )); do s+=\""_s;
+    source += step;
+    source += "\"; (( i++ )); done";
+
+    result = Benchmark::Run(source);
+    Benchmark::Report("append", count, "steps", result);
+    return Environment::GetVariable("s"_sv).Size() == step.Size() * count;
+}
+
+int main()
+{
+    constexpr StringView step  = "0123456789"_sv;
+    constexpr usize      total = usize(1) << 20;
+    usize                count = (total + step.Size() - 1) / step.Size();
+
+    // A value copied on every append makes the bytes allocated grow with
+    // the square of its length, ten times the appends may take ten times
+    // the bytes, not a hundred
+    Benchmark::Result    few, many;
+    bool                 ok = Append(step, count / 10, few);
+    ok &= Append(step, count, many);
+    ok &= many.Bytes <= few.Bytes * 20;
+
+    return ok ? 0 : 1;
+}